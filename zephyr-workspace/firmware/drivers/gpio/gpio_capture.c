@@ -0,0 +1,139 @@
+#include <drivers/misc/output_capture.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/kernel.h>
+
+#define DT_DRV_COMPAT dan_gpio_capture
+
+struct gpio_capture_config
+{
+    /* Has to be first, for the GPIO API. */
+    struct gpio_driver_config common;
+};
+
+struct gpio_capture_data
+{
+    /* Has to be first, for the GPIO API. */
+    struct gpio_driver_data common;
+
+    struct k_spinlock lock;
+    gpio_port_pins_t outputs;
+    gpio_port_value_t values;
+};
+
+/**
+ * @brief Set the port's output latch, recording the output pins that
+ * changed.
+ */
+static void update(const struct device *dev, gpio_port_pins_t mask,
+                   gpio_port_value_t values)
+{
+    struct gpio_capture_data *data = dev->data;
+    k_spinlock_key_t key = k_spin_lock(&data->lock);
+    gpio_port_value_t old = data->values;
+    gpio_port_pins_t changed;
+
+    data->values = (old & ~mask) | (values & mask);
+    changed = (old ^ data->values) & data->outputs;
+
+    /* Recorded under the lock, so they're in the order they happened. */
+    while (changed) {
+        gpio_pin_t pin = find_lsb_set(changed) - 1;
+
+        output_capture_record(dev, pin, (data->values >> pin) & 1);
+        changed &= changed - 1;
+    }
+
+    k_spin_unlock(&data->lock, key);
+}
+
+static int pin_configure(const struct device *dev, gpio_pin_t pin,
+                         gpio_flags_t flags)
+{
+    struct gpio_capture_data *data = dev->data;
+    k_spinlock_key_t key;
+
+    if (flags & (GPIO_PULL_UP | GPIO_PULL_DOWN)) {
+        return -ENOTSUP;
+    }
+
+    key = k_spin_lock(&data->lock);
+    WRITE_BIT(data->outputs, pin, flags & GPIO_OUTPUT);
+    k_spin_unlock(&data->lock, key);
+
+    if (flags & GPIO_OUTPUT_INIT_HIGH) {
+        update(dev, BIT(pin), BIT(pin));
+    } else if (flags & GPIO_OUTPUT_INIT_LOW) {
+        update(dev, BIT(pin), 0);
+    }
+
+    return 0;
+}
+
+static int port_get_raw(const struct device *dev, gpio_port_value_t *value)
+{
+    struct gpio_capture_data *data = dev->data;
+
+    *value = data->values;
+    return 0;
+}
+
+static int port_set_masked_raw(const struct device *dev,
+                               gpio_port_pins_t mask, gpio_port_value_t value)
+{
+    update(dev, mask, value);
+    return 0;
+}
+
+static int port_set_bits_raw(const struct device *dev, gpio_port_pins_t pins)
+{
+    update(dev, pins, pins);
+    return 0;
+}
+
+static int port_clear_bits_raw(const struct device *dev,
+                               gpio_port_pins_t pins)
+{
+    update(dev, pins, 0);
+    return 0;
+}
+
+static int port_toggle_bits(const struct device *dev, gpio_port_pins_t pins)
+{
+    struct gpio_capture_data *data = dev->data;
+
+    update(dev, pins, ~data->values);
+    return 0;
+}
+
+static int pin_interrupt_configure(const struct device *dev, gpio_pin_t pin,
+                                   enum gpio_int_mode mode,
+                                   enum gpio_int_trig trig)
+{
+    return mode == GPIO_INT_MODE_DISABLED ? 0 : -ENOTSUP;
+}
+
+static const struct gpio_driver_api gpio_capture_api = {
+    .pin_configure = pin_configure,
+    .port_get_raw = port_get_raw,
+    .port_set_masked_raw = port_set_masked_raw,
+    .port_set_bits_raw = port_set_bits_raw,
+    .port_clear_bits_raw = port_clear_bits_raw,
+    .port_toggle_bits = port_toggle_bits,
+    .pin_interrupt_configure = pin_interrupt_configure,
+};
+
+#define GPIO_CAPTURE_DEFINE(n)                                               \
+    static const struct gpio_capture_config gpio_capture_cfg_##n = {         \
+        .common = {                                                          \
+            .port_pin_mask = GPIO_PORT_PIN_MASK_FROM_DT_INST(n),             \
+        },                                                                   \
+    };                                                                       \
+                                                                             \
+    static struct gpio_capture_data gpio_capture_data_##n;                   \
+                                                                             \
+    DEVICE_DT_INST_DEFINE(n, NULL, NULL, &gpio_capture_data_##n,             \
+                          &gpio_capture_cfg_##n, PRE_KERNEL_1,               \
+                          CONFIG_GPIO_INIT_PRIORITY, &gpio_capture_api);
+
+DT_INST_FOREACH_STATUS_OKAY(GPIO_CAPTURE_DEFINE)
@@ -0,0 +1,129 @@
+#include <drivers/misc/output_capture.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/sys/util.h>
+
+#ifdef CONFIG_SHELL
+#include <zephyr/shell/shell.h>
+#endif
+
+#define RING_SIZE CONFIG_DAN_OUTPUT_CAPTURE_SIZE
+
+BUILD_ASSERT(IS_POWER_OF_TWO(RING_SIZE),
+             "output capture size must be a power of two");
+
+static struct k_spinlock lock;
+static struct output_edge ring[RING_SIZE];
+/* Free running, so head - tail is how many are waiting. */
+static uint32_t head, tail;
+static struct output_capture_stats stats;
+
+void output_capture_record(const struct device *dev, uint16_t channel,
+                           uint32_t value)
+{
+    struct output_edge edge = {
+        .ns = k_cyc_to_ns_floor64(k_cycle_get_64()),
+        .dev = dev,
+        .channel = channel,
+        .value = value,
+    };
+    k_spinlock_key_t key;
+
+#ifdef CONFIG_DAN_OUTPUT_CAPTURE_PRINT
+    printk("edge,%llu,%s,%u,%u\n", (unsigned long long)edge.ns, dev->name,
+           channel, value);
+#endif
+
+    key = k_spin_lock(&lock);
+
+    /* Keep the oldest: it's the start of a change that matters. */
+    if (head - tail == RING_SIZE) {
+        stats.dropped++;
+    } else {
+        ring[head++ & (RING_SIZE - 1)] = edge;
+        stats.recorded++;
+    }
+
+    k_spin_unlock(&lock, key);
+}
+
+size_t output_capture_read(struct output_edge *edges, size_t max)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    size_t n = 0;
+
+    while (n < max && tail != head)
+        edges[n++] = ring[tail++ & (RING_SIZE - 1)];
+
+    k_spin_unlock(&lock, key);
+
+    return n;
+}
+
+void output_capture_clear(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    tail = head;
+    stats.recorded = 0;
+    stats.dropped = 0;
+    k_spin_unlock(&lock, key);
+}
+
+void output_capture_get_stats(struct output_capture_stats *out)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    *out = stats;
+    k_spin_unlock(&lock, key);
+}
+
+#ifdef CONFIG_SHELL
+/**
+ * @brief Print the record as CSV, emptying it.
+ */
+static int cmd_capture_dump(const struct shell *sh, size_t argc, char **argv)
+{
+    struct output_edge edges[16];
+    size_t n;
+
+    shell_print(sh, "ns,device,channel,value");
+
+    while ((n = output_capture_read(edges, ARRAY_SIZE(edges))) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            shell_print(sh, "%llu,%s,%u,%u", (unsigned long long)edges[i].ns,
+                        edges[i].dev->name, edges[i].channel, edges[i].value);
+        }
+    }
+
+    return 0;
+}
+
+static int cmd_capture_clear(const struct shell *sh, size_t argc, char **argv)
+{
+    output_capture_clear();
+    return 0;
+}
+
+static int cmd_capture_stats(const struct shell *sh, size_t argc, char **argv)
+{
+    struct output_capture_stats s;
+
+    output_capture_get_stats(&s);
+    shell_print(sh, "%u recorded, %u dropped, %u waiting", s.recorded,
+                s.dropped, head - tail);
+
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(
+    capture_cmds,
+    SHELL_CMD(dump, NULL, "Print the output changes as CSV, and forget them",
+              cmd_capture_dump),
+    SHELL_CMD(clear, NULL, "Forget the output changes", cmd_capture_clear),
+    SHELL_CMD(stats, NULL, "Output changes recorded and dropped",
+              cmd_capture_stats),
+    SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(capture, &capture_cmds, "Emulated output changes", NULL);
+#endif
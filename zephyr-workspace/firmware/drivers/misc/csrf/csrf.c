@@ -6,17 +6,50 @@
 #include <zephyr/sys/byteorder.h>
 #include <zephyr/sys/ring_buffer.h>
 
+#include "csrf_channels.h"
+#include "csrf_crc.h"
+#include "csrf_parser.h"
+
 #define DT_DRV_COMPAT dan_csrf
 
 LOG_MODULE_REGISTER(dan_csrf, CONFIG_DAN_CSRF_LOG_LEVEL);
 
-enum rx_state
+#ifdef CONFIG_DAN_CSRF_RX_ASYNC
+/**
+ * @brief A run of received octets, still sitting in a DMA buffer.
+ */
+struct rx_span
+{
+    const uint8_t *buf;
+    size_t len;
+    /* When the first octet arrived. */
+    uint32_t cycles;
+};
+#else
+/* A power of two. */
+#define RX_BURSTS 16
+
+/**
+ * @brief Where in the ring a burst of back to back octets starts, and when
+ * its first octet arrived.
+ */
+struct rx_burst
 {
-    RX_STATE_IDLE,
-    RX_STATE_GET_LEN,
-    RX_STATE_GET_TYPE,
-    RX_STATE_CHECK_CRC
+    uint32_t pos;
+    uint32_t cycles;
 };
+#endif
+
+#ifdef CONFIG_DAN_CSRF_TELEMETRY
+/**
+ * @brief A frame built and waiting to go to the radio.
+ */
+struct tx_buf
+{
+    uint8_t len;
+    uint8_t data[CSRF_MAX_FRAME_LEN + 2];
+} __aligned(4);
+#endif
 
 struct csrf_config
 {
@@ -29,56 +62,207 @@ struct csrf_data
     const struct device *dev;
 
     csrf_channel_callback_t channel_callback;
+    csrf_device_callback_t device_callback;
+    csrf_link_callback_t link_callback;
+
+    /* Subset frames only update some channels, so we keep the lot. */
+    struct csrf_channel_data channels;
+
+    /* How long an octet takes on the wire, in k_cycle_get_32() cycles, or
+     * 0 if the UART can't say. */
+    uint32_t octet_cycles;
+
+    /* Counters with one writer each: the UART's interrupt for the rx_
+     * ones, and the thread for the parser's. */
+    struct csrf_stats stats;
+    /* Any thread can send telemetry. */
+    atomic_t tx_full;
 
     struct k_thread thread;
     K_KERNEL_STACK_MEMBER(thread_stack, CONFIG_DAN_CSRF_THREAD_STACK_SIZE);
 
     struct
     {
+#ifdef CONFIG_DAN_CSRF_RX_ASYNC
+        /* The UART DMA ping-pongs between these, and the thread parses
+         * straight out of them. */
+        uint8_t dma_buf[2][CONFIG_DAN_CSRF_RX_DMA_BUF_SIZE];
+        uint8_t next_dma_buf;
+
+        struct k_msgq spans;
+        struct rx_span spans_data[CONFIG_DAN_CSRF_RX_SPAN_QUEUE_SIZE];
+#else
         struct ring_buf buf;
         uint8_t buf_data[CONFIG_DAN_CSRF_RX_BUFFER_SIZE];
         struct k_sem have_rx_data;
 
-        enum rx_state state;
-        uint8_t len;
-        uint8_t type;
-        uint8_t payload[64];
+        /* Octets put in the ring and taken out, free running. */
+        uint32_t put;
+        uint32_t got;
+        /* Written by the interrupt, which moves the head on, and read by
+         * the thread, which moves the tail. */
+        struct rx_burst bursts[RX_BURSTS];
+        atomic_t burst_head;
+        uint32_t burst_tail;
+        uint32_t last_octet;
+#endif
+
+        struct csrf_parser parser;
     } rx;
+
+#ifdef CONFIG_DAN_CSRF_TELEMETRY
+    struct
+    {
+        struct k_mem_slab pool;
+        struct tx_buf pool_data[CONFIG_DAN_CSRF_TX_POOL_SIZE];
+
+        /* Frames waiting for a gap after an RC frame. */
+        struct k_msgq queue;
+        struct tx_buf *queue_data[CONFIG_DAN_CSRF_TX_POOL_SIZE];
+
+        /* The frame the DMA is sending, if there is one. */
+        struct tx_buf *active;
+    } tx;
+#endif
 };
 
-static uint8_t crc8tab[256] = {
-    0x00, 0xD5, 0x7F, 0xAA, 0xFE, 0x2B, 0x81, 0x54, 0x29, 0xFC, 0x56, 0x83,
-    0xD7, 0x02, 0xA8, 0x7D, 0x52, 0x87, 0x2D, 0xF8, 0xAC, 0x79, 0xD3, 0x06,
-    0x7B, 0xAE, 0x04, 0xD1, 0x85, 0x50, 0xFA, 0x2F, 0xA4, 0x71, 0xDB, 0x0E,
-    0x5A, 0x8F, 0x25, 0xF0, 0x8D, 0x58, 0xF2, 0x27, 0x73, 0xA6, 0x0C, 0xD9,
-    0xF6, 0x23, 0x89, 0x5C, 0x08, 0xDD, 0x77, 0xA2, 0xDF, 0x0A, 0xA0, 0x75,
-    0x21, 0xF4, 0x5E, 0x8B, 0x9D, 0x48, 0xE2, 0x37, 0x63, 0xB6, 0x1C, 0xC9,
-    0xB4, 0x61, 0xCB, 0x1E, 0x4A, 0x9F, 0x35, 0xE0, 0xCF, 0x1A, 0xB0, 0x65,
-    0x31, 0xE4, 0x4E, 0x9B, 0xE6, 0x33, 0x99, 0x4C, 0x18, 0xCD, 0x67, 0xB2,
-    0x39, 0xEC, 0x46, 0x93, 0xC7, 0x12, 0xB8, 0x6D, 0x10, 0xC5, 0x6F, 0xBA,
-    0xEE, 0x3B, 0x91, 0x44, 0x6B, 0xBE, 0x14, 0xC1, 0x95, 0x40, 0xEA, 0x3F,
-    0x42, 0x97, 0x3D, 0xE8, 0xBC, 0x69, 0xC3, 0x16, 0xEF, 0x3A, 0x90, 0x45,
-    0x11, 0xC4, 0x6E, 0xBB, 0xC6, 0x13, 0xB9, 0x6C, 0x38, 0xED, 0x47, 0x92,
-    0xBD, 0x68, 0xC2, 0x17, 0x43, 0x96, 0x3C, 0xE9, 0x94, 0x41, 0xEB, 0x3E,
-    0x6A, 0xBF, 0x15, 0xC0, 0x4B, 0x9E, 0x34, 0xE1, 0xB5, 0x60, 0xCA, 0x1F,
-    0x62, 0xB7, 0x1D, 0xC8, 0x9C, 0x49, 0xE3, 0x36, 0x19, 0xCC, 0x66, 0xB3,
-    0xE7, 0x32, 0x98, 0x4D, 0x30, 0xE5, 0x4F, 0x9A, 0xCE, 0x1B, 0xB1, 0x64,
-    0x72, 0xA7, 0x0D, 0xD8, 0x8C, 0x59, 0xF3, 0x26, 0x5B, 0x8E, 0x24, 0xF1,
-    0xA5, 0x70, 0xDA, 0x0F, 0x20, 0xF5, 0x5F, 0x8A, 0xDE, 0x0B, 0xA1, 0x74,
-    0x09, 0xDC, 0x76, 0xA3, 0xF7, 0x22, 0x88, 0x5D, 0xD6, 0x03, 0xA9, 0x7C,
-    0x28, 0xFD, 0x57, 0x82, 0xFF, 0x2A, 0x80, 0x55, 0x01, 0xD4, 0x7E, 0xAB,
-    0x84, 0x51, 0xFB, 0x2E, 0x7A, 0xAF, 0x05, 0xD0, 0xAD, 0x78, 0xD2, 0x07,
-    0x53, 0x86, 0x2C, 0xF9};
+#ifdef CONFIG_DAN_CSRF_RX_ASYNC
+static void uart_callback(const struct device *dev, struct uart_event *evt,
+                          void *user_data)
+{
+    const struct device *csrf_dev = (const struct device *)user_data;
+    struct csrf_data *data = csrf_dev->data;
+    struct rx_span span;
+    int rc;
+
+    switch (evt->type) {
+        case UART_RX_RDY:
+            /* The DMA has already put the octets in memory, so we just
+             * tell the thread where they are. */
+            span.buf = &evt->data.rx.buf[evt->data.rx.offset];
+            span.len = evt->data.rx.len;
+            /* The span's handed over once the line's been idle for an
+             * octet, so its first octet arrived len octets ago. */
+            span.cycles = k_cycle_get_32() - span.len * data->octet_cycles;
+
+            data->stats.rx_irqs++;
+            data->stats.rx_octets += span.len;
+
+            if (k_msgq_put(&data->rx.spans, &span, K_NO_WAIT)) {
+                data->stats.rx_overflow += span.len;
+                LOG_WRN("%s: RX span dropped", csrf_dev->name);
+            }
+            break;
+
+        case UART_RX_BUF_REQUEST:
+            rc = uart_rx_buf_rsp(dev, data->rx.dma_buf[data->rx.next_dma_buf],
+                                 CONFIG_DAN_CSRF_RX_DMA_BUF_SIZE);
+            if (rc) {
+                LOG_ERR("%s: Failed to provide RX buffer", csrf_dev->name);
+            }
+            data->rx.next_dma_buf ^= 1;
+            break;
+
+        case UART_RX_STOPPED:
+            data->stats.rx_errors++;
+            LOG_DBG("%s: RX stopped (%d)", csrf_dev->name,
+                    evt->data.rx_stop.reason);
+            break;
+
+#ifdef CONFIG_DAN_CSRF_TELEMETRY
+        case UART_TX_DONE:
+        case UART_TX_ABORTED:
+            if (data->tx.active) {
+                k_mem_slab_free(&data->tx.pool, data->tx.active);
+                data->tx.active = NULL;
+            }
+            break;
+#endif
+
+        case UART_RX_DISABLED:
+            /* Either a line error or we ran out of buffers. Either way, we
+             * want to keep listening to the radio. */
+            data->rx.next_dma_buf = 1;
+            rc = uart_rx_enable(dev, data->rx.dma_buf[0],
+                                CONFIG_DAN_CSRF_RX_DMA_BUF_SIZE,
+                                CONFIG_DAN_CSRF_RX_IDLE_TIMEOUT_US);
+            if (rc) {
+                LOG_ERR("%s: Failed to restart RX", csrf_dev->name);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+#else
+/**
+ * @brief Note when the octets just put in the ring arrived. If they're the
+ * first after a gap they start a burst. The receiver sends each frame in
+ * one go, so the rest of a burst's octets follow an octet time apart.
+ */
+static void rx_mark(struct csrf_data *data, uint32_t now, uint32_t n)
+{
+    uint32_t first = now - (n - 1) * data->octet_cycles;
+    uint32_t head = atomic_get(&data->rx.burst_head);
+
+    if (head == 0 || first - data->rx.last_octet > 2 * data->octet_cycles) {
+        data->rx.bursts[head & (RX_BURSTS - 1)] = (struct rx_burst){
+            .pos = data->rx.put,
+            .cycles = first,
+        };
+        atomic_set(&data->rx.burst_head, head + 1);
+    }
+
+    data->rx.last_octet = now;
+    data->rx.put += n;
+}
+
+/**
+ * @brief When the next octet the thread takes from the ring arrived, from
+ * the start of its burst.
+ *
+ * @param len Octets the thread's claimed, cut short where the next burst
+ * starts so each chunk is fed with its own stamp.
+ */
+static uint32_t rx_stamp(struct csrf_data *data, uint32_t *len)
+{
+    uint32_t head = atomic_get(&data->rx.burst_head);
+    uint32_t tail = data->rx.burst_tail;
+    const struct rx_burst *burst;
+
+    /* The interrupt's gone round and written over some. */
+    if (head - tail > RX_BURSTS)
+        tail = head - RX_BURSTS;
+
+    while (head - tail > 1) {
+        burst = &data->rx.bursts[(tail + 1) & (RX_BURSTS - 1)];
+        if ((int32_t)(burst->pos - data->rx.got) > 0) {
+            *len = MIN(*len, burst->pos - data->rx.got);
+            break;
+        }
+        tail++;
+    }
+
+    data->rx.burst_tail = tail;
+    burst = &data->rx.bursts[tail & (RX_BURSTS - 1)];
+
+    return burst->cycles + (data->rx.got - burst->pos) * data->octet_cycles;
+}
 
 static void uart_callback(const struct device *dev, void *user_data)
 {
     const struct device *csrf_dev = (const struct device *)user_data;
     struct csrf_data *data = csrf_dev->data;
+    uint32_t now = k_cycle_get_32();
+    uint32_t put = 0;
     uint8_t ch;
-    bool have_rx_data = false;
+
+    data->stats.rx_irqs++;
 
     /* Clear the error if there is one. */
-    uart_err_check(dev);
+    if (uart_err_check(dev) > 0)
+        data->stats.rx_errors++;
 
     /* Acknowledge the interrupt, and then check if there's
      * actually work to do. */
@@ -86,151 +270,216 @@ static void uart_callback(const struct device *dev, void *user_data)
         return;
 
     while (uart_fifo_read(dev, &ch, 1) > 0) {
-        ring_buf_put(&data->rx.buf, &ch, 1);
-        have_rx_data = true;
+        data->stats.rx_octets++;
+        if (ring_buf_put(&data->rx.buf, &ch, 1) == 0)
+            data->stats.rx_overflow++;
+        else
+            put++;
     }
 
-    if (have_rx_data) {
+    if (put) {
+        rx_mark(data, now, put);
         k_sem_give(&data->rx.have_rx_data);
     }
 }
-
-static uint8_t csrf_crc8(const uint8_t *ptr, uint8_t len)
+#endif
+
+#ifdef CONFIG_DAN_CSRF_TELEMETRY
+/**
+ * @brief Start sending the next queued frame.
+ *
+ * This is called just after an RC frame has been handled, which is when
+ * the receiver expects to hear from us. Only one frame goes out per RC
+ * frame, so telemetry can never run into the next one.
+ */
+static void tx_slot(struct csrf_data *data)
 {
-    uint8_t crc = 0;
-    for (uint8_t i = 0; i < len; i++) crc = crc8tab[crc ^ *ptr++];
-    return crc;
+    const struct csrf_config *cfg = data->dev->config;
+    struct tx_buf *buf;
+
+    /* Still going from last time. */
+    if (data->tx.active)
+        return;
+
+    if (k_msgq_get(&data->tx.queue, &buf, K_NO_WAIT))
+        return;
+
+    data->tx.active = buf;
+    if (uart_tx(cfg->uart_dev, buf->data, buf->len, SYS_FOREVER_US)) {
+        data->tx.active = NULL;
+        k_mem_slab_free(&data->tx.pool, buf);
+    }
 }
+#endif
 
-static void handle_rx_frame(struct csrf_data *data)
+static void deliver_channels(struct csrf_data *data,
+                             const struct csrf_frame *frame)
 {
-    k_sleep(K_MSEC(1));
+    struct csrf_channel_data *channels = &data->channels;
 
-    switch (data->rx.type) {
-        case 0x16: {
-            uint8_t *payload = data->rx.payload;
-            struct csrf_channel_data channels;
+    channels->ts.crc = k_cycle_get_32();
+    channels->ts.rx = frame->sync_stamp;
+    channels->ts.frame = frame->frame_stamp;
 
-            /* Each channel is 11 bits, so we need to unpack it all! */
-            for (int i = 0; i < 16; i++) {
-                uint32_t byte_index = (i * 11) / 8;
-                uint32_t bit_offset = (i * 11) % 8;
+    data->channel_callback(channels);
+}
 
-                uint16_t val = (payload[byte_index] >> bit_offset) |
-                               (payload[byte_index + 1] << (8 - bit_offset));
+static void handle_rc_channels(void *user_data, const struct csrf_frame *frame)
+{
+    struct csrf_data *data = user_data;
 
-                /* Special case when our value spans 3 octets. */
-                if (bit_offset > 5)
-                    val |= payload[byte_index + 2] << (16 - bit_offset);
+    if (data->channel_callback) {
+        csrf_unpack_rc_channels(frame->payload, data->channels.ch);
+        deliver_channels(data, frame);
+    }
 
-                val &= 0x07ff;
+#ifdef CONFIG_DAN_CSRF_TELEMETRY
+    tx_slot(data);
+#endif
+}
 
-                channels.ch[i] = (int16_t)val;
+static void handle_subset_rc_channels(void *user_data,
+                                      const struct csrf_frame *frame)
+{
+    struct csrf_data *data = user_data;
 
-                if (data->channel_callback)
-                    data->channel_callback(&channels);
-            }
-            break;
-        }
-        default:
-            break;
+    if (data->channel_callback &&
+        csrf_unpack_subset_rc_channels(frame->payload, frame->payload_len,
+                                       data->channels.ch) > 0) {
+        deliver_channels(data, frame);
     }
+
+#ifdef CONFIG_DAN_CSRF_TELEMETRY
+    tx_slot(data);
+#endif
 }
 
-static void process_buffer(struct csrf_data *data)
+static void handle_device_frame(void *user_data,
+                                const struct csrf_frame *frame)
 {
-    uint32_t len;
-    uint8_t buf[64];
-
-    switch (data->rx.state) {
-        case RX_STATE_IDLE:
-            len = ring_buf_get(&data->rx.buf, buf, 1);
-            if (len != 1)
-                return;
+    struct csrf_data *data = user_data;
 
-            /* TODO handle other sync bytes */
-            if (buf[0] != 0xc8)
-                break;
+    if (data->device_callback)
+        data->device_callback(frame->type, frame->payload, frame->payload_len);
+}
 
-            data->rx.state = RX_STATE_GET_LEN;
-            break;
+static void handle_link_statistics(void *user_data,
+                                   const struct csrf_frame *frame)
+{
+    struct csrf_data *data = user_data;
+    const uint8_t *p = frame->payload;
+
+    if (data->link_callback)
+        data->link_callback(&(const struct csrf_link_stats){
+            .uplink_rssi = {p[0], p[1]},
+            .uplink_lq = p[2],
+            .uplink_snr = (int8_t)p[3],
+            .active_antenna = p[4],
+            .rf_mode = p[5],
+            .uplink_power = p[6],
+            .downlink_rssi = p[7],
+            .downlink_lq = p[8],
+            .downlink_snr = (int8_t)p[9],
+        });
+}
 
-        case RX_STATE_GET_LEN:
-            len = ring_buf_peek(&data->rx.buf, buf, 1);
-            if (len != 1)
-                return;
+static const struct csrf_frame_handler frame_handlers[] = {
+    {CSRF_FRAME_RC_CHANNELS, CSRF_RC_CHANNELS_PAYLOAD_LEN,
+     CSRF_RC_CHANNELS_PAYLOAD_LEN, handle_rc_channels},
+    {CSRF_FRAME_SUBSET_RC_CHANNELS, 2, CSRF_MAX_FRAME_LEN - 2,
+     handle_subset_rc_channels},
+    {CSRF_FRAME_LINK_STATISTICS, CSRF_LINK_STATISTICS_PAYLOAD_LEN,
+     CSRF_LINK_STATISTICS_PAYLOAD_LEN, handle_link_statistics},
+    /* To, from, and for reads and writes the parameter and the chunk or
+     * value. */
+    {CSRF_FRAME_DEVICE_PING, 2, 2, handle_device_frame},
+    {CSRF_FRAME_PARAMETER_READ, 4, 4, handle_device_frame},
+    {CSRF_FRAME_PARAMETER_WRITE, 4, CSRF_MAX_FRAME_LEN - 2,
+     handle_device_frame},
+};
 
-            if (buf[0] < 2 || buf[0] > 62) {
-                ring_buf_get(&data->rx.buf, NULL, 1);
-                data->rx.state = RX_STATE_IDLE;
-            }
+static uint32_t csrf_clock(void)
+{
+    return k_cycle_get_32();
+}
 
-            data->rx.len = buf[0];
-            data->rx.state = RX_STATE_GET_TYPE;
-            break;
+static void csrf_thread(void *p1, void *p2, void *p3)
+{
+    struct csrf_data *data = (struct csrf_data *)p1;
+    int rc;
 
-        case RX_STATE_GET_TYPE:
-            /* Wait until we have a complete frame worth. */
-            len = ring_buf_peek(&data->rx.buf, buf, data->rx.len + 1);
-            if (len != data->rx.len + 1)
-                return;
+    LOG_INF("CSRF thread started");
 
-            /* TODO make sure it's a valid type. */
-            data->rx.type = buf[1];
-            data->rx.state = RX_STATE_CHECK_CRC;
-            break;
+    while (1) {
+#ifdef CONFIG_DAN_CSRF_RX_ASYNC
+        struct rx_span span;
 
-        case RX_STATE_CHECK_CRC: {
-            uint8_t expected, received;
+        rc = k_msgq_get(&data->rx.spans, &span, K_FOREVER);
+        if (rc)
+            continue;
 
-            /* At this point, we're already figured out we have a complete
-             * frame. if we don't, we'll reset the state! */
-            len = ring_buf_peek(&data->rx.buf, buf, data->rx.len + 1);
-            if (len != data->rx.len + 1) {
-                data->rx.state = RX_STATE_IDLE;
-                return;
-            }
+        csrf_parser_feed(&data->rx.parser, span.buf, span.len, span.cycles);
+#else
+        uint8_t *buf;
+        uint32_t len;
 
-            expected = csrf_crc8(&buf[1], data->rx.len - 1);
-            received = buf[data->rx.len];
+        rc = k_sem_take(&data->rx.have_rx_data, K_FOREVER);
+        if (rc)
+            continue;
 
-            if (expected != received) {
-                data->rx.state = RX_STATE_IDLE;
-                return;
-            }
+        while ((len = ring_buf_get_claim(&data->rx.buf, &buf,
+                                         CONFIG_DAN_CSRF_RX_BUFFER_SIZE))) {
+            uint32_t stamp = rx_stamp(data, &len);
 
-            /* We have a valid frame! */
-            memcpy(data->rx.payload, &buf[2], data->rx.len - 2);
-            ring_buf_get(&data->rx.buf, NULL, data->rx.len + 1);
-            data->rx.state = RX_STATE_IDLE;
-            handle_rx_frame(data);
-            break;
+            csrf_parser_feed(&data->rx.parser, buf, len, stamp);
+            ring_buf_get_finish(&data->rx.buf, len);
+            data->rx.got += len;
         }
-
-        default:
-            LOG_WRN("Invalid state %d", data->rx.state);
-            data->rx.state = RX_STATE_IDLE;
-            break;
+#endif
     }
 }
 
-static void csrf_thread(void *p1, void *p2, void *p3)
+#ifdef CONFIG_DAN_CSRF_CRC_BENCHMARK
+static void crc_benchmark_run(const char *name,
+                              uint8_t (*crc8)(const uint8_t *, size_t),
+                              const uint8_t *buf, size_t len)
 {
-    struct csrf_data *data = (struct csrf_data *)p1;
-    int rc;
+    const unsigned reps = 1000;
+    volatile uint8_t crc;
+    uint32_t start, cycles, octets_per_kcycle;
 
-    data->rx.state = RX_STATE_IDLE;
+    start = k_cycle_get_32();
+    for (unsigned i = 0; i < reps; i++) crc = crc8(buf, len);
+    cycles = k_cycle_get_32() - start;
 
-    LOG_INF("CSRF thread started");
+    octets_per_kcycle = (uint64_t)reps * len * 1000 / MAX(cycles, 1);
 
-    while (1) {
-        rc = k_sem_take(&data->rx.have_rx_data, K_FOREVER);
-        if (rc)
-            continue;
+    LOG_INF("crc %s: %u octets in %u cycles, %u.%03u octets/cycle (0x%02x)",
+            name, reps * len, cycles, octets_per_kcycle / 1000,
+            octets_per_kcycle % 1000, crc);
+}
 
-        while (!ring_buf_is_empty(&data->rx.buf)) process_buffer(data);
+/**
+ * @brief Time each CRC backend over a frame the size of an RC frame, and
+ * over the largest frame.
+ */
+static void crc_benchmark(void)
+{
+    static const size_t lens[] = {CSRF_RC_CHANNELS_PAYLOAD_LEN + 1,
+                                  CSRF_MAX_FRAME_LEN - 1};
+    uint8_t buf[CSRF_MAX_FRAME_LEN - 1];
+
+    for (size_t i = 0; i < sizeof(buf); i++) buf[i] = i * 37 + 11;
+
+    for (size_t i = 0; i < ARRAY_SIZE(lens); i++) {
+        crc_benchmark_run("table", csrf_crc8_table, buf, lens[i]);
+        crc_benchmark_run("slice4", csrf_crc8_slice4, buf, lens[i]);
+#ifdef CONFIG_DAN_CSRF_CRC_HW
+        crc_benchmark_run("hw", csrf_crc8_hw, buf, lens[i]);
+#endif
     }
 }
+#endif
 
 static int set_channel_callback(const struct device *dev,
                                 csrf_channel_callback_t callback)
@@ -243,6 +492,84 @@ static int set_channel_callback(const struct device *dev,
     return 0;
 }
 
+static int set_device_callback(const struct device *dev,
+                               csrf_device_callback_t callback)
+{
+    struct csrf_data *data = dev->data;
+
+    data->device_callback = callback;
+
+    return 0;
+}
+
+static int set_link_callback(const struct device *dev,
+                             csrf_link_callback_t callback)
+{
+    struct csrf_data *data = dev->data;
+
+    data->link_callback = callback;
+
+    return 0;
+}
+
+static int get_stats(const struct device *dev, struct csrf_stats *stats)
+{
+    struct csrf_data *data = dev->data;
+    const struct csrf_parser_stats *parser = &data->rx.parser.stats;
+
+    *stats = data->stats;
+    stats->frames = parser->frames;
+    stats->unhandled = parser->unhandled;
+    stats->bad_crc = parser->bad_crc;
+    stats->bad_len = parser->bad_len;
+    stats->noise = parser->noise;
+    stats->tx_full = atomic_get(&data->tx_full);
+
+    return 0;
+}
+
+static int send_frame(const struct device *dev, uint8_t type,
+                      const uint8_t *payload, size_t len)
+{
+#ifdef CONFIG_DAN_CSRF_TELEMETRY
+    struct csrf_data *data = dev->data;
+    struct tx_buf *buf;
+
+    if (k_mem_slab_alloc(&data->tx.pool, (void **)&buf, K_NO_WAIT)) {
+        atomic_inc(&data->tx_full);
+        return -ENOMEM;
+    }
+
+    buf->data[0] = CSRF_ADDR_FLIGHT_CONTROLLER;
+    buf->data[1] = len + 2;
+    buf->data[2] = type;
+    memcpy(&buf->data[3], payload, len);
+    buf->data[3 + len] = csrf_crc8(&buf->data[2], len + 1);
+    buf->len = len + 4;
+
+    /* The queue holds as many frames as the pool, so this can't fail. */
+    k_msgq_put(&data->tx.queue, &buf, K_NO_WAIT);
+
+    return 0;
+#else
+    return -ENOTSUP;
+#endif
+}
+
+/**
+ * @brief How long an octet takes at the UART's baud rate: a start bit, 8
+ * data bits and a stop bit.
+ */
+static uint32_t get_octet_cycles(const struct device *uart_dev)
+{
+    struct uart_config config;
+
+    if (uart_config_get(uart_dev, &config) || config.baudrate == 0)
+        return 0;
+
+    return (uint64_t)sys_clock_hw_cycles_per_sec() * 10 / config.baudrate;
+}
+
 static int csrf_init(const struct device *dev)
 {
     const struct csrf_config *cfg = dev->config;
@@ -258,12 +585,37 @@ static int csrf_init(const struct device *dev)
 
     data->dev = dev;
 
+#ifdef CONFIG_DAN_CSRF_CRC_BENCHMARK
+    crc_benchmark();
+#endif
+
     gpio_pin_configure_dt(&cfg->reset_gpio, GPIO_OUTPUT);
 
     gpio_pin_set_dt(&cfg->reset_gpio, 1);
     k_busy_wait(100);
     gpio_pin_set_dt(&cfg->reset_gpio, 0);
 
+    csrf_parser_init(&data->rx.parser, frame_handlers,
+                     ARRAY_SIZE(frame_handlers), data, csrf_clock);
+    data->octet_cycles = get_octet_cycles(cfg->uart_dev);
+    csrf_parser_set_octet_time(&data->rx.parser, data->octet_cycles);
+
+#ifdef CONFIG_DAN_CSRF_TELEMETRY
+    rc = k_mem_slab_init(&data->tx.pool, data->tx.pool_data,
+                         sizeof(struct tx_buf), CONFIG_DAN_CSRF_TX_POOL_SIZE);
+    if (rc) {
+        LOG_ERR("%s: Failed to init TX pool", dev->name);
+        return rc;
+    }
+
+    k_msgq_init(&data->tx.queue, (char *)data->tx.queue_data,
+                sizeof(struct tx_buf *), CONFIG_DAN_CSRF_TX_POOL_SIZE);
+#endif
+
+#ifdef CONFIG_DAN_CSRF_RX_ASYNC
+    k_msgq_init(&data->rx.spans, (char *)data->rx.spans_data,
+                sizeof(struct rx_span), CONFIG_DAN_CSRF_RX_SPAN_QUEUE_SIZE);
+#else
     ring_buf_init(&data->rx.buf, CONFIG_DAN_CSRF_RX_BUFFER_SIZE,
                   data->rx.buf_data);
 
@@ -272,12 +624,30 @@ static int csrf_init(const struct device *dev)
         LOG_ERR("%s: Failed to init semaphore", dev->name);
         return rc;
     }
+#endif
 
     k_thread_create(&data->thread, data->thread_stack,
                     CONFIG_DAN_CSRF_THREAD_STACK_SIZE, csrf_thread, data, NULL,
                     NULL, K_PRIO_COOP(CONFIG_DAN_CSRF_THREAD_PRIORITY), 0,
                     K_NO_WAIT);
+    k_thread_name_set(&data->thread, dev->name);
 
+#ifdef CONFIG_DAN_CSRF_RX_ASYNC
+    rc = uart_callback_set(cfg->uart_dev, uart_callback, (void *)dev);
+    if (rc) {
+        LOG_ERR("%s: Failed to set UART callback", dev->name);
+        return rc;
+    }
+
+    data->rx.next_dma_buf = 1;
+    rc = uart_rx_enable(cfg->uart_dev, data->rx.dma_buf[0],
+                        CONFIG_DAN_CSRF_RX_DMA_BUF_SIZE,
+                        CONFIG_DAN_CSRF_RX_IDLE_TIMEOUT_US);
+    if (rc) {
+        LOG_ERR("%s: Failed to enable RX", dev->name);
+        return rc;
+    }
+#else
     rc = uart_irq_callback_user_data_set(cfg->uart_dev, uart_callback,
                                          (void *)dev);
     if (rc) {
@@ -286,12 +656,17 @@ static int csrf_init(const struct device *dev)
     }
 
     uart_irq_rx_enable(cfg->uart_dev);
+#endif
 
     return 0;
 }
 
 struct csrf_driver_api csrf_api = {
     .set_channel_callback = set_channel_callback,
+    .send_frame = send_frame,
+    .set_device_callback = set_device_callback,
+    .set_link_callback = set_link_callback,
+    .get_stats = get_stats,
 };
 
 #define CSRF_DEFINE(n)                                                       \
@@ -0,0 +1,97 @@
+#include "csrf_channels.h"
+
+/**
+ * @brief Unpack eight 11 bit channels from 11 octets.
+ *
+ * The bit offsets repeat every 11 octets, so this is written out with
+ * fixed shifts - there's no index arithmetic or branching at run time.
+ */
+static inline void unpack8(const uint8_t *p, uint16_t *ch)
+{
+    ch[0] = (p[0] | p[1] << 8) & 0x07ff;
+    ch[1] = (p[1] >> 3 | p[2] << 5) & 0x07ff;
+    ch[2] = (p[2] >> 6 | p[3] << 2 | p[4] << 10) & 0x07ff;
+    ch[3] = (p[4] >> 1 | p[5] << 7) & 0x07ff;
+    ch[4] = (p[5] >> 4 | p[6] << 4) & 0x07ff;
+    ch[5] = (p[6] >> 7 | p[7] << 1 | p[8] << 9) & 0x07ff;
+    ch[6] = (p[8] >> 2 | p[9] << 6) & 0x07ff;
+    ch[7] = (p[9] >> 5 | p[10] << 3) & 0x07ff;
+}
+
+void csrf_unpack_rc_channels(const uint8_t *payload, uint16_t *ch)
+{
+    unpack8(&payload[0], &ch[0]);
+    unpack8(&payload[11], &ch[8]);
+}
+
+void csrf_pack_rc_channels(const uint16_t *ch, uint8_t *payload)
+{
+    uint32_t acc = 0;
+    unsigned acc_bits = 0;
+
+    /* LSB first, so it's the reverse of the unpacking. */
+    for (int i = 0; i < CSRF_NUM_CHANNELS; i++) {
+        acc |= (uint32_t)(ch[i] & 0x07ff) << acc_bits;
+        acc_bits += 11;
+
+        while (acc_bits >= 8) {
+            *payload++ = acc;
+            acc >>= 8;
+            acc_bits -= 8;
+        }
+    }
+}
+
+/**
+ * @brief Convert a subset channel value to the 11 bit RC channels scale.
+ *
+ * A subset value of v at n bits is 988 + v * 1024 / 2^n us, and the 11 bit
+ * scale is (us - 881) / 0.62477 - the same mapping the flight controllers
+ * use. This works in eighths of a microsecond, with 1 / 0.62477 as Q16.
+ */
+static inline uint16_t subset_to_rc(uint32_t v, unsigned bits)
+{
+    uint32_t us8 = (988 - 881) * 8 + (v << (13 - bits));
+    uint32_t rc = (us8 * 104896u) >> 19;
+
+    return rc > 0x07ff ? 0x07ff : rc;
+}
+
+int csrf_unpack_subset_rc_channels(const uint8_t *payload, size_t len,
+                                   uint16_t *ch)
+{
+    unsigned first, bits, count;
+    uint32_t acc = 0, mask;
+    unsigned acc_bits = 0;
+    const uint8_t *p;
+
+    if (len < 2)
+        return -1;
+
+    first = payload[0] & 0x1f;
+    if (first >= CSRF_NUM_CHANNELS)
+        return -1;
+
+    bits = 10 + ((payload[0] >> 5) & 0x03);
+    mask = (1u << bits) - 1;
+
+    /* Any bits left over are padding. */
+    count = (len - 1) * 8 / bits;
+    if (first + count > CSRF_NUM_CHANNELS)
+        count = CSRF_NUM_CHANNELS - first;
+
+    p = &payload[1];
+    for (unsigned i = 0; i < count; i++) {
+        /* Channels are packed LSB first, the same as the full frame. */
+        while (acc_bits < bits) {
+            acc |= (uint32_t)*p++ << acc_bits;
+            acc_bits += 8;
+        }
+
+        ch[first + i] = subset_to_rc(acc & mask, bits);
+        acc >>= bits;
+        acc_bits -= bits;
+    }
+
+    return count;
+}
@@ -0,0 +1,44 @@
+#ifndef ZEPHYR_DRIVERS_MISC_CSRF_CHANNELS_H_
+#define ZEPHYR_DRIVERS_MISC_CSRF_CHANNELS_H_
+
+/*
+ * RC channel packing and unpacking, 16 channels of 11 bits each in 22
+ * octets.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CSRF_NUM_CHANNELS 16
+
+#define CSRF_FRAME_SUBSET_RC_CHANNELS 0x17
+
+/* Payload of an RC channels frame: 16 channels of 11 bits. */
+#define CSRF_RC_CHANNELS_PAYLOAD_LEN 22
+
+/**
+ * @brief Unpack all 16 channels of an RC channels (0x16) payload.
+ */
+extern void csrf_unpack_rc_channels(const uint8_t *payload, uint16_t *ch);
+
+/**
+ * @brief Pack 16 channels into an RC channels payload, the way a receiver
+ * does. Only the low 11 bits of each are used.
+ */
+extern void csrf_pack_rc_channels(const uint16_t *ch, uint8_t *payload);
+
+/**
+ * @brief Unpack a subset RC channels (0x17) payload.
+ *
+ * The first octet holds the first channel in the frame and the resolution
+ * (10 to 13 bits). The rest is that many bits per channel, for as many
+ * channels as fit. Values are converted to the 11 bit scale of the full
+ * RC channels frame, so callers don't need to care which frame they came
+ * from. Channels that aren't in the frame are left alone.
+ *
+ * @return How many channels were updated, or -1 if the frame is bad.
+ */
+extern int csrf_unpack_subset_rc_channels(const uint8_t *payload, size_t len,
+                                          uint16_t *ch);
+
+#endif
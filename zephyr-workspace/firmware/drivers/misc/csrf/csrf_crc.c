@@ -0,0 +1,133 @@
+#include "csrf_crc.h"
+
+const uint8_t csrf_crc8tab[256] = {
+    0x00, 0xD5, 0x7F, 0xAA, 0xFE, 0x2B, 0x81, 0x54, 0x29, 0xFC, 0x56, 0x83,
+    0xD7, 0x02, 0xA8, 0x7D, 0x52, 0x87, 0x2D, 0xF8, 0xAC, 0x79, 0xD3, 0x06,
+    0x7B, 0xAE, 0x04, 0xD1, 0x85, 0x50, 0xFA, 0x2F, 0xA4, 0x71, 0xDB, 0x0E,
+    0x5A, 0x8F, 0x25, 0xF0, 0x8D, 0x58, 0xF2, 0x27, 0x73, 0xA6, 0x0C, 0xD9,
+    0xF6, 0x23, 0x89, 0x5C, 0x08, 0xDD, 0x77, 0xA2, 0xDF, 0x0A, 0xA0, 0x75,
+    0x21, 0xF4, 0x5E, 0x8B, 0x9D, 0x48, 0xE2, 0x37, 0x63, 0xB6, 0x1C, 0xC9,
+    0xB4, 0x61, 0xCB, 0x1E, 0x4A, 0x9F, 0x35, 0xE0, 0xCF, 0x1A, 0xB0, 0x65,
+    0x31, 0xE4, 0x4E, 0x9B, 0xE6, 0x33, 0x99, 0x4C, 0x18, 0xCD, 0x67, 0xB2,
+    0x39, 0xEC, 0x46, 0x93, 0xC7, 0x12, 0xB8, 0x6D, 0x10, 0xC5, 0x6F, 0xBA,
+    0xEE, 0x3B, 0x91, 0x44, 0x6B, 0xBE, 0x14, 0xC1, 0x95, 0x40, 0xEA, 0x3F,
+    0x42, 0x97, 0x3D, 0xE8, 0xBC, 0x69, 0xC3, 0x16, 0xEF, 0x3A, 0x90, 0x45,
+    0x11, 0xC4, 0x6E, 0xBB, 0xC6, 0x13, 0xB9, 0x6C, 0x38, 0xED, 0x47, 0x92,
+    0xBD, 0x68, 0xC2, 0x17, 0x43, 0x96, 0x3C, 0xE9, 0x94, 0x41, 0xEB, 0x3E,
+    0x6A, 0xBF, 0x15, 0xC0, 0x4B, 0x9E, 0x34, 0xE1, 0xB5, 0x60, 0xCA, 0x1F,
+    0x62, 0xB7, 0x1D, 0xC8, 0x9C, 0x49, 0xE3, 0x36, 0x19, 0xCC, 0x66, 0xB3,
+    0xE7, 0x32, 0x98, 0x4D, 0x30, 0xE5, 0x4F, 0x9A, 0xCE, 0x1B, 0xB1, 0x64,
+    0x72, 0xA7, 0x0D, 0xD8, 0x8C, 0x59, 0xF3, 0x26, 0x5B, 0x8E, 0x24, 0xF1,
+    0xA5, 0x70, 0xDA, 0x0F, 0x20, 0xF5, 0x5F, 0x8A, 0xDE, 0x0B, 0xA1, 0x74,
+    0x09, 0xDC, 0x76, 0xA3, 0xF7, 0x22, 0x88, 0x5D, 0xD6, 0x03, 0xA9, 0x7C,
+    0x28, 0xFD, 0x57, 0x82, 0xFF, 0x2A, 0x80, 0x55, 0x01, 0xD4, 0x7E, 0xAB,
+    0x84, 0x51, 0xFB, 0x2E, 0x7A, 0xAF, 0x05, 0xD0, 0xAD, 0x78, 0xD2, 0x07,
+    0x53, 0x86, 0x2C, 0xF9};
+
+/* crc8tabN is the CRC of an octet followed by N zero octets. The CRC is
+ * linear, so four octets can be looked up independently and combined. */
+static const uint8_t crc8tab1[256] = {
+    0x00, 0x0B, 0x16, 0x1D, 0x2C, 0x27, 0x3A, 0x31, 0x58, 0x53, 0x4E, 0x45,
+    0x74, 0x7F, 0x62, 0x69, 0xB0, 0xBB, 0xA6, 0xAD, 0x9C, 0x97, 0x8A, 0x81,
+    0xE8, 0xE3, 0xFE, 0xF5, 0xC4, 0xCF, 0xD2, 0xD9, 0xB5, 0xBE, 0xA3, 0xA8,
+    0x99, 0x92, 0x8F, 0x84, 0xED, 0xE6, 0xFB, 0xF0, 0xC1, 0xCA, 0xD7, 0xDC,
+    0x05, 0x0E, 0x13, 0x18, 0x29, 0x22, 0x3F, 0x34, 0x5D, 0x56, 0x4B, 0x40,
+    0x71, 0x7A, 0x67, 0x6C, 0xBF, 0xB4, 0xA9, 0xA2, 0x93, 0x98, 0x85, 0x8E,
+    0xE7, 0xEC, 0xF1, 0xFA, 0xCB, 0xC0, 0xDD, 0xD6, 0x0F, 0x04, 0x19, 0x12,
+    0x23, 0x28, 0x35, 0x3E, 0x57, 0x5C, 0x41, 0x4A, 0x7B, 0x70, 0x6D, 0x66,
+    0x0A, 0x01, 0x1C, 0x17, 0x26, 0x2D, 0x30, 0x3B, 0x52, 0x59, 0x44, 0x4F,
+    0x7E, 0x75, 0x68, 0x63, 0xBA, 0xB1, 0xAC, 0xA7, 0x96, 0x9D, 0x80, 0x8B,
+    0xE2, 0xE9, 0xF4, 0xFF, 0xCE, 0xC5, 0xD8, 0xD3, 0xAB, 0xA0, 0xBD, 0xB6,
+    0x87, 0x8C, 0x91, 0x9A, 0xF3, 0xF8, 0xE5, 0xEE, 0xDF, 0xD4, 0xC9, 0xC2,
+    0x1B, 0x10, 0x0D, 0x06, 0x37, 0x3C, 0x21, 0x2A, 0x43, 0x48, 0x55, 0x5E,
+    0x6F, 0x64, 0x79, 0x72, 0x1E, 0x15, 0x08, 0x03, 0x32, 0x39, 0x24, 0x2F,
+    0x46, 0x4D, 0x50, 0x5B, 0x6A, 0x61, 0x7C, 0x77, 0xAE, 0xA5, 0xB8, 0xB3,
+    0x82, 0x89, 0x94, 0x9F, 0xF6, 0xFD, 0xE0, 0xEB, 0xDA, 0xD1, 0xCC, 0xC7,
+    0x14, 0x1F, 0x02, 0x09, 0x38, 0x33, 0x2E, 0x25, 0x4C, 0x47, 0x5A, 0x51,
+    0x60, 0x6B, 0x76, 0x7D, 0xA4, 0xAF, 0xB2, 0xB9, 0x88, 0x83, 0x9E, 0x95,
+    0xFC, 0xF7, 0xEA, 0xE1, 0xD0, 0xDB, 0xC6, 0xCD, 0xA1, 0xAA, 0xB7, 0xBC,
+    0x8D, 0x86, 0x9B, 0x90, 0xF9, 0xF2, 0xEF, 0xE4, 0xD5, 0xDE, 0xC3, 0xC8,
+    0x11, 0x1A, 0x07, 0x0C, 0x3D, 0x36, 0x2B, 0x20, 0x49, 0x42, 0x5F, 0x54,
+    0x65, 0x6E, 0x73, 0x78};
+
+static const uint8_t crc8tab2[256] = {
+    0x00, 0x83, 0xD3, 0x50, 0x73, 0xF0, 0xA0, 0x23, 0xE6, 0x65, 0x35, 0xB6,
+    0x95, 0x16, 0x46, 0xC5, 0x19, 0x9A, 0xCA, 0x49, 0x6A, 0xE9, 0xB9, 0x3A,
+    0xFF, 0x7C, 0x2C, 0xAF, 0x8C, 0x0F, 0x5F, 0xDC, 0x32, 0xB1, 0xE1, 0x62,
+    0x41, 0xC2, 0x92, 0x11, 0xD4, 0x57, 0x07, 0x84, 0xA7, 0x24, 0x74, 0xF7,
+    0x2B, 0xA8, 0xF8, 0x7B, 0x58, 0xDB, 0x8B, 0x08, 0xCD, 0x4E, 0x1E, 0x9D,
+    0xBE, 0x3D, 0x6D, 0xEE, 0x64, 0xE7, 0xB7, 0x34, 0x17, 0x94, 0xC4, 0x47,
+    0x82, 0x01, 0x51, 0xD2, 0xF1, 0x72, 0x22, 0xA1, 0x7D, 0xFE, 0xAE, 0x2D,
+    0x0E, 0x8D, 0xDD, 0x5E, 0x9B, 0x18, 0x48, 0xCB, 0xE8, 0x6B, 0x3B, 0xB8,
+    0x56, 0xD5, 0x85, 0x06, 0x25, 0xA6, 0xF6, 0x75, 0xB0, 0x33, 0x63, 0xE0,
+    0xC3, 0x40, 0x10, 0x93, 0x4F, 0xCC, 0x9C, 0x1F, 0x3C, 0xBF, 0xEF, 0x6C,
+    0xA9, 0x2A, 0x7A, 0xF9, 0xDA, 0x59, 0x09, 0x8A, 0xC8, 0x4B, 0x1B, 0x98,
+    0xBB, 0x38, 0x68, 0xEB, 0x2E, 0xAD, 0xFD, 0x7E, 0x5D, 0xDE, 0x8E, 0x0D,
+    0xD1, 0x52, 0x02, 0x81, 0xA2, 0x21, 0x71, 0xF2, 0x37, 0xB4, 0xE4, 0x67,
+    0x44, 0xC7, 0x97, 0x14, 0xFA, 0x79, 0x29, 0xAA, 0x89, 0x0A, 0x5A, 0xD9,
+    0x1C, 0x9F, 0xCF, 0x4C, 0x6F, 0xEC, 0xBC, 0x3F, 0xE3, 0x60, 0x30, 0xB3,
+    0x90, 0x13, 0x43, 0xC0, 0x05, 0x86, 0xD6, 0x55, 0x76, 0xF5, 0xA5, 0x26,
+    0xAC, 0x2F, 0x7F, 0xFC, 0xDF, 0x5C, 0x0C, 0x8F, 0x4A, 0xC9, 0x99, 0x1A,
+    0x39, 0xBA, 0xEA, 0x69, 0xB5, 0x36, 0x66, 0xE5, 0xC6, 0x45, 0x15, 0x96,
+    0x53, 0xD0, 0x80, 0x03, 0x20, 0xA3, 0xF3, 0x70, 0x9E, 0x1D, 0x4D, 0xCE,
+    0xED, 0x6E, 0x3E, 0xBD, 0x78, 0xFB, 0xAB, 0x28, 0x0B, 0x88, 0xD8, 0x5B,
+    0x87, 0x04, 0x54, 0xD7, 0xF4, 0x77, 0x27, 0xA4, 0x61, 0xE2, 0xB2, 0x31,
+    0x12, 0x91, 0xC1, 0x42};
+
+static const uint8_t crc8tab3[256] = {
+    0x00, 0x45, 0x8A, 0xCF, 0xC1, 0x84, 0x4B, 0x0E, 0x57, 0x12, 0xDD, 0x98,
+    0x96, 0xD3, 0x1C, 0x59, 0xAE, 0xEB, 0x24, 0x61, 0x6F, 0x2A, 0xE5, 0xA0,
+    0xF9, 0xBC, 0x73, 0x36, 0x38, 0x7D, 0xB2, 0xF7, 0x89, 0xCC, 0x03, 0x46,
+    0x48, 0x0D, 0xC2, 0x87, 0xDE, 0x9B, 0x54, 0x11, 0x1F, 0x5A, 0x95, 0xD0,
+    0x27, 0x62, 0xAD, 0xE8, 0xE6, 0xA3, 0x6C, 0x29, 0x70, 0x35, 0xFA, 0xBF,
+    0xB1, 0xF4, 0x3B, 0x7E, 0xC7, 0x82, 0x4D, 0x08, 0x06, 0x43, 0x8C, 0xC9,
+    0x90, 0xD5, 0x1A, 0x5F, 0x51, 0x14, 0xDB, 0x9E, 0x69, 0x2C, 0xE3, 0xA6,
+    0xA8, 0xED, 0x22, 0x67, 0x3E, 0x7B, 0xB4, 0xF1, 0xFF, 0xBA, 0x75, 0x30,
+    0x4E, 0x0B, 0xC4, 0x81, 0x8F, 0xCA, 0x05, 0x40, 0x19, 0x5C, 0x93, 0xD6,
+    0xD8, 0x9D, 0x52, 0x17, 0xE0, 0xA5, 0x6A, 0x2F, 0x21, 0x64, 0xAB, 0xEE,
+    0xB7, 0xF2, 0x3D, 0x78, 0x76, 0x33, 0xFC, 0xB9, 0x5B, 0x1E, 0xD1, 0x94,
+    0x9A, 0xDF, 0x10, 0x55, 0x0C, 0x49, 0x86, 0xC3, 0xCD, 0x88, 0x47, 0x02,
+    0xF5, 0xB0, 0x7F, 0x3A, 0x34, 0x71, 0xBE, 0xFB, 0xA2, 0xE7, 0x28, 0x6D,
+    0x63, 0x26, 0xE9, 0xAC, 0xD2, 0x97, 0x58, 0x1D, 0x13, 0x56, 0x99, 0xDC,
+    0x85, 0xC0, 0x0F, 0x4A, 0x44, 0x01, 0xCE, 0x8B, 0x7C, 0x39, 0xF6, 0xB3,
+    0xBD, 0xF8, 0x37, 0x72, 0x2B, 0x6E, 0xA1, 0xE4, 0xEA, 0xAF, 0x60, 0x25,
+    0x9C, 0xD9, 0x16, 0x53, 0x5D, 0x18, 0xD7, 0x92, 0xCB, 0x8E, 0x41, 0x04,
+    0x0A, 0x4F, 0x80, 0xC5, 0x32, 0x77, 0xB8, 0xFD, 0xF3, 0xB6, 0x79, 0x3C,
+    0x65, 0x20, 0xEF, 0xAA, 0xA4, 0xE1, 0x2E, 0x6B, 0x15, 0x50, 0x9F, 0xDA,
+    0xD4, 0x91, 0x5E, 0x1B, 0x42, 0x07, 0xC8, 0x8D, 0x83, 0xC6, 0x09, 0x4C,
+    0xBB, 0xFE, 0x31, 0x74, 0x7A, 0x3F, 0xF0, 0xB5, 0xEC, 0xA9, 0x66, 0x23,
+    0x2D, 0x68, 0xA7, 0xE2};
+
+uint8_t csrf_crc8_table(const uint8_t *ptr, size_t len)
+{
+    uint8_t crc = 0;
+    for (size_t i = 0; i < len; i++) crc = csrf_crc8_update(crc, *ptr++);
+    return crc;
+}
+
+uint8_t csrf_crc8_slice4(const uint8_t *ptr, size_t len)
+{
+    uint8_t crc = 0;
+
+    while (len >= 4) {
+        crc = crc8tab3[crc ^ ptr[0]] ^ crc8tab2[ptr[1]] ^ crc8tab1[ptr[2]] ^
+              csrf_crc8tab[ptr[3]];
+        ptr += 4;
+        len -= 4;
+    }
+
+    while (len--) crc = csrf_crc8_update(crc, *ptr++);
+
+    return crc;
+}
+
+#if !defined(CONFIG_DAN_CSRF_CRC_HW)
+uint8_t csrf_crc8(const uint8_t *ptr, size_t len)
+{
+#ifdef CONFIG_DAN_CSRF_CRC_TABLE
+    return csrf_crc8_table(ptr, len);
+#else
+    return csrf_crc8_slice4(ptr, len);
+#endif
+}
+#endif
@@ -0,0 +1,50 @@
+#ifndef ZEPHYR_DRIVERS_MISC_CSRF_CRC_H_
+#define ZEPHYR_DRIVERS_MISC_CSRF_CRC_H_
+
+/*
+ * CSRF CRC8 (polynomial 0xD5, no reflection, zero initial value).
+ *
+ * csrf_crc8() is provided by whichever backend Kconfig picked: the STM32 CRC
+ * unit, or one of the software versions. The software versions are always
+ * there, so they can be compared - on the host too.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+extern const uint8_t csrf_crc8tab[256];
+
+/**
+ * @brief Add one octet to a running CRC.
+ *
+ * This is for frames that arrive in pieces, where the CRC is worked out as
+ * the octets come in.
+ */
+static inline uint8_t csrf_crc8_update(uint8_t crc, uint8_t octet)
+{
+    return csrf_crc8tab[crc ^ octet];
+}
+
+/**
+ * @brief CRC of a whole buffer, using the configured backend.
+ */
+extern uint8_t csrf_crc8(const uint8_t *ptr, size_t len);
+
+/**
+ * @brief One table lookup per octet.
+ */
+extern uint8_t csrf_crc8_table(const uint8_t *ptr, size_t len);
+
+/**
+ * @brief Slice-by-4: four independent table lookups per 4 octets.
+ */
+extern uint8_t csrf_crc8_slice4(const uint8_t *ptr, size_t len);
+
+#ifdef CONFIG_DAN_CSRF_CRC_HW
+/**
+ * @brief Use the STM32 CRC unit.
+ */
+extern uint8_t csrf_crc8_hw(const uint8_t *ptr, size_t len);
+#endif
+
+#endif
@@ -0,0 +1,73 @@
+#include <zephyr/device.h>
+#include <zephyr/drivers/clock_control.h>
+#include <zephyr/drivers/clock_control/stm32_clock_control.h>
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+
+#include <stm32_ll_crc.h>
+
+#include "csrf_crc.h"
+
+#define CRC_NODE DT_COMPAT_GET_ANY_STATUS_OKAY(dan_stm32_crc)
+
+static CRC_TypeDef *const crc_unit = (CRC_TypeDef *)DT_REG_ADDR(CRC_NODE);
+
+/* The unit holds state between octets, so only one CRC at a time. */
+static struct k_spinlock crc_lock;
+
+uint8_t csrf_crc8_hw(const uint8_t *ptr, size_t len)
+{
+    k_spinlock_key_t key = k_spin_lock(&crc_lock);
+    uint8_t crc;
+
+    LL_CRC_ResetCRCCalculationUnit(crc_unit);
+
+    /* The unit takes the most significant octet of a word first, so the
+     * words are swapped to keep the octets in order. */
+    while (len >= 4) {
+        LL_CRC_FeedData32(crc_unit, sys_get_be32(ptr));
+        ptr += 4;
+        len -= 4;
+    }
+
+    while (len--) LL_CRC_FeedData8(crc_unit, *ptr++);
+
+    crc = LL_CRC_ReadData8(crc_unit);
+
+    k_spin_unlock(&crc_lock, key);
+
+    return crc;
+}
+
+uint8_t csrf_crc8(const uint8_t *ptr, size_t len)
+{
+    return csrf_crc8_hw(ptr, len);
+}
+
+static int csrf_crc_init(void)
+{
+    const struct device *clk = DEVICE_DT_GET(STM32_CLOCK_CONTROL_NODE);
+    struct stm32_pclken pclken = STM32_CLOCK_INFO(0, CRC_NODE);
+    int rc;
+
+    if (!device_is_ready(clk)) {
+        return -ENODEV;
+    }
+
+    rc = clock_control_on(clk, (clock_control_subsys_t)&pclken);
+    if (rc) {
+        return rc;
+    }
+
+    LL_CRC_SetPolynomialSize(crc_unit, LL_CRC_POLYLENGTH_8B);
+    LL_CRC_SetPolynomialCoef(crc_unit, 0xd5);
+    LL_CRC_SetInitialData(crc_unit, 0);
+    LL_CRC_SetInputDataReverseMode(crc_unit, LL_CRC_INDATA_REVERSE_NONE);
+    LL_CRC_SetOutputDataReverseMode(crc_unit, LL_CRC_OUTDATA_REVERSE_NONE);
+
+    return 0;
+}
+
+/* Before the CSRF driver starts parsing. */
+SYS_INIT(csrf_crc_init, PRE_KERNEL_2, 0);
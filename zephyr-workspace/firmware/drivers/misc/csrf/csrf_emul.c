@@ -0,0 +1,371 @@
+#include <drivers/misc/csrf_emul.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/serial/uart_emul.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#ifdef CONFIG_SHELL
+#include <stdlib.h>
+#include <zephyr/shell/shell.h>
+#endif
+
+#ifdef CONFIG_ARCH_POSIX
+#include <cmdline.h>
+#include <posix_native_task.h>
+#endif
+
+#include "csrf_parser.h"
+#include "csrf_sim.h"
+
+#define DT_DRV_COMPAT dan_csrf_emul
+
+LOG_MODULE_REGISTER(dan_csrf_emul, CONFIG_DAN_CSRF_LOG_LEVEL);
+
+struct csrf_emul_config
+{
+    /* The UART emulator the CSRF driver is on. */
+    const struct device *uart_dev;
+    uint32_t link_stats_interval;
+};
+
+struct csrf_emul_data
+{
+    const struct device *dev;
+
+    /* Set from the devicetree, and on native_sim the command line, before
+     * init. */
+    struct csrf_emul_link link;
+    uint32_t seed;
+    uint32_t lost_at_ms;
+
+    /* The timer, the shell and the driver's telemetry all get at these. */
+    struct k_spinlock lock;
+    struct csrf_sim sim;
+    bool running;
+    /* When the next slot's due, in us since boot. */
+    int64_t next_us;
+    uint32_t overrun;
+
+    /* Checks the telemetry coming back. */
+    struct csrf_parser tx_parser;
+
+    struct k_timer slot_timer;
+};
+
+/**
+ * @brief Each RC frame slot: send what the receiver would, and set the
+ * timer for the next one.
+ */
+static void slot_timer_handler(struct k_timer *timer)
+{
+    const struct device *dev = k_timer_user_data_get(timer);
+    const struct csrf_emul_config *cfg = dev->config;
+    struct csrf_emul_data *data = dev->data;
+    uint8_t buf[CSRF_SIM_MAX_OCTETS];
+    k_spinlock_key_t key;
+    uint32_t gap_us;
+    size_t len, put;
+
+    key = k_spin_lock(&data->lock);
+
+    if (data->lost_at_ms && k_uptime_get() >= data->lost_at_ms) {
+        data->running = false;
+        data->lost_at_ms = 0;
+        LOG_INF("%s: Link lost", dev->name);
+    }
+
+    if (!data->running) {
+        k_spin_unlock(&data->lock, key);
+        return;
+    }
+
+    len = csrf_sim_next(&data->sim, buf, &gap_us);
+
+    /* From an absolute time, so the timer's rounding doesn't add up. */
+    data->next_us += gap_us;
+    k_timer_start(&data->slot_timer, K_TIMEOUT_ABS_US(data->next_us),
+                  K_NO_WAIT);
+
+    k_spin_unlock(&data->lock, key);
+
+    if (len) {
+        put = uart_emul_put_rx_data(cfg->uart_dev, buf, len);
+        if (put < len) {
+            key = k_spin_lock(&data->lock);
+            data->overrun += len - put;
+            k_spin_unlock(&data->lock, key);
+        }
+    }
+}
+
+/**
+ * @brief Telemetry from the driver: count the good frames.
+ */
+static void tx_data_ready(const struct device *uart_dev, size_t size,
+                          void *user_data)
+{
+    const struct device *dev = user_data;
+    struct csrf_emul_data *data = dev->data;
+    uint8_t buf[32];
+    k_spinlock_key_t key;
+    uint32_t len;
+
+    while ((len = uart_emul_get_tx_data(uart_dev, buf, sizeof(buf))) > 0) {
+        key = k_spin_lock(&data->lock);
+        csrf_parser_feed(&data->tx_parser, buf, len, 0);
+        k_spin_unlock(&data->lock, key);
+    }
+}
+
+static void sim_config(const struct device *dev, struct csrf_sim_config *sim)
+{
+    const struct csrf_emul_config *cfg = dev->config;
+    struct csrf_emul_data *data = dev->data;
+
+    *sim = (struct csrf_sim_config){
+        .rate_hz = data->link.rate_hz,
+        .jitter_us = data->link.jitter_us,
+        .bit_error_ppm = data->link.bit_error_ppm,
+        .drop_percent = data->link.drop_percent,
+        .drop_burst = data->link.drop_burst,
+        .link_stats_interval = cfg->link_stats_interval,
+    };
+}
+
+void csrf_emul_set_link(const struct device *dev,
+                        const struct csrf_emul_link *link)
+{
+    struct csrf_emul_data *data = dev->data;
+    k_spinlock_key_t key = k_spin_lock(&data->lock);
+
+    data->link = *link;
+    sim_config(dev, &data->sim.config);
+    if (!data->sim.config.rate_hz) {
+        data->sim.config.rate_hz = 1;
+    }
+
+    k_spin_unlock(&data->lock, key);
+}
+
+void csrf_emul_set_channels(const struct device *dev, const uint16_t *ch)
+{
+    struct csrf_emul_data *data = dev->data;
+    k_spinlock_key_t key = k_spin_lock(&data->lock);
+
+    csrf_sim_set_channels(&data->sim, ch);
+    k_spin_unlock(&data->lock, key);
+}
+
+void csrf_emul_set_running(const struct device *dev, bool running)
+{
+    struct csrf_emul_data *data = dev->data;
+    k_spinlock_key_t key = k_spin_lock(&data->lock);
+
+    if (running && !data->running) {
+        data->next_us = k_ticks_to_us_floor64(k_uptime_ticks());
+        k_timer_start(&data->slot_timer, K_NO_WAIT, K_NO_WAIT);
+    }
+
+    data->running = running;
+    k_spin_unlock(&data->lock, key);
+}
+
+void csrf_emul_get_stats(const struct device *dev,
+                         struct csrf_emul_stats *stats)
+{
+    struct csrf_emul_data *data = dev->data;
+    k_spinlock_key_t key = k_spin_lock(&data->lock);
+
+    *stats = (struct csrf_emul_stats){
+        .slots = data->sim.stats.slots,
+        .frames = data->sim.stats.frames,
+        .dropped = data->sim.stats.dropped,
+        .corrupted = data->sim.stats.corrupted,
+        .overrun = data->overrun,
+        .telemetry = data->tx_parser.stats.frames,
+    };
+
+    k_spin_unlock(&data->lock, key);
+}
+
+static int csrf_emul_init(const struct device *dev)
+{
+    const struct csrf_emul_config *cfg = dev->config;
+    struct csrf_emul_data *data = dev->data;
+    struct csrf_sim_config sim;
+
+    if (!device_is_ready(cfg->uart_dev)) {
+        LOG_ERR("%s: UART emulator not ready", dev->name);
+        return -ENODEV;
+    }
+
+    data->dev = dev;
+
+    sim_config(dev, &sim);
+    csrf_sim_init(&data->sim, &sim, data->seed);
+
+    /* Only the frame counts matter. */
+    csrf_parser_init(&data->tx_parser, NULL, 0, NULL, NULL);
+    uart_emul_callback_tx_data_ready_set(cfg->uart_dev, tx_data_ready,
+                                         (void *)dev);
+
+    k_timer_init(&data->slot_timer, slot_timer_handler, NULL);
+    k_timer_user_data_set(&data->slot_timer, (void *)dev);
+    csrf_emul_set_running(dev, true);
+
+    LOG_INF("%s: %u Hz, %u%% dropouts, %u ppm bit errors", dev->name,
+            sim.rate_hz, sim.drop_percent, sim.bit_error_ppm);
+
+    return 0;
+}
+
+#define CSRF_EMUL_DEFINE(n)                                                  \
+    static const struct csrf_emul_config csrf_emul_cfg_##n = {               \
+        .uart_dev = DEVICE_DT_GET(DT_INST_PHANDLE(n, uart)),                 \
+        .link_stats_interval = DT_INST_PROP(n, link_stats_interval),         \
+    };                                                                       \
+                                                                             \
+    static struct csrf_emul_data csrf_emul_data_##n = {                      \
+        .link = {                                                            \
+            .rate_hz = DT_INST_PROP(n, rate_hz),                             \
+            .jitter_us = DT_INST_PROP(n, jitter_us),                         \
+            .bit_error_ppm = DT_INST_PROP(n, bit_error_ppm),                 \
+            .drop_percent = DT_INST_PROP(n, drop_percent),                   \
+            .drop_burst = DT_INST_PROP(n, drop_burst),                       \
+        },                                                                   \
+        .seed = DT_INST_PROP(n, seed),                                       \
+        .lost_at_ms = DT_INST_PROP(n, lost_at_ms),                           \
+    };                                                                       \
+                                                                             \
+    DEVICE_DT_INST_DEFINE(n, csrf_emul_init, NULL, &csrf_emul_data_##n,      \
+                          &csrf_emul_cfg_##n, POST_KERNEL,                   \
+                          CONFIG_DAN_CSRF_EMUL_INIT_PRIORITY, NULL);
+
+DT_INST_FOREACH_STATUS_OKAY(CSRF_EMUL_DEFINE)
+
+#ifdef CONFIG_ARCH_POSIX
+/**
+ * @brief On native_sim the first radio's link can be changed from the
+ * command line, so one build can be run against several.
+ */
+static void add_options(void)
+{
+    static struct args_struct_t options[] = {
+        {
+            .option = "radio_rate",
+            .name = "hz",
+            .type = 'u',
+            .dest = &csrf_emul_data_0.link.rate_hz,
+            .descript = "RC frames a second from the emulated radio",
+        },
+        {
+            .option = "radio_drop",
+            .name = "percent",
+            .type = 'u',
+            .dest = &csrf_emul_data_0.link.drop_percent,
+            .descript = "Chance of each radio frame starting a dropout",
+        },
+        {
+            .option = "radio_burst",
+            .name = "frames",
+            .type = 'u',
+            .dest = &csrf_emul_data_0.link.drop_burst,
+            .descript = "Average radio frames lost in a dropout",
+        },
+        {
+            .option = "radio_ber",
+            .name = "ppm",
+            .type = 'u',
+            .dest = &csrf_emul_data_0.link.bit_error_ppm,
+            .descript = "Bit errors on the radio's serial line, per million",
+        },
+        {
+            .option = "radio_lost_at",
+            .name = "ms",
+            .type = 'u',
+            .dest = &csrf_emul_data_0.lost_at_ms,
+            .descript = "Lose the radio link this long after boot",
+        },
+        {
+            .option = "radio_seed",
+            .name = "seed",
+            .type = 'u',
+            .dest = &csrf_emul_data_0.seed,
+            .descript = "Seed for the radio's noise and dropouts",
+        },
+        ARG_TABLE_ENDMARKER,
+    };
+
+    native_add_command_line_opts(options);
+}
+
+NATIVE_TASK(add_options, PRE_BOOT_1, 10);
+#endif
+
+#ifdef CONFIG_SHELL
+static const struct device *const radio = DEVICE_DT_INST_GET(0);
+
+static int cmd_radio_emul_stats(const struct shell *sh, size_t argc,
+                                char **argv)
+{
+    struct csrf_emul_stats s;
+
+    csrf_emul_get_stats(radio, &s);
+    shell_print(sh, "%u slots, %u frames, %u dropped, %u corrupted", s.slots,
+                s.frames, s.dropped, s.corrupted);
+    shell_print(sh, "%u octets overrun, %u telemetry frames back",
+                s.overrun, s.telemetry);
+
+    return 0;
+}
+
+static int cmd_radio_emul_start(const struct shell *sh, size_t argc,
+                                char **argv)
+{
+    csrf_emul_set_running(radio, true);
+    return 0;
+}
+
+static int cmd_radio_emul_stop(const struct shell *sh, size_t argc,
+                               char **argv)
+{
+    csrf_emul_set_running(radio, false);
+    return 0;
+}
+
+static int cmd_radio_emul_link(const struct shell *sh, size_t argc,
+                               char **argv)
+{
+    struct csrf_emul_data *data = radio->data;
+    struct csrf_emul_link link = data->link;
+
+    link.rate_hz = strtoul(argv[1], NULL, 0);
+    link.drop_percent = strtoul(argv[2], NULL, 0);
+    link.drop_burst = strtoul(argv[3], NULL, 0);
+    link.bit_error_ppm = strtoul(argv[4], NULL, 0);
+
+    if (!link.rate_hz || link.drop_percent > 100) {
+        shell_error(sh, "Bad link");
+        return -EINVAL;
+    }
+
+    csrf_emul_set_link(radio, &link);
+
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(
+    radio_emul_cmds,
+    SHELL_CMD(stats, NULL, "Frames sent, lost and corrupted",
+              cmd_radio_emul_stats),
+    SHELL_CMD(start, NULL, "Start sending", cmd_radio_emul_start),
+    SHELL_CMD(stop, NULL, "Stop sending, as if out of range",
+              cmd_radio_emul_stop),
+    SHELL_CMD_ARG(link, NULL,
+                  "<rate Hz> <dropout %> <dropout frames> <bit errors ppm>",
+                  cmd_radio_emul_link, 5, 0),
+    SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(radio_emul, &radio_emul_cmds, "Emulated ELRS receiver",
+                   NULL);
+#endif
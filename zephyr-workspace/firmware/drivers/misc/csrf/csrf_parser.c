@@ -0,0 +1,223 @@
+#include "csrf_parser.h"
+
+#include <string.h>
+
+static inline int is_sync(uint8_t octet)
+{
+    return octet == CSRF_ADDR_FLIGHT_CONTROLLER ||
+           octet == CSRF_ADDR_RADIO_TRANSMITTER ||
+           octet == CSRF_ADDR_CRSF_TRANSMITTER;
+}
+
+static const struct csrf_frame_handler *
+find_handler(const struct csrf_parser *parser, uint8_t type)
+{
+    for (size_t i = 0; i < parser->num_handlers; i++) {
+        if (parser->handlers[i].type == type)
+            return &parser->handlers[i];
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Check the length octet agrees with the frame type.
+ */
+static inline int length_ok(const struct csrf_frame_handler *handler,
+                            uint8_t len)
+{
+    return !handler || (len - 2 >= handler->min_payload_len &&
+                        len - 2 <= handler->max_payload_len);
+}
+
+/**
+ * @brief Hand a good frame to its handler.
+ *
+ * @param frame The type and payload octets.
+ * @param len The value of the length octet.
+ */
+static void dispatch(struct csrf_parser *parser,
+                     const struct csrf_frame_handler *handler,
+                     const uint8_t *frame, uint8_t len, uint32_t frame_stamp)
+{
+    struct csrf_frame f = {
+        .addr = parser->addr,
+        .type = frame[0],
+        .payload = &frame[1],
+        .payload_len = len - 2,
+        .sync_stamp = parser->sync_stamp,
+        .frame_stamp = frame_stamp,
+    };
+
+    parser->stats.frames++;
+
+    if (!handler) {
+        parser->stats.unhandled++;
+        return;
+    }
+
+    handler->handler(parser->user_data, &f);
+}
+
+/**
+ * @brief Look for a frame inside the stitched frame that just failed.
+ *
+ * The octets after the sync byte might hold a real frame, so they're run
+ * through the parser again. A frame that lies wholly inside them is
+ * dispatched from the length state as usual. One that starts in them and
+ * runs past their end leaves the parser part way through it, to carry on
+ * with whatever's fed next.
+ *
+ * A stitched frame is only started when there are too few octets left to
+ * hold it, so one can't complete inside the re-fed octets. The only way
+ * back in here is a bad type on its first octet, which leaves just its
+ * length octet to re-feed - so the recursion goes no deeper than that.
+ */
+static void resync(struct csrf_parser *parser)
+{
+    uint8_t octets[CSRF_MAX_FRAME_LEN + 1];
+    size_t len = parser->pos + 1;
+
+    octets[0] = parser->len;
+    memcpy(&octets[1], parser->frame, parser->pos);
+
+    parser->state = CSRF_PARSER_SYNC;
+    /* The length octet came one after the sync byte. */
+    csrf_parser_feed(parser, octets, len,
+                     parser->sync_stamp + parser->octet_time);
+}
+
+void csrf_parser_init(struct csrf_parser *parser,
+                      const struct csrf_frame_handler *handlers,
+                      size_t num_handlers, void *user_data,
+                      uint32_t (*clock)(void))
+{
+    memset(parser, 0, sizeof(*parser));
+
+    parser->handlers = handlers;
+    parser->num_handlers = num_handlers;
+    parser->user_data = user_data;
+    parser->clock = clock;
+    parser->state = CSRF_PARSER_SYNC;
+}
+
+void csrf_parser_set_octet_time(struct csrf_parser *parser,
+                                uint32_t octet_time)
+{
+    parser->octet_time = octet_time;
+}
+
+void csrf_parser_feed(struct csrf_parser *parser, const uint8_t *buf,
+                      size_t len, uint32_t stamp)
+{
+    size_t i = 0;
+
+    while (i < len) {
+        switch (parser->state) {
+            case CSRF_PARSER_SYNC:
+                if (is_sync(buf[i])) {
+                    parser->addr = buf[i];
+                    parser->sync_stamp = stamp + i * parser->octet_time;
+                    parser->state = CSRF_PARSER_LEN;
+                } else {
+                    parser->stats.noise++;
+                }
+                i++;
+                break;
+
+            case CSRF_PARSER_LEN: {
+                const struct csrf_frame_handler *handler;
+                uint8_t frame_len = buf[i];
+                uint32_t frame_stamp;
+
+                if (frame_len < 2 || frame_len > CSRF_MAX_FRAME_LEN) {
+                    /* Leave the octet where it is, as it might be the sync
+                     * byte of the real frame. */
+                    parser->stats.bad_len++;
+                    parser->state = CSRF_PARSER_SYNC;
+                    break;
+                }
+
+                i++;
+
+                if (len - i < frame_len) {
+                    parser->len = frame_len;
+                    parser->pos = 0;
+                    parser->crc = 0;
+                    parser->state = CSRF_PARSER_FRAME;
+                    break;
+                }
+
+                /* We have the whole frame already! */
+                frame_stamp = parser->clock ? parser->clock() : stamp;
+                parser->state = CSRF_PARSER_SYNC;
+
+                handler = find_handler(parser, buf[i]);
+                if (!length_ok(handler, frame_len)) {
+                    parser->stats.bad_len++;
+                    i--;
+                    break;
+                }
+
+                if (csrf_crc8(&buf[i], frame_len - 1) !=
+                    buf[i + frame_len - 1]) {
+                    /* Start looking again from the length octet. */
+                    parser->stats.bad_crc++;
+                    i--;
+                    break;
+                }
+
+                dispatch(parser, handler, &buf[i], frame_len, frame_stamp);
+                i += frame_len;
+                break;
+            }
+
+            case CSRF_PARSER_FRAME: {
+                uint8_t crc = parser->crc;
+                uint8_t pos = parser->pos;
+                uint32_t frame_stamp;
+
+                if (pos == 0) {
+                    parser->handler = find_handler(parser, buf[i]);
+                    if (!length_ok(parser->handler, parser->len)) {
+                        parser->stats.bad_len++;
+                        resync(parser);
+                        break;
+                    }
+                }
+
+                /* Everything but the last octet is covered by the CRC. */
+                while (i < len && pos < parser->len - 1) {
+                    parser->frame[pos++] = buf[i];
+                    crc = csrf_crc8_update(crc, buf[i++]);
+                }
+
+                if (i < len && pos == parser->len - 1)
+                    parser->frame[pos++] = buf[i++];
+
+                parser->crc = crc;
+                parser->pos = pos;
+
+                if (pos < parser->len)
+                    break;
+
+                frame_stamp = parser->clock ? parser->clock() : stamp;
+                parser->state = CSRF_PARSER_SYNC;
+
+                if (crc != parser->frame[pos - 1]) {
+                    parser->stats.bad_crc++;
+                    resync(parser);
+                    break;
+                }
+
+                dispatch(parser, parser->handler, parser->frame, parser->len,
+                         frame_stamp);
+                break;
+            }
+
+            default:
+                parser->state = CSRF_PARSER_SYNC;
+                break;
+        }
+    }
+}
@@ -0,0 +1,141 @@
+#ifndef ZEPHYR_DRIVERS_MISC_CSRF_PARSER_H_
+#define ZEPHYR_DRIVERS_MISC_CSRF_PARSER_H_
+
+/*
+ * Streaming CSRF frame parser.
+ *
+ * This is plain C with no Zephyr dependencies so that it can be built and
+ * benchmarked on the host - see tools/csrf_bench.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "csrf_crc.h"
+
+/* Largest value the length octet can take: type + payload + CRC. */
+#define CSRF_MAX_FRAME_LEN 62
+
+/* Sync octets. These are really the address of the device the frame is
+ * going to, and ELRS receivers don't always use the flight controller's. */
+#define CSRF_ADDR_FLIGHT_CONTROLLER 0xc8
+#define CSRF_ADDR_RADIO_TRANSMITTER 0xea
+#define CSRF_ADDR_CRSF_TRANSMITTER 0xee
+
+#define CSRF_FRAME_RC_CHANNELS 0x16
+
+enum csrf_parser_state
+{
+    CSRF_PARSER_SYNC,
+    CSRF_PARSER_LEN,
+    CSRF_PARSER_FRAME,
+};
+
+/**
+ * @brief A frame that's passed its CRC check.
+ */
+struct csrf_frame
+{
+    uint8_t addr;
+    uint8_t type;
+    const uint8_t *payload;
+    uint8_t payload_len;
+
+    /* When the sync byte arrived, from the stamp passed in with it. */
+    uint32_t sync_stamp;
+    /* From the parser's clock, when the last octet arrived. */
+    uint32_t frame_stamp;
+};
+
+typedef void (*csrf_frame_handler_t)(void *user_data,
+                                     const struct csrf_frame *frame);
+
+/**
+ * @brief An entry in the frame type dispatch table.
+ */
+struct csrf_frame_handler
+{
+    uint8_t type;
+    /* Frames outside these limits are treated as a bad length. Knowing this
+     * as soon as the type octet arrives lets us throw away a bogus frame
+     * without waiting for the rest of it. */
+    uint8_t min_payload_len;
+    uint8_t max_payload_len;
+    csrf_frame_handler_t handler;
+};
+
+struct csrf_parser_stats
+{
+    /* Frames that passed the CRC check. */
+    uint32_t frames;
+    /* Frames with a type we have no handler for. */
+    uint32_t unhandled;
+    uint32_t bad_crc;
+    /* Lengths that are out of range, or wrong for the frame type. */
+    uint32_t bad_len;
+    /* Octets thrown away while looking for a sync byte. */
+    uint32_t noise;
+};
+
+struct csrf_parser
+{
+    const struct csrf_frame_handler *handlers;
+    size_t num_handlers;
+    void *user_data;
+    uint32_t (*clock)(void);
+    /* How long each octet takes on the wire, in the stamps' units. */
+    uint32_t octet_time;
+
+    enum csrf_parser_state state;
+    uint8_t addr;
+    uint8_t len;
+    uint8_t pos;
+    uint8_t crc;
+    const struct csrf_frame_handler *handler;
+    uint32_t sync_stamp;
+    /* Only used for frames that are split across two chunks. */
+    uint8_t frame[CSRF_MAX_FRAME_LEN];
+
+    struct csrf_parser_stats stats;
+};
+
+/**
+ * @brief Set up a parser.
+ *
+ * @param handlers Dispatch table, searched in order.
+ * @param user_data Passed to every handler.
+ * @param clock Used to stamp each frame when it's complete. May be NULL.
+ */
+extern void csrf_parser_init(struct csrf_parser *parser,
+                             const struct csrf_frame_handler *handlers,
+                             size_t num_handlers, void *user_data,
+                             uint32_t (*clock)(void));
+
+/**
+ * @brief Set how long an octet takes on the wire, so a sync byte part way
+ * through a chunk gets the time it arrived rather than the chunk's. It's 0,
+ * so every frame gets the chunk's stamp, until this is called.
+ */
+extern void csrf_parser_set_octet_time(struct csrf_parser *parser,
+                                       uint32_t octet_time);
+
+/**
+ * @brief Run a chunk of received octets through the parser.
+ *
+ * Every octet is looked at once. Frames that are wholly inside the chunk
+ * are checked where they are, so there's no copying in the common case
+ * where one idle-line event delivers one frame. Frames that straddle two
+ * chunks are stitched together in the parser, with the CRC worked out as
+ * the octets arrive.
+ *
+ * When a frame fails its checks, the search for the next sync byte starts
+ * with the octet after the bad frame's sync byte, so a noise octet that
+ * looked like a sync byte doesn't cost us the real frame behind it.
+ *
+ * @param stamp When the chunk's first octet arrived. A frame's sync_stamp
+ * is this plus the octet time for each octet before its sync byte.
+ */
+extern void csrf_parser_feed(struct csrf_parser *parser, const uint8_t *buf,
+                             size_t len, uint32_t stamp);
+
+#endif
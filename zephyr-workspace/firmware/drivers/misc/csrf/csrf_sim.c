@@ -0,0 +1,150 @@
+#include "csrf_sim.h"
+
+#include <string.h>
+
+/* The same as CSRF_FRAME_LINK_STATISTICS, which is in the driver's header
+ * along with Zephyr's. */
+#define LINK_STATISTICS 0x14
+#define LINK_STATISTICS_LEN 10
+
+/* Channel centre on the 11 bit scale, 1500 us. */
+#define CHANNEL_CENTRE 992
+
+static uint32_t rng(struct csrf_sim *sim)
+{
+    /* xorshift32, so runs are repeatable. */
+    sim->rng ^= sim->rng << 13;
+    sim->rng ^= sim->rng >> 17;
+    sim->rng ^= sim->rng << 5;
+    return sim->rng;
+}
+
+void csrf_sim_init(struct csrf_sim *sim, const struct csrf_sim_config *config,
+                   uint32_t seed)
+{
+    memset(sim, 0, sizeof(*sim));
+    sim->config = *config;
+    sim->rng = seed ? seed : 1;
+
+    if (!sim->config.rate_hz)
+        sim->config.rate_hz = 1;
+
+    for (int i = 0; i < CSRF_NUM_CHANNELS; i++) sim->ch[i] = CHANNEL_CENTRE;
+}
+
+void csrf_sim_set_channels(struct csrf_sim *sim, const uint16_t *ch)
+{
+    memcpy(sim->ch, ch, sizeof(sim->ch));
+}
+
+/**
+ * @brief Frame a payload the way the receiver does, to the flight
+ * controller.
+ */
+static size_t put_frame(uint8_t *out, uint8_t type, const uint8_t *payload,
+                        size_t len)
+{
+    out[0] = CSRF_ADDR_FLIGHT_CONTROLLER;
+    out[1] = len + 2;
+    out[2] = type;
+    memcpy(&out[3], payload, len);
+    out[3 + len] = csrf_crc8(&out[2], len + 1);
+
+    return len + 4;
+}
+
+/**
+ * @brief Whether this slot's lost to a dropout, starting one at random.
+ */
+static bool dropped(struct csrf_sim *sim)
+{
+    const struct csrf_sim_config *config = &sim->config;
+
+    if (!sim->burst_left && config->drop_percent &&
+        rng(sim) % 100 < config->drop_percent) {
+        /* Geometric, so the average is drop_burst. */
+        sim->burst_left = 1;
+        while (config->drop_burst > 1 && rng(sim) % config->drop_burst)
+            sim->burst_left++;
+    }
+
+    if (!sim->burst_left)
+        return false;
+
+    sim->burst_left--;
+    return true;
+}
+
+/**
+ * @brief Flip bits on the line, returning whether any were.
+ */
+static bool add_noise(struct csrf_sim *sim, uint8_t *buf, size_t len)
+{
+    bool flipped = false;
+
+    if (!sim->config.bit_error_ppm)
+        return false;
+
+    for (size_t i = 0; i < len; i++) {
+        for (int b = 0; b < 8; b++) {
+            if (rng(sim) % 1000000 < sim->config.bit_error_ppm) {
+                buf[i] ^= 1 << b;
+                flipped = true;
+            }
+        }
+    }
+
+    return flipped;
+}
+
+size_t csrf_sim_next(struct csrf_sim *sim, uint8_t *out, uint32_t *gap_us)
+{
+    const struct csrf_sim_config *config = &sim->config;
+    uint8_t payload[CSRF_RC_CHANNELS_PAYLOAD_LEN];
+    uint32_t period_us = 1000000 / config->rate_hz;
+    uint32_t jitter = config->jitter_us < period_us ? config->jitter_us : 0;
+    size_t len = 0;
+    bool lost;
+
+    *gap_us = period_us;
+    if (jitter)
+        *gap_us += rng(sim) % (2 * jitter + 1) - jitter;
+
+    sim->stats.slots++;
+    sim->window_slots++;
+
+    lost = dropped(sim);
+    if (lost) {
+        sim->stats.dropped++;
+    } else {
+        csrf_pack_rc_channels(sim->ch, payload);
+        len = put_frame(out, CSRF_FRAME_RC_CHANNELS, payload, sizeof(payload));
+        sim->stats.frames++;
+        sim->window_frames++;
+    }
+
+    if (config->link_stats_interval &&
+        sim->window_slots >= config->link_stats_interval) {
+        /* Strong signal both ways: only the link quality moves. */
+        uint8_t stats[LINK_STATISTICS_LEN] = {50, 50, 0, 10, 0,
+                                              4,  2,  50, 100, 8};
+
+        stats[2] = sim->window_frames * 100 / sim->window_slots;
+        sim->window_slots = 0;
+        sim->window_frames = 0;
+
+        /* It goes out straight after the RC frame, so it's lost with it. */
+        if (!lost) {
+            len += put_frame(&out[len], LINK_STATISTICS, stats,
+                             sizeof(stats));
+            sim->stats.link_stats++;
+        }
+    }
+
+    if (add_noise(sim, out, len))
+        sim->stats.corrupted++;
+
+    sim->stats.octets += len;
+
+    return len;
+}
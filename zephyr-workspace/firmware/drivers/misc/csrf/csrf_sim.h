@@ -0,0 +1,92 @@
+#ifndef ZEPHYR_DRIVERS_MISC_CSRF_SIM_H_
+#define ZEPHYR_DRIVERS_MISC_CSRF_SIM_H_
+
+/*
+ * A simulated ELRS receiver: what comes down its serial line each RC frame
+ * slot, with the line's bit errors and the radio link's dropouts applied.
+ * Every few slots a link statistics frame follows the RC frame, with the
+ * link quality the dropouts add up to.
+ *
+ * The emulator (csrf_emul.c) plays it into a UART emulator on native_sim.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "csrf_channels.h"
+#include "csrf_parser.h"
+
+/* An RC frame and a link statistics frame. */
+#define CSRF_SIM_MAX_OCTETS (2 * (CSRF_MAX_FRAME_LEN + 2))
+
+struct csrf_sim_config
+{
+    /* RC frames a second, which ELRS calls the packet rate. */
+    uint32_t rate_hz;
+    /* Each gap is this much either way of 1 / rate_hz, at random. */
+    uint32_t jitter_us;
+    /* Chance of each bit on the serial line being flipped, per million. */
+    uint32_t bit_error_ppm;
+    /* Chance of each frame starting a dropout, in percent, and the average
+     * number of frames it loses. */
+    uint32_t drop_percent;
+    uint32_t drop_burst;
+    /* A link statistics frame after every this many RC frame slots, or 0
+     * for none. */
+    uint32_t link_stats_interval;
+};
+
+struct csrf_sim_stats
+{
+    /* RC frame slots, and the frames that went out in them. */
+    uint32_t slots;
+    uint32_t frames;
+    /* Lost to dropouts. */
+    uint32_t dropped;
+    /* Slots whose octets went out with at least one bit flipped. */
+    uint32_t corrupted;
+    uint32_t link_stats;
+    uint32_t octets;
+};
+
+struct csrf_sim
+{
+    struct csrf_sim_config config;
+    uint32_t rng;
+
+    uint16_t ch[CSRF_NUM_CHANNELS];
+
+    /* Frames still to lose in this dropout. */
+    uint32_t burst_left;
+    /* Slots and frames sent since the last link statistics frame. */
+    uint32_t window_slots;
+    uint32_t window_frames;
+
+    struct csrf_sim_stats stats;
+};
+
+/**
+ * @brief Set up a receiver with every channel centred.
+ *
+ * @param seed For the noise and dropouts, so runs can be repeated. Not 0.
+ */
+extern void csrf_sim_init(struct csrf_sim *sim,
+                          const struct csrf_sim_config *config, uint32_t seed);
+
+/**
+ * @brief The channels to send from the next frame on, 11 bits each.
+ */
+extern void csrf_sim_set_channels(struct csrf_sim *sim, const uint16_t *ch);
+
+/**
+ * @brief What comes down the line in the next RC frame slot.
+ *
+ * @param out Room for CSRF_SIM_MAX_OCTETS.
+ * @param gap_us Set to the time until the next slot.
+ * @return How many octets went in out, 0 if the slot's frames were lost.
+ */
+extern size_t csrf_sim_next(struct csrf_sim *sim, uint8_t *out,
+                            uint32_t *gap_us);
+
+#endif
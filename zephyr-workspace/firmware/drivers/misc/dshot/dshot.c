@@ -0,0 +1,556 @@
+#include <drivers/misc/dshot.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/clock_control.h>
+#include <zephyr/drivers/clock_control/stm32_clock_control.h>
+#include <zephyr/drivers/dma.h>
+#include <zephyr/drivers/pinctrl.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/pm/device.h>
+#include <zephyr/sys/atomic.h>
+
+#include <stm32_ll_tim.h>
+
+#include "dshot_frame.h"
+
+#define DT_DRV_COMPAT dan_stm32_dshot
+
+LOG_MODULE_REGISTER(dan_dshot, CONFIG_DAN_DSHOT_LOG_LEVEL);
+
+/* Room for one edge too many, so a noisy reply shows up as too long. */
+#define EDGE_BUF_LEN (DSHOT_TELEMETRY_MAX_EDGES + 1)
+
+struct dshot_config
+{
+    TIM_TypeDef *timer;
+    struct stm32_pclken pclken;
+    /* 1-4. */
+    uint8_t channel;
+
+    const struct device *dma_dev;
+    uint32_t dma_channel;
+    uint32_t dma_slot;
+
+    /* Kbit/s: 150, 300 or 600. */
+    uint16_t speed;
+    bool bidirectional;
+    uint8_t motor_poles;
+
+    const struct pinctrl_dev_config *pcfg;
+};
+
+struct dshot_data
+{
+    const struct device *dev;
+
+    /* Timer counts for a bit, and the compare values for a 0 and a 1. */
+    uint16_t period;
+    uint16_t t0, t1;
+    /* Length of a telemetry bit, which runs at 5/4 the rate, as Q8. */
+    uint32_t telemetry_bit_q8;
+
+    /* DShot value to send: 0 or DSHOT_THROTTLE_MIN up. */
+    atomic_t throttle;
+    /* Command to send instead, and how many more times. */
+    atomic_t command;
+    atomic_t command_repeat;
+    /* Frames since the ESC was last asked for serial telemetry. */
+    uint32_t telemetry_count;
+
+    uint16_t buf[DSHOT_BUF_LEN] __aligned(4);
+    uint16_t edges[EDGE_BUF_LEN] __aligned(4);
+
+    /* The DMA is sending a frame. */
+    bool sending;
+    /* The channel is an input, waiting for the ESC to reply. */
+    bool capturing;
+
+    atomic_t erpm;
+    atomic_t erpm_time;
+
+    struct
+    {
+        uint32_t frames;
+        uint32_t replies;
+        uint32_t bad_replies;
+    } stats;
+
+    struct k_timer frame_timer;
+};
+
+static const uint32_t ll_channels[] = {
+    LL_TIM_CHANNEL_CH1,
+    LL_TIM_CHANNEL_CH2,
+    LL_TIM_CHANNEL_CH3,
+    LL_TIM_CHANNEL_CH4,
+};
+
+static const uint32_t ll_burst_base[] = {
+    LL_TIM_DMABURST_BASEADDR_CCR1,
+    LL_TIM_DMABURST_BASEADDR_CCR2,
+    LL_TIM_DMABURST_BASEADDR_CCR3,
+    LL_TIM_DMABURST_BASEADDR_CCR4,
+};
+
+static void dma_callback(const struct device *dma_dev, void *user_data,
+                         uint32_t channel, int status);
+
+static inline volatile uint32_t *ccr(const struct dshot_config *cfg)
+{
+    return &cfg->timer->CCR1 + (cfg->channel - 1);
+}
+
+/**
+ * @brief Clear a channel's half of a CCMR register, so none of the input
+ * settings leak into the output settings or the other way round.
+ */
+static void ccmr_clear(const struct dshot_config *cfg)
+{
+    volatile uint32_t *ccmr =
+        cfg->channel <= 2 ? &cfg->timer->CCMR1 : &cfg->timer->CCMR2;
+    uint32_t shift = ((cfg->channel - 1) & 1) * 8;
+
+    *ccmr &= ~(0x000100ffu << shift);
+}
+
+static int start_dma(const struct device *dev, bool out)
+{
+    const struct dshot_config *cfg = dev->config;
+    struct dshot_data *data = dev->data;
+    struct dma_block_config blk = {0};
+    struct dma_config dma_cfg = {
+        .dma_slot = cfg->dma_slot,
+        .source_data_size = sizeof(uint16_t),
+        .dest_data_size = sizeof(uint16_t),
+        .source_burst_length = 1,
+        .dest_burst_length = 1,
+        .block_count = 1,
+        .head_block = &blk,
+        .dma_callback = dma_callback,
+        .user_data = (void *)dev,
+    };
+    int rc;
+
+    if (out) {
+        dma_cfg.channel_direction = MEMORY_TO_PERIPHERAL;
+        blk.source_address = (uint32_t)data->buf;
+        blk.dest_address = (uint32_t)&cfg->timer->DMAR;
+        blk.source_addr_adj = DMA_ADDR_ADJ_INCREMENT;
+        blk.dest_addr_adj = DMA_ADDR_ADJ_NO_CHANGE;
+        blk.block_size = sizeof(data->buf);
+    } else {
+        dma_cfg.channel_direction = PERIPHERAL_TO_MEMORY;
+        blk.source_address = (uint32_t)ccr(cfg);
+        blk.dest_address = (uint32_t)data->edges;
+        blk.source_addr_adj = DMA_ADDR_ADJ_NO_CHANGE;
+        blk.dest_addr_adj = DMA_ADDR_ADJ_INCREMENT;
+        blk.block_size = sizeof(data->edges);
+    }
+
+    rc = dma_config(cfg->dma_dev, cfg->dma_channel, &dma_cfg);
+    if (rc) {
+        return rc;
+    }
+
+    return dma_start(cfg->dma_dev, cfg->dma_channel);
+}
+
+/**
+ * @brief Make the channel a PWM output, idle, with the DMA writing the
+ * compare value on each update.
+ */
+static void output_mode(const struct device *dev)
+{
+    const struct dshot_config *cfg = dev->config;
+    struct dshot_data *data = dev->data;
+    uint32_t ch = ll_channels[cfg->channel - 1];
+
+    LL_TIM_CC_DisableChannel(cfg->timer, ch);
+    CLEAR_BIT(cfg->timer->DIER, TIM_DIER_CC1DE << (cfg->channel - 1));
+
+    ccmr_clear(cfg);
+    LL_TIM_IC_SetPolarity(cfg->timer, ch, LL_TIM_IC_POLARITY_RISING);
+
+    /* The counter could be anywhere after a capture. */
+    LL_TIM_SetAutoReload(cfg->timer, data->period - 1);
+    LL_TIM_SetCounter(cfg->timer, 0);
+    LL_TIM_OC_SetMode(cfg->timer, ch, LL_TIM_OCMODE_PWM1);
+    /* Bidirectional DShot idles high. */
+    LL_TIM_OC_SetPolarity(cfg->timer, ch,
+                          cfg->bidirectional ? LL_TIM_OCPOLARITY_LOW
+                                             : LL_TIM_OCPOLARITY_HIGH);
+    LL_TIM_OC_EnablePreload(cfg->timer, ch);
+    *ccr(cfg) = 0;
+
+    LL_TIM_ConfigDMABurst(cfg->timer, ll_burst_base[cfg->channel - 1],
+                          LL_TIM_DMABURST_LENGTH_1TRANSFER);
+
+    LL_TIM_CC_EnableChannel(cfg->timer, ch);
+}
+
+/**
+ * @brief Make the channel an input and time every edge of the reply.
+ */
+static int capture_mode(const struct device *dev)
+{
+    const struct dshot_config *cfg = dev->config;
+    uint32_t ch = ll_channels[cfg->channel - 1];
+    int rc;
+
+    LL_TIM_DisableDMAReq_UPDATE(cfg->timer);
+    LL_TIM_CC_DisableChannel(cfg->timer, ch);
+
+    ccmr_clear(cfg);
+    LL_TIM_IC_SetActiveInput(cfg->timer, ch, LL_TIM_ACTIVEINPUT_DIRECTTI);
+    LL_TIM_IC_SetPrescaler(cfg->timer, ch, LL_TIM_ICPSC_DIV1);
+    LL_TIM_IC_SetFilter(cfg->timer, ch, LL_TIM_IC_FILTER_FDIV1_N2);
+    LL_TIM_IC_SetPolarity(cfg->timer, ch, LL_TIM_IC_POLARITY_BOTHEDGE);
+
+    /* A whole reply fits in one run of the counter. */
+    LL_TIM_SetAutoReload(cfg->timer, 0xffff);
+
+    rc = start_dma(dev, false);
+    if (rc) {
+        return rc;
+    }
+
+    SET_BIT(cfg->timer->DIER, TIM_DIER_CC1DE << (cfg->channel - 1));
+    LL_TIM_CC_EnableChannel(cfg->timer, ch);
+
+    return 0;
+}
+
+/**
+ * @brief Decode whatever the ESC sent back after the last frame.
+ */
+static void finish_capture(const struct device *dev)
+{
+    const struct dshot_config *cfg = dev->config;
+    struct dshot_data *data = dev->data;
+    struct dma_status status;
+    uint32_t gcr;
+    uint16_t value;
+    size_t count = 0;
+
+    if (!dma_get_status(cfg->dma_dev, cfg->dma_channel, &status)) {
+        count = EDGE_BUF_LEN - status.pending_length;
+    }
+
+    dma_stop(cfg->dma_dev, cfg->dma_channel);
+    data->capturing = false;
+
+    if (count == 0) {
+        return;
+    }
+
+    if (dshot_edges_to_gcr(data->edges, count, data->telemetry_bit_q8,
+                           &gcr) ||
+        dshot_gcr_to_value(gcr, &value)) {
+        data->stats.bad_replies++;
+        return;
+    }
+
+    data->stats.replies++;
+    atomic_set(&data->erpm, dshot_value_to_erpm(value));
+    atomic_set(&data->erpm_time, k_uptime_get_32());
+}
+
+static void dma_callback(const struct device *dma_dev, void *user_data,
+                         uint32_t channel, int status)
+{
+    const struct device *dev = user_data;
+    const struct dshot_config *cfg = dev->config;
+    struct dshot_data *data = dev->data;
+
+    /* A full capture buffer is dealt with on the next frame. */
+    if (!data->sending) {
+        return;
+    }
+
+    data->sending = false;
+
+    if (status < 0) {
+        LOG_ERR("%s: DMA error %d", dev->name, status);
+        return;
+    }
+
+    /* The idle bits are on the line now, so it's safe to let go of it. */
+    if (cfg->bidirectional) {
+        dma_stop(cfg->dma_dev, cfg->dma_channel);
+        if (capture_mode(dev) == 0) {
+            data->capturing = true;
+        }
+    }
+}
+
+/**
+ * @brief Pick the next value to send - a pending command, or the throttle.
+ */
+static uint16_t next_value(struct dshot_data *data, bool *telemetry)
+{
+    if (atomic_get(&data->command_repeat) > 0) {
+        atomic_dec(&data->command_repeat);
+        /* The ESC only acts on commands with the telemetry bit set. */
+        *telemetry = true;
+        return atomic_get(&data->command);
+    }
+
+#if CONFIG_DAN_DSHOT_TELEMETRY_REQUEST_INTERVAL > 0
+    /* Ask the ESC for a serial telemetry frame every so often. */
+    if (++data->telemetry_count >=
+        CONFIG_DAN_DSHOT_TELEMETRY_REQUEST_INTERVAL) {
+        data->telemetry_count = 0;
+        *telemetry = true;
+        return atomic_get(&data->throttle);
+    }
+#endif
+
+    *telemetry = false;
+    return atomic_get(&data->throttle);
+}
+
+static void frame_timer_handler(struct k_timer *timer)
+{
+    const struct device *dev = k_timer_user_data_get(timer);
+    const struct dshot_config *cfg = dev->config;
+    struct dshot_data *data = dev->data;
+    bool telemetry;
+    uint16_t value;
+
+    if (data->sending) {
+        return;
+    }
+
+    if (data->capturing) {
+        finish_capture(dev);
+        output_mode(dev);
+    }
+
+    value = next_value(data, &telemetry);
+    dshot_frame_to_ccr(dshot_frame(value, telemetry, cfg->bidirectional),
+                       data->t0, data->t1, data->buf);
+
+    data->sending = true;
+    if (start_dma(dev, true)) {
+        data->sending = false;
+        return;
+    }
+
+    LL_TIM_EnableDMAReq_UPDATE(cfg->timer);
+    data->stats.frames++;
+}
+
+static int set_throttle(const struct device *dev, uint16_t throttle)
+{
+    struct dshot_data *data = dev->data;
+
+    atomic_set(&data->throttle,
+               throttle ? throttle + DSHOT_THROTTLE_MIN - 1 : 0);
+
+    return 0;
+}
+
+static int send_command(const struct device *dev, uint8_t command)
+{
+    struct dshot_data *data = dev->data;
+
+    if (command >= DSHOT_THROTTLE_MIN) {
+        return -EINVAL;
+    }
+
+    if (atomic_get(&data->throttle) || atomic_get(&data->command_repeat)) {
+        return -EBUSY;
+    }
+
+    atomic_set(&data->command, command);
+    atomic_set(&data->command_repeat, CONFIG_DAN_DSHOT_COMMAND_REPEAT);
+
+    return 0;
+}
+
+static int get_erpm(const struct device *dev, uint32_t *erpm)
+{
+    const struct dshot_config *cfg = dev->config;
+    struct dshot_data *data = dev->data;
+    uint32_t age;
+
+    if (!cfg->bidirectional) {
+        return -ENOTSUP;
+    }
+
+    age = k_uptime_get_32() - (uint32_t)atomic_get(&data->erpm_time);
+    if (data->stats.replies == 0 ||
+        age > CONFIG_DAN_DSHOT_TELEMETRY_TIMEOUT_MS) {
+        return -ENODATA;
+    }
+
+    *erpm = atomic_get(&data->erpm);
+
+    return 0;
+}
+
+static int get_rpm(const struct device *dev, uint32_t *rpm)
+{
+    const struct dshot_config *cfg = dev->config;
+    uint32_t erpm;
+    int rc;
+
+    rc = get_erpm(dev, &erpm);
+    if (rc) {
+        return rc;
+    }
+
+    *rpm = erpm * 2 / cfg->motor_poles;
+
+    return 0;
+}
+
+static int dshot_init(const struct device *dev)
+{
+    const struct dshot_config *cfg = dev->config;
+    struct dshot_data *data = dev->data;
+    const struct device *clk = DEVICE_DT_GET(STM32_CLOCK_CONTROL_NODE);
+    uint32_t rate, bus_prescaler;
+    int rc;
+
+    data->dev = dev;
+
+    if (!device_is_ready(cfg->dma_dev)) {
+        LOG_ERR("%s: DMA not ready", dev->name);
+        return -ENODEV;
+    }
+
+    rc = clock_control_on(clk, (clock_control_subsys_t)&cfg->pclken);
+    if (rc) {
+        return rc;
+    }
+
+    rc = clock_control_get_rate(clk, (clock_control_subsys_t)&cfg->pclken,
+                                &rate);
+    if (rc) {
+        return rc;
+    }
+
+    /* Timers run at twice the bus clock when the bus is divided down. */
+    bus_prescaler = cfg->pclken.bus == STM32_CLOCK_BUS_APB2
+                        ? STM32_APB2_PRESCALER
+                        : STM32_APB1_PRESCALER;
+    if (bus_prescaler > 1) {
+        rate *= 2;
+    }
+
+    rate /= cfg->speed * 1000;
+    if (rate < 8 || rate > 0xffff) {
+        LOG_ERR("%s: Can't do DShot%u from this clock", dev->name,
+                cfg->speed);
+        return -EINVAL;
+    }
+
+    data->period = rate;
+    data->t1 = rate * 3 / 4;
+    data->t0 = rate * 3 / 8;
+    data->telemetry_bit_q8 = rate * 256 * 4 / 5;
+
+    LL_TIM_DisableCounter(cfg->timer);
+    LL_TIM_SetPrescaler(cfg->timer, 0);
+    LL_TIM_SetCounterMode(cfg->timer, LL_TIM_COUNTERMODE_UP);
+    LL_TIM_DisableARRPreload(cfg->timer);
+
+    output_mode(dev);
+
+    if (IS_TIM_BREAK_INSTANCE(cfg->timer)) {
+        LL_TIM_EnableAllOutputs(cfg->timer);
+    }
+
+    rc = pinctrl_apply_state(cfg->pcfg, PINCTRL_STATE_DEFAULT);
+    if (rc) {
+        LOG_ERR("%s: Failed to apply pinctrl", dev->name);
+        return rc;
+    }
+
+    LL_TIM_EnableCounter(cfg->timer);
+
+    k_timer_init(&data->frame_timer, frame_timer_handler, NULL);
+    k_timer_user_data_set(&data->frame_timer, (void *)dev);
+    k_timer_start(&data->frame_timer, K_NO_WAIT,
+                  K_USEC(USEC_PER_SEC / CONFIG_DAN_DSHOT_RATE_HZ));
+
+    LOG_INF("%s: DShot%u%s", dev->name, cfg->speed,
+            cfg->bidirectional ? " bidirectional" : "");
+
+    return 0;
+}
+
+#ifdef CONFIG_PM_DEVICE
+/**
+ * @brief Stop sending frames and leave the line idle, which the ESC takes
+ * as the signal being lost, and start again on resume. The throttle and
+ * any command are kept.
+ */
+static int dshot_pm_action(const struct device *dev,
+                           enum pm_device_action action)
+{
+    const struct dshot_config *cfg = dev->config;
+    struct dshot_data *data = dev->data;
+    unsigned int key;
+
+    switch (action) {
+        case PM_DEVICE_ACTION_SUSPEND:
+            k_timer_stop(&data->frame_timer);
+
+            /* The DMA callback and frame timer run from interrupts. */
+            key = irq_lock();
+            dma_stop(cfg->dma_dev, cfg->dma_channel);
+            LL_TIM_DisableDMAReq_UPDATE(cfg->timer);
+            data->sending = false;
+            data->capturing = false;
+            output_mode(dev);
+            irq_unlock(key);
+            return 0;
+
+        case PM_DEVICE_ACTION_RESUME:
+            k_timer_start(&data->frame_timer, K_NO_WAIT,
+                          K_USEC(USEC_PER_SEC / CONFIG_DAN_DSHOT_RATE_HZ));
+            return 0;
+
+        default:
+            return -ENOTSUP;
+    }
+}
+#endif
+
+static const struct dshot_driver_api dshot_api = {
+    .set_throttle = set_throttle,
+    .send_command = send_command,
+    .get_erpm = get_erpm,
+    .get_rpm = get_rpm,
+};
+
+#define DSHOT_TIMER(n) DT_INST_PHANDLE(n, timer)
+
+#define DSHOT_DEFINE(n)                                                      \
+    PINCTRL_DT_INST_DEFINE(n);                                               \
+                                                                             \
+    static const struct dshot_config dshot_cfg_##n = {                       \
+        .timer = (TIM_TypeDef *)DT_REG_ADDR(DSHOT_TIMER(n)),                 \
+        .pclken = STM32_CLOCK_INFO(0, DSHOT_TIMER(n)),                       \
+        .channel = DT_INST_PROP(n, channel),                                 \
+        .dma_dev = DEVICE_DT_GET(DT_INST_DMAS_CTLR_BY_IDX(n, 0)),            \
+        .dma_channel = DT_INST_DMAS_CELL_BY_IDX(n, 0, channel),              \
+        .dma_slot = DT_INST_DMAS_CELL_BY_IDX(n, 0, slot),                    \
+        .speed = DT_INST_PROP(n, speed),                                     \
+        .bidirectional = DT_INST_PROP(n, bidirectional),                     \
+        .motor_poles = DT_INST_PROP(n, motor_poles),                         \
+        .pcfg = PINCTRL_DT_INST_DEV_CONFIG_GET(n),                           \
+    };                                                                       \
+                                                                             \
+    static struct dshot_data dshot_data_##n;                                 \
+                                                                             \
+    PM_DEVICE_DT_INST_DEFINE(n, dshot_pm_action);                            \
+                                                                             \
+    DEVICE_DT_INST_DEFINE(n, dshot_init, PM_DEVICE_DT_INST_GET(n),           \
+                          &dshot_data_##n,                                   \
+                          &dshot_cfg_##n, POST_KERNEL,                       \
+                          CONFIG_DAN_DSHOT_INIT_PRIORITY, &dshot_api);
+
+DT_INST_FOREACH_STATUS_OKAY(DSHOT_DEFINE)
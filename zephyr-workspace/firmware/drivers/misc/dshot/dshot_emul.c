@@ -0,0 +1,214 @@
+#include <drivers/misc/dshot.h>
+#include <drivers/misc/output_capture.h>
+#include <zephyr/device.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/pm/device.h>
+#include <zephyr/sys/atomic.h>
+
+#include "dshot_frame.h"
+
+#define DT_DRV_COMPAT dan_dshot_emul
+
+LOG_MODULE_REGISTER(dan_dshot_emul, CONFIG_DAN_DSHOT_LOG_LEVEL);
+
+#define FRAME_US (USEC_PER_SEC / CONFIG_DAN_DSHOT_RATE_HZ)
+
+struct dshot_emul_config
+{
+    bool bidirectional;
+    uint8_t motor_poles;
+    /* eRPM at full throttle, and how quickly the motor gets there. */
+    uint32_t max_erpm;
+    uint32_t spin_up_us;
+};
+
+struct dshot_emul_data
+{
+    /* DShot value to send: 0 or DSHOT_THROTTLE_MIN up. */
+    atomic_t throttle;
+    /* Command to send instead, and how many more times. */
+    atomic_t command;
+    atomic_t command_repeat;
+
+    /* The last value sent, to record only the changes, and the frames
+     * since starting. */
+    uint16_t sent;
+    uint32_t frames;
+
+    atomic_t erpm;
+
+    struct k_timer frame_timer;
+};
+
+static uint16_t next_value(struct dshot_emul_data *data)
+{
+    if (atomic_get(&data->command_repeat) > 0) {
+        atomic_dec(&data->command_repeat);
+        return atomic_get(&data->command);
+    }
+
+    return atomic_get(&data->throttle);
+}
+
+/**
+ * @brief Each frame the ESC would get: record the value on the line if
+ * it's changed, and move the motor towards the speed it's asking for.
+ */
+static void frame_timer_handler(struct k_timer *timer)
+{
+    const struct device *dev = k_timer_user_data_get(timer);
+    const struct dshot_emul_config *cfg = dev->config;
+    struct dshot_emul_data *data = dev->data;
+    uint16_t value = next_value(data);
+    int32_t erpm = atomic_get(&data->erpm);
+    int32_t target = 0;
+
+    if (value != data->sent || data->frames == 0) {
+        output_capture_record(dev, 0, value);
+        data->sent = value;
+    }
+    data->frames++;
+
+    /* Commands leave the motor stopped. */
+    if (value >= DSHOT_THROTTLE_MIN) {
+        target = (uint64_t)cfg->max_erpm * (value - DSHOT_THROTTLE_MIN + 1) /
+                 DSHOT_THROTTLE_RANGE;
+    }
+
+    /* First order, stepped backwards so it's stable at any frame rate. */
+    erpm += (int64_t)(target - erpm) * FRAME_US / (cfg->spin_up_us + FRAME_US);
+    atomic_set(&data->erpm, erpm);
+}
+
+static int set_throttle(const struct device *dev, uint16_t throttle)
+{
+    struct dshot_emul_data *data = dev->data;
+
+    atomic_set(&data->throttle,
+               throttle ? throttle + DSHOT_THROTTLE_MIN - 1 : 0);
+
+    return 0;
+}
+
+static int send_command(const struct device *dev, uint8_t command)
+{
+    struct dshot_emul_data *data = dev->data;
+
+    if (command >= DSHOT_THROTTLE_MIN) {
+        return -EINVAL;
+    }
+
+    if (atomic_get(&data->throttle) || atomic_get(&data->command_repeat)) {
+        return -EBUSY;
+    }
+
+    atomic_set(&data->command, command);
+    atomic_set(&data->command_repeat, CONFIG_DAN_DSHOT_COMMAND_REPEAT);
+
+    return 0;
+}
+
+static int get_erpm(const struct device *dev, uint32_t *erpm)
+{
+    const struct dshot_emul_config *cfg = dev->config;
+    struct dshot_emul_data *data = dev->data;
+
+    if (!cfg->bidirectional) {
+        return -ENOTSUP;
+    }
+
+    /* No frames, no replies. */
+    if (data->frames == 0) {
+        return -ENODATA;
+    }
+
+    *erpm = atomic_get(&data->erpm);
+
+    return 0;
+}
+
+static int get_rpm(const struct device *dev, uint32_t *rpm)
+{
+    const struct dshot_emul_config *cfg = dev->config;
+    uint32_t erpm;
+    int rc;
+
+    rc = get_erpm(dev, &erpm);
+    if (rc) {
+        return rc;
+    }
+
+    *rpm = erpm * 2 / cfg->motor_poles;
+
+    return 0;
+}
+
+static int dshot_emul_init(const struct device *dev)
+{
+    const struct dshot_emul_config *cfg = dev->config;
+    struct dshot_emul_data *data = dev->data;
+
+    k_timer_init(&data->frame_timer, frame_timer_handler, NULL);
+    k_timer_user_data_set(&data->frame_timer, (void *)dev);
+    k_timer_start(&data->frame_timer, K_NO_WAIT, K_USEC(FRAME_US));
+
+    LOG_INF("%s: emulated, %u eRPM flat out", dev->name, cfg->max_erpm);
+
+    return 0;
+}
+
+#ifdef CONFIG_PM_DEVICE
+/**
+ * @brief Stop sending frames, as the real driver does, so the motor spins
+ * down, and start again on resume.
+ */
+static int dshot_emul_pm_action(const struct device *dev,
+                                enum pm_device_action action)
+{
+    struct dshot_emul_data *data = dev->data;
+
+    switch (action) {
+        case PM_DEVICE_ACTION_SUSPEND:
+            k_timer_stop(&data->frame_timer);
+            atomic_set(&data->erpm, 0);
+            data->frames = 0;
+            /* The line's idle. */
+            output_capture_record(dev, 0, 0);
+            return 0;
+
+        case PM_DEVICE_ACTION_RESUME:
+            k_timer_start(&data->frame_timer, K_NO_WAIT, K_USEC(FRAME_US));
+            return 0;
+
+        default:
+            return -ENOTSUP;
+    }
+}
+#endif
+
+static const struct dshot_driver_api dshot_emul_api = {
+    .set_throttle = set_throttle,
+    .send_command = send_command,
+    .get_erpm = get_erpm,
+    .get_rpm = get_rpm,
+};
+
+#define DSHOT_EMUL_DEFINE(n)                                                 \
+    static const struct dshot_emul_config dshot_emul_cfg_##n = {             \
+        .bidirectional = DT_INST_PROP(n, bidirectional),                     \
+        .motor_poles = DT_INST_PROP(n, motor_poles),                         \
+        .max_erpm = DT_INST_PROP(n, max_erpm),                               \
+        .spin_up_us = DT_INST_PROP(n, spin_up_ms) * USEC_PER_MSEC,           \
+    };                                                                       \
+                                                                             \
+    static struct dshot_emul_data dshot_emul_data_##n;                       \
+                                                                             \
+    PM_DEVICE_DT_INST_DEFINE(n, dshot_emul_pm_action);                       \
+                                                                             \
+    DEVICE_DT_INST_DEFINE(n, dshot_emul_init, PM_DEVICE_DT_INST_GET(n),      \
+                          &dshot_emul_data_##n, &dshot_emul_cfg_##n,         \
+                          POST_KERNEL, CONFIG_DAN_DSHOT_INIT_PRIORITY,       \
+                          &dshot_emul_api);
+
+DT_INST_FOREACH_STATUS_OKAY(DSHOT_EMUL_DEFINE)
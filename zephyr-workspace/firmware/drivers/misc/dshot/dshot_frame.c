@@ -0,0 +1,88 @@
+#include "dshot_frame.h"
+
+/* 5 bit GCR symbol to nibble. Anything that isn't a symbol maps to 0xff. */
+static const uint8_t gcr_decode[32] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0x09, 0x0a, 0x0b, 0xff, 0x0d, 0x0e, 0x0f,
+    0xff, 0xff, 0x02, 0x03, 0xff, 0x05, 0x06, 0x07,
+    0xff, 0x00, 0x08, 0x01, 0xff, 0x04, 0x0c, 0xff,
+};
+
+void dshot_frame_to_ccr(uint16_t frame, uint16_t t0, uint16_t t1,
+                        uint16_t *buf)
+{
+    for (int i = 0; i < DSHOT_FRAME_BITS; i++) {
+        buf[i] = (frame & 0x8000) ? t1 : t0;
+        frame <<= 1;
+    }
+
+    for (int i = DSHOT_FRAME_BITS; i < DSHOT_BUF_LEN; i++)
+        buf[i] = 0;
+}
+
+int dshot_edges_to_gcr(const uint16_t *edges, size_t count, uint32_t bit_q8,
+                       uint32_t *gcr)
+{
+    uint32_t value = 0;
+    unsigned bits = 0;
+    unsigned len;
+
+    if (count == 0 || count > DSHOT_TELEMETRY_MAX_EDGES)
+        return -1;
+
+    for (size_t i = 1; i <= count; i++) {
+        if (i < count) {
+            uint16_t diff = edges[i] - edges[i - 1];
+
+            len = ((uint32_t)diff * 256 + bit_q8 / 2) / bit_q8;
+        } else {
+            /* No edge to end the last run - it's whatever is left. */
+            len = DSHOT_TELEMETRY_BITS - bits;
+        }
+
+        if (len == 0 || bits + len > DSHOT_TELEMETRY_BITS)
+            return -1;
+
+        value = value << len | 1u << (len - 1);
+        bits += len;
+    }
+
+    *gcr = value;
+
+    return 0;
+}
+
+int dshot_gcr_to_value(uint32_t gcr, uint16_t *value)
+{
+    uint32_t v = 0;
+    uint32_t csum;
+
+    for (int i = 3; i >= 0; i--) {
+        uint8_t nibble = gcr_decode[(gcr >> (i * 5)) & 0x1f];
+
+        if (nibble == 0xff)
+            return -1;
+
+        v = v << 4 | nibble;
+    }
+
+    csum = v ^ (v >> 8);
+    csum ^= csum >> 4;
+    if ((csum & 0x0f) != 0x0f)
+        return -1;
+
+    *value = v >> 4;
+
+    return 0;
+}
+
+uint32_t dshot_value_to_erpm(uint16_t value)
+{
+    uint32_t period_us = (value & 0x01ff) << (value >> 9);
+
+    /* The longest period the ESC can report means it's stopped. */
+    if (value == 0x0fff || period_us == 0)
+        return 0;
+
+    return (60000000 + period_us / 2) / period_us;
+}
@@ -0,0 +1,89 @@
+#ifndef ZEPHYR_DRIVERS_MISC_DSHOT_FRAME_H_
+#define ZEPHYR_DRIVERS_MISC_DSHOT_FRAME_H_
+
+/*
+ * DShot frame encoding and bidirectional DShot telemetry decoding, apart
+ * from the timers that send and sample the bits.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Values below this are commands rather than throttle. */
+#define DSHOT_THROTTLE_MIN 48
+#define DSHOT_THROTTLE_MAX 2047
+
+#define DSHOT_FRAME_BITS 16
+
+/* Idle bits after a frame, so the line is quiet before the DMA finishes. */
+#define DSHOT_IDLE_BITS 2
+
+#define DSHOT_BUF_LEN (DSHOT_FRAME_BITS + DSHOT_IDLE_BITS)
+
+/* The telemetry reply: a start transition then 4 GCR nibbles of 5 bits. */
+#define DSHOT_TELEMETRY_BITS 21
+
+/* Most edges a telemetry reply can have. */
+#define DSHOT_TELEMETRY_MAX_EDGES DSHOT_TELEMETRY_BITS
+
+/**
+ * @brief Build a frame: 11 bits of value, the telemetry request bit and a
+ * 4 bit checksum.
+ *
+ * @param inverted For bidirectional DShot, where the checksum is inverted
+ * so the ESC knows to reply.
+ */
+static inline uint16_t dshot_frame(uint16_t value, bool telemetry,
+                                   bool inverted)
+{
+    uint16_t v = (value & 0x07ff) << 1 | telemetry;
+    uint16_t crc = (v ^ (v >> 4) ^ (v >> 8)) & 0x0f;
+
+    if (inverted)
+        crc = ~crc & 0x0f;
+
+    return v << 4 | crc;
+}
+
+/**
+ * @brief Turn a frame into timer compare values, MSB first, followed by
+ * DSHOT_IDLE_BITS zeros.
+ *
+ * @param t0 Compare value for a 0 bit - 37.5% of the bit period.
+ * @param t1 Compare value for a 1 bit - 75% of the bit period.
+ */
+extern void dshot_frame_to_ccr(uint16_t frame, uint16_t t0, uint16_t t1,
+                               uint16_t *buf);
+
+/**
+ * @brief Rebuild the 21 bit telemetry word from captured edge times.
+ *
+ * Every edge is a 1 and the bits between them are 0s. The times are
+ * timer counts, and can wrap.
+ *
+ * @param bit_q8 Length of a telemetry bit in timer counts, as Q8.
+ *
+ * @return 0, or -1 if the edges don't add up to a whole reply.
+ */
+extern int dshot_edges_to_gcr(const uint16_t *edges, size_t count,
+                              uint32_t bit_q8, uint32_t *gcr);
+
+/**
+ * @brief Decode the GCR nibbles and check the checksum.
+ *
+ * @return 0, or -1 if there's an invalid symbol or the checksum is wrong.
+ */
+extern int dshot_gcr_to_value(uint32_t gcr, uint16_t *value);
+
+/**
+ * @brief Electrical RPM from a telemetry value.
+ *
+ * The value is a period in microseconds as a 9 bit mantissa and 3 bit
+ * shift.
+ *
+ * @return The eRPM, or 0 if the motor is stopped.
+ */
+extern uint32_t dshot_value_to_erpm(uint16_t value);
+
+#endif
@@ -0,0 +1,197 @@
+#include <drivers/misc/esc_telemetry.h>
+#include <zephyr/drivers/uart.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/barrier.h>
+
+#include "kiss_telemetry.h"
+
+#define DT_DRV_COMPAT dan_esc_telemetry
+
+LOG_MODULE_REGISTER(dan_esc_telemetry, CONFIG_DAN_ESC_TELEMETRY_LOG_LEVEL);
+
+struct esc_telemetry_config
+{
+    const struct device *uart_dev;
+    uint32_t baud;
+};
+
+struct esc_telemetry_data
+{
+    const struct device *dev;
+
+    /* The UART DMA ping-pongs between these. */
+    uint8_t dma_buf[2][CONFIG_DAN_ESC_TELEMETRY_RX_DMA_BUF_SIZE];
+    uint8_t next_dma_buf;
+
+    struct kiss_parser parser;
+
+    /* Odd while the sample is being written. */
+    atomic_t seq;
+    struct esc_telemetry_sample sample;
+};
+
+/**
+ * @brief Publish a new sample. Only ever called from the UART callback.
+ */
+static void publish(struct esc_telemetry_data *data,
+                    const struct kiss_telemetry *telemetry, uint32_t stamp)
+{
+    atomic_inc(&data->seq);
+    barrier_dmem_fence_full();
+
+    data->sample.temperature = telemetry->temperature;
+    data->sample.voltage = telemetry->voltage;
+    data->sample.current = telemetry->current;
+    data->sample.consumption = telemetry->consumption;
+    data->sample.erpm = telemetry->erpm;
+    data->sample.stamp = stamp;
+
+    barrier_dmem_fence_full();
+    atomic_inc(&data->seq);
+}
+
+static void uart_callback(const struct device *dev, struct uart_event *evt,
+                          void *user_data)
+{
+    const struct device *esc_dev = (const struct device *)user_data;
+    struct esc_telemetry_data *data = esc_dev->data;
+    struct kiss_telemetry telemetry;
+    uint32_t stamp;
+    int rc;
+
+    switch (evt->type) {
+        case UART_RX_RDY:
+            /* Frames are only ten octets, so they're parsed right here
+             * rather than handed to a thread. */
+            stamp = k_cycle_get_32();
+            if (kiss_parser_feed(&data->parser,
+                                 &evt->data.rx.buf[evt->data.rx.offset],
+                                 evt->data.rx.len, stamp, &telemetry)) {
+                publish(data, &telemetry, stamp);
+            }
+            break;
+
+        case UART_RX_BUF_REQUEST:
+            rc = uart_rx_buf_rsp(dev, data->dma_buf[data->next_dma_buf],
+                                 CONFIG_DAN_ESC_TELEMETRY_RX_DMA_BUF_SIZE);
+            if (rc) {
+                LOG_ERR("%s: Failed to provide RX buffer", esc_dev->name);
+            }
+            data->next_dma_buf ^= 1;
+            break;
+
+        case UART_RX_DISABLED:
+            /* A line error, most likely from the ESC powering up. */
+            data->next_dma_buf = 1;
+            rc = uart_rx_enable(dev, data->dma_buf[0],
+                                CONFIG_DAN_ESC_TELEMETRY_RX_DMA_BUF_SIZE,
+                                CONFIG_DAN_ESC_TELEMETRY_RX_IDLE_TIMEOUT_US);
+            if (rc) {
+                LOG_ERR("%s: Failed to restart RX", esc_dev->name);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+static int get(const struct device *dev, struct esc_telemetry_sample *sample)
+{
+    struct esc_telemetry_data *data = dev->data;
+    atomic_val_t seq;
+
+    /* The writer is the UART interrupt, which never waits on us, so this
+     * only goes round again if a frame landed while we were copying. */
+    do {
+        seq = atomic_get(&data->seq);
+        barrier_dmem_fence_full();
+        *sample = data->sample;
+        barrier_dmem_fence_full();
+    } while ((seq & 1) || seq != atomic_get(&data->seq));
+
+    if (seq == 0) {
+        return -ENODATA;
+    }
+
+    if (k_cycle_get_32() - sample->stamp >
+        k_ms_to_cyc_ceil32(CONFIG_DAN_ESC_TELEMETRY_TIMEOUT_MS)) {
+        return -ENODATA;
+    }
+
+    return 0;
+}
+
+static int get_stats(const struct device *dev,
+                     struct esc_telemetry_stats *stats)
+{
+    struct esc_telemetry_data *data = dev->data;
+
+    stats->frames = data->parser.stats.frames;
+    stats->bad_crc = data->parser.stats.bad_crc;
+    stats->noise = data->parser.stats.noise;
+
+    return 0;
+}
+
+static int esc_telemetry_init(const struct device *dev)
+{
+    const struct esc_telemetry_config *cfg = dev->config;
+    struct esc_telemetry_data *data = dev->data;
+    uint32_t gap_us;
+    int rc;
+
+    if (!device_is_ready(cfg->uart_dev)) {
+        LOG_ERR("%s: UART not ready!", dev->name);
+        return -ENODEV;
+    }
+
+    data->dev = dev;
+
+    /* A frame can be split over two chunks when a DMA buffer fills, but
+     * they'll never be further apart than a frame and an idle timeout. */
+    gap_us = KISS_FRAME_LEN * 10 * USEC_PER_SEC / cfg->baud +
+             CONFIG_DAN_ESC_TELEMETRY_RX_IDLE_TIMEOUT_US;
+    kiss_parser_init(&data->parser, k_us_to_cyc_ceil32(gap_us));
+
+    rc = uart_callback_set(cfg->uart_dev, uart_callback, (void *)dev);
+    if (rc) {
+        LOG_ERR("%s: Failed to set UART callback", dev->name);
+        return rc;
+    }
+
+    data->next_dma_buf = 1;
+    rc = uart_rx_enable(cfg->uart_dev, data->dma_buf[0],
+                        CONFIG_DAN_ESC_TELEMETRY_RX_DMA_BUF_SIZE,
+                        CONFIG_DAN_ESC_TELEMETRY_RX_IDLE_TIMEOUT_US);
+    if (rc) {
+        LOG_ERR("%s: Failed to enable RX", dev->name);
+        return rc;
+    }
+
+    LOG_INF("%s: Listening at %u baud", dev->name, cfg->baud);
+
+    return 0;
+}
+
+static const struct esc_telemetry_driver_api esc_telemetry_api = {
+    .get = get,
+    .get_stats = get_stats,
+};
+
+#define ESC_TELEMETRY_DEFINE(n)                                               \
+    static const struct esc_telemetry_config esc_telemetry_cfg_##n = {        \
+        .uart_dev = DEVICE_DT_GET(DT_INST_BUS(n)),                            \
+        .baud = DT_PROP(DT_INST_BUS(n), current_speed),                       \
+    };                                                                        \
+                                                                              \
+    static struct esc_telemetry_data esc_telemetry_data_##n;                  \
+                                                                              \
+    DEVICE_DT_INST_DEFINE(n, esc_telemetry_init, NULL,                        \
+                          &esc_telemetry_data_##n, &esc_telemetry_cfg_##n,    \
+                          POST_KERNEL, CONFIG_DAN_ESC_TELEMETRY_INIT_PRIORITY, \
+                          &esc_telemetry_api);
+
+DT_INST_FOREACH_STATUS_OKAY(ESC_TELEMETRY_DEFINE)
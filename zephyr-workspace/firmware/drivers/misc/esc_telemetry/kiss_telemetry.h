@@ -0,0 +1,89 @@
+#ifndef ZEPHYR_DRIVERS_MISC_KISS_TELEMETRY_H_
+#define ZEPHYR_DRIVERS_MISC_KISS_TELEMETRY_H_
+
+/*
+ * KISS ESC serial telemetry, as sent by KISS, BLHeli_32 and AM32 ESCs when
+ * a DShot frame has the telemetry bit set.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Temperature, voltage, current, consumption, eRPM and the CRC. */
+#define KISS_FRAME_LEN 10
+
+/**
+ * @brief One telemetry frame, decoded.
+ */
+struct kiss_telemetry
+{
+    /* Degrees C. */
+    uint8_t temperature;
+    /* In 10 mV. */
+    uint16_t voltage;
+    /* In 10 mA. */
+    uint16_t current;
+    /* Used so far, in mAh. */
+    uint16_t consumption;
+    /* Electrical RPM. The ESC sends it in hundreds. */
+    uint32_t erpm;
+};
+
+struct kiss_parser_stats
+{
+    /* Frames that passed the CRC check. */
+    uint32_t frames;
+    /* Ten octet windows that failed it. While we're out of step with the
+     * ESC, that's one per octet. */
+    uint32_t bad_crc;
+    /* Octets thrown away. */
+    uint32_t noise;
+};
+
+struct kiss_parser
+{
+    /* Longest pause, in stamp units, that can fall inside a frame. */
+    uint32_t gap;
+    uint32_t stamp;
+
+    /* Only used for frames that are split across chunks, or while finding
+     * our way back into step. */
+    uint8_t frame[KISS_FRAME_LEN];
+    uint8_t len;
+
+    struct kiss_parser_stats stats;
+};
+
+/**
+ * @brief CRC8 with polynomial 0x07, no reflection and zero initial value.
+ */
+extern uint8_t kiss_crc8(const uint8_t *ptr, size_t len);
+
+/**
+ * @brief Set up a parser.
+ *
+ * @param gap A pause longer than this between chunks throws away any
+ * partial frame, in the same units as the stamps passed to
+ * kiss_parser_feed().
+ */
+extern void kiss_parser_init(struct kiss_parser *parser, uint32_t gap);
+
+/**
+ * @brief Run a chunk of received octets through the parser.
+ *
+ * Frames have no sync octet, so they're found by their CRC. A frame at the
+ * start of a chunk is checked in place. Anything else goes through the
+ * parser's buffer, and after a failed check the buffer slides along an
+ * octet at a time until a frame checks out.
+ *
+ * @param stamp When the chunk arrived.
+ * @param telemetry Set to the last good frame in the chunk, if there is one.
+ *
+ * @return 1 if a good frame was found, otherwise 0.
+ */
+extern int kiss_parser_feed(struct kiss_parser *parser, const uint8_t *buf,
+                            size_t len, uint32_t stamp,
+                            struct kiss_telemetry *telemetry);
+
+#endif
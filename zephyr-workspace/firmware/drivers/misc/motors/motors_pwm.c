@@ -0,0 +1,124 @@
+#include <drivers/misc/motors.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/pwm.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#define DT_DRV_COMPAT dan_pwm_motors
+
+LOG_MODULE_REGISTER(dan_motors_pwm, CONFIG_DAN_MOTORS_LOG_LEVEL);
+
+struct motors_pwm_config
+{
+    struct pwm_dt_spec pwm[MOTORS_NUM_CHANNELS];
+    struct gpio_dt_spec dir[MOTORS_NUM_CHANNELS];
+    struct gpio_dt_spec sleep;
+};
+
+struct motors_pwm_data
+{
+    /* The control path and the failsafe can both set the outputs. */
+    struct k_spinlock lock;
+};
+
+static inline uint32_t duty_to_pulse(const struct pwm_dt_spec *pwm,
+                                     uint16_t duty)
+{
+    return ((uint64_t)MIN(duty, MOTORS_DUTY_MAX) * pwm->period) >> 15;
+}
+
+static int set(const struct device *dev, const struct motors_output *out)
+{
+    const struct motors_pwm_config *cfg = dev->config;
+    struct motors_pwm_data *data = dev->data;
+    k_spinlock_key_t key;
+    int rc = 0;
+
+    /* The outputs change one after another, so wake the drivers before
+     * anything else changes and put them to sleep after, so the motors
+     * never run on a mix of old and new. */
+    key = k_spin_lock(&data->lock);
+
+    if (!out->sleep) {
+        rc |= gpio_pin_set_dt(&cfg->sleep, 0);
+    }
+
+    for (int i = 0; i < MOTORS_NUM_CHANNELS; i++) {
+        rc |= gpio_pin_set_dt(&cfg->dir[i], out->dir[i]);
+        rc |= pwm_set_pulse_dt(&cfg->pwm[i],
+                               duty_to_pulse(&cfg->pwm[i], out->duty[i]));
+    }
+
+    if (out->sleep) {
+        rc |= gpio_pin_set_dt(&cfg->sleep, 1);
+    }
+
+    k_spin_unlock(&data->lock, key);
+
+    return rc ? -EIO : 0;
+}
+
+static int motors_pwm_init(const struct device *dev)
+{
+    const struct motors_pwm_config *cfg = dev->config;
+    int rc;
+
+    for (int i = 0; i < MOTORS_NUM_CHANNELS; i++) {
+        if (!pwm_is_ready_dt(&cfg->pwm[i])) {
+            LOG_ERR("%s: PWM not ready", dev->name);
+            return -ENODEV;
+        }
+
+        rc = gpio_pin_configure_dt(&cfg->dir[i], GPIO_OUTPUT_INACTIVE);
+        if (rc) {
+            LOG_ERR("%s: Failed to configure direction pin", dev->name);
+            return rc;
+        }
+
+        rc = pwm_set_pulse_dt(&cfg->pwm[i], 0);
+        if (rc) {
+            LOG_ERR("%s: Failed to stop motor %d", dev->name, i);
+            return rc;
+        }
+    }
+
+    /* Asleep until we're told otherwise. */
+    rc = gpio_pin_configure_dt(&cfg->sleep, GPIO_OUTPUT_ACTIVE);
+    if (rc) {
+        LOG_ERR("%s: Failed to configure sleep pin", dev->name);
+        return rc;
+    }
+
+    LOG_INF("%s: %u ns period", dev->name, cfg->pwm[0].period);
+
+    return 0;
+}
+
+static const struct motors_driver_api motors_pwm_api = {
+    .set = set,
+};
+
+#define MOTORS_PWM(idx, n) PWM_DT_SPEC_INST_GET_BY_IDX(n, idx)
+
+#define MOTORS_DIR(idx, n) GPIO_DT_SPEC_INST_GET_BY_IDX(n, dir_gpios, idx)
+
+#define MOTORS_PWM_DEFINE(n)                                                 \
+    BUILD_ASSERT(DT_INST_PROP_LEN(n, pwms) == MOTORS_NUM_CHANNELS,           \
+                 "need a PWM channel per motor");                            \
+    BUILD_ASSERT(DT_INST_PROP_LEN(n, dir_gpios) == MOTORS_NUM_CHANNELS,      \
+                 "need a direction pin per motor");                          \
+                                                                             \
+    static const struct motors_pwm_config motors_pwm_cfg_##n = {             \
+        .pwm = {LISTIFY(MOTORS_NUM_CHANNELS, MOTORS_PWM, (, ), n)},          \
+        .dir = {LISTIFY(MOTORS_NUM_CHANNELS, MOTORS_DIR, (, ), n)},          \
+        .sleep = GPIO_DT_SPEC_INST_GET(n, sleep_gpios),                      \
+    };                                                                       \
+                                                                             \
+    static struct motors_pwm_data motors_pwm_data_##n;                       \
+                                                                             \
+    DEVICE_DT_INST_DEFINE(n, motors_pwm_init, NULL, &motors_pwm_data_##n,    \
+                          &motors_pwm_cfg_##n, POST_KERNEL,                  \
+                          CONFIG_DAN_MOTORS_INIT_PRIORITY, &motors_pwm_api);
+
+DT_INST_FOREACH_STATUS_OKAY(MOTORS_PWM_DEFINE)
@@ -0,0 +1,284 @@
+#include <drivers/misc/motors.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/clock_control.h>
+#include <zephyr/drivers/clock_control/stm32_clock_control.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/pinctrl.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include <stm32_ll_dma.h>
+#include <stm32_ll_tim.h>
+
+#define DT_DRV_COMPAT dan_stm32_motors
+
+LOG_MODULE_REGISTER(dan_motors, CONFIG_DAN_MOTORS_LOG_LEVEL);
+
+struct motors_config
+{
+    TIM_TypeDef *timer;
+    struct stm32_pclken pclken;
+    uint32_t frequency;
+
+    DMA_TypeDef *dma;
+    uint32_t dma_channel;
+    uint32_t dma_request;
+
+    GPIO_TypeDef *port;
+    struct gpio_dt_spec dir[MOTORS_NUM_CHANNELS];
+    struct gpio_dt_spec sleep;
+
+    const struct pinctrl_dev_config *pcfg;
+};
+
+struct motors_data
+{
+    /* Timer counts in one PWM period. */
+    uint32_t period;
+
+    /* BSRR words to drive each pin to logical 0 or 1. */
+    uint32_t dir_bsrr[MOTORS_NUM_CHANNELS][2];
+    uint32_t sleep_bsrr[2];
+
+    /* Written to the port's BSRR by DMA on every update event. */
+    volatile uint32_t bsrr;
+
+    /* The control path and the failsafe can both set the outputs. */
+    struct k_spinlock lock;
+};
+
+static const uint32_t ll_channels[MOTORS_NUM_CHANNELS] = {
+    LL_TIM_CHANNEL_CH1,
+    LL_TIM_CHANNEL_CH2,
+    LL_TIM_CHANNEL_CH3,
+    LL_TIM_CHANNEL_CH4,
+};
+
+/**
+ * @brief Work out the BSRR words that set a pin to each logical level.
+ */
+static void pin_bsrr(const struct gpio_dt_spec *spec, uint32_t *bsrr)
+{
+    uint32_t set = BIT(spec->pin);
+    uint32_t reset = BIT(spec->pin + 16);
+
+    if (spec->dt_flags & GPIO_ACTIVE_LOW) {
+        bsrr[0] = set;
+        bsrr[1] = reset;
+    } else {
+        bsrr[0] = reset;
+        bsrr[1] = set;
+    }
+}
+
+static inline uint32_t duty_to_ccr(const struct motors_data *data,
+                                   uint16_t duty)
+{
+    return ((uint32_t)MIN(duty, MOTORS_DUTY_MAX) * data->period) >> 15;
+}
+
+static int set(const struct device *dev, const struct motors_output *out)
+{
+    const struct motors_config *cfg = dev->config;
+    struct motors_data *data = dev->data;
+    uint32_t bsrr = data->sleep_bsrr[out->sleep];
+    k_spinlock_key_t key;
+
+    for (int i = 0; i < MOTORS_NUM_CHANNELS; i++)
+        bsrr |= data->dir_bsrr[i][out->dir[i]];
+
+    /* With update events held off, nothing moves from the preload
+     * registers to the timer and the DMA isn't triggered. Everything
+     * written here then goes out together on the next update. */
+    key = k_spin_lock(&data->lock);
+    LL_TIM_DisableUpdateEvent(cfg->timer);
+
+    LL_TIM_OC_SetCompareCH1(cfg->timer, duty_to_ccr(data, out->duty[0]));
+    LL_TIM_OC_SetCompareCH2(cfg->timer, duty_to_ccr(data, out->duty[1]));
+    LL_TIM_OC_SetCompareCH3(cfg->timer, duty_to_ccr(data, out->duty[2]));
+    LL_TIM_OC_SetCompareCH4(cfg->timer, duty_to_ccr(data, out->duty[3]));
+    data->bsrr = bsrr;
+
+    LL_TIM_EnableUpdateEvent(cfg->timer);
+    k_spin_unlock(&data->lock, key);
+
+    return 0;
+}
+
+static int init_timer(const struct device *dev)
+{
+    const struct motors_config *cfg = dev->config;
+    struct motors_data *data = dev->data;
+    const struct device *clk = DEVICE_DT_GET(STM32_CLOCK_CONTROL_NODE);
+    uint32_t rate, bus_prescaler;
+    int rc;
+
+    rc = clock_control_on(clk, (clock_control_subsys_t)&cfg->pclken);
+    if (rc) {
+        return rc;
+    }
+
+    rc = clock_control_get_rate(clk, (clock_control_subsys_t)&cfg->pclken,
+                                &rate);
+    if (rc) {
+        return rc;
+    }
+
+    /* Timers run at twice the bus clock when the bus is divided down. */
+    bus_prescaler = cfg->pclken.bus == STM32_CLOCK_BUS_APB2
+                        ? STM32_APB2_PRESCALER
+                        : STM32_APB1_PRESCALER;
+    if (bus_prescaler > 1) {
+        rate *= 2;
+    }
+
+    data->period = rate / cfg->frequency;
+    if (data->period < 2 || data->period > 0x10000) {
+        return -EINVAL;
+    }
+
+    LL_TIM_DisableCounter(cfg->timer);
+    LL_TIM_SetPrescaler(cfg->timer, 0);
+    LL_TIM_SetCounterMode(cfg->timer, LL_TIM_COUNTERMODE_UP);
+    LL_TIM_SetAutoReload(cfg->timer, data->period - 1);
+    LL_TIM_EnableARRPreload(cfg->timer);
+
+    for (int i = 0; i < MOTORS_NUM_CHANNELS; i++) {
+        LL_TIM_OC_SetMode(cfg->timer, ll_channels[i], LL_TIM_OCMODE_PWM1);
+        LL_TIM_OC_SetPolarity(cfg->timer, ll_channels[i],
+                              LL_TIM_OCPOLARITY_HIGH);
+        LL_TIM_OC_EnablePreload(cfg->timer, ll_channels[i]);
+        LL_TIM_CC_EnableChannel(cfg->timer, ll_channels[i]);
+    }
+
+    LL_TIM_OC_SetCompareCH1(cfg->timer, 0);
+    LL_TIM_OC_SetCompareCH2(cfg->timer, 0);
+    LL_TIM_OC_SetCompareCH3(cfg->timer, 0);
+    LL_TIM_OC_SetCompareCH4(cfg->timer, 0);
+
+    /* Load the preload registers before the outputs are enabled. */
+    LL_TIM_GenerateEvent_UPDATE(cfg->timer);
+
+    return 0;
+}
+
+/**
+ * @brief Set up a DMA channel to copy the BSRR word to the GPIO port on
+ * every timer update, forever.
+ */
+static void init_dma(const struct device *dev)
+{
+    const struct motors_config *cfg = dev->config;
+    struct motors_data *data = dev->data;
+
+    LL_DMA_DisableChannel(cfg->dma, cfg->dma_channel);
+
+    LL_DMA_ConfigTransfer(cfg->dma, cfg->dma_channel,
+                          LL_DMA_DIRECTION_MEMORY_TO_PERIPH |
+                              LL_DMA_MODE_CIRCULAR |
+                              LL_DMA_PERIPH_NOINCREMENT |
+                              LL_DMA_MEMORY_NOINCREMENT |
+                              LL_DMA_PDATAALIGN_WORD | LL_DMA_MDATAALIGN_WORD |
+                              LL_DMA_PRIORITY_HIGH);
+    LL_DMA_SetPeriphRequest(cfg->dma, cfg->dma_channel, cfg->dma_request);
+    LL_DMA_SetPeriphAddress(cfg->dma, cfg->dma_channel,
+                            (uint32_t)&cfg->port->BSRR);
+    LL_DMA_SetMemoryAddress(cfg->dma, cfg->dma_channel,
+                            (uint32_t)&data->bsrr);
+    LL_DMA_SetDataLength(cfg->dma, cfg->dma_channel, 1);
+
+    LL_DMA_EnableChannel(cfg->dma, cfg->dma_channel);
+    LL_TIM_EnableDMAReq_UPDATE(cfg->timer);
+}
+
+static int motors_init(const struct device *dev)
+{
+    const struct motors_config *cfg = dev->config;
+    struct motors_data *data = dev->data;
+    int rc;
+
+    for (int i = 0; i < MOTORS_NUM_CHANNELS; i++) {
+        rc = gpio_pin_configure_dt(&cfg->dir[i], GPIO_OUTPUT_INACTIVE);
+        if (rc) {
+            LOG_ERR("%s: Failed to configure direction pin", dev->name);
+            return rc;
+        }
+
+        pin_bsrr(&cfg->dir[i], data->dir_bsrr[i]);
+    }
+
+    /* Asleep until we're told otherwise. */
+    rc = gpio_pin_configure_dt(&cfg->sleep, GPIO_OUTPUT_ACTIVE);
+    if (rc) {
+        LOG_ERR("%s: Failed to configure sleep pin", dev->name);
+        return rc;
+    }
+
+    pin_bsrr(&cfg->sleep, data->sleep_bsrr);
+    data->bsrr = data->sleep_bsrr[1] | data->dir_bsrr[0][0] |
+                 data->dir_bsrr[1][0] | data->dir_bsrr[2][0] |
+                 data->dir_bsrr[3][0];
+
+    rc = init_timer(dev);
+    if (rc) {
+        LOG_ERR("%s: Failed to set up the timer", dev->name);
+        return rc;
+    }
+
+    init_dma(dev);
+
+    rc = pinctrl_apply_state(cfg->pcfg, PINCTRL_STATE_DEFAULT);
+    if (rc) {
+        LOG_ERR("%s: Failed to apply pinctrl", dev->name);
+        return rc;
+    }
+
+    LL_TIM_EnableCounter(cfg->timer);
+
+    LOG_INF("%s: %u Hz, %u steps", dev->name, cfg->frequency, data->period);
+
+    return 0;
+}
+
+static const struct motors_driver_api motors_api = {
+    .set = set,
+};
+
+#define MOTORS_TIMER(n) DT_INST_PHANDLE(n, timer)
+
+#define MOTORS_DIR(idx, n) GPIO_DT_SPEC_INST_GET_BY_IDX(n, dir_gpios, idx)
+
+/* The DMA copies into BSRR, so the pins all have to be on one port. */
+#define MOTORS_SAME_PORT(idx, n)                                     \
+    BUILD_ASSERT(DT_SAME_NODE(DT_INST_GPIO_CTLR_BY_IDX(n, dir_gpios, idx), \
+                              DT_INST_GPIO_CTLR(n, sleep_gpios)),          \
+                 "motor pins must all be on one GPIO port");
+
+#define MOTORS_DEFINE(n)                                                     \
+    BUILD_ASSERT(DT_INST_PROP_LEN(n, dir_gpios) == MOTORS_NUM_CHANNELS,      \
+                 "need a direction pin per motor");                          \
+    LISTIFY(MOTORS_NUM_CHANNELS, MOTORS_SAME_PORT, (), n)                    \
+                                                                             \
+    PINCTRL_DT_INST_DEFINE(n);                                               \
+                                                                             \
+    static const struct motors_config motors_cfg_##n = {                     \
+        .timer = (TIM_TypeDef *)DT_REG_ADDR(MOTORS_TIMER(n)),                \
+        .pclken = STM32_CLOCK_INFO(0, MOTORS_TIMER(n)),                      \
+        .frequency = DT_INST_PROP(n, frequency),                             \
+        .dma = (DMA_TypeDef *)DT_REG_ADDR(DT_INST_DMAS_CTLR_BY_IDX(n, 0)),   \
+        .dma_channel = DT_INST_DMAS_CELL_BY_IDX(n, 0, channel) - 1,          \
+        .dma_request = DT_INST_DMAS_CELL_BY_IDX(n, 0, slot),                 \
+        .port = (GPIO_TypeDef *)DT_REG_ADDR(                                 \
+            DT_INST_GPIO_CTLR(n, sleep_gpios)),                              \
+        .dir = {LISTIFY(MOTORS_NUM_CHANNELS, MOTORS_DIR, (, ), n)},          \
+        .sleep = GPIO_DT_SPEC_INST_GET(n, sleep_gpios),                      \
+        .pcfg = PINCTRL_DT_INST_DEV_CONFIG_GET(n),                           \
+    };                                                                       \
+                                                                             \
+    static struct motors_data motors_data_##n;                               \
+                                                                             \
+    DEVICE_DT_INST_DEFINE(n, motors_init, NULL, &motors_data_##n,            \
+                          &motors_cfg_##n, POST_KERNEL,                      \
+                          CONFIG_DAN_MOTORS_INIT_PRIORITY, &motors_api);
+
+DT_INST_FOREACH_STATUS_OKAY(MOTORS_DEFINE)
@@ -0,0 +1,71 @@
+#include <drivers/misc/output_capture.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/pwm.h>
+#include <zephyr/kernel.h>
+
+#define DT_DRV_COMPAT dan_pwm_capture
+
+struct pwm_capture_config
+{
+    uint32_t channels;
+};
+
+struct pwm_capture_data
+{
+    struct k_spinlock lock;
+    /* The last pulse width set on each channel, in ns. */
+    uint32_t *pulse;
+};
+
+static int set_cycles(const struct device *dev, uint32_t channel,
+                      uint32_t period_cycles, uint32_t pulse_cycles,
+                      pwm_flags_t flags)
+{
+    const struct pwm_capture_config *cfg = dev->config;
+    struct pwm_capture_data *data = dev->data;
+    k_spinlock_key_t key;
+
+    if (channel >= cfg->channels || pulse_cycles > period_cycles) {
+        return -EINVAL;
+    }
+
+    /* Recorded under the lock, so they're in the order they happened. */
+    key = k_spin_lock(&data->lock);
+    if (data->pulse[channel] != pulse_cycles) {
+        data->pulse[channel] = pulse_cycles;
+        output_capture_record(dev, channel, pulse_cycles);
+    }
+    k_spin_unlock(&data->lock, key);
+
+    return 0;
+}
+
+static int get_cycles_per_sec(const struct device *dev, uint32_t channel,
+                              uint64_t *cycles)
+{
+    /* A cycle's a nanosecond, so the record's in ns. */
+    *cycles = NSEC_PER_SEC;
+    return 0;
+}
+
+static const struct pwm_driver_api pwm_capture_api = {
+    .set_cycles = set_cycles,
+    .get_cycles_per_sec = get_cycles_per_sec,
+};
+
+#define PWM_CAPTURE_DEFINE(n)                                                \
+    static uint32_t pwm_capture_pulse_##n[DT_INST_PROP(n, channels)];        \
+                                                                             \
+    static const struct pwm_capture_config pwm_capture_cfg_##n = {           \
+        .channels = DT_INST_PROP(n, channels),                               \
+    };                                                                       \
+                                                                             \
+    static struct pwm_capture_data pwm_capture_data_##n = {                  \
+        .pulse = pwm_capture_pulse_##n,                                      \
+    };                                                                       \
+                                                                             \
+    DEVICE_DT_INST_DEFINE(n, NULL, NULL, &pwm_capture_data_##n,              \
+                          &pwm_capture_cfg_##n, POST_KERNEL,                 \
+                          CONFIG_PWM_INIT_PRIORITY, &pwm_capture_api);
+
+DT_INST_FOREACH_STATUS_OKAY(PWM_CAPTURE_DEFINE)
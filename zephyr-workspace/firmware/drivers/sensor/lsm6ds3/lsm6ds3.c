@@ -1,8 +1,9 @@
 #include <zephyr/kernel.h>
 #include <zephyr/drivers/sensor.h>
+#include <zephyr/pm/device.h>
 #include <zephyr/sys/byteorder.h>
 
-#include <sensor/st/stmemsc/stmemsc.h>
+#include "lsm6ds3.h"
 #include "lsm6ds3tr-c_reg.h"
 
 #include <zephyr/logging/log.h>
@@ -10,43 +11,393 @@ LOG_MODULE_REGISTER(lsm6ds3, CONFIG_SENSOR_LOG_LEVEL);
 
 #define DT_DRV_COMPAT st_lsm6ds3
 
-#if DT_ANY_INST_ON_BUS_STATUS_OKAY(spi)
-#include <zephyr/drivers/spi.h>
-#endif
+/* Indexed by ODR register code. */
+static const uint16_t odr_hz[] = {0, 13, 26, 52, 104, 208, 416, 833, 1660};
+static const uint32_t odr_period_ns[] = {
+    0, 80000000, 38461538, 19230769, 9615385, 4807692, 2403846, 1200480,
+    602410,
+};
 
-#if DT_ANY_INST_ON_BUS_STATUS_OKAY(i2c)
-#include <zephyr/drivers/i2c.h>
-#endif
+/* Indexed by FS_XL register code, which isn't in order of range. */
+static const uint8_t accel_range_g[] = {2, 16, 4, 8};
+static const uint16_t accel_ug_per_lsb[] = {61, 488, 122, 244};
+
+/* Indexed by FS_G register code, with 4 standing in for the FS_125 bit. */
+static const uint16_t gyro_range_dps[] = {250, 500, 1000, 2000, 125};
+static const uint32_t gyro_udps_per_lsb[] = {8750, 17500, 35000, 70000, 4375};
+
+#define GYRO_FS_125 4
 
-struct lsm6ds3_config
+uint32_t lsm6ds3_accel_ug_per_lsb(uint8_t fs)
 {
-    stmdev_ctx_t ctx;
-    union
-    {
-#if DT_ANY_INST_ON_BUS_STATUS_OKAY(i2c)
-        const struct i2c_dt_spec i2c;
-#endif
-#if DT_ANY_INST_ON_BUS_STATUS_OKAY(spi)
-        const struct spi_dt_spec spi;
-#endif
-    } stmemsc_cfg;
-};
+    return accel_ug_per_lsb[fs];
+}
 
-struct lsm6ds3_data
+uint32_t lsm6ds3_gyro_udps_per_lsb(uint8_t fs)
 {
-    uint16_t accel[3];
-    uint16_t gyro[3];
-};
+    return gyro_udps_per_lsb[fs];
+}
+
+uint32_t lsm6ds3_odr_period_ns(uint8_t odr)
+{
+    return odr_period_ns[odr];
+}
+
+int lsm6ds3_reg_read(const struct device *dev, uint8_t reg, uint8_t *buf,
+                     uint16_t len)
+{
+    const struct lsm6ds3_config *cfg = dev->config;
+
+    return lsm6ds3tr_c_read_reg((stmdev_ctx_t *)&cfg->ctx, reg, buf, len);
+}
+
+int lsm6ds3_reg_write(const struct device *dev, uint8_t reg, uint8_t val)
+{
+    const struct lsm6ds3_config *cfg = dev->config;
+
+    return lsm6ds3tr_c_write_reg((stmdev_ctx_t *)&cfg->ctx, reg, &val, 1);
+}
+
+/**
+ * @brief The ODR register code for the slowest rate at least as fast as
+ * asked for.
+ */
+static int odr_from_hz(uint32_t hz)
+{
+    for (int odr = 0; odr < ARRAY_SIZE(odr_hz); odr++) {
+        if (odr_hz[odr] >= hz)
+            return odr;
+    }
+
+    return -EINVAL;
+}
+
+static int accel_fs_from_g(uint32_t g)
+{
+    int best = -EINVAL;
+
+    for (int fs = 0; fs < ARRAY_SIZE(accel_range_g); fs++) {
+        if (accel_range_g[fs] >= g &&
+            (best < 0 || accel_range_g[fs] < accel_range_g[best]))
+            best = fs;
+    }
+
+    return best;
+}
+
+static int gyro_fs_from_dps(uint32_t dps)
+{
+    int best = -EINVAL;
+
+    for (int fs = 0; fs < ARRAY_SIZE(gyro_range_dps); fs++) {
+        if (gyro_range_dps[fs] >= dps &&
+            (best < 0 || gyro_range_dps[fs] < gyro_range_dps[best]))
+            best = fs;
+    }
+
+    return best;
+}
+
+static int set_accel(const struct device *dev, uint8_t odr, uint8_t fs)
+{
+    struct lsm6ds3_data *data = dev->data;
+    int rc;
+
+    rc = lsm6ds3_reg_write(dev, LSM6DS3_REG_CTRL1_XL, odr << 4 | fs << 2);
+    if (rc)
+        return rc;
+
+    data->accel_odr = odr;
+    data->accel_fs = fs;
+
+    return 0;
+}
+
+static int set_gyro(const struct device *dev, uint8_t odr, uint8_t fs)
+{
+    struct lsm6ds3_data *data = dev->data;
+    uint8_t fs_bits = fs == GYRO_FS_125 ? BIT(1) : fs << 2;
+    int rc;
+
+    rc = lsm6ds3_reg_write(dev, LSM6DS3_REG_CTRL2_G, odr << 4 | fs_bits);
+    if (rc)
+        return rc;
+
+    data->gyro_odr = odr;
+    data->gyro_fs = fs;
+
+    return 0;
+}
+
+/**
+ * @brief Set the FIFO going, or turn it off if there's no watermark.
+ *
+ * Gyro and accel both go in undecimated at the gyro's rate, so the FIFO
+ * is a stream of whole sets. The accel should run at least that fast.
+ */
+int lsm6ds3_fifo_config(const struct device *dev, uint16_t watermark)
+{
+    struct lsm6ds3_data *data = dev->data;
+    uint16_t words = watermark * LSM6DS3_WORDS_PER_SET;
+    int rc;
+
+    if (words >= LSM6DS3_FIFO_WORDS)
+        return -EINVAL;
+
+    /* Going through bypass empties the FIFO. */
+    rc = lsm6ds3_reg_write(dev, LSM6DS3_REG_FIFO_CTRL5,
+                           LSM6DS3_FIFO_MODE_BYPASS);
+    if (rc || !watermark || !data->gyro_odr) {
+        data->fifo_enabled = false;
+        return rc;
+    }
+
+    rc = lsm6ds3_reg_write(dev, LSM6DS3_REG_FIFO_CTRL1, words & 0xff);
+    rc |= lsm6ds3_reg_write(dev, LSM6DS3_REG_FIFO_CTRL2, words >> 8);
+    rc |= lsm6ds3_reg_write(dev, LSM6DS3_REG_FIFO_CTRL3,
+                            LSM6DS3_FIFO_DEC_NONE);
+    rc |= lsm6ds3_reg_write(dev, LSM6DS3_REG_FIFO_CTRL5,
+                            data->gyro_odr << 3 |
+                                LSM6DS3_FIFO_MODE_CONTINUOUS);
+    if (rc)
+        return -EIO;
+
+    data->fifo_watermark = watermark;
+    data->fifo_enabled = true;
+
+    return 0;
+}
+
+int lsm6ds3_fifo_read(const struct device *dev, struct lsm6ds3_sample *buf,
+                      size_t max, bool *overrun)
+{
+    uint8_t status[4];
+    uint16_t words, pattern;
+    size_t sets;
+    int rc;
+
+    rc = lsm6ds3_reg_read(dev, LSM6DS3_REG_FIFO_STATUS1, status,
+                          sizeof(status));
+    if (rc)
+        return -EIO;
+
+    words = (status[1] & 0x0f) << 8 | status[0];
+    /* A full FIFO's 4096 words don't fit in the 12 bit count, and read as
+     * none, but it isn't empty. */
+    if (!words && !(status[1] & LSM6DS3_FIFO_STATUS2_EMPTY))
+        words = LSM6DS3_FIFO_WORDS;
+    pattern = (status[3] & 0x03) << 8 | status[2];
+    *overrun = status[1] & LSM6DS3_FIFO_STATUS2_OVER_RUN;
+
+    /* After an overrun the next word might not be a gyro X. Throw words
+     * away until it is. */
+    if (pattern && words >= LSM6DS3_WORDS_PER_SET - pattern) {
+        uint8_t skip[2 * LSM6DS3_WORDS_PER_SET];
+
+        rc = lsm6ds3_reg_read(dev, LSM6DS3_REG_FIFO_DATA_OUT_L, skip,
+                              2 * (LSM6DS3_WORDS_PER_SET - pattern));
+        if (rc)
+            return -EIO;
+
+        words -= LSM6DS3_WORDS_PER_SET - pattern;
+    }
 
-static const int LSM6DS3_ID = 0x69;
+    sets = MIN(words / LSM6DS3_WORDS_PER_SET, max);
+    if (!sets)
+        return 0;
+
+    /* With IF_INC set, the address wraps from FIFO_DATA_OUT_H back to
+     * FIFO_DATA_OUT_L, so the whole lot comes out in one transaction. */
+    rc = lsm6ds3_reg_read(dev, LSM6DS3_REG_FIFO_DATA_OUT_L, (uint8_t *)buf,
+                          sets * sizeof(*buf));
+    if (rc)
+        return -EIO;
+
+    for (size_t i = 0; i < sets; i++) {
+        for (int axis = 0; axis < 3; axis++) {
+            buf[i].gyro[axis] = sys_le16_to_cpu(buf[i].gyro[axis]);
+            buf[i].accel[axis] = sys_le16_to_cpu(buf[i].accel[axis]);
+        }
+    }
+
+    return sets;
+}
+
+static int lsm6ds3_sample_fetch(const struct device *dev,
+                                enum sensor_channel chan)
+{
+    struct lsm6ds3_data *data = dev->data;
+    struct lsm6ds3_sample sample;
+
+    if (chan != SENSOR_CHAN_ALL && chan != SENSOR_CHAN_ACCEL_XYZ &&
+        chan != SENSOR_CHAN_GYRO_XYZ)
+        return -ENOTSUP;
+
+    /* Gyro then accel output registers are next to each other, in the
+     * same order as the FIFO. The FIFO is left alone. */
+    if (lsm6ds3_reg_read(dev, LSM6DS3_REG_OUTX_L_G, (uint8_t *)&sample,
+                         sizeof(sample)))
+        return -EIO;
+
+    for (int axis = 0; axis < 3; axis++) {
+        data->sample.gyro[axis] = sys_le16_to_cpu(sample.gyro[axis]);
+        data->sample.accel[axis] = sys_le16_to_cpu(sample.accel[axis]);
+    }
+
+    return 0;
+}
+
+static void accel_value(const struct lsm6ds3_data *data, int axis,
+                        struct sensor_value *val)
+{
+    sensor_ug_to_ms2(data->sample.accel[axis] *
+                         (int32_t)lsm6ds3_accel_ug_per_lsb(data->accel_fs),
+                     val);
+}
+
+static void gyro_value(const struct lsm6ds3_data *data, int axis,
+                       struct sensor_value *val)
+{
+    /* In 10 udps, so full scale at 2000 dps still fits in 32 bits. */
+    sensor_10udegrees_to_rad(
+        data->sample.gyro[axis] *
+            (int32_t)(lsm6ds3_gyro_udps_per_lsb(data->gyro_fs) / 10),
+        val);
+}
+
+static int lsm6ds3_channel_get(const struct device *dev,
+                               enum sensor_channel chan,
+                               struct sensor_value *val)
+{
+    struct lsm6ds3_data *data = dev->data;
+
+    switch (chan) {
+        case SENSOR_CHAN_ACCEL_X:
+        case SENSOR_CHAN_ACCEL_Y:
+        case SENSOR_CHAN_ACCEL_Z:
+            accel_value(data, chan - SENSOR_CHAN_ACCEL_X, val);
+            break;
+
+        case SENSOR_CHAN_ACCEL_XYZ:
+            for (int axis = 0; axis < 3; axis++)
+                accel_value(data, axis, &val[axis]);
+            break;
+
+        case SENSOR_CHAN_GYRO_X:
+        case SENSOR_CHAN_GYRO_Y:
+        case SENSOR_CHAN_GYRO_Z:
+            gyro_value(data, chan - SENSOR_CHAN_GYRO_X, val);
+            break;
+
+        case SENSOR_CHAN_GYRO_XYZ:
+            for (int axis = 0; axis < 3; axis++)
+                gyro_value(data, axis, &val[axis]);
+            break;
+
+        default:
+            return -ENOTSUP;
+    }
+
+    return 0;
+}
+
+static int lsm6ds3_attr_set(const struct device *dev,
+                            enum sensor_channel chan,
+                            enum sensor_attribute attr,
+                            const struct sensor_value *val)
+{
+    struct lsm6ds3_data *data = dev->data;
+    bool accel = chan == SENSOR_CHAN_ACCEL_XYZ || chan == SENSOR_CHAN_ALL;
+    bool gyro = chan == SENSOR_CHAN_GYRO_XYZ || chan == SENSOR_CHAN_ALL;
+    int code, rc = 0;
+
+    if (!accel && !gyro)
+        return -ENOTSUP;
+
+    switch (attr) {
+        case SENSOR_ATTR_SAMPLING_FREQUENCY:
+            code = odr_from_hz(val->val1 + (val->val2 > 0));
+            if (code < 0)
+                return code;
+
+            if (accel)
+                rc |= set_accel(dev, code, data->accel_fs);
+            if (gyro)
+                rc |= set_gyro(dev, code, data->gyro_fs);
+
+            /* The FIFO runs at the gyro's rate. */
+            if (gyro && data->fifo_enabled)
+                rc |= lsm6ds3_fifo_config(dev, data->fifo_watermark);
+            break;
+
+        case SENSOR_ATTR_FULL_SCALE:
+            if (accel && gyro)
+                return -ENOTSUP;
+
+            if (accel) {
+                code = accel_fs_from_g(sensor_ms2_to_g(val));
+                if (code < 0)
+                    return code;
+                rc = set_accel(dev, data->accel_odr, code);
+            } else {
+                code = gyro_fs_from_dps(sensor_rad_to_degrees(val));
+                if (code < 0)
+                    return code;
+                rc = set_gyro(dev, data->gyro_odr, code);
+            }
+            break;
+
+        default:
+            return -ENOTSUP;
+    }
+
+    return rc ? -EIO : 0;
+}
+
+#ifdef CONFIG_PM_DEVICE
+/**
+ * @brief Power-down mode is just both rates at 0. The rates, ranges and
+ * FIFO settings are kept, to go back to on resume.
+ */
+static int lsm6ds3_pm_action(const struct device *dev,
+                             enum pm_device_action action)
+{
+    struct lsm6ds3_data *data = dev->data;
+    int rc;
+
+    switch (action) {
+        case PM_DEVICE_ACTION_SUSPEND:
+            rc = lsm6ds3_reg_write(dev, LSM6DS3_REG_FIFO_CTRL5,
+                                   LSM6DS3_FIFO_MODE_BYPASS);
+            rc |= lsm6ds3_reg_write(dev, LSM6DS3_REG_CTRL1_XL, 0);
+            rc |= lsm6ds3_reg_write(dev, LSM6DS3_REG_CTRL2_G, 0);
+            break;
+
+        case PM_DEVICE_ACTION_RESUME:
+            rc = set_accel(dev, data->accel_odr, data->accel_fs);
+            rc |= set_gyro(dev, data->gyro_odr, data->gyro_fs);
+            if (!rc && data->fifo_enabled)
+                rc = lsm6ds3_fifo_config(dev, data->fifo_watermark);
+            break;
+
+        default:
+            return -ENOTSUP;
+    }
+
+    return rc ? -EIO : 0;
+}
+#endif
 
 static int lsm6ds3_init(const struct device *dev)
 {
     const struct lsm6ds3_config *cfg = dev->config;
-    stmdev_ctx_t *ctx = (stmdev_ctx_t *)&cfg->ctx;
-    uint8_t chip_id;
+    struct lsm6ds3_data *data = dev->data;
+    uint8_t chip_id, ctrl3;
+    int rc;
+
+    data->dev = dev;
 
-    if (lsm6ds3tr_c_device_id_get(ctx, &chip_id) < 0)
+    if (lsm6ds3_reg_read(dev, LSM6DS3_REG_WHO_AM_I, &chip_id, 1) < 0)
     {
         LOG_DBG("Failed reading chip id");
         return -EIO;
@@ -55,28 +406,121 @@ static int lsm6ds3_init(const struct device *dev)
     LOG_INF("chip id 0x%x", chip_id);
 
     /* This driver supports LSM6DS3 - which is different to the LSM6DS3TR-C */
-    if (chip_id != LSM6DS3_ID)
+    if (chip_id != LSM6DS3_WHO_AM_I)
     {
         LOG_DBG("Invalid chip id 0x%x", chip_id);
         return -EIO;
     }
 
+    /* Start from a known state, whatever happened before a warm reset. */
+    rc = lsm6ds3_reg_write(dev, LSM6DS3_REG_CTRL3_C, LSM6DS3_CTRL3_SW_RESET);
+    if (rc) {
+        LOG_ERR("%s: Failed to reset", dev->name);
+        return rc;
+    }
+
+    for (int i = 0; i < 10; i++) {
+        k_busy_wait(50);
+        rc = lsm6ds3_reg_read(dev, LSM6DS3_REG_CTRL3_C, &ctrl3, 1);
+        if (!rc && !(ctrl3 & LSM6DS3_CTRL3_SW_RESET))
+            break;
+    }
+
+    /* Don't let the two halves of a sample come from different updates,
+     * and step through registers on burst reads. */
+    rc = lsm6ds3_reg_write(dev, LSM6DS3_REG_CTRL3_C,
+                           LSM6DS3_CTRL3_BDU | LSM6DS3_CTRL3_IF_INC);
+    rc |= set_accel(dev, cfg->accel_odr, cfg->accel_fs);
+    rc |= set_gyro(dev, cfg->gyro_odr, cfg->gyro_fs);
+    if (rc) {
+        LOG_ERR("%s: Failed to configure", dev->name);
+        return -EIO;
+    }
+
+    rc = lsm6ds3_fifo_config(dev, cfg->fifo_watermark);
+    if (rc) {
+        LOG_ERR("%s: Failed to configure the FIFO", dev->name);
+        return rc;
+    }
+
+#ifdef CONFIG_LSM6DS3_TRIGGER
+    if (cfg->irq_gpio.port) {
+        rc = lsm6ds3_trigger_init(dev);
+        if (rc) {
+            LOG_ERR("%s: Failed to set up the interrupt", dev->name);
+            return rc;
+        }
+    }
+#endif
+
+    LOG_INF("%s: accel %u Hz %u g, gyro %u Hz %u dps, FIFO watermark %u",
+            dev->name, odr_hz[data->accel_odr], accel_range_g[data->accel_fs],
+            odr_hz[data->gyro_odr], gyro_range_dps[data->gyro_fs],
+            data->fifo_enabled ? data->fifo_watermark : 0);
+
     return 0;
 }
 
-static const struct sensor_driver_api lsm6ds3_api = {};
+static const struct sensor_driver_api lsm6ds3_api = {
+    .attr_set = lsm6ds3_attr_set,
+    .sample_fetch = lsm6ds3_sample_fetch,
+    .channel_get = lsm6ds3_channel_get,
+#ifdef CONFIG_LSM6DS3_TRIGGER
+    .trigger_set = lsm6ds3_trigger_set,
+#endif
+#ifdef CONFIG_SENSOR_ASYNC_API
+    .submit = lsm6ds3_submit,
+    .get_decoder = lsm6ds3_get_decoder,
+#endif
+};
 
 #define LSM6DS3_SPI_OP (SPI_WORD_SET(8) |    \
                         SPI_OP_MODE_MASTER | \
                         SPI_MODE_CPOL |      \
                         SPI_MODE_CPHA)
 
+/* Register codes for the devicetree settings. */
+#define LSM6DS3_ODR(hz)                                                     \
+    ((hz) == 0      ? 0                                                     \
+     : (hz) <= 13   ? 1                                                     \
+     : (hz) <= 26   ? 2                                                     \
+     : (hz) <= 52   ? 3                                                     \
+     : (hz) <= 104  ? 4                                                     \
+     : (hz) <= 208  ? 5                                                     \
+     : (hz) <= 416  ? 6                                                     \
+     : (hz) <= 833  ? 7                                                     \
+                    : 8)
+#define LSM6DS3_ACCEL_FS(g) \
+    ((g) == 2 ? 0 : (g) == 4 ? 2 : (g) == 8 ? 3 : 1)
+#define LSM6DS3_GYRO_FS(dps)                                                 \
+    ((dps) == 125    ? GYRO_FS_125                                           \
+     : (dps) == 250  ? 0                                                     \
+     : (dps) == 500  ? 1                                                     \
+     : (dps) == 1000 ? 2                                                     \
+                     : 3)
+
+#ifdef CONFIG_LSM6DS3_TRIGGER
+#define LSM6DS3_CFG_IRQ(n) \
+    .irq_gpio = GPIO_DT_SPEC_INST_GET_OR(n, irq_gpios, {0}),
+#else
+#define LSM6DS3_CFG_IRQ(n)
+#endif
+
+#define LSM6DS3_CFG_COMMON(n)                                          \
+    .accel_odr = LSM6DS3_ODR(DT_INST_PROP(n, accel_odr)),              \
+    .accel_fs = LSM6DS3_ACCEL_FS(DT_INST_PROP(n, accel_range)),        \
+    .gyro_odr = LSM6DS3_ODR(DT_INST_PROP(n, gyro_odr)),                \
+    .gyro_fs = LSM6DS3_GYRO_FS(DT_INST_PROP(n, gyro_range)),           \
+    .fifo_watermark = DT_INST_PROP(n, fifo_watermark),                 \
+    LSM6DS3_CFG_IRQ(n)
+
 #define LSM6DS3_CFG_SPI(n)                                     \
     {                                                          \
         STMEMSC_CTX_SPI(&lsm6ds3_config_##n.stmemsc_cfg),      \
         .stmemsc_cfg = {                                       \
             .spi = SPI_DT_SPEC_INST_GET(n, LSM6DS3_SPI_OP, 0), \
         },                                                     \
+        LSM6DS3_CFG_COMMON(n)                                  \
     }
 
 #define LSM6DS3_CFG_I2C(n)                                \
@@ -85,6 +529,7 @@ static const struct sensor_driver_api lsm6ds3_api = {};
         .stmemsc_cfg = {                                  \
             .i2c = I2C_DT_SPEC_INST_GET(n),               \
         },                                                \
+        LSM6DS3_CFG_COMMON(n)                             \
     }
 
 #define LSM6DS3_DRIVER_INIT(n)                                \
@@ -95,9 +540,11 @@ static const struct sensor_driver_api lsm6ds3_api = {};
                     (LSM6DS3_CFG_SPI(n)),                     \
                     (LSM6DS3_CFG_I2C(n)));                    \
                                                               \
+    PM_DEVICE_DT_INST_DEFINE(n, lsm6ds3_pm_action);           \
+                                                              \
     SENSOR_DEVICE_DT_INST_DEFINE(n,                           \
                                  &lsm6ds3_init,               \
-                                 NULL,                        \
+                                 PM_DEVICE_DT_INST_GET(n),    \
                                  &lsm6ds3_data_##n,           \
                                  &lsm6ds3_config_##n,         \
                                  POST_KERNEL,                 \
@@ -0,0 +1,219 @@
+#ifndef ZEPHYR_DRIVERS_SENSOR_LSM6DS3_H_
+#define ZEPHYR_DRIVERS_SENSOR_LSM6DS3_H_
+
+#include <stdint.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/kernel.h>
+
+#include <sensor/st/stmemsc/stmemsc.h>
+
+#if DT_ANY_INST_ON_BUS_STATUS_OKAY(spi)
+#include <zephyr/drivers/spi.h>
+#endif
+
+#if DT_ANY_INST_ON_BUS_STATUS_OKAY(i2c)
+#include <zephyr/drivers/i2c.h>
+#endif
+
+/*
+ * Registers. The LSM6DS3 isn't the LSM6DS3TR-C that the HAL describes - the
+ * FIFO in particular is laid out differently - so these come from the
+ * LSM6DS3 datasheet and only the HAL's bus access is used.
+ */
+#define LSM6DS3_REG_FIFO_CTRL1 0x06
+#define LSM6DS3_REG_FIFO_CTRL2 0x07
+#define LSM6DS3_REG_FIFO_CTRL3 0x08
+#define LSM6DS3_REG_FIFO_CTRL4 0x09
+#define LSM6DS3_REG_FIFO_CTRL5 0x0a
+#define LSM6DS3_REG_INT1_CTRL 0x0d
+#define LSM6DS3_REG_WHO_AM_I 0x0f
+#define LSM6DS3_REG_CTRL1_XL 0x10
+#define LSM6DS3_REG_CTRL2_G 0x11
+#define LSM6DS3_REG_CTRL3_C 0x12
+#define LSM6DS3_REG_STATUS 0x1e
+#define LSM6DS3_REG_OUTX_L_G 0x22
+#define LSM6DS3_REG_OUTX_L_XL 0x28
+#define LSM6DS3_REG_FIFO_STATUS1 0x3a
+#define LSM6DS3_REG_FIFO_STATUS2 0x3b
+#define LSM6DS3_REG_FIFO_STATUS3 0x3c
+#define LSM6DS3_REG_FIFO_STATUS4 0x3d
+#define LSM6DS3_REG_FIFO_DATA_OUT_L 0x3e
+#define LSM6DS3_REG_FIFO_DATA_OUT_H 0x3f
+
+#define LSM6DS3_WHO_AM_I 0x69
+
+/* FIFO_CTRL3: no decimation, so gyro and accel go in at the FIFO rate. */
+#define LSM6DS3_FIFO_DEC_NONE 0x09
+
+/* FIFO_CTRL5 modes. */
+#define LSM6DS3_FIFO_MODE_BYPASS 0x0
+#define LSM6DS3_FIFO_MODE_CONTINUOUS 0x6
+
+#define LSM6DS3_INT1_DRDY_G BIT(1)
+#define LSM6DS3_INT1_FTH BIT(3)
+#define LSM6DS3_INT1_FIFO_OVR BIT(4)
+
+#define LSM6DS3_CTRL3_BDU BIT(6)
+#define LSM6DS3_CTRL3_IF_INC BIT(2)
+#define LSM6DS3_CTRL3_SW_RESET BIT(0)
+
+#define LSM6DS3_STATUS_GDA BIT(1)
+
+#define LSM6DS3_FIFO_STATUS2_FTH BIT(7)
+#define LSM6DS3_FIFO_STATUS2_OVER_RUN BIT(6)
+#define LSM6DS3_FIFO_STATUS2_EMPTY BIT(4)
+
+/* The FIFO holds 4096 16 bit words. */
+#define LSM6DS3_FIFO_WORDS 4096
+
+/* A gyro sample then an accel sample, as the FIFO stores them. */
+#define LSM6DS3_WORDS_PER_SET 6
+
+/* ODR register codes run from 1 (12.5 Hz) to 8 (1.66 kHz), roughly
+ * doubling. 0 is powered down. */
+#define LSM6DS3_ODR_MAX 8
+
+/**
+ * @brief One gyro and accel sample, as the chip sends them.
+ */
+struct lsm6ds3_sample
+{
+    int16_t gyro[3];
+    int16_t accel[3];
+} __packed;
+
+/* Flags in an encoded read. */
+#define LSM6DS3_ENCODED_WATERMARK BIT(0)
+#define LSM6DS3_ENCODED_OVERRUN BIT(1)
+
+/**
+ * @brief What a read through the RTIO path leaves in its buffer, ready for
+ * the decoder: a run of sets one sample period apart.
+ */
+struct lsm6ds3_encoded
+{
+    /* When the last set was read. */
+    uint64_t timestamp_ns;
+    uint32_t period_ns;
+    uint16_t count;
+    uint8_t accel_fs;
+    uint8_t gyro_fs;
+    uint8_t flags;
+    struct lsm6ds3_sample sets[];
+};
+
+struct lsm6ds3_config
+{
+    stmdev_ctx_t ctx;
+    union
+    {
+#if DT_ANY_INST_ON_BUS_STATUS_OKAY(i2c)
+        const struct i2c_dt_spec i2c;
+#endif
+#if DT_ANY_INST_ON_BUS_STATUS_OKAY(spi)
+        const struct spi_dt_spec spi;
+#endif
+    } stmemsc_cfg;
+
+    /* Defaults from the devicetree, as register codes. */
+    uint8_t accel_odr;
+    uint8_t accel_fs;
+    uint8_t gyro_odr;
+    uint8_t gyro_fs;
+    uint16_t fifo_watermark;
+
+#ifdef CONFIG_LSM6DS3_TRIGGER
+    struct gpio_dt_spec irq_gpio;
+#endif
+};
+
+struct lsm6ds3_data
+{
+    const struct device *dev;
+
+    /* Latest sample from sample_fetch(). */
+    struct lsm6ds3_sample sample;
+
+    uint8_t accel_odr;
+    uint8_t accel_fs;
+    uint8_t gyro_odr;
+    uint8_t gyro_fs;
+    uint16_t fifo_watermark;
+    bool fifo_enabled;
+
+#ifdef CONFIG_LSM6DS3_TRIGGER
+    struct gpio_callback gpio_cb;
+    struct k_sem irq_sem;
+    struct k_thread thread;
+    K_KERNEL_STACK_MEMBER(thread_stack, CONFIG_LSM6DS3_THREAD_STACK_SIZE);
+
+    /* What's routed to INT1. */
+    uint8_t int1_ctrl;
+
+    sensor_trigger_handler_t drdy_handler;
+    const struct sensor_trigger *drdy_trigger;
+    sensor_trigger_handler_t fifo_handler;
+    const struct sensor_trigger *fifo_trigger;
+
+#ifdef CONFIG_SENSOR_ASYNC_API
+    /* A streaming read waiting for the FIFO watermark. */
+    struct rtio_iodev_sqe *stream_sqe;
+#endif
+#endif
+};
+
+extern int lsm6ds3_reg_read(const struct device *dev, uint8_t reg,
+                            uint8_t *buf, uint16_t len);
+extern int lsm6ds3_reg_write(const struct device *dev, uint8_t reg,
+                             uint8_t val);
+
+/**
+ * @brief Accel and gyro scale for a full-scale register code.
+ */
+extern uint32_t lsm6ds3_accel_ug_per_lsb(uint8_t fs);
+extern uint32_t lsm6ds3_gyro_udps_per_lsb(uint8_t fs);
+
+/**
+ * @brief Sample period for an ODR register code, in ns.
+ */
+extern uint32_t lsm6ds3_odr_period_ns(uint8_t odr);
+
+/**
+ * @brief Put the FIFO in continuous mode with a watermark in sample sets,
+ * or bypass it if the watermark is 0.
+ */
+extern int lsm6ds3_fifo_config(const struct device *dev, uint16_t watermark);
+
+/**
+ * @brief Read sample sets out of the FIFO, in as few bus transactions as
+ * the buffer allows.
+ *
+ * @param max How many sets fit in the buffer.
+ * @param overrun Set if the FIFO filled up and samples were lost.
+ *
+ * @return How many sets were read, or a negative error.
+ */
+extern int lsm6ds3_fifo_read(const struct device *dev,
+                             struct lsm6ds3_sample *buf, size_t max,
+                             bool *overrun);
+
+#ifdef CONFIG_LSM6DS3_TRIGGER
+extern int lsm6ds3_trigger_init(const struct device *dev);
+extern int lsm6ds3_trigger_set(const struct device *dev,
+                               const struct sensor_trigger *trig,
+                               sensor_trigger_handler_t handler);
+#endif
+
+#ifdef CONFIG_SENSOR_ASYNC_API
+extern void lsm6ds3_submit(const struct device *dev,
+                           struct rtio_iodev_sqe *iodev_sqe);
+extern int lsm6ds3_get_decoder(const struct device *dev,
+                               const struct sensor_decoder_api **decoder);
+#ifdef CONFIG_LSM6DS3_TRIGGER
+extern void lsm6ds3_stream_irq(const struct device *dev);
+#endif
+#endif
+
+#endif
@@ -0,0 +1,127 @@
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/drivers/sensor_data_types.h>
+
+#include "lsm6ds3.h"
+
+/*
+ * Raw counts to q31. The shifts give +-256 m/s^2 and +-64 rad/s, enough for
+ * 16 g and 2000 dps. The K factors fold in the unit change and the shift, so
+ * that q31 = (raw * scale * K) >> 16 with scale in ug or udps per LSB:
+ *
+ *     accel: 9.80665e-6 m/s^2/ug * 2^(31 - 8 + 16) = 5391263
+ *     gyro:  pi / 180e6 rad/s/udps * 2^(31 - 6 + 16) = 38380
+ */
+#define ACCEL_SHIFT 8
+#define ACCEL_K 5391263LL
+#define GYRO_SHIFT 6
+#define GYRO_K 38380LL
+
+static bool is_xyz(struct sensor_chan_spec chan)
+{
+    return chan.chan_idx == 0 && (chan.chan_type == SENSOR_CHAN_ACCEL_XYZ ||
+                                  chan.chan_type == SENSOR_CHAN_GYRO_XYZ);
+}
+
+static int get_frame_count(const uint8_t *buffer, struct sensor_chan_spec chan,
+                           uint16_t *frame_count)
+{
+    const struct lsm6ds3_encoded *enc = (const struct lsm6ds3_encoded *)buffer;
+
+    if (!is_xyz(chan))
+        return -ENOTSUP;
+
+    *frame_count = enc->count;
+
+    return 0;
+}
+
+static int get_size_info(struct sensor_chan_spec chan, size_t *base_size,
+                         size_t *frame_size)
+{
+    if (!is_xyz(chan))
+        return -ENOTSUP;
+
+    *base_size = sizeof(struct sensor_three_axis_data);
+    *frame_size = sizeof(struct sensor_three_axis_sample_data);
+
+    return 0;
+}
+
+static int decode(const uint8_t *buffer, struct sensor_chan_spec chan,
+                  uint32_t *fit, uint16_t max_count, void *data_out)
+{
+    const struct lsm6ds3_encoded *enc = (const struct lsm6ds3_encoded *)buffer;
+    struct sensor_three_axis_data *out = data_out;
+    bool accel = chan.chan_type == SENSOR_CHAN_ACCEL_XYZ;
+    int64_t k;
+    int count = 0;
+
+    if (!is_xyz(chan))
+        return -ENOTSUP;
+
+    if (*fit >= enc->count || max_count == 0)
+        return 0;
+
+    if (accel) {
+        k = lsm6ds3_accel_ug_per_lsb(enc->accel_fs) * ACCEL_K;
+        out->shift = ACCEL_SHIFT;
+    } else {
+        k = lsm6ds3_gyro_udps_per_lsb(enc->gyro_fs) * GYRO_K;
+        out->shift = GYRO_SHIFT;
+    }
+
+    /* The timestamp is for the last set, so the earlier ones are worked
+     * back from it a period at a time. */
+    out->header.base_timestamp_ns =
+        enc->timestamp_ns -
+        (uint64_t)(enc->count - 1 - *fit) * enc->period_ns;
+
+    while (*fit < enc->count && count < max_count) {
+        const struct lsm6ds3_sample *set = &enc->sets[*fit];
+        const int16_t *raw = accel ? set->accel : set->gyro;
+        struct sensor_three_axis_sample_data *reading = &out->readings[count];
+
+        reading->timestamp_delta = count * enc->period_ns;
+        for (int axis = 0; axis < 3; axis++)
+            reading->values[axis] = (raw[axis] * k) >> 16;
+
+        count++;
+        (*fit)++;
+    }
+
+    out->header.reading_count = count;
+
+    return count;
+}
+
+static bool has_trigger(const uint8_t *buffer, enum sensor_trigger_type trigger)
+{
+    const struct lsm6ds3_encoded *enc = (const struct lsm6ds3_encoded *)buffer;
+
+    switch (trigger) {
+        case SENSOR_TRIG_FIFO_WATERMARK:
+            return enc->flags & LSM6DS3_ENCODED_WATERMARK;
+
+        case SENSOR_TRIG_FIFO_FULL:
+            return enc->flags & LSM6DS3_ENCODED_OVERRUN;
+
+        default:
+            return false;
+    }
+}
+
+SENSOR_DECODER_API_DT_DEFINE() = {
+    .get_frame_count = get_frame_count,
+    .get_size_info = get_size_info,
+    .decode = decode,
+    .has_trigger = has_trigger,
+};
+
+int lsm6ds3_get_decoder(const struct device *dev,
+                        const struct sensor_decoder_api **decoder)
+{
+    ARG_UNUSED(dev);
+    *decoder = &SENSOR_DECODER_NAME();
+
+    return 0;
+}
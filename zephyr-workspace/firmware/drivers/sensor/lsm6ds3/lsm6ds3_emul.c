@@ -0,0 +1,409 @@
+#define DT_DRV_COMPAT st_lsm6ds3
+
+#include <math.h>
+#include <string.h>
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/emul.h>
+#include <zephyr/drivers/emul_sensor.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/gpio/gpio_emul.h>
+#include <zephyr/drivers/i2c.h>
+#include <zephyr/drivers/i2c_emul.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+
+#include "lsm6ds3.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(lsm6ds3_emul, CONFIG_SENSOR_LOG_LEVEL);
+
+/*
+ * Enough of the LSM6DS3 to run the driver against: the registers, the
+ * output registers, and a continuous-mode FIFO that fills at the gyro ODR
+ * from whatever the outputs are set to. INT1 drives the irq-gpios pin
+ * through the GPIO emulator if there is one.
+ */
+
+#define NUM_REGS 0x80
+
+/* Same q31 shifts as the decoder. */
+#define ACCEL_SHIFT 8
+#define GYRO_SHIFT 6
+
+struct lsm6ds3_emul_cfg
+{
+    struct gpio_dt_spec irq_gpio;
+};
+
+struct lsm6ds3_emul_data
+{
+    const struct emul *target;
+    struct k_spinlock lock;
+    struct k_timer timer;
+
+    uint8_t regs[NUM_REGS];
+
+    int16_t fifo[LSM6DS3_FIFO_WORDS];
+    uint16_t fifo_head;
+    uint16_t fifo_count;
+    /* Words popped since the FIFO was last emptied, for the pattern. */
+    uint32_t fifo_popped;
+    bool fifo_overrun;
+};
+
+static const uint32_t odr_period_us[] = {
+    0, 80000, 38462, 19231, 9615, 4808, 2404, 1200, 602,
+};
+
+static void reset(struct lsm6ds3_emul_data *data)
+{
+    memset(data->regs, 0, sizeof(data->regs));
+    data->regs[LSM6DS3_REG_WHO_AM_I] = LSM6DS3_WHO_AM_I;
+    data->regs[LSM6DS3_REG_CTRL3_C] = LSM6DS3_CTRL3_IF_INC;
+
+    data->fifo_head = 0;
+    data->fifo_count = 0;
+    data->fifo_popped = 0;
+    data->fifo_overrun = false;
+
+    k_timer_stop(&data->timer);
+}
+
+static uint16_t fifo_watermark(const struct lsm6ds3_emul_data *data)
+{
+    return (data->regs[LSM6DS3_REG_FIFO_CTRL2] & 0x0f) << 8 |
+           data->regs[LSM6DS3_REG_FIFO_CTRL1];
+}
+
+static bool fifo_continuous(const struct lsm6ds3_emul_data *data)
+{
+    return (data->regs[LSM6DS3_REG_FIFO_CTRL5] & 0x07) ==
+           LSM6DS3_FIFO_MODE_CONTINUOUS;
+}
+
+static bool fifo_fth(const struct lsm6ds3_emul_data *data)
+{
+    uint16_t watermark = fifo_watermark(data);
+
+    return watermark && data->fifo_count >= watermark;
+}
+
+static bool int1_level(const struct lsm6ds3_emul_data *data)
+{
+    uint8_t int1 = data->regs[LSM6DS3_REG_INT1_CTRL];
+
+    return ((int1 & LSM6DS3_INT1_FTH) && fifo_fth(data)) ||
+           ((int1 & LSM6DS3_INT1_FIFO_OVR) && data->fifo_overrun) ||
+           ((int1 & LSM6DS3_INT1_DRDY_G) &&
+            (data->regs[LSM6DS3_REG_STATUS] & LSM6DS3_STATUS_GDA));
+}
+
+static void set_int1(const struct emul *target, bool level)
+{
+#ifdef CONFIG_GPIO_EMUL
+    const struct lsm6ds3_emul_cfg *cfg = target->cfg;
+
+    if (!cfg->irq_gpio.port)
+        return;
+
+    if (cfg->irq_gpio.dt_flags & GPIO_ACTIVE_LOW)
+        level = !level;
+
+    gpio_emul_input_set(cfg->irq_gpio.port, cfg->irq_gpio.pin, level);
+#endif
+}
+
+static void fifo_push(struct lsm6ds3_emul_data *data, int16_t word)
+{
+    uint16_t tail;
+
+    /* Continuous mode drops the oldest word to make room. */
+    if (data->fifo_count == LSM6DS3_FIFO_WORDS) {
+        data->fifo_head = (data->fifo_head + 1) % LSM6DS3_FIFO_WORDS;
+        data->fifo_count--;
+        data->fifo_popped++;
+        data->fifo_overrun = true;
+    }
+
+    tail = (data->fifo_head + data->fifo_count) % LSM6DS3_FIFO_WORDS;
+    data->fifo[tail] = word;
+    data->fifo_count++;
+}
+
+static void timer_expiry(struct k_timer *timer)
+{
+    struct lsm6ds3_emul_data *data =
+        CONTAINER_OF(timer, struct lsm6ds3_emul_data, timer);
+    k_spinlock_key_t key = k_spin_lock(&data->lock);
+    bool level;
+
+    data->regs[LSM6DS3_REG_STATUS] |= LSM6DS3_STATUS_GDA;
+
+    if (fifo_continuous(data)) {
+        /* Gyro then accel, the same as the output registers. */
+        for (int i = 0; i < LSM6DS3_WORDS_PER_SET; i++)
+            fifo_push(data, sys_get_le16(
+                                &data->regs[LSM6DS3_REG_OUTX_L_G + 2 * i]));
+    }
+
+    level = int1_level(data);
+    k_spin_unlock(&data->lock, key);
+
+    set_int1(data->target, level);
+}
+
+static uint8_t read_reg(struct lsm6ds3_emul_data *data, uint8_t reg)
+{
+    switch (reg) {
+        case LSM6DS3_REG_FIFO_STATUS1:
+            return data->fifo_count & 0xff;
+
+        case LSM6DS3_REG_FIFO_STATUS2:
+            return (data->fifo_count >> 8 & 0x0f) |
+                   (fifo_fth(data) ? LSM6DS3_FIFO_STATUS2_FTH : 0) |
+                   (data->fifo_overrun ? LSM6DS3_FIFO_STATUS2_OVER_RUN : 0) |
+                   (data->fifo_count ? 0 : LSM6DS3_FIFO_STATUS2_EMPTY);
+
+        case LSM6DS3_REG_FIFO_STATUS3:
+            return (data->fifo_popped % LSM6DS3_WORDS_PER_SET) & 0xff;
+
+        case LSM6DS3_REG_FIFO_STATUS4:
+            return 0;
+
+        case LSM6DS3_REG_FIFO_DATA_OUT_L:
+            return data->fifo_count ? data->fifo[data->fifo_head] & 0xff : 0;
+
+        case LSM6DS3_REG_FIFO_DATA_OUT_H: {
+            uint8_t val;
+
+            if (!data->fifo_count)
+                return 0;
+
+            val = (uint16_t)data->fifo[data->fifo_head] >> 8;
+            data->fifo_head = (data->fifo_head + 1) % LSM6DS3_FIFO_WORDS;
+            data->fifo_count--;
+            data->fifo_popped++;
+            data->fifo_overrun = false;
+
+            return val;
+        }
+
+        case LSM6DS3_REG_OUTX_L_G + 5:
+            /* Reading the last gyro byte clears data ready. */
+            data->regs[LSM6DS3_REG_STATUS] &= ~LSM6DS3_STATUS_GDA;
+            return data->regs[reg];
+
+        default:
+            return data->regs[reg];
+    }
+}
+
+static void write_reg(struct lsm6ds3_emul_data *data, uint8_t reg, uint8_t val)
+{
+    switch (reg) {
+        case LSM6DS3_REG_CTRL3_C:
+            if (val & LSM6DS3_CTRL3_SW_RESET) {
+                reset(data);
+                return;
+            }
+            break;
+
+        case LSM6DS3_REG_CTRL2_G: {
+            uint32_t period_us = odr_period_us[MIN(val >> 4, LSM6DS3_ODR_MAX)];
+
+            if (period_us) {
+                k_timer_start(&data->timer, K_USEC(period_us),
+                              K_USEC(period_us));
+            } else {
+                k_timer_stop(&data->timer);
+            }
+            break;
+        }
+
+        case LSM6DS3_REG_FIFO_CTRL5:
+            if ((val & 0x07) == LSM6DS3_FIFO_MODE_BYPASS) {
+                data->fifo_head = 0;
+                data->fifo_count = 0;
+                data->fifo_popped = 0;
+                data->fifo_overrun = false;
+            }
+            break;
+
+        case LSM6DS3_REG_WHO_AM_I:
+        case LSM6DS3_REG_STATUS:
+            /* Read only. */
+            return;
+
+        default:
+            break;
+    }
+
+    data->regs[reg] = val;
+}
+
+static uint8_t next_reg(const struct lsm6ds3_emul_data *data, uint8_t reg)
+{
+    if (!(data->regs[LSM6DS3_REG_CTRL3_C] & LSM6DS3_CTRL3_IF_INC))
+        return reg;
+
+    /* The FIFO output wraps on itself so it can be burst read. */
+    if (reg == LSM6DS3_REG_FIFO_DATA_OUT_H)
+        return LSM6DS3_REG_FIFO_DATA_OUT_L;
+
+    return (reg + 1) % NUM_REGS;
+}
+
+static int lsm6ds3_emul_transfer(const struct emul *target,
+                                 struct i2c_msg *msgs, int num_msgs, int addr)
+{
+    struct lsm6ds3_emul_data *data = target->data;
+    k_spinlock_key_t key;
+    bool have_reg = false;
+    uint8_t reg = 0;
+    bool level;
+
+    key = k_spin_lock(&data->lock);
+
+    for (int m = 0; m < num_msgs; m++) {
+        for (uint32_t i = 0; i < msgs[m].len; i++) {
+            if (msgs[m].flags & I2C_MSG_READ) {
+                if (!have_reg) {
+                    k_spin_unlock(&data->lock, key);
+                    return -EIO;
+                }
+
+                msgs[m].buf[i] = read_reg(data, reg);
+                reg = next_reg(data, reg);
+            } else if (!have_reg) {
+                reg = msgs[m].buf[i] % NUM_REGS;
+                have_reg = true;
+            } else {
+                write_reg(data, reg, msgs[m].buf[i]);
+                reg = next_reg(data, reg);
+            }
+        }
+    }
+
+    level = int1_level(data);
+    k_spin_unlock(&data->lock, key);
+
+    set_int1(target, level);
+
+    return 0;
+}
+
+static const struct i2c_emul_api lsm6ds3_emul_bus_api = {
+    .transfer = lsm6ds3_emul_transfer,
+};
+
+/**
+ * @brief Output register and scale for a channel, in SI units per LSB.
+ */
+static int channel_info(const struct lsm6ds3_emul_data *data,
+                        enum sensor_channel chan, uint8_t *reg, double *scale,
+                        int8_t *shift)
+{
+    uint8_t accel_fs = data->regs[LSM6DS3_REG_CTRL1_XL] >> 2 & 0x03;
+    uint8_t ctrl2 = data->regs[LSM6DS3_REG_CTRL2_G];
+    uint8_t gyro_fs = (ctrl2 & BIT(1)) ? 4 : ctrl2 >> 2 & 0x03;
+
+    switch (chan) {
+        case SENSOR_CHAN_ACCEL_X:
+        case SENSOR_CHAN_ACCEL_Y:
+        case SENSOR_CHAN_ACCEL_Z:
+            *reg = LSM6DS3_REG_OUTX_L_XL + 2 * (chan - SENSOR_CHAN_ACCEL_X);
+            *scale = lsm6ds3_accel_ug_per_lsb(accel_fs) * 9.80665e-6;
+            *shift = ACCEL_SHIFT;
+            return 0;
+
+        case SENSOR_CHAN_GYRO_X:
+        case SENSOR_CHAN_GYRO_Y:
+        case SENSOR_CHAN_GYRO_Z:
+            *reg = LSM6DS3_REG_OUTX_L_G + 2 * (chan - SENSOR_CHAN_GYRO_X);
+            *scale = lsm6ds3_gyro_udps_per_lsb(gyro_fs) * 1e-6 * M_PI / 180;
+            *shift = GYRO_SHIFT;
+            return 0;
+
+        default:
+            return -ENOTSUP;
+    }
+}
+
+static int lsm6ds3_emul_set_channel(const struct emul *target,
+                                    struct sensor_chan_spec ch,
+                                    const q31_t *value, int8_t shift)
+{
+    struct lsm6ds3_emul_data *data = target->data;
+    k_spinlock_key_t key;
+    double scale, raw;
+    int8_t unused;
+    uint8_t reg;
+    int rc;
+
+    key = k_spin_lock(&data->lock);
+
+    rc = channel_info(data, ch.chan_type, &reg, &scale, &unused);
+    if (!rc) {
+        raw = ldexp(*value, shift - 31) / scale;
+        raw = CLAMP(round(raw), INT16_MIN, INT16_MAX);
+        sys_put_le16((int16_t)raw, &data->regs[reg]);
+    }
+
+    k_spin_unlock(&data->lock, key);
+
+    return rc;
+}
+
+static int lsm6ds3_emul_get_sample_range(const struct emul *target,
+                                         struct sensor_chan_spec ch,
+                                         q31_t *lower, q31_t *upper,
+                                         q31_t *epsilon, int8_t *shift)
+{
+    struct lsm6ds3_emul_data *data = target->data;
+    double scale;
+    uint8_t reg;
+    int rc;
+
+    rc = channel_info(data, ch.chan_type, &reg, &scale, shift);
+    if (rc)
+        return rc;
+
+    *lower = ldexp(INT16_MIN * scale, 31 - *shift);
+    *upper = ldexp(INT16_MAX * scale, 31 - *shift);
+    *epsilon = ldexp(scale, 31 - *shift);
+
+    return 0;
+}
+
+static const struct emul_sensor_driver_api lsm6ds3_emul_sensor_api = {
+    .set_channel = lsm6ds3_emul_set_channel,
+    .get_sample_range = lsm6ds3_emul_get_sample_range,
+};
+
+static int lsm6ds3_emul_init(const struct emul *target,
+                             const struct device *parent)
+{
+    struct lsm6ds3_emul_data *data = target->data;
+
+    ARG_UNUSED(parent);
+
+    data->target = target;
+    k_timer_init(&data->timer, timer_expiry, NULL);
+    reset(data);
+
+    return 0;
+}
+
+#define LSM6DS3_EMUL(n)                                                 \
+    static struct lsm6ds3_emul_data lsm6ds3_emul_data_##n;              \
+                                                                        \
+    static const struct lsm6ds3_emul_cfg lsm6ds3_emul_cfg_##n = {       \
+        .irq_gpio = GPIO_DT_SPEC_INST_GET_OR(n, irq_gpios, {0}),        \
+    };                                                                  \
+                                                                        \
+    EMUL_DT_INST_DEFINE(n, lsm6ds3_emul_init, &lsm6ds3_emul_data_##n,   \
+                        &lsm6ds3_emul_cfg_##n, &lsm6ds3_emul_bus_api,   \
+                        &lsm6ds3_emul_sensor_api);
+
+DT_INST_FOREACH_STATUS_OKAY(LSM6DS3_EMUL)
@@ -0,0 +1,158 @@
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/kernel.h>
+#include <zephyr/rtio/rtio.h>
+#include <zephyr/sys/byteorder.h>
+
+#include "lsm6ds3.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_DECLARE(lsm6ds3, CONFIG_SENSOR_LOG_LEVEL);
+
+/* Most sets the FIFO can hold, so one read can always empty it. */
+#define MAX_SETS (LSM6DS3_FIFO_WORDS / LSM6DS3_WORDS_PER_SET)
+
+/**
+ * @brief Fill a read's buffer with everything in the FIFO, or with the
+ * output registers if the FIFO's off or empty.
+ */
+static int fill(const struct device *dev, struct rtio_iodev_sqe *iodev_sqe,
+                uint8_t flags)
+{
+    struct lsm6ds3_data *data = dev->data;
+    const uint32_t min_len =
+        sizeof(struct lsm6ds3_encoded) + sizeof(struct lsm6ds3_sample);
+    const uint32_t max_len = sizeof(struct lsm6ds3_encoded) +
+                             MAX_SETS * sizeof(struct lsm6ds3_sample);
+    struct lsm6ds3_encoded *enc;
+    uint8_t *buf;
+    uint32_t len;
+    bool overrun = false;
+    int count = 0;
+
+    if (rtio_sqe_rx_buf(iodev_sqe, min_len, max_len, &buf, &len))
+        return -ENOMEM;
+
+    enc = (struct lsm6ds3_encoded *)buf;
+
+    if (data->fifo_enabled) {
+        count = lsm6ds3_fifo_read(dev, enc->sets,
+                                  (len - sizeof(*enc)) / sizeof(enc->sets[0]),
+                                  &overrun);
+        if (count < 0)
+            return count;
+    }
+
+    if (count == 0) {
+        struct lsm6ds3_sample *set = &enc->sets[0];
+
+        if (lsm6ds3_reg_read(dev, LSM6DS3_REG_OUTX_L_G, (uint8_t *)set,
+                             sizeof(*set)))
+            return -EIO;
+
+        for (int axis = 0; axis < 3; axis++) {
+            set->gyro[axis] = sys_le16_to_cpu(set->gyro[axis]);
+            set->accel[axis] = sys_le16_to_cpu(set->accel[axis]);
+        }
+        count = 1;
+    }
+
+    enc->timestamp_ns = k_ticks_to_ns_floor64(k_uptime_ticks());
+    enc->period_ns = lsm6ds3_odr_period_ns(data->gyro_odr);
+    enc->count = count;
+    enc->accel_fs = data->accel_fs;
+    enc->gyro_fs = data->gyro_fs;
+    enc->flags = flags | (overrun ? LSM6DS3_ENCODED_OVERRUN : 0);
+
+    return 0;
+}
+
+#ifdef CONFIG_LSM6DS3_TRIGGER
+void lsm6ds3_stream_irq(const struct device *dev)
+{
+    struct lsm6ds3_data *data = dev->data;
+    struct rtio_iodev_sqe *iodev_sqe = data->stream_sqe;
+    const struct sensor_read_config *read_cfg;
+    int rc = 0;
+
+    if (!iodev_sqe)
+        return;
+
+    /* A multishot read is handed straight back to submit() when it
+     * completes, which puts it back here for the next watermark. */
+    data->stream_sqe = NULL;
+    read_cfg = iodev_sqe->sqe.iodev->data;
+
+    switch (read_cfg->triggers[0].opt) {
+        case SENSOR_STREAM_DATA_DROP:
+            rc = lsm6ds3_fifo_config(dev, data->fifo_watermark);
+            break;
+
+        case SENSOR_STREAM_DATA_NOP:
+            break;
+
+        default:
+            rc = fill(dev, iodev_sqe, LSM6DS3_ENCODED_WATERMARK);
+            break;
+    }
+
+    if (rc) {
+        rtio_iodev_sqe_err(iodev_sqe, rc);
+    } else {
+        rtio_iodev_sqe_ok(iodev_sqe, 0);
+    }
+}
+#endif
+
+static int submit_stream(const struct device *dev,
+                         struct rtio_iodev_sqe *iodev_sqe)
+{
+#ifdef CONFIG_LSM6DS3_TRIGGER
+    const struct lsm6ds3_config *cfg = dev->config;
+    struct lsm6ds3_data *data = dev->data;
+    const struct sensor_read_config *read_cfg = iodev_sqe->sqe.iodev->data;
+    int rc;
+
+    /* Streaming is driven by the FIFO watermark, and nothing else. */
+    if (!cfg->irq_gpio.port || !data->fifo_enabled || read_cfg->count != 1 ||
+        read_cfg->triggers[0].trigger != SENSOR_TRIG_FIFO_WATERMARK)
+        return -ENOTSUP;
+
+    data->stream_sqe = iodev_sqe;
+
+    if (!(data->int1_ctrl & LSM6DS3_INT1_FTH)) {
+        rc = lsm6ds3_reg_write(dev, LSM6DS3_REG_INT1_CTRL,
+                               data->int1_ctrl | LSM6DS3_INT1_FTH);
+        if (rc) {
+            data->stream_sqe = NULL;
+            return -EIO;
+        }
+        data->int1_ctrl |= LSM6DS3_INT1_FTH;
+    }
+
+    return 0;
+#else
+    return -ENOTSUP;
+#endif
+}
+
+void lsm6ds3_submit(const struct device *dev, struct rtio_iodev_sqe *iodev_sqe)
+{
+    const struct sensor_read_config *read_cfg = iodev_sqe->sqe.iodev->data;
+    int rc;
+
+    if (read_cfg->is_streaming) {
+        rc = submit_stream(dev, iodev_sqe);
+        if (rc)
+            rtio_iodev_sqe_err(iodev_sqe, rc);
+        return;
+    }
+
+    /* A one-shot read gets every set there is, whatever channels it asked
+     * for - the decoder picks out the ones that are wanted. */
+    rc = fill(dev, iodev_sqe, 0);
+    if (rc) {
+        rtio_iodev_sqe_err(iodev_sqe, rc);
+    } else {
+        rtio_iodev_sqe_ok(iodev_sqe, 0);
+    }
+}
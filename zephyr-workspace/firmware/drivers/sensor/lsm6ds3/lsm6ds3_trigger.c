@@ -0,0 +1,151 @@
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/kernel.h>
+
+#include "lsm6ds3.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_DECLARE(lsm6ds3, CONFIG_SENSOR_LOG_LEVEL);
+
+/* How many times the handlers get to bring INT1 back down before we give
+ * up and empty the FIFO ourselves. */
+#define MAX_IRQ_PASSES 8
+
+static int update_int1(const struct device *dev, uint8_t set, uint8_t clear)
+{
+    struct lsm6ds3_data *data = dev->data;
+    uint8_t int1_ctrl = (data->int1_ctrl & ~clear) | set;
+    int rc;
+
+    if (int1_ctrl == data->int1_ctrl)
+        return 0;
+
+    rc = lsm6ds3_reg_write(dev, LSM6DS3_REG_INT1_CTRL, int1_ctrl);
+    if (rc)
+        return -EIO;
+
+    data->int1_ctrl = int1_ctrl;
+
+    return 0;
+}
+
+int lsm6ds3_trigger_set(const struct device *dev,
+                        const struct sensor_trigger *trig,
+                        sensor_trigger_handler_t handler)
+{
+    const struct lsm6ds3_config *cfg = dev->config;
+    struct lsm6ds3_data *data = dev->data;
+    uint8_t bit;
+
+    if (!cfg->irq_gpio.port)
+        return -ENOTSUP;
+
+    switch (trig->type) {
+        case SENSOR_TRIG_DATA_READY:
+            data->drdy_handler = handler;
+            data->drdy_trigger = trig;
+            bit = LSM6DS3_INT1_DRDY_G;
+            break;
+
+        case SENSOR_TRIG_FIFO_WATERMARK:
+            if (!data->fifo_enabled)
+                return -EINVAL;
+
+            data->fifo_handler = handler;
+            data->fifo_trigger = trig;
+            bit = LSM6DS3_INT1_FTH;
+            break;
+
+        default:
+            return -ENOTSUP;
+    }
+
+    return handler ? update_int1(dev, bit, 0) : update_int1(dev, 0, bit);
+}
+
+static void handle_irq(const struct device *dev)
+{
+    struct lsm6ds3_data *data = dev->data;
+
+    if (data->drdy_handler)
+        data->drdy_handler(dev, data->drdy_trigger);
+
+    if (data->fifo_handler)
+        data->fifo_handler(dev, data->fifo_trigger);
+
+#ifdef CONFIG_SENSOR_ASYNC_API
+    lsm6ds3_stream_irq(dev);
+#endif
+}
+
+static void lsm6ds3_thread(void *p1, void *p2, void *p3)
+{
+    const struct device *dev = p1;
+    const struct lsm6ds3_config *cfg = dev->config;
+    struct lsm6ds3_data *data = dev->data;
+    int passes;
+
+    while (1) {
+        k_sem_take(&data->irq_sem, K_FOREVER);
+
+        /* The EXTI only sees edges, so keep going while the pin is still
+         * active or we'd never hear about it again. */
+        for (passes = 0; passes < MAX_IRQ_PASSES; passes++) {
+            handle_irq(dev);
+
+            if (gpio_pin_get_dt(&cfg->irq_gpio) <= 0)
+                break;
+        }
+
+        if (passes == MAX_IRQ_PASSES && data->fifo_enabled) {
+            LOG_WRN("%s: Nothing is reading the FIFO", dev->name);
+            lsm6ds3_fifo_config(dev, data->fifo_watermark);
+        }
+    }
+}
+
+static void gpio_callback(const struct device *port, struct gpio_callback *cb,
+                          uint32_t pins)
+{
+    struct lsm6ds3_data *data = CONTAINER_OF(cb, struct lsm6ds3_data,
+                                             gpio_cb);
+
+    k_sem_give(&data->irq_sem);
+}
+
+int lsm6ds3_trigger_init(const struct device *dev)
+{
+    const struct lsm6ds3_config *cfg = dev->config;
+    struct lsm6ds3_data *data = dev->data;
+    int rc;
+
+    if (!gpio_is_ready_dt(&cfg->irq_gpio)) {
+        LOG_ERR("%s: Interrupt GPIO not ready", dev->name);
+        return -ENODEV;
+    }
+
+    k_sem_init(&data->irq_sem, 0, 1);
+
+    rc = update_int1(dev, 0, 0xff);
+    if (rc)
+        return rc;
+
+    rc = gpio_pin_configure_dt(&cfg->irq_gpio, GPIO_INPUT);
+    if (rc)
+        return rc;
+
+    gpio_init_callback(&data->gpio_cb, gpio_callback, BIT(cfg->irq_gpio.pin));
+
+    rc = gpio_add_callback(cfg->irq_gpio.port, &data->gpio_cb);
+    if (rc)
+        return rc;
+
+    k_thread_create(&data->thread, data->thread_stack,
+                    CONFIG_LSM6DS3_THREAD_STACK_SIZE, lsm6ds3_thread,
+                    (void *)dev, NULL, NULL,
+                    K_PRIO_COOP(CONFIG_LSM6DS3_THREAD_PRIORITY), 0, K_NO_WAIT);
+    k_thread_name_set(&data->thread, dev->name);
+
+    return gpio_pin_interrupt_configure_dt(&cfg->irq_gpio,
+                                           GPIO_INT_EDGE_TO_ACTIVE);
+}
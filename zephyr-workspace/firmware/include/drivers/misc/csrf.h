@@ -2,19 +2,143 @@
 #define ZEPHYR_DRIVERS_MISC_CSRF_H_
 
 #include <stdint.h>
+#include <string.h>
 #include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+
+/* Telemetry frame types we can send to the radio. */
+#define CSRF_FRAME_BATTERY 0x08
+#define CSRF_FRAME_ATTITUDE 0x1e
+#define CSRF_FRAME_FLIGHT_MODE 0x21
+
+/* Device protocol frames. Their payload starts with the address of the
+ * device they're for, then the one they're from. */
+#define CSRF_FRAME_DEVICE_PING 0x28
+#define CSRF_FRAME_DEVICE_INFO 0x29
+#define CSRF_FRAME_PARAMETER_ENTRY 0x2b
+#define CSRF_FRAME_PARAMETER_READ 0x2c
+#define CSRF_FRAME_PARAMETER_WRITE 0x2d
+
+/* Link statistics from the receiver, sent in between RC frames. */
+#define CSRF_FRAME_LINK_STATISTICS 0x14
+#define CSRF_LINK_STATISTICS_PAYLOAD_LEN 10
+
+/* Longest payload that fits in a frame. */
+#define CSRF_MAX_PAYLOAD_LEN 60
+
+/**
+ * @brief When a frame passed through the driver, in k_cycle_get_32() cycles.
+ */
+struct csrf_frame_timestamps
+{
+    /* The sync byte arrived, worked back from when the UART handed it
+     * over at the UART's baud rate. */
+    uint32_t rx;
+    /* The parser had every octet of the frame. */
+    uint32_t frame;
+    /* The CRC checked out. */
+    uint32_t crc;
+};
 
 struct csrf_channel_data
 {
     uint16_t ch[16];
+    struct csrf_frame_timestamps ts;
 };
 
+/* Called once per valid RC channels or subset RC channels frame, from the
+ * CSRF thread. Channels a subset frame didn't carry keep their last value. */
 typedef void (*csrf_channel_callback_t)(const struct csrf_channel_data *data);
 
+/* Called with each device ping, parameter read and parameter write, from
+ * the CSRF thread, whoever they're addressed to. This holds up the RC
+ * frames behind it, so it mustn't do more than queue the frame. */
+typedef void (*csrf_device_callback_t)(uint8_t type, const uint8_t *payload,
+                                       size_t len);
+
+/**
+ * @brief The receiver's view of the link.
+ */
+struct csrf_link_stats
+{
+    /* Uplink is from the handset. RSSI is in -dBm. */
+    uint8_t uplink_rssi[2];
+    /* Percent of packets received. */
+    uint8_t uplink_lq;
+    /* In dB. */
+    int8_t uplink_snr;
+    uint8_t active_antenna;
+    uint8_t rf_mode;
+    uint8_t uplink_power;
+    uint8_t downlink_rssi;
+    uint8_t downlink_lq;
+    int8_t downlink_snr;
+};
+
+/* Called with each link statistics frame, from the CSRF thread. */
+typedef void (*csrf_link_callback_t)(const struct csrf_link_stats *stats);
+
+/**
+ * @brief Battery sensor telemetry.
+ */
+struct csrf_battery
+{
+    /* In 0.1 V. */
+    uint16_t voltage;
+    /* In 0.1 A. */
+    uint16_t current;
+    /* Used so far, in mAh. Only 24 bits are sent. */
+    uint32_t capacity;
+    /* Percent. */
+    uint8_t remaining;
+};
+
+/**
+ * @brief Attitude telemetry, in 100 urad.
+ */
+struct csrf_attitude
+{
+    int16_t pitch;
+    int16_t roll;
+    int16_t yaw;
+};
+
+/**
+ * @brief What the driver's received and sent, since it started.
+ */
+struct csrf_stats
+{
+    /* UART interrupts, or in DMA mode the received spans handed over. */
+    uint32_t rx_irqs;
+    uint32_t rx_octets;
+    /* Octets lost because the thread wasn't keeping up. */
+    uint32_t rx_overflow;
+    /* Framing, parity, noise and overrun errors on the line. */
+    uint32_t rx_errors;
+
+    /* Frames that passed the CRC check, and those thrown away by why. */
+    uint32_t frames;
+    uint32_t unhandled;
+    uint32_t bad_crc;
+    uint32_t bad_len;
+    /* Octets thrown away while looking for a sync byte. */
+    uint32_t noise;
+
+    /* Telemetry frames refused because every buffer was queued. */
+    uint32_t tx_full;
+};
+
 struct csrf_driver_api
 {
     int (*set_channel_callback)(const struct device *dev,
                                 csrf_channel_callback_t callback);
+    int (*send_frame)(const struct device *dev, uint8_t type,
+                      const uint8_t *payload, size_t len);
+    int (*set_device_callback)(const struct device *dev,
+                               csrf_device_callback_t callback);
+    int (*set_link_callback)(const struct device *dev,
+                             csrf_link_callback_t callback);
+    int (*get_stats)(const struct device *dev, struct csrf_stats *stats);
 };
 
 static inline int csrf_set_channel_callback(const struct device *dev,
@@ -29,4 +153,107 @@ static inline int csrf_set_channel_callback(const struct device *dev,
     return api->set_channel_callback(dev, callback);
 }
 
+static inline int csrf_set_device_callback(const struct device *dev,
+                                           csrf_device_callback_t callback)
+{
+    const struct csrf_driver_api *api = dev->api;
+
+    if (api == NULL || api->set_device_callback == NULL) {
+        return -ENOTSUP;
+    }
+
+    return api->set_device_callback(dev, callback);
+}
+
+static inline int csrf_set_link_callback(const struct device *dev,
+                                         csrf_link_callback_t callback)
+{
+    const struct csrf_driver_api *api = dev->api;
+
+    if (api == NULL || api->set_link_callback == NULL) {
+        return -ENOTSUP;
+    }
+
+    return api->set_link_callback(dev, callback);
+}
+
+/**
+ * @brief Take a copy of the driver's counters.
+ *
+ * Each counter has a single writer and is never locked, so they're cheap
+ * enough to leave counting, but the copy can be an octet or a frame out
+ * between one counter and the next.
+ */
+static inline int csrf_get_stats(const struct device *dev,
+                                 struct csrf_stats *stats)
+{
+    const struct csrf_driver_api *api = dev->api;
+
+    if (api == NULL || api->get_stats == NULL) {
+        return -ENOTSUP;
+    }
+
+    return api->get_stats(dev, stats);
+}
+
+/**
+ * @brief Queue a frame to go to the radio.
+ *
+ * This never blocks. The frame is built straight away and sent by DMA in
+ * the gap after the next RC frame, so it can't collide with control data.
+ *
+ * @retval -ENOMEM if every telemetry buffer is already queued.
+ */
+static inline int csrf_send_frame(const struct device *dev, uint8_t type,
+                                  const uint8_t *payload, size_t len)
+{
+    const struct csrf_driver_api *api = dev->api;
+
+    if (api == NULL || api->send_frame == NULL) {
+        return -ENOTSUP;
+    }
+
+    if (len > CSRF_MAX_PAYLOAD_LEN) {
+        return -EINVAL;
+    }
+
+    return api->send_frame(dev, type, payload, len);
+}
+
+static inline int csrf_send_battery(const struct device *dev,
+                                    const struct csrf_battery *battery)
+{
+    uint8_t payload[8];
+
+    sys_put_be16(battery->voltage, &payload[0]);
+    sys_put_be16(battery->current, &payload[2]);
+    sys_put_be24(battery->capacity, &payload[4]);
+    payload[7] = battery->remaining;
+
+    return csrf_send_frame(dev, CSRF_FRAME_BATTERY, payload, sizeof(payload));
+}
+
+static inline int csrf_send_attitude(const struct device *dev,
+                                     const struct csrf_attitude *attitude)
+{
+    uint8_t payload[6];
+
+    sys_put_be16(attitude->pitch, &payload[0]);
+    sys_put_be16(attitude->roll, &payload[2]);
+    sys_put_be16(attitude->yaw, &payload[4]);
+
+    return csrf_send_frame(dev, CSRF_FRAME_ATTITUDE, payload, sizeof(payload));
+}
+
+/**
+ * @brief Send the flight mode - the handset shows this as a short string.
+ */
+static inline int csrf_send_flight_mode(const struct device *dev,
+                                        const char *mode)
+{
+    /* The terminator is sent too. */
+    return csrf_send_frame(dev, CSRF_FRAME_FLIGHT_MODE, (const uint8_t *)mode,
+                           strlen(mode) + 1);
+}
+
 #endif
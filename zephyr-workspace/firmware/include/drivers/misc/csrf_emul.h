@@ -0,0 +1,66 @@
+#ifndef ZEPHYR_DRIVERS_MISC_CSRF_EMUL_H_
+#define ZEPHYR_DRIVERS_MISC_CSRF_EMUL_H_
+
+/*
+ * An emulated ELRS receiver for native_sim, playing RC frames into a UART
+ * emulator for the CSRF driver to read, with the noise and dropouts of a
+ * real link.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <zephyr/device.h>
+
+/**
+ * @brief The radio link, as set from the devicetree at boot.
+ */
+struct csrf_emul_link
+{
+    /* RC frames a second, and how far either way each gap can wander. */
+    uint32_t rate_hz;
+    uint32_t jitter_us;
+    /* Chance of each bit on the serial line being flipped, per million. */
+    uint32_t bit_error_ppm;
+    /* Chance of each frame starting a dropout, in percent, and the average
+     * number of frames it loses. */
+    uint32_t drop_percent;
+    uint32_t drop_burst;
+};
+
+struct csrf_emul_stats
+{
+    /* RC frame slots, and the frames that went out in them. */
+    uint32_t slots;
+    uint32_t frames;
+    uint32_t dropped;
+    /* Slots with at least one bit flipped. */
+    uint32_t corrupted;
+    /* Octets the UART emulator wouldn't take, because the driver wasn't
+     * keeping up. */
+    uint32_t overrun;
+    /* Good frames the driver sent back. */
+    uint32_t telemetry;
+};
+
+/**
+ * @brief Change the link from the next slot on. The statistics carry on.
+ */
+extern void csrf_emul_set_link(const struct device *dev,
+                               const struct csrf_emul_link *link);
+
+/**
+ * @brief The sticks and switches to send, 16 channels of 11 bits.
+ */
+extern void csrf_emul_set_channels(const struct device *dev,
+                                   const uint16_t *ch);
+
+/**
+ * @brief Stop sending anything, as when the transmitter's switched off or
+ * out of range, or start again.
+ */
+extern void csrf_emul_set_running(const struct device *dev, bool running);
+
+extern void csrf_emul_get_stats(const struct device *dev,
+                                struct csrf_emul_stats *stats);
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef ZEPHYR_DRIVERS_MISC_DSHOT_H_
+#define ZEPHYR_DRIVERS_MISC_DSHOT_H_
+
+#include <stdint.h>
+#include <zephyr/device.h>
+
+/* Throttle runs from 0 (stopped) to this. */
+#define DSHOT_THROTTLE_RANGE 2000
+
+/* Commands the ESC will act on while the throttle is 0. */
+#define DSHOT_CMD_BEEP1 1
+#define DSHOT_CMD_SPIN_DIRECTION_NORMAL 20
+#define DSHOT_CMD_SPIN_DIRECTION_REVERSED 21
+
+struct dshot_driver_api
+{
+    int (*set_throttle)(const struct device *dev, uint16_t throttle);
+    int (*send_command)(const struct device *dev, uint8_t command);
+    int (*get_erpm)(const struct device *dev, uint32_t *erpm);
+    int (*get_rpm)(const struct device *dev, uint32_t *rpm);
+};
+
+/**
+ * @brief Set the throttle, from 0 to DSHOT_THROTTLE_RANGE.
+ *
+ * This doesn't block. The value goes out in the next frame.
+ */
+static inline int dshot_set_throttle(const struct device *dev,
+                                     uint16_t throttle)
+{
+    const struct dshot_driver_api *api = dev->api;
+
+    if (api == NULL || api->set_throttle == NULL) {
+        return -ENOTSUP;
+    }
+
+    if (throttle > DSHOT_THROTTLE_RANGE) {
+        return -EINVAL;
+    }
+
+    return api->set_throttle(dev, throttle);
+}
+
+/**
+ * @brief Send a command in place of the throttle, repeated as the ESC
+ * needs it to be.
+ *
+ * @retval -EBUSY if the throttle isn't 0, or a command is still going out.
+ */
+static inline int dshot_send_command(const struct device *dev,
+                                     uint8_t command)
+{
+    const struct dshot_driver_api *api = dev->api;
+
+    if (api == NULL || api->send_command == NULL) {
+        return -ENOTSUP;
+    }
+
+    return api->send_command(dev, command);
+}
+
+/**
+ * @brief The last electrical RPM the ESC reported over bidirectional DShot.
+ *
+ * @retval -ENODATA if there hasn't been a good reply recently.
+ */
+static inline int dshot_get_erpm(const struct device *dev, uint32_t *erpm)
+{
+    const struct dshot_driver_api *api = dev->api;
+
+    if (api == NULL || api->get_erpm == NULL) {
+        return -ENOTSUP;
+    }
+
+    return api->get_erpm(dev, erpm);
+}
+
+/**
+ * @brief The last mechanical RPM, using the motor's pole count.
+ */
+static inline int dshot_get_rpm(const struct device *dev, uint32_t *rpm)
+{
+    const struct dshot_driver_api *api = dev->api;
+
+    if (api == NULL || api->get_rpm == NULL) {
+        return -ENOTSUP;
+    }
+
+    return api->get_rpm(dev, rpm);
+}
+
+#endif
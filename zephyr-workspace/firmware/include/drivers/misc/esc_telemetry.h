@@ -0,0 +1,77 @@
+#ifndef ZEPHYR_DRIVERS_MISC_ESC_TELEMETRY_H_
+#define ZEPHYR_DRIVERS_MISC_ESC_TELEMETRY_H_
+
+#include <stdint.h>
+#include <zephyr/device.h>
+
+/**
+ * @brief The latest telemetry from an ESC.
+ */
+struct esc_telemetry_sample
+{
+    /* Degrees C. */
+    uint8_t temperature;
+    /* In 10 mV. */
+    uint16_t voltage;
+    /* In 10 mA. */
+    uint16_t current;
+    /* Used so far, in mAh. */
+    uint16_t consumption;
+    /* Electrical RPM, to the nearest 100. */
+    uint32_t erpm;
+
+    /* k_cycle_get_32() when the frame arrived. */
+    uint32_t stamp;
+};
+
+struct esc_telemetry_stats
+{
+    uint32_t frames;
+    uint32_t bad_crc;
+    uint32_t noise;
+};
+
+struct esc_telemetry_driver_api
+{
+    int (*get)(const struct device *dev, struct esc_telemetry_sample *sample);
+    int (*get_stats)(const struct device *dev,
+                     struct esc_telemetry_stats *stats);
+};
+
+/**
+ * @brief Copy out the latest sample.
+ *
+ * This never blocks and takes no locks, so it's fine to call from the
+ * control loop on every frame. The receiver publishes each sample with a
+ * sequence count, and a read that overlaps a new sample is just retried.
+ *
+ * @retval -ENODATA if there hasn't been a good frame recently.
+ */
+static inline int esc_telemetry_get(const struct device *dev,
+                                    struct esc_telemetry_sample *sample)
+{
+    const struct esc_telemetry_driver_api *api = dev->api;
+
+    if (api == NULL || api->get == NULL) {
+        return -ENOTSUP;
+    }
+
+    return api->get(dev, sample);
+}
+
+/**
+ * @brief Frame counts since boot.
+ */
+static inline int esc_telemetry_get_stats(const struct device *dev,
+                                          struct esc_telemetry_stats *stats)
+{
+    const struct esc_telemetry_driver_api *api = dev->api;
+
+    if (api == NULL || api->get_stats == NULL) {
+        return -ENOTSUP;
+    }
+
+    return api->get_stats(dev, stats);
+}
+
+#endif
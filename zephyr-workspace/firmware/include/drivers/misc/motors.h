@@ -0,0 +1,50 @@
+#ifndef ZEPHYR_DRIVERS_MISC_MOTORS_H_
+#define ZEPHYR_DRIVERS_MISC_MOTORS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <zephyr/device.h>
+
+#define MOTORS_NUM_CHANNELS 4
+
+/* Duty cycle for a motor that's fully on. */
+#define MOTORS_DUTY_MAX (1 << 15)
+
+/**
+ * @brief Everything the drive motors need for one frame.
+ */
+struct motors_output
+{
+    /* 0 to MOTORS_DUTY_MAX. */
+    uint16_t duty[MOTORS_NUM_CHANNELS];
+    /* Logical level of each direction pin. */
+    bool dir[MOTORS_NUM_CHANNELS];
+    /* Put the motor drivers to sleep. */
+    bool sleep;
+};
+
+struct motors_driver_api
+{
+    int (*set)(const struct device *dev, const struct motors_output *out);
+};
+
+/**
+ * @brief Set every motor output at once.
+ *
+ * The duty cycles, direction pins and sleep pin all change together at the
+ * start of the next PWM period, so the motors never see a mix of old and new
+ * outputs. This doesn't wait for that to happen.
+ */
+static inline int motors_set(const struct device *dev,
+                             const struct motors_output *out)
+{
+    const struct motors_driver_api *api = dev->api;
+
+    if (api == NULL || api->set == NULL) {
+        return -ENOTSUP;
+    }
+
+    return api->set(dev, out);
+}
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef ZEPHYR_DRIVERS_MISC_OUTPUT_CAPTURE_H_
+#define ZEPHYR_DRIVERS_MISC_OUTPUT_CAPTURE_H_
+
+/*
+ * A timestamped record of what the emulated outputs did - pin levels, PWM
+ * pulses and ESC throttles - so a test can see what the robot drove, and
+ * when, without a logic analyser.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/device.h>
+
+struct output_edge
+{
+    /* Nanoseconds since boot, from the cycle counter. */
+    uint64_t ns;
+    /* The device that changed, and which of its outputs. */
+    const struct device *dev;
+    uint16_t channel;
+    /* Pin level, pulse width in ns, or throttle, by the kind of device. */
+    uint32_t value;
+};
+
+struct output_capture_stats
+{
+    uint32_t recorded;
+    /* Changes lost because nobody read the record in time. */
+    uint32_t dropped;
+};
+
+#ifdef CONFIG_DAN_OUTPUT_CAPTURE
+
+/**
+ * @brief Note that an output changed, now. Safe from interrupts.
+ */
+extern void output_capture_record(const struct device *dev, uint16_t channel,
+                                  uint32_t value);
+
+/**
+ * @brief Take the oldest changes from the record.
+ *
+ * @return How many went in edges.
+ */
+extern size_t output_capture_read(struct output_edge *edges, size_t max);
+
+extern void output_capture_clear(void);
+
+extern void output_capture_get_stats(struct output_capture_stats *stats);
+
+#else
+
+static inline void output_capture_record(const struct device *dev,
+                                         uint16_t channel, uint32_t value)
+{
+}
+
+#endif /* CONFIG_DAN_OUTPUT_CAPTURE */
+
+#endif
@@ -0,0 +1,201 @@
+#include "attitude.h"
+
+#include <stddef.h>
+
+/* The up vector is kept as Q30, so slow turns aren't lost to rounding. */
+#define Q30_ONE (1 << 30)
+
+/* pi / 180000 * 2^40: mdps to radians per second, as Q40. */
+#define MDPS_TO_RAD_Q40 19190098LL
+
+/* The accelerometer only counts if it reads between these, in mg. A hit or
+ * hard acceleration would drag the estimate off. */
+#define ACCEL_MIN_MG 700
+#define ACCEL_MAX_MG 1300
+
+/* atan(x) ~= 45 x - x (x - 1) (14.02 + 3.80 x) degrees, for 0 <= x <= 1. */
+#define ATAN_A 4500
+#define ATAN_B 1402
+#define ATAN_C 380
+
+void attitude_config_default(struct attitude_config *config)
+{
+    *config = (struct attitude_config){
+        .rate_hz = 500,
+        .accel_tau_ms = 250,
+        .invert_threshold = ATTITUDE_Q14_ONE * 3 / 10,
+        .invert_ms = 10,
+    };
+}
+
+/**
+ * @brief Integer square root, always 16 steps.
+ */
+static uint32_t isqrt32(uint32_t v)
+{
+    uint32_t root = 0;
+
+    for (uint32_t bit = 1u << 30; bit; bit >>= 2) {
+        uint32_t trial = root + bit;
+
+        root >>= 1;
+        if (v >= trial) {
+            v -= trial;
+            root += bit;
+        }
+    }
+
+    return root;
+}
+
+int32_t attitude_atan2(int32_t y, int32_t x)
+{
+    int64_t ay = y < 0 ? -(int64_t)y : y;
+    int64_t ax = x < 0 ? -(int64_t)x : x;
+    int64_t r, a;
+
+    if (ax == 0 && ay == 0)
+        return 0;
+
+    /* Fold into the first octant, with r = min / max as Q15. */
+    r = ((ax < ay ? ax : ay) << 15) / (ax < ay ? ay : ax);
+    a = ATAN_A * r -
+        ((r * (r - 32768)) >> 15) * (ATAN_B + ((ATAN_C * r) >> 15));
+    a >>= 15;
+
+    if (ay > ax)
+        a = 9000 - a;
+    if (x < 0)
+        a = 18000 - a;
+
+    return y < 0 ? -a : a;
+}
+
+void attitude_init(struct attitude *att, const struct attitude_config *config)
+{
+    uint32_t rate_hz = config->rate_hz ? config->rate_hz : 1;
+    uint64_t tau_ticks = (uint64_t)config->accel_tau_ms * rate_hz;
+
+    /* Q40 / rate is radians per tick as Q40, so >> 10 gives Q30. */
+    att->gyro_k = MDPS_TO_RAD_Q40 / rate_hz;
+    att->alpha = tau_ticks ? (32768ULL * 1000) / tau_ticks : 32768;
+    att->alpha = att->alpha > 32768 ? 32768 : att->alpha;
+    att->invert_threshold = config->invert_threshold;
+    att->invert_ticks = (config->invert_ms * rate_hz + 999) / 1000;
+
+    att->state = (struct attitude_state){0};
+
+    /* Until there's data, assume it's sitting the right way up. */
+    att->up[0] = 0;
+    att->up[1] = 0;
+    att->up[2] = Q30_ONE;
+    att->past_threshold = 0;
+}
+
+/**
+ * @brief Unit vector along the accelerometer reading as Q30, or false if
+ * the reading is too far from 1 g to be gravity.
+ */
+static bool accel_direction(const int32_t *accel_mg, int32_t *dir)
+{
+    int64_t n2 = (int64_t)accel_mg[0] * accel_mg[0] +
+                 (int64_t)accel_mg[1] * accel_mg[1] +
+                 (int64_t)accel_mg[2] * accel_mg[2];
+    uint32_t n;
+
+    if (n2 < ACCEL_MIN_MG * ACCEL_MIN_MG || n2 > ACCEL_MAX_MG * ACCEL_MAX_MG)
+        return false;
+
+    n = isqrt32(n2);
+
+    for (int i = 0; i < 3; i++)
+        dir[i] = (int64_t)accel_mg[i] * Q30_ONE / n;
+
+    return true;
+}
+
+static void update_state(struct attitude *att)
+{
+    struct attitude_state *s = &att->state;
+    int32_t up[3];
+    uint32_t yz;
+
+    for (int i = 0; i < 3; i++) {
+        up[i] = att->up[i] >> 16;
+        s->up[i] = up[i];
+    }
+
+    yz = isqrt32(up[1] * up[1] + up[2] * up[2]);
+    s->roll = attitude_atan2(up[1], up[2]);
+    s->pitch = attitude_atan2(-up[0], yz);
+
+    /* Hysteresis both on the level and on how long it's held there. */
+    if (s->inverted ? up[2] > att->invert_threshold
+                    : up[2] < -att->invert_threshold) {
+        if (++att->past_threshold >= att->invert_ticks) {
+            s->inverted = !s->inverted;
+            s->flips++;
+            att->past_threshold = 0;
+        }
+    } else {
+        att->past_threshold = 0;
+    }
+}
+
+void attitude_reset(struct attitude *att, const int32_t *accel_mg)
+{
+    int32_t dir[3];
+
+    if (!accel_direction(accel_mg, dir))
+        return;
+
+    for (int i = 0; i < 3; i++) att->up[i] = dir[i];
+
+    /* No waiting about - this is what it's sitting on. */
+    att->state.inverted = dir[2] < 0;
+    att->past_threshold = 0;
+    update_state(att);
+}
+
+void attitude_update(struct attitude *att, const int32_t *gyro_mdps,
+                     const int32_t *accel_mg)
+{
+    int32_t *u = att->up;
+    int32_t t[3], dir[3], next[3];
+    int64_t n2;
+
+    /* How far the robot turned this tick, in radians as Q30. A vector
+     * that's fixed in the world turns the other way in the robot's frame:
+     * du = u x theta. */
+    for (int i = 0; i < 3; i++)
+        t[i] = ((int64_t)gyro_mdps[i] * att->gyro_k) >> 10;
+
+    next[0] = u[0] + (((int64_t)u[1] * t[2] - (int64_t)u[2] * t[1]) >> 30);
+    next[1] = u[1] + (((int64_t)u[2] * t[0] - (int64_t)u[0] * t[2]) >> 30);
+    next[2] = u[2] + (((int64_t)u[0] * t[1] - (int64_t)u[1] * t[0]) >> 30);
+
+    if (accel_direction(accel_mg, dir)) {
+        for (int i = 0; i < 3; i++)
+            next[i] += ((int64_t)(dir[i] - next[i]) * att->alpha) >> 15;
+    } else {
+        att->state.accel_rejects++;
+    }
+
+    /* One Newton step towards unit length: u *= (3 - |u|^2) / 2. */
+    n2 = (((int64_t)next[0] * next[0]) >> 30) +
+         (((int64_t)next[1] * next[1]) >> 30) +
+         (((int64_t)next[2] * next[2]) >> 30);
+
+    for (int i = 0; i < 3; i++)
+        u[i] = ((int64_t)next[i] * (3LL * Q30_ONE - n2)) >> 31;
+
+    update_state(att);
+}
+
+int32_t attitude_yaw_rate(const struct attitude *att, const int32_t *gyro_mdps)
+{
+    return ((int64_t)gyro_mdps[0] * att->up[0] +
+            (int64_t)gyro_mdps[1] * att->up[1] +
+            (int64_t)gyro_mdps[2] * att->up[2]) >>
+           30;
+}
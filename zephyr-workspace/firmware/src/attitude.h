@@ -0,0 +1,102 @@
+#ifndef ATTITUDE_H
+#define ATTITUDE_H
+
+/*
+ * Attitude estimator. A complementary filter on the direction of "up" in
+ * the robot's frame: the gyro turns it every tick, and the accelerometer
+ * pulls it back towards gravity whenever the robot isn't being thrown
+ * about. That's all it takes to tell which way up the robot is, and to
+ * give roll and pitch for telemetry. Heading isn't tracked.
+ *
+ * The robot's frame is x forward, y left and z up. Fixed point throughout,
+ * with no data dependent loops.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* 1.0 in the Q14 up vector. */
+#define ATTITUDE_Q14_ONE (1 << 14)
+
+struct attitude_config
+{
+    /* How often attitude_update() is called. */
+    uint32_t rate_hz;
+    /* Time constant for the pull towards the accelerometer. */
+    uint32_t accel_tau_ms;
+    /* The robot counts as upside down once up's z component goes below
+     * minus this, and as the right way up again once it goes above it, as
+     * Q14. */
+    int32_t invert_threshold;
+    /* How long it has to stay past the threshold. */
+    uint32_t invert_ms;
+};
+
+/**
+ * @brief The estimate, for telemetry and logging.
+ */
+struct attitude_state
+{
+    /* Unit vector pointing up, in the robot's frame, as Q14. */
+    int16_t up[3];
+    /* In hundredths of a degree. */
+    int16_t roll;
+    int16_t pitch;
+    bool inverted;
+    /* How many times it's changed which way up it is. */
+    uint16_t flips;
+    /* Ticks where the accelerometer was ignored because of a hit. */
+    uint32_t accel_rejects;
+};
+
+struct attitude
+{
+    struct attitude_state state;
+
+    int32_t up[3];
+
+    /* Gyro mdps to Q14 radians per tick, as Q26. */
+    int32_t gyro_k;
+    /* Accelerometer pull per tick, as Q15. */
+    int32_t alpha;
+    int32_t invert_threshold;
+    uint32_t invert_ticks;
+
+    uint32_t past_threshold;
+};
+
+extern void attitude_config_default(struct attitude_config *config);
+
+extern void attitude_init(struct attitude *att,
+                          const struct attitude_config *config);
+
+/**
+ * @brief Start again from what the accelerometer says, for when the robot's
+ * sitting still.
+ */
+extern void attitude_reset(struct attitude *att, const int32_t *accel_mg);
+
+/**
+ * @brief Run one tick.
+ *
+ * @param gyro_mdps Body rates, in millidegrees per second.
+ * @param accel_mg Specific force, in thousandths of a g. Sitting the right
+ * way up this is +1000 on z.
+ */
+extern void attitude_update(struct attitude *att, const int32_t *gyro_mdps,
+                            const int32_t *accel_mg);
+
+/**
+ * @brief Rate of turn about the world's vertical, in mdps.
+ *
+ * Positive is anticlockwise seen from above, whichever way up the robot is.
+ */
+extern int32_t attitude_yaw_rate(const struct attitude *att,
+                                 const int32_t *gyro_mdps);
+
+/**
+ * @brief atan2 in hundredths of a degree, good to about 0.1 degrees.
+ */
+extern int32_t attitude_atan2(int32_t y, int32_t x);
+
+#endif /* ATTITUDE_H */
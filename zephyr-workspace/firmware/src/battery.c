@@ -0,0 +1,211 @@
+#include "battery.h"
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/adc.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+
+#ifdef CONFIG_SHELL
+#include <zephyr/shell/shell.h>
+#endif
+
+#define BATTERY_NODE DT_NODELABEL(battery)
+
+#define HAS_CURRENT DT_PROP_HAS_NAME(BATTERY_NODE, io_channels, current)
+
+static const struct adc_dt_spec voltage_ch =
+    ADC_DT_SPEC_GET_BY_NAME(BATTERY_NODE, voltage);
+
+#if HAS_CURRENT
+static const struct adc_dt_spec current_ch =
+    ADC_DT_SPEC_GET_BY_NAME(BATTERY_NODE, current);
+
+BUILD_ASSERT(DT_SAME_NODE(DT_IO_CHANNELS_CTLR_BY_NAME(BATTERY_NODE, voltage),
+                          DT_IO_CHANNELS_CTLR_BY_NAME(BATTERY_NODE, current)),
+             "The battery's voltage and current need to be on the same ADC");
+#endif
+
+static struct k_spinlock lock;
+static struct battery_monitor monitor;
+
+/* The latest reading, packed into one word so it can be read without a
+ * lock: mV in the low half and 10 mA in the high half, signed. */
+static atomic_t published;
+
+/* Asked to stop, and the sampling that's stopped since. */
+static atomic_t stopping;
+static K_SEM_DEFINE(stopped, 1, 1);
+static bool ready, running;
+
+/* One reading of each channel, lowest channel first. */
+static uint16_t samples[1 + HAS_CURRENT];
+
+static enum adc_action sampled(const struct device *dev,
+                               const struct adc_sequence *sequence,
+                               uint16_t sampling_index);
+
+static const struct adc_sequence_options options = {
+    .interval_us = CONFIG_COMBAT_BATTERY_INTERVAL_US,
+    .callback = sampled,
+};
+
+static struct adc_sequence sequence = {
+    .options = &options,
+    .buffer = samples,
+    .buffer_size = sizeof(samples),
+};
+
+static void publish(const struct battery_reading *reading)
+{
+    uint16_t mv = MIN(reading->mv, UINT16_MAX);
+    int16_t ma10 = CLAMP(reading->ma / 10, INT16_MIN, INT16_MAX);
+
+    atomic_set(&published, mv | ((uint32_t)(uint16_t)ma10 << 16));
+}
+
+void battery_get(struct battery_reading *reading)
+{
+    uint32_t v = atomic_get(&published);
+
+    reading->mv = v & 0xffff;
+    reading->ma = (int16_t)(v >> 16) * 10;
+}
+
+/**
+ * @brief Each reading, from the ADC's interrupt. It's sampled again into
+ * the same buffer until it's told to stop.
+ */
+static enum adc_action sampled(const struct device *dev,
+                               const struct adc_sequence *sequence,
+                               uint16_t sampling_index)
+{
+    struct battery_reading reading = {0};
+    uint16_t voltage = samples[0], current = 0;
+    k_spinlock_key_t key;
+
+    if (atomic_get(&stopping)) {
+        publish(&reading);
+        k_sem_give(&stopped);
+        return ADC_ACTION_FINISH;
+    }
+
+#if HAS_CURRENT
+    if (current_ch.channel_id < voltage_ch.channel_id) {
+        current = samples[0];
+        voltage = samples[1];
+    } else {
+        current = samples[1];
+    }
+#endif
+
+    key = k_spin_lock(&lock);
+    battery_monitor_sample(&monitor, voltage, current);
+    battery_monitor_get(&monitor, &reading);
+    k_spin_unlock(&lock, key);
+
+    publish(&reading);
+
+    return ADC_ACTION_REPEAT;
+}
+
+void battery_get_stats(struct battery_stats *stats)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    *stats = monitor.stats;
+    k_spin_unlock(&lock, key);
+}
+
+void battery_set_active(bool active)
+{
+    int rc;
+
+    if (!ready || active == running)
+        return;
+
+    if (!active) {
+        atomic_set(&stopping, 1);
+        running = false;
+        return;
+    }
+
+    /* The last run has to have finished, or this would wait for ever for
+     * the ADC. */
+    k_sem_take(&stopped, K_FOREVER);
+    atomic_set(&stopping, 0);
+
+    rc = adc_read_async(voltage_ch.dev, &sequence, NULL);
+    if (rc) {
+        printk("Battery: sampling failed to start (%d)\n", rc);
+        k_sem_give(&stopped);
+        return;
+    }
+
+    running = true;
+}
+
+int battery_init(void)
+{
+    struct battery_monitor_config config = {
+        .resolution = voltage_ch.resolution,
+        .full_ohms = DT_PROP(BATTERY_NODE, full_ohms),
+        .output_ohms = DT_PROP(BATTERY_NODE, output_ohms),
+        .current_zero_mv = DT_PROP(BATTERY_NODE, current_zero_mv),
+        .current_mv_per_amp = DT_PROP(BATTERY_NODE, current_mv_per_amp),
+        .interval_us = CONFIG_COMBAT_BATTERY_INTERVAL_US,
+        .tau_us = CONFIG_COMBAT_BATTERY_TAU_MS * USEC_PER_MSEC,
+    };
+    int rc;
+
+    if (!adc_is_ready_dt(&voltage_ch))
+        return -ENODEV;
+
+    rc = adc_channel_setup_dt(&voltage_ch);
+    if (rc)
+        return rc;
+
+#if HAS_CURRENT
+    rc = adc_channel_setup_dt(&current_ch);
+    if (rc)
+        return rc;
+#else
+    config.current_mv_per_amp = 0;
+#endif
+
+    config.vref_mv = voltage_ch.channel_cfg.reference == ADC_REF_INTERNAL
+                         ? adc_ref_internal(voltage_ch.dev)
+                         : voltage_ch.vref_mv;
+    battery_monitor_init(&monitor, &config);
+
+    /* The oversampling's from the devicetree, and done by the ADC. */
+    rc = adc_sequence_init_dt(&voltage_ch, &sequence);
+    if (rc)
+        return rc;
+#if HAS_CURRENT
+    sequence.channels |= BIT(current_ch.channel_id);
+#endif
+
+    ready = true;
+    battery_set_active(true);
+
+    return running ? 0 : -EIO;
+}
+
+#ifdef CONFIG_SHELL
+static int cmd_battery(const struct shell *sh, size_t argc, char **argv)
+{
+    struct battery_reading reading;
+    struct battery_stats stats;
+
+    battery_get(&reading);
+    battery_get_stats(&stats);
+
+    shell_print(sh, "%u mV, %d mA", reading.mv, reading.ma);
+    shell_print(sh, "lowest %u mV, highest %d mA, %u samples", stats.min_mv,
+                stats.max_ma, stats.samples);
+
+    return 0;
+}
+
+SHELL_CMD_REGISTER(battery, NULL, "Battery voltage and current", cmd_battery);
+#endif
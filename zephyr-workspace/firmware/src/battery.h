@@ -0,0 +1,52 @@
+#ifndef BATTERY_H
+#define BATTERY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "battery_monitor.h"
+
+#ifdef CONFIG_COMBAT_BATTERY
+
+/**
+ * @brief Start sampling the battery, every CONFIG_COMBAT_BATTERY_INTERVAL_US
+ * from the ADC's interrupt.
+ */
+extern int battery_init(void);
+
+/**
+ * @brief The latest filtered voltage and current, without taking a lock,
+ * so it's safe from anywhere. 0 mV until the first reading, and while
+ * sampling's stopped.
+ *
+ * The current's to the nearest 10 mA.
+ */
+extern void battery_get(struct battery_reading *reading);
+
+extern void battery_get_stats(struct battery_stats *stats);
+
+/**
+ * @brief Stop sampling, so the CPU isn't woken for it, or start again.
+ */
+extern void battery_set_active(bool active);
+
+#else
+
+static inline int battery_init(void)
+{
+    return 0;
+}
+
+static inline void battery_get(struct battery_reading *reading)
+{
+    reading->mv = 0;
+    reading->ma = 0;
+}
+
+static inline void battery_set_active(bool active)
+{
+}
+
+#endif /* CONFIG_COMBAT_BATTERY */
+
+#endif /* BATTERY_H */
@@ -0,0 +1,80 @@
+#include "battery_monitor.h"
+
+#include <string.h>
+
+#define Q16_ONE (1 << 16)
+
+void battery_monitor_init(struct battery_monitor *mon,
+                          const struct battery_monitor_config *config)
+{
+    memset(mon, 0, sizeof(*mon));
+    mon->config = *config;
+
+    /* For a time constant much longer than the interval, this is
+     * 1 - exp(-interval / tau). */
+    mon->alpha = (uint64_t)config->interval_us * Q16_ONE /
+                 (config->tau_us + config->interval_us);
+    if (!mon->alpha)
+        mon->alpha = 1;
+}
+
+static void filter(int32_t *q, uint16_t raw, uint32_t alpha)
+{
+    int32_t target = (int32_t)raw << 16;
+
+    *q += ((int64_t)(target - *q) * alpha) >> 16;
+}
+
+/**
+ * @brief A filtered reading as microvolts at the ADC pin.
+ */
+static int64_t pin_uv(const struct battery_monitor_config *config,
+                      int32_t q)
+{
+    return ((int64_t)q * config->vref_mv * 1000) >> (16 + config->resolution);
+}
+
+void battery_monitor_get(const struct battery_monitor *mon,
+                         struct battery_reading *reading)
+{
+    const struct battery_monitor_config *config = &mon->config;
+
+    if (!mon->stats.samples) {
+        reading->mv = 0;
+        reading->ma = 0;
+        return;
+    }
+
+    reading->mv = pin_uv(config, mon->voltage_q) * config->full_ohms /
+                  config->output_ohms / 1000;
+
+    /* uV over mV per amp is mA. */
+    reading->ma = config->current_mv_per_amp
+                      ? (pin_uv(config, mon->current_q) -
+                         (int64_t)config->current_zero_mv * 1000) /
+                            (int32_t)config->current_mv_per_amp
+                      : 0;
+}
+
+void battery_monitor_sample(struct battery_monitor *mon,
+                            uint16_t voltage_raw, uint16_t current_raw)
+{
+    struct battery_reading reading;
+
+    /* The first reading is where the filter starts from. */
+    if (!mon->stats.samples) {
+        mon->voltage_q = (int32_t)voltage_raw << 16;
+        mon->current_q = (int32_t)current_raw << 16;
+    } else {
+        filter(&mon->voltage_q, voltage_raw, mon->alpha);
+        filter(&mon->current_q, current_raw, mon->alpha);
+    }
+
+    mon->stats.samples++;
+
+    battery_monitor_get(mon, &reading);
+    if (mon->stats.samples == 1 || reading.mv < mon->stats.min_mv)
+        mon->stats.min_mv = reading.mv;
+    if (mon->stats.samples == 1 || reading.ma > mon->stats.max_ma)
+        mon->stats.max_ma = reading.ma;
+}
@@ -0,0 +1,81 @@
+#ifndef BATTERY_MONITOR_H
+#define BATTERY_MONITOR_H
+
+/*
+ * Battery monitor. Takes raw ADC readings of the pack's voltage, through a
+ * divider, and of a current sensor if there is one, filters them and turns
+ * them into mV and mA, and keeps track of how far the pack's sagged.
+ *
+ * The filter's a first order low pass on the raw readings with 16
+ * fractional bits, so it settles on the true value however slow it is.
+ * Not thread safe.
+ */
+
+#include <stdint.h>
+
+struct battery_monitor_config
+{
+    /* The ADC's reference, and its resolution in bits, up to 15. */
+    uint32_t vref_mv;
+    uint8_t resolution;
+    /* The pack's voltage comes through a divider, output_ohms of the
+     * full_ohms to ground. */
+    uint32_t full_ohms;
+    uint32_t output_ohms;
+    /* The current sensor's output at 0 A, and how far it moves per amp,
+     * or 0 if there isn't one. */
+    uint32_t current_zero_mv;
+    uint32_t current_mv_per_amp;
+    /* Time between readings, and the filter's time constant. */
+    uint32_t interval_us;
+    uint32_t tau_us;
+};
+
+struct battery_reading
+{
+    uint32_t mv;
+    /* Out of the pack. 0 without a current sensor. */
+    int32_t ma;
+};
+
+struct battery_stats
+{
+    uint32_t samples;
+    /* The lowest the filtered voltage's been, and the highest current. */
+    uint32_t min_mv;
+    int32_t max_ma;
+};
+
+struct battery_monitor
+{
+    struct battery_monitor_config config;
+
+    /* How much of each new reading goes in, as Q16. */
+    uint32_t alpha;
+    /* The filtered readings, as Q16. */
+    int32_t voltage_q;
+    int32_t current_q;
+
+    struct battery_stats stats;
+};
+
+extern void battery_monitor_init(struct battery_monitor *mon,
+                                 const struct battery_monitor_config *config);
+
+/**
+ * @brief A reading, every interval_us.
+ *
+ * @param current_raw Ignored without a current sensor.
+ */
+extern void battery_monitor_sample(struct battery_monitor *mon,
+                                   uint16_t voltage_raw,
+                                   uint16_t current_raw);
+
+/**
+ * @brief The filtered voltage and current, or 0 mV before the first
+ * reading.
+ */
+extern void battery_monitor_get(const struct battery_monitor *mon,
+                                struct battery_reading *reading);
+
+#endif /* BATTERY_MONITOR_H */
@@ -0,0 +1,255 @@
+#include "blackbox.h"
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/pm/device.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/atomic.h>
+
+#include "supervisor.h"
+
+BUILD_ASSERT(FIXED_PARTITION_EXISTS(blackbox_partition),
+             "The black box needs a blackbox_partition in the devicetree");
+BUILD_ASSERT(IS_POWER_OF_TWO(CONFIG_COMBAT_BLACKBOX_RING_SIZE),
+             "The black box ring size has to be a power of two");
+
+/* The W25Q32's smallest erase. */
+#define SECTOR_SIZE 4096
+
+#define RING_SIZE CONFIG_COMBAT_BLACKBOX_RING_SIZE
+
+static struct blackbox_record rc_buf[RING_SIZE];
+static struct blackbox_record imu_buf[RING_SIZE];
+
+/* Set up statically, so records can be queued before the thread's
+ * started. */
+static struct blackbox_ring rings[BLACKBOX_SOURCE_COUNT] = {
+    [BLACKBOX_SOURCE_RC] = {.buf = rc_buf, .mask = RING_SIZE - 1},
+    [BLACKBOX_SOURCE_IMU] = {.buf = imu_buf, .mask = RING_SIZE - 1},
+};
+
+static atomic_t faults;
+
+/* Asked to put the flash to sleep, and to wake it up again. */
+static atomic_t asleep;
+static K_SEM_DEFINE(wake, 0, 1);
+
+static const struct flash_area *area;
+static struct blackbox_flash flash;
+static struct blackbox_log blackbox;
+
+/* The log's stats as the rest of the firmware sees them. */
+static struct k_spinlock lock;
+static struct blackbox_log_stats published;
+
+static K_THREAD_STACK_DEFINE(thread_stack, CONFIG_COMBAT_BLACKBOX_STACK_SIZE);
+static struct k_thread thread;
+
+static uint32_t now_us(void)
+{
+    return k_ticks_to_us_floor32(k_uptime_ticks());
+}
+
+static int area_read(void *ctx, uint32_t offset, void *buf, size_t len)
+{
+    return flash_area_read(ctx, offset, buf, len);
+}
+
+static int area_write(void *ctx, uint32_t offset, const void *buf, size_t len)
+{
+    return flash_area_write(ctx, offset, buf, len);
+}
+
+static int area_erase(void *ctx, uint32_t offset, size_t len)
+{
+    return flash_area_erase(ctx, offset, len);
+}
+
+void blackbox_record(enum blackbox_source source, enum blackbox_type type,
+                     const int32_t *v)
+{
+    struct blackbox_record rec;
+
+    rec.time_us = now_us();
+    rec.type = type;
+    memcpy(rec.v, v, blackbox_fields[type] * sizeof(rec.v[0]));
+
+    blackbox_ring_push(&rings[source], &rec);
+}
+
+void blackbox_fault(uint32_t bits)
+{
+    atomic_or(&faults, bits);
+}
+
+static uint32_t dropped(void)
+{
+    uint32_t total = 0;
+
+    for (int i = 0; i < BLACKBOX_SOURCE_COUNT; i++) total += rings[i].dropped;
+
+    return total;
+}
+
+void blackbox_set_active(bool active)
+{
+    if (!active)
+        atomic_set(&asleep, 1);
+    else if (atomic_cas(&asleep, 1, 0))
+        k_sem_give(&wake);
+}
+
+void blackbox_get_stats(struct blackbox_stats *stats)
+{
+    k_spinlock_key_t key;
+
+    key = k_spin_lock(&lock);
+    stats->log = published;
+    k_spin_unlock(&lock, key);
+
+    stats->session = blackbox.session;
+    stats->dropped = dropped();
+}
+
+/**
+ * @brief The oldest record waiting in any ring, so the log comes out in
+ * time order.
+ */
+static struct blackbox_ring *oldest(void)
+{
+    const struct blackbox_record *best = NULL;
+    struct blackbox_ring *from = NULL;
+
+    for (int i = 0; i < BLACKBOX_SOURCE_COUNT; i++) {
+        const struct blackbox_record *rec = blackbox_ring_peek(&rings[i]);
+
+        if (rec && (!best || (int32_t)(rec->time_us - best->time_us) < 0)) {
+            best = rec;
+            from = &rings[i];
+        }
+    }
+
+    return from;
+}
+
+static void append(const struct blackbox_record *rec)
+{
+    if (blackbox_log_append(&blackbox, rec))
+        atomic_or(&faults, BLACKBOX_FAULT_FLASH);
+}
+
+/**
+ * @brief Write out the part filled page, and keep the flash in deep
+ * power-down until it's wanted again.
+ */
+static void sleep_flash(void)
+{
+    if (blackbox_log_flush(&blackbox))
+        atomic_or(&faults, BLACKBOX_FAULT_FLASH);
+
+    supervisor_pause(SUPERVISOR_TASK_BLACKBOX);
+    pm_device_action_run(area->fa_dev, PM_DEVICE_ACTION_SUSPEND);
+
+    k_sem_take(&wake, K_FOREVER);
+
+    pm_device_action_run(area->fa_dev, PM_DEVICE_ACTION_RESUME);
+    supervisor_resume(SUPERVISOR_TASK_BLACKBOX);
+}
+
+static void blackbox_thread(void *p1, void *p2, void *p3)
+{
+    uint32_t last_flush, last_dropped = 0;
+    struct blackbox_ring *ring;
+    int rc;
+
+    /* Scanning the flash takes a while, so it's done here rather than
+     * holding up the rest of boot. Records queue up meanwhile. */
+    rc = blackbox_log_mount(&blackbox, &flash);
+    if (rc) {
+        printk("Black box mount failed: %d\n", rc);
+        return;
+    }
+    printk("Black box session %u at 0x%x\n", blackbox.session,
+           blackbox.next);
+
+    last_flush = k_uptime_get_32();
+
+    /* Erasing a sector of the NOR flash can take a few hundred ms. */
+    supervisor_register(SUPERVISOR_TASK_BLACKBOX, 1000,
+                        CONFIG_COMBAT_BLACKBOX_DRAIN_MS + 1000);
+
+    while (1) {
+        uint32_t bits, drops;
+        k_spinlock_key_t key;
+
+        supervisor_start(SUPERVISOR_TASK_BLACKBOX);
+        bits = atomic_clear(&faults);
+        drops = dropped();
+
+        if (bits || drops != last_dropped) {
+            struct blackbox_record rec = {
+                .time_us = now_us(),
+                .type = BLACKBOX_FAULT,
+                .v = {bits, drops},
+            };
+
+            append(&rec);
+            last_dropped = drops;
+        }
+
+        while ((ring = oldest())) {
+            append(blackbox_ring_peek(ring));
+            blackbox_ring_pop(ring);
+        }
+
+        /* A part filled page is lost with the power, so don't leave one
+         * sitting for long. */
+        if (k_uptime_get_32() - last_flush >= CONFIG_COMBAT_BLACKBOX_FLUSH_MS) {
+            if (blackbox_log_flush(&blackbox))
+                atomic_or(&faults, BLACKBOX_FAULT_FLASH);
+            last_flush = k_uptime_get_32();
+        }
+
+        key = k_spin_lock(&lock);
+        published = blackbox.stats;
+        k_spin_unlock(&lock, key);
+
+        supervisor_done(SUPERVISOR_TASK_BLACKBOX);
+
+        if (atomic_get(&asleep)) {
+            sleep_flash();
+            last_flush = k_uptime_get_32();
+            continue;
+        }
+
+        k_sleep(K_MSEC(CONFIG_COMBAT_BLACKBOX_DRAIN_MS));
+    }
+}
+
+int blackbox_init(void)
+{
+    k_tid_t tid;
+    int rc;
+
+    rc = flash_area_open(FIXED_PARTITION_ID(blackbox_partition), &area);
+    if (rc)
+        return rc;
+
+    flash.ctx = (void *)area;
+    flash.read = area_read;
+    flash.write = area_write;
+    flash.erase = area_erase;
+    flash.size = area->fa_size;
+    flash.sector_size = SECTOR_SIZE;
+
+    /* Below everything else, so the flash only gets the time that's left
+     * over. */
+    tid = k_thread_create(&thread, thread_stack,
+                          K_THREAD_STACK_SIZEOF(thread_stack),
+                          blackbox_thread, NULL, NULL, NULL,
+                          K_PRIO_PREEMPT(CONFIG_COMBAT_BLACKBOX_PRIORITY), 0,
+                          K_NO_WAIT);
+    k_thread_name_set(tid, "blackbox");
+
+    return 0;
+}
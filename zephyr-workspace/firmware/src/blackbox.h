@@ -0,0 +1,90 @@
+#ifndef BLACKBOX_H
+#define BLACKBOX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "blackbox_log.h"
+
+/**
+ * @brief Where records come from. Each source has its own ring with a
+ * single producer, so a source must only ever be recorded to from one
+ * thread.
+ */
+enum blackbox_source
+{
+    /* The radio callback. */
+    BLACKBOX_SOURCE_RC,
+    /* The IMU loop, and the yaw loop it runs. */
+    BLACKBOX_SOURCE_IMU,
+
+    BLACKBOX_SOURCE_COUNT,
+};
+
+/* Fault bits. These can be raised from anywhere. */
+#define BLACKBOX_FAULT_RADIO_LOST (1 << 0)
+#define BLACKBOX_FAULT_WEAPON_CUT (1 << 1)
+#define BLACKBOX_FAULT_IMU_READ (1 << 2)
+#define BLACKBOX_FAULT_FLASH (1 << 3)
+#define BLACKBOX_FAULT_DEADLINE (1 << 4)
+
+struct blackbox_stats
+{
+    uint16_t session;
+    /* Records that didn't fit in a ring, from every source. */
+    uint32_t dropped;
+    struct blackbox_log_stats log;
+};
+
+#ifdef CONFIG_COMBAT_BLACKBOX
+
+/**
+ * @brief Find the end of the log and start recording after it.
+ */
+extern int blackbox_init(void);
+
+/**
+ * @brief Queue a record. This never blocks: if the ring is full the record
+ * is dropped and counted.
+ *
+ * @param v As many fields as blackbox_fields[] says for the type.
+ */
+extern void blackbox_record(enum blackbox_source source,
+                            enum blackbox_type type, const int32_t *v);
+
+/**
+ * @brief Flag faults for the next fault record.
+ */
+extern void blackbox_fault(uint32_t faults);
+
+extern void blackbox_get_stats(struct blackbox_stats *stats);
+
+/**
+ * @brief Put the flash in deep power-down once what's queued is written,
+ * or wake it up again. Records queued while it's asleep wait in the rings.
+ */
+extern void blackbox_set_active(bool active);
+
+#else
+
+static inline int blackbox_init(void)
+{
+    return 0;
+}
+
+static inline void blackbox_record(enum blackbox_source source,
+                                   enum blackbox_type type, const int32_t *v)
+{
+}
+
+static inline void blackbox_fault(uint32_t faults)
+{
+}
+
+static inline void blackbox_set_active(bool active)
+{
+}
+
+#endif /* CONFIG_COMBAT_BLACKBOX */
+
+#endif /* BLACKBOX_H */
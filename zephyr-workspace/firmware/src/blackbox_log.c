@@ -0,0 +1,440 @@
+#include "blackbox_log.h"
+
+#include <errno.h>
+#include <string.h>
+
+#define MAGIC 0xb10c
+
+/* Header layout, all little endian. The CRC covers everything after it. */
+#define OFF_MAGIC 0
+#define OFF_CRC 2
+#define OFF_SEQ 4
+#define OFF_SESSION 8
+#define OFF_USED 10
+#define OFF_TIME 12
+
+/* Type, time delta, field mask and a delta for every field. */
+#define MAX_RECORD_SIZE (1 + 5 + 3 + 5 * BLACKBOX_MAX_FIELDS)
+
+const uint8_t blackbox_fields[BLACKBOX_TYPE_COUNT] = {
+    [BLACKBOX_CHANNELS] = 16,
+    [BLACKBOX_DRIVE] = 6,
+    [BLACKBOX_IMU] = 6,
+    [BLACKBOX_LINK] = 2,
+    [BLACKBOX_FAULT] = 2,
+    [BLACKBOX_BATTERY] = 2,
+    [BLACKBOX_RADIO] = 3,
+};
+
+void blackbox_ring_init(struct blackbox_ring *ring,
+                        struct blackbox_record *buf, uint32_t size)
+{
+    ring->buf = buf;
+    ring->mask = size - 1;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->dropped, 0);
+}
+
+bool blackbox_ring_push(struct blackbox_ring *ring,
+                        const struct blackbox_record *rec)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    if (head - tail > ring->mask) {
+        /* Only the producer writes this, so it doesn't need to be an
+         * atomic add. */
+        atomic_store_explicit(
+            &ring->dropped,
+            atomic_load_explicit(&ring->dropped, memory_order_relaxed) + 1,
+            memory_order_relaxed);
+        return false;
+    }
+
+    ring->buf[head & ring->mask] = *rec;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+    return true;
+}
+
+const struct blackbox_record *blackbox_ring_peek(struct blackbox_ring *ring)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    return head == tail ? NULL : &ring->buf[tail & ring->mask];
+}
+
+void blackbox_ring_pop(struct blackbox_ring *ring)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+static uint16_t get_le16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void put_le16(uint8_t *p, uint16_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+/**
+ * @brief CRC-16/CCITT-FALSE. It's once a page, so speed doesn't matter.
+ */
+static uint16_t crc16(const uint8_t *p, size_t len)
+{
+    uint16_t crc = 0xffff;
+
+    while (len--) {
+        crc ^= *p++ << 8;
+        for (int i = 0; i < 8; i++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+
+    return crc;
+}
+
+static bool blank(const uint8_t *p, size_t len)
+{
+    while (len--) {
+        if (*p++ != 0xff)
+            return false;
+    }
+
+    return true;
+}
+
+static uint8_t *put_varint(uint8_t *p, uint32_t v)
+{
+    while (v >= 0x80) {
+        *p++ = v | 0x80;
+        v >>= 7;
+    }
+    *p++ = v;
+
+    return p;
+}
+
+/* Small deltas either way round come out as small unsigned numbers. */
+static uint32_t zigzag(int32_t v)
+{
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static int32_t unzigzag(uint32_t v)
+{
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+static bool get_varint(struct blackbox_reader *reader, uint32_t *out)
+{
+    uint32_t v = 0;
+
+    for (int shift = 0; shift < 35; shift += 7) {
+        uint8_t b;
+
+        if (reader->pos >= reader->used)
+            return false;
+
+        b = reader->page[reader->pos++];
+        v |= (uint32_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *out = v;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool blackbox_page_check(const uint8_t *page, struct blackbox_page_info *info)
+{
+    uint16_t used;
+
+    if (get_le16(&page[OFF_MAGIC]) != MAGIC)
+        return false;
+
+    if (get_le16(&page[OFF_CRC]) !=
+        crc16(&page[OFF_SEQ], BLACKBOX_PAGE_SIZE - OFF_SEQ))
+        return false;
+
+    used = get_le16(&page[OFF_USED]);
+    if (used < BLACKBOX_HEADER_SIZE || used > BLACKBOX_PAGE_SIZE)
+        return false;
+
+    info->seq = get_le32(&page[OFF_SEQ]);
+    info->session = get_le16(&page[OFF_SESSION]);
+    info->used = used;
+    info->time_us = get_le32(&page[OFF_TIME]);
+
+    return true;
+}
+
+void blackbox_reader_init(struct blackbox_reader *reader, const uint8_t *page)
+{
+    reader->page = page;
+    reader->pos = BLACKBOX_HEADER_SIZE;
+    reader->used = get_le16(&page[OFF_USED]);
+    reader->time_us = get_le32(&page[OFF_TIME]);
+    memset(reader->prev, 0, sizeof(reader->prev));
+}
+
+bool blackbox_reader_next(struct blackbox_reader *reader,
+                          struct blackbox_record *rec)
+{
+    uint32_t delta, mask;
+    uint8_t type;
+
+    if (reader->pos >= reader->used)
+        return false;
+
+    type = reader->page[reader->pos++];
+    if (type >= BLACKBOX_TYPE_COUNT)
+        return false;
+
+    if (!get_varint(reader, &delta) || !get_varint(reader, &mask))
+        return false;
+
+    reader->time_us += unzigzag(delta);
+    rec->time_us = reader->time_us;
+    rec->type = type;
+
+    for (int i = 0; i < blackbox_fields[type]; i++) {
+        if (mask & (1u << i)) {
+            if (!get_varint(reader, &delta))
+                return false;
+            reader->prev[type][i] = (uint32_t)reader->prev[type][i] +
+                                    (uint32_t)unzigzag(delta);
+        }
+        rec->v[i] = reader->prev[type][i];
+    }
+
+    return true;
+}
+
+/**
+ * @brief Encode a record against the page's deltas, without touching them.
+ *
+ * Only the fields that changed since the last record of the same type in
+ * the page are stored, so a channel frame with the sticks still is 4 or 5
+ * octets.
+ */
+static size_t encode(const struct blackbox_log *log,
+                     const struct blackbox_record *rec, uint8_t *buf)
+{
+    const int32_t *prev = log->prev[rec->type];
+    uint8_t *p = buf;
+    uint32_t mask = 0;
+
+    for (int i = 0; i < blackbox_fields[rec->type]; i++) {
+        if (rec->v[i] != prev[i])
+            mask |= 1u << i;
+    }
+
+    *p++ = rec->type;
+    p = put_varint(p, zigzag((int32_t)(rec->time_us - log->time_us)));
+    p = put_varint(p, mask);
+
+    for (int i = 0; i < blackbox_fields[rec->type]; i++) {
+        if (mask & (1u << i)) {
+            /* Wrapping, so even the biggest jump comes back out the
+             * same. */
+            uint32_t delta = (uint32_t)rec->v[i] - (uint32_t)prev[i];
+
+            p = put_varint(p, zigzag(delta));
+        }
+    }
+
+    return p - buf;
+}
+
+static void start_page(struct blackbox_log *log)
+{
+    memset(log->page, 0xff, sizeof(log->page));
+    memset(log->prev, 0, sizeof(log->prev));
+    log->used = BLACKBOX_HEADER_SIZE;
+}
+
+int blackbox_log_flush(struct blackbox_log *log)
+{
+    const struct blackbox_flash *flash = log->flash;
+    uint8_t *page = log->page;
+    int rc;
+
+    if (!blackbox_log_pending(log))
+        return 0;
+
+    /* A new sector is the oldest one in the log, so it goes. */
+    if (log->next % flash->sector_size == 0) {
+        log->stats.erases++;
+        rc = flash->erase(flash->ctx, log->next, flash->sector_size);
+        if (rc) {
+            /* Try again with the next one. This page is lost either
+             * way. */
+            log->stats.errors++;
+            log->next = (log->next + flash->sector_size) % flash->size;
+            start_page(log);
+            return rc;
+        }
+    }
+
+    put_le16(&page[OFF_MAGIC], MAGIC);
+    put_le32(&page[OFF_SEQ], log->seq);
+    put_le16(&page[OFF_SESSION], log->session);
+    put_le16(&page[OFF_USED], log->used);
+    put_le32(&page[OFF_TIME], log->start_us);
+    put_le16(&page[OFF_CRC],
+             crc16(&page[OFF_SEQ], BLACKBOX_PAGE_SIZE - OFF_SEQ));
+
+    rc = flash->write(flash->ctx, log->next, page, BLACKBOX_PAGE_SIZE);
+
+    /* A page that didn't write properly can't be written again until its
+     * sector is erased, so move on regardless. */
+    log->next = (log->next + BLACKBOX_PAGE_SIZE) % flash->size;
+    log->seq++;
+    start_page(log);
+
+    if (rc) {
+        log->stats.errors++;
+        return rc;
+    }
+
+    log->stats.pages++;
+
+    return 0;
+}
+
+int blackbox_log_append(struct blackbox_log *log,
+                        const struct blackbox_record *rec)
+{
+    uint8_t buf[MAX_RECORD_SIZE];
+    size_t len;
+    int rc = 0;
+
+    if (rec->type >= BLACKBOX_TYPE_COUNT)
+        return -EINVAL;
+
+    if (!blackbox_log_pending(log))
+        log->start_us = log->time_us = rec->time_us;
+
+    len = encode(log, rec, buf);
+    if (log->used + len > BLACKBOX_PAGE_SIZE) {
+        rc = blackbox_log_flush(log);
+
+        /* Against a clean page this time. */
+        log->start_us = log->time_us = rec->time_us;
+        len = encode(log, rec, buf);
+    }
+
+    memcpy(&log->page[log->used], buf, len);
+    log->used += len;
+    log->time_us = rec->time_us;
+    memcpy(log->prev[rec->type], rec->v,
+           blackbox_fields[rec->type] * sizeof(rec->v[0]));
+    log->stats.records++;
+
+    return rc;
+}
+
+/**
+ * @brief The first good page in a sector.
+ *
+ * That's usually the first page, unless a power cut tore it.
+ */
+static bool sector_first(struct blackbox_log *log, uint32_t sector,
+                         struct blackbox_page_info *info)
+{
+    const struct blackbox_flash *flash = log->flash;
+
+    for (uint32_t off = 0; off < flash->sector_size;
+         off += BLACKBOX_PAGE_SIZE) {
+        if (flash->read(flash->ctx, sector + off, log->page,
+                        BLACKBOX_PAGE_SIZE))
+            return false;
+
+        if (blackbox_page_check(log->page, info))
+            return true;
+
+        /* Pages are written in order, so the rest are blank too. */
+        if (blank(log->page, BLACKBOX_PAGE_SIZE))
+            return false;
+    }
+
+    return false;
+}
+
+int blackbox_log_mount(struct blackbox_log *log,
+                       const struct blackbox_flash *flash)
+{
+    struct blackbox_page_info info, newest = {0};
+    uint32_t head = 0, end;
+    bool found = false;
+
+    if (flash->sector_size % BLACKBOX_PAGE_SIZE ||
+        flash->size % flash->sector_size || !flash->size)
+        return -EINVAL;
+
+    memset(log, 0, sizeof(*log));
+    log->flash = flash;
+
+    /* The newest sector is the one whose first page is furthest on. */
+    for (uint32_t sector = 0; sector < flash->size;
+         sector += flash->sector_size) {
+        if (sector_first(log, sector, &info) &&
+            (!found || info.seq > newest.seq)) {
+            newest = info;
+            head = sector;
+            found = true;
+        }
+    }
+
+    if (found) {
+        /* Then the log carries on after the last page in it that's been
+         * written at all, good or not. */
+        end = head;
+        for (uint32_t off = 0; off < flash->sector_size;
+             off += BLACKBOX_PAGE_SIZE) {
+            if (flash->read(flash->ctx, head + off, log->page,
+                            BLACKBOX_PAGE_SIZE)) {
+                /* Don't risk writing over anything - start afresh in the
+                 * next sector. */
+                end = head + flash->sector_size;
+                break;
+            }
+
+            if (blackbox_page_check(log->page, &info) &&
+                info.seq > newest.seq)
+                newest = info;
+
+            if (!blank(log->page, BLACKBOX_PAGE_SIZE))
+                end = head + off + BLACKBOX_PAGE_SIZE;
+        }
+
+        log->next = end % flash->size;
+        log->seq = newest.seq + 1;
+        log->session = newest.session + 1;
+    }
+
+    start_page(log);
+
+    return 0;
+}
@@ -0,0 +1,227 @@
+#ifndef BLACKBOX_LOG_H
+#define BLACKBOX_LOG_H
+
+/*
+ * Black box log: the ring records wait in, the format they're packed into,
+ * and how the packed pages are laid out in NOR flash.
+ *
+ * Records are delta encoded into pages that each stand on their own, with a
+ * sequence number and a CRC. The pages go round the flash region in order,
+ * erasing the oldest sector as they come to it, so every sector wears at
+ * the same rate and there's nothing else to keep up to date. A page torn by
+ * a power cut fails its CRC and is skipped, and the log carries on after
+ * it at the next boot.
+ */
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* The flash's program page. Pages are only ever written whole. */
+#define BLACKBOX_PAGE_SIZE 256
+#define BLACKBOX_HEADER_SIZE 16
+
+#define BLACKBOX_MAX_FIELDS 16
+
+enum blackbox_type
+{
+    /* The 16 RC channels, 0-2047. */
+    BLACKBOX_CHANNELS,
+    /* Wheel duty for FL, RL, FR and RR, negative when the direction output
+     * is low, then the weapon throttle (0-2000) and 1 if armed. */
+    BLACKBOX_DRIVE,
+    /* Gyro in mdps and accelerometer in mg, x, y then z. */
+    BLACKBOX_IMU,
+    /* us since the last RC frame, and from its first octet arriving to the
+     * outputs changing. */
+    BLACKBOX_LINK,
+    /* Fault bits since the last fault record, and records dropped so far. */
+    BLACKBOX_FAULT,
+    /* Filtered pack voltage in mV and current in mA. */
+    BLACKBOX_BATTERY,
+    /* The receiver's uplink link quality in percent, RSSI on its active
+     * antenna in -dBm and SNR in dB, from its last link statistics. */
+    BLACKBOX_RADIO,
+
+    BLACKBOX_TYPE_COUNT,
+};
+
+/**
+ * @brief How many fields each type of record has.
+ */
+extern const uint8_t blackbox_fields[BLACKBOX_TYPE_COUNT];
+
+struct blackbox_record
+{
+    uint32_t time_us;
+    uint8_t type;
+    int32_t v[BLACKBOX_MAX_FIELDS];
+};
+
+/**
+ * @brief Records on their way to the flash.
+ *
+ * A single producer and a single consumer, and no locks: the producer only
+ * moves head and the consumer only moves tail. A full ring drops the new
+ * record rather than making the producer wait.
+ */
+struct blackbox_ring
+{
+    struct blackbox_record *buf;
+    uint32_t mask;
+
+    /* Free-running counts of records pushed and popped. */
+    atomic_uint head;
+    atomic_uint tail;
+    atomic_uint dropped;
+};
+
+/**
+ * @brief A page's header, once its CRC has checked out.
+ */
+struct blackbox_page_info
+{
+    uint32_t seq;
+    /* Counts up each time the log's mounted. */
+    uint16_t session;
+    /* Bytes of the page in use, header included. */
+    uint16_t used;
+    /* Time of the first record. */
+    uint32_t time_us;
+};
+
+/**
+ * @brief Walks the records in a page.
+ */
+struct blackbox_reader
+{
+    const uint8_t *page;
+    uint16_t pos;
+    uint16_t used;
+    uint32_t time_us;
+    int32_t prev[BLACKBOX_TYPE_COUNT][BLACKBOX_MAX_FIELDS];
+};
+
+/**
+ * @brief The flash region the log lives in.
+ *
+ * Offsets are from the start of the region. Both sizes have to be multiples
+ * of BLACKBOX_PAGE_SIZE.
+ */
+struct blackbox_flash
+{
+    void *ctx;
+    int (*read)(void *ctx, uint32_t offset, void *buf, size_t len);
+    int (*write)(void *ctx, uint32_t offset, const void *buf, size_t len);
+    int (*erase)(void *ctx, uint32_t offset, size_t len);
+
+    uint32_t size;
+    uint32_t sector_size;
+};
+
+struct blackbox_log_stats
+{
+    uint32_t records;
+    uint32_t pages;
+    uint32_t erases;
+    /* Flash operations that failed. The page or sector is skipped. */
+    uint32_t errors;
+};
+
+struct blackbox_log
+{
+    const struct blackbox_flash *flash;
+
+    /* Where the next page goes. */
+    uint32_t next;
+    uint32_t seq;
+    uint16_t session;
+
+    /* The page being filled, and what its deltas are from. */
+    uint8_t page[BLACKBOX_PAGE_SIZE];
+    uint16_t used;
+    uint32_t start_us;
+    uint32_t time_us;
+    int32_t prev[BLACKBOX_TYPE_COUNT][BLACKBOX_MAX_FIELDS];
+
+    struct blackbox_log_stats stats;
+};
+
+/**
+ * @brief Set up an empty ring.
+ *
+ * @param size Number of records in buf, a power of two.
+ */
+extern void blackbox_ring_init(struct blackbox_ring *ring,
+                               struct blackbox_record *buf, uint32_t size);
+
+/**
+ * @brief Add a record, from the producer.
+ *
+ * @return False if the ring was full and the record was dropped.
+ */
+extern bool blackbox_ring_push(struct blackbox_ring *ring,
+                               const struct blackbox_record *rec);
+
+/**
+ * @brief The oldest record, from the consumer, or NULL if there's none.
+ *
+ * It stays put until blackbox_ring_pop().
+ */
+extern const struct blackbox_record *
+blackbox_ring_peek(struct blackbox_ring *ring);
+
+extern void blackbox_ring_pop(struct blackbox_ring *ring);
+
+/**
+ * @brief Check a page's magic number and CRC.
+ */
+extern bool blackbox_page_check(const uint8_t *page,
+                                struct blackbox_page_info *info);
+
+/**
+ * @brief Start walking a page that's passed blackbox_page_check().
+ */
+extern void blackbox_reader_init(struct blackbox_reader *reader,
+                                 const uint8_t *page);
+
+/**
+ * @brief The next record in the page.
+ *
+ * @return False at the end of the page, or if the rest of it doesn't make
+ * sense.
+ */
+extern bool blackbox_reader_next(struct blackbox_reader *reader,
+                                 struct blackbox_record *rec);
+
+/**
+ * @brief Find the end of the log in flash, and start a new session after
+ * it.
+ *
+ * This reads a page from each sector, then every page in the newest one.
+ * An empty or unreadable region gives a new log at the start.
+ */
+extern int blackbox_log_mount(struct blackbox_log *log,
+                              const struct blackbox_flash *flash);
+
+/**
+ * @brief Add a record to the page being filled, writing the page out first
+ * if it won't fit.
+ *
+ * Writing a page may take a sector erase, so this can take tens of ms.
+ */
+extern int blackbox_log_append(struct blackbox_log *log,
+                               const struct blackbox_record *rec);
+
+/**
+ * @brief Write out the page being filled, even if it's not full.
+ */
+extern int blackbox_log_flush(struct blackbox_log *log);
+
+static inline bool blackbox_log_pending(const struct blackbox_log *log)
+{
+    return log->used > BLACKBOX_HEADER_SIZE;
+}
+
+#endif /* BLACKBOX_LOG_H */
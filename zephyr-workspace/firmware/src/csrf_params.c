@@ -0,0 +1,167 @@
+#include "csrf_params.h"
+
+#include <string.h>
+
+/* The options for settings that are picked from a list, instead of being
+ * numbers. */
+static const char *const selections[ROBOT_SETTINGS_COUNT] = {
+    [ROBOT_SETTING_MIX] = "Tank;Arcade",
+};
+
+static enum csrf_param_type param_type(int setting)
+{
+    if (selections[setting])
+        return CSRF_PARAM_TEXT_SELECTION;
+
+    return robot_settings_info[setting].max > 0xff ? CSRF_PARAM_UINT16
+                                                   : CSRF_PARAM_UINT8;
+}
+
+static uint8_t *put_string(uint8_t *p, const char *s)
+{
+    size_t len = strlen(s) + 1;
+
+    memcpy(p, s, len);
+    return p + len;
+}
+
+/**
+ * @brief A number, big endian like everything else in CRSF.
+ */
+static uint8_t *put_be(uint8_t *p, uint32_t v, int size)
+{
+    for (int i = size - 1; i >= 0; i--) *p++ = v >> (8 * i);
+    return p;
+}
+
+static size_t device_info(const struct csrf_params *params, uint8_t dest,
+                          uint8_t *reply)
+{
+    uint8_t *p = reply;
+
+    *p++ = dest;
+    *p++ = params->addr;
+    p = put_string(p, params->name);
+    /* Serial number, hardware and software versions. The handset only
+     * looks at them to spot ELRS devices. */
+    p = put_be(p, 0, 4);
+    p = put_be(p, 0, 4);
+    p = put_be(p, 0, 4);
+    *p++ = ROBOT_SETTINGS_COUNT;
+    /* Parameter protocol version. */
+    *p++ = 0;
+
+    return p - reply;
+}
+
+static size_t entry(const struct csrf_params *params, uint8_t id,
+                    uint8_t dest, uint8_t *reply)
+{
+    uint8_t *p = reply;
+    int setting = id - 1;
+    const struct robot_setting_info *info;
+    enum csrf_param_type type;
+    int size;
+
+    *p++ = dest;
+    *p++ = params->addr;
+    *p++ = id;
+    /* Chunks still to come. */
+    *p++ = 0;
+    /* The folder it's in. */
+    *p++ = 0;
+
+    if (id == 0) {
+        *p++ = CSRF_PARAM_FOLDER;
+        p = put_string(p, params->name);
+        for (int i = 1; i <= ROBOT_SETTINGS_COUNT; i++) *p++ = i;
+        *p++ = 0xff;
+
+        return p - reply;
+    }
+
+    info = &robot_settings_info[setting];
+    type = param_type(setting);
+    size = type == CSRF_PARAM_UINT16 ? 2 : 1;
+
+    *p++ = type;
+    p = put_string(p, info->name);
+    if (type == CSRF_PARAM_TEXT_SELECTION)
+        p = put_string(p, selections[setting]);
+    p = put_be(p, params->settings->v[setting], size);
+    p = put_be(p, info->min, size);
+    p = put_be(p, info->max, size);
+    p = put_be(p, params->defaults->v[setting], size);
+    p = put_string(p, info->unit);
+
+    return p - reply;
+}
+
+static bool write_setting(const struct csrf_params *params,
+                          const uint8_t *payload, size_t len)
+{
+    int setting = payload[2] - 1;
+    uint16_t v;
+
+    if (setting < 0 || setting >= ROBOT_SETTINGS_COUNT)
+        return false;
+
+    if (param_type(setting) == CSRF_PARAM_UINT16) {
+        if (len < 5)
+            return false;
+        v = (payload[3] << 8) | payload[4];
+    } else {
+        v = payload[3];
+    }
+
+    if (v < robot_settings_info[setting].min ||
+        v > robot_settings_info[setting].max ||
+        v == params->settings->v[setting])
+        return false;
+
+    params->settings->v[setting] = v;
+
+    return true;
+}
+
+size_t csrf_params_handle(const struct csrf_params *params, uint8_t type,
+                          const uint8_t *payload, size_t len,
+                          uint8_t *reply_type, uint8_t *reply, bool *changed)
+{
+    uint8_t dest, origin;
+
+    *changed = false;
+
+    /* The frame handlers in the driver have already checked the lengths
+     * against these. */
+    if (len < 2 || (type != CSRF_FRAME_DEVICE_PING && len < 4))
+        return 0;
+
+    dest = payload[0];
+    origin = payload[1];
+    if (dest != params->addr &&
+        !(type == CSRF_FRAME_DEVICE_PING &&
+          dest == CSRF_PARAMS_ADDR_BROADCAST))
+        return 0;
+
+    switch (type) {
+        case CSRF_FRAME_DEVICE_PING:
+            *reply_type = CSRF_FRAME_DEVICE_INFO;
+            return device_info(params, origin, reply);
+
+        case CSRF_FRAME_PARAMETER_READ:
+            /* Everything fits in the first chunk. */
+            if (payload[2] > ROBOT_SETTINGS_COUNT || payload[3] != 0)
+                return 0;
+            *reply_type = CSRF_FRAME_PARAMETER_ENTRY;
+            return entry(params, payload[2], origin, reply);
+
+        case CSRF_FRAME_PARAMETER_WRITE:
+            /* The handset reads the parameter back itself. */
+            *changed = write_setting(params, payload, len);
+            return 0;
+
+        default:
+            return 0;
+    }
+}
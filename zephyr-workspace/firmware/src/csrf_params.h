@@ -0,0 +1,65 @@
+#ifndef CSRF_PARAMS_H
+#define CSRF_PARAMS_H
+
+/*
+ * The CRSF device protocol, for the robot's settings: answers pings with
+ * the device info, and lets the handset read and write each setting as a
+ * parameter, so they can be changed from the ELRS Lua script.
+ *
+ * Parameter 0 is a folder holding the rest, and parameter n + 1 is
+ * setting n. Every entry fits in one chunk.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "robot_settings.h"
+
+/* The same as in drivers/misc/csrf.h, which needs Zephyr. */
+#define CSRF_FRAME_DEVICE_PING 0x28
+#define CSRF_FRAME_DEVICE_INFO 0x29
+#define CSRF_FRAME_PARAMETER_ENTRY 0x2b
+#define CSRF_FRAME_PARAMETER_READ 0x2c
+#define CSRF_FRAME_PARAMETER_WRITE 0x2d
+
+#define CSRF_PARAMS_ADDR_BROADCAST 0x00
+#define CSRF_PARAMS_ADDR_FLIGHT_CONTROLLER 0xc8
+
+/* Room for the longest reply. */
+#define CSRF_PARAMS_MAX_REPLY 60
+
+enum csrf_param_type
+{
+    CSRF_PARAM_UINT8 = 0,
+    CSRF_PARAM_UINT16 = 2,
+    CSRF_PARAM_TEXT_SELECTION = 9,
+    CSRF_PARAM_FOLDER = 11,
+};
+
+struct csrf_params
+{
+    /* Ours, and what the handset lists us as. */
+    uint8_t addr;
+    const char *name;
+
+    struct robot_settings *settings;
+    const struct robot_settings *defaults;
+};
+
+/**
+ * @brief Handle a device protocol frame.
+ *
+ * Frames for other devices, and writes that are out of range, are ignored.
+ *
+ * @param payload From the destination address on.
+ * @param reply Room for CSRF_PARAMS_MAX_REPLY octets.
+ * @param changed Set if a write changed a setting.
+ * @return The length of the reply, or 0 for none.
+ */
+extern size_t csrf_params_handle(const struct csrf_params *params,
+                                 uint8_t type, const uint8_t *payload,
+                                 size_t len, uint8_t *reply_type,
+                                 uint8_t *reply, bool *changed);
+
+#endif /* CSRF_PARAMS_H */
@@ -0,0 +1,189 @@
+#include "failsafe.h"
+
+#include <zephyr/kernel.h>
+
+#include "drivers/misc/csrf.h"
+
+static struct k_spinlock lock;
+static struct link_monitor mon;
+static struct failsafe_stats stats;
+static struct csrf_link_stats last_link;
+/* The timer only runs until the frames stop. */
+static bool watching;
+
+static failsafe_stop_t stop_fn;
+
+static void timer_handler(struct k_timer *timer);
+static K_TIMER_DEFINE(failsafe_timer, timer_handler, NULL);
+
+static K_SEM_DEFINE(tripped, 0, 1);
+
+static K_THREAD_STACK_DEFINE(thread_stack, CONFIG_COMBAT_FAILSAFE_STACK_SIZE);
+static struct k_thread thread;
+
+/**
+ * @brief Check the link whenever it could next get worse, from the timer
+ * interrupt, so nothing on the workqueues can hold it up.
+ */
+static void timer_handler(struct k_timer *timer)
+{
+    uint32_t now = k_cycle_get_32();
+    k_spinlock_key_t key;
+    enum link_level level;
+    uint32_t next;
+
+    key = k_spin_lock(&lock);
+    level = link_monitor_update(&mon, now, &next);
+    if (level == LINK_STOPPED)
+        watching = false;
+    else
+        k_timer_start(&failsafe_timer, K_CYC(next - now), K_NO_WAIT);
+    k_spin_unlock(&lock, key);
+
+    if (level == LINK_STOPPED)
+        k_sem_give(&tripped);
+}
+
+/**
+ * @brief Stop everything, at cooperative priority so nothing gets in
+ * between the trip and the motors.
+ */
+static void failsafe_thread(void *p1, void *p2, void *p3)
+{
+    k_spinlock_key_t key;
+    uint32_t last, stop_after, since;
+    bool stopped;
+
+    while (1) {
+        k_sem_take(&tripped, K_FOREVER);
+
+        key = k_spin_lock(&lock);
+        stopped = mon.level == LINK_STOPPED;
+        last = mon.last_frame;
+        stop_after = link_monitor_stop_after(&mon);
+        k_spin_unlock(&lock, key);
+
+        /* Nothing preempts this thread but interrupts, so if the frames
+         * haven't come back by now they won't before the motors stop. */
+        if (!stopped)
+            continue;
+
+        stop_fn();
+
+        since = k_cycle_get_32() - last;
+
+        key = k_spin_lock(&lock);
+        stats.trips++;
+        stats.last_trip_us = k_cyc_to_us_floor32(since);
+        if (since > stop_after)
+            stats.max_late_us = MAX(stats.max_late_us,
+                                    k_cyc_to_us_floor32(since - stop_after));
+        k_spin_unlock(&lock, key);
+
+        printk("Failsafe: stopped %u us after the last frame\n",
+               k_cyc_to_us_floor32(since));
+    }
+}
+
+static void link_callback(const struct csrf_link_stats *link)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    link_monitor_quality(&mon, link->uplink_lq);
+    last_link = *link;
+    k_spin_unlock(&lock, key);
+}
+
+uint8_t failsafe_frame(uint32_t rx_cycles)
+{
+    uint32_t now = k_cycle_get_32();
+    k_spinlock_key_t key;
+    uint8_t percent;
+    uint32_t next;
+
+    key = k_spin_lock(&lock);
+    link_monitor_frame(&mon, rx_cycles);
+    link_monitor_update(&mon, now, &next);
+    percent = link_monitor_drive_percent(&mon);
+
+    /* While the timer's running it picks up the new frame when it fires,
+     * so there's nothing to do here per frame. */
+    if (!watching && mon.level != LINK_STOPPED) {
+        k_timer_start(&failsafe_timer, K_CYC(next - now), K_NO_WAIT);
+        watching = true;
+    }
+    k_spin_unlock(&lock, key);
+
+    return percent;
+}
+
+uint8_t failsafe_drive_percent(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    uint8_t percent = link_monitor_drive_percent(&mon);
+
+    k_spin_unlock(&lock, key);
+
+    return percent;
+}
+
+uint32_t failsafe_stop_after_ms(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    uint32_t stop_after = link_monitor_stop_after(&mon);
+
+    k_spin_unlock(&lock, key);
+
+    return k_cyc_to_ms_ceil32(stop_after);
+}
+
+void failsafe_set_max_ms(uint32_t ms)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    mon.config.max_stop = k_ms_to_cyc_ceil32(ms);
+    k_spin_unlock(&lock, key);
+}
+
+void failsafe_get_stats(struct failsafe_stats *out)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    *out = stats;
+    k_spin_unlock(&lock, key);
+}
+
+void failsafe_get_link(struct csrf_link_stats *link)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    *link = last_link;
+    k_spin_unlock(&lock, key);
+}
+
+int failsafe_init(const struct device *radio, failsafe_stop_t stop)
+{
+    struct link_monitor_config config;
+    k_tid_t tid;
+
+    link_monitor_config_default(&config);
+    config.initial_interval = k_us_to_cyc_ceil32(config.initial_interval);
+    config.min_stop = k_ms_to_cyc_ceil32(CONFIG_COMBAT_FAILSAFE_MIN_MS);
+    config.max_stop = k_ms_to_cyc_ceil32(CONFIG_COMBAT_FAILSAFE_MS);
+    config.limit_frames = CONFIG_COMBAT_FAILSAFE_LIMIT_FRAMES;
+    config.stop_frames = CONFIG_COMBAT_FAILSAFE_STOP_FRAMES;
+    config.lq_limit = CONFIG_COMBAT_FAILSAFE_LQ_LIMIT;
+    config.limit_percent = CONFIG_COMBAT_FAILSAFE_LIMIT_PERCENT;
+    link_monitor_init(&mon, &config);
+
+    stop_fn = stop;
+
+    tid = k_thread_create(&thread, thread_stack,
+                          K_THREAD_STACK_SIZEOF(thread_stack), failsafe_thread,
+                          NULL, NULL, NULL,
+                          K_PRIO_COOP(CONFIG_COMBAT_FAILSAFE_PRIORITY), 0,
+                          K_NO_WAIT);
+    k_thread_name_set(tid, "failsafe");
+
+    return csrf_set_link_callback(radio, link_callback);
+}
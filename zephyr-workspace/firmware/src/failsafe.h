@@ -0,0 +1,67 @@
+#ifndef FAILSAFE_H
+#define FAILSAFE_H
+
+#include <stdint.h>
+#include <zephyr/device.h>
+
+#include "drivers/misc/csrf.h"
+#include "link_monitor.h"
+
+/**
+ * @brief Stops everything. Called from the failsafe thread.
+ */
+typedef void (*failsafe_stop_t)(void);
+
+struct failsafe_stats
+{
+    /* How many times everything's been stopped. */
+    uint32_t trips;
+    /* From the last frame to the motors stopping, on the last trip. */
+    uint32_t last_trip_us;
+    /* The longest a stop has come after its deadline. */
+    uint32_t max_late_us;
+};
+
+/**
+ * @brief Start watching the link. Until the first frame everything's
+ * treated as stopped.
+ *
+ * @param radio For the link statistics.
+ * @param stop Called each time the frames stop.
+ */
+extern int failsafe_init(const struct device *radio, failsafe_stop_t stop);
+
+/**
+ * @brief An RC frame came in, from the CSRF thread.
+ *
+ * @param rx_cycles When it started arriving, from k_cycle_get_32().
+ * @return How far the drive can go, in percent.
+ */
+extern uint8_t failsafe_frame(uint32_t rx_cycles);
+
+/**
+ * @brief How far the drive can go right now, in percent.
+ */
+extern uint8_t failsafe_drive_percent(void);
+
+/**
+ * @brief How long after the last frame everything stops, at the frame
+ * rate the link's running at, in ms.
+ */
+extern uint32_t failsafe_stop_after_ms(void);
+
+/**
+ * @brief Always stop by this long after the last frame, however slow the
+ * frames are.
+ */
+extern void failsafe_set_max_ms(uint32_t ms);
+
+extern void failsafe_get_stats(struct failsafe_stats *stats);
+
+/**
+ * @brief The link statistics the receiver last sent, all zero until it
+ * sends some.
+ */
+extern void failsafe_get_link(struct csrf_link_stats *link);
+
+#endif /* FAILSAFE_H */
@@ -0,0 +1,271 @@
+#include "imu.h"
+
+#include <string.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/kernel.h>
+#include <zephyr/pm/device.h>
+#include <zephyr/rtio/rtio.h>
+
+#include "blackbox.h"
+#include "supervisor.h"
+#include "usb_telemetry.h"
+#include "yaw_control.h"
+
+BUILD_ASSERT(DT_PROP(IMU_NODE, fifo_watermark) > 0,
+             "The IMU loop needs the IMU FIFO");
+
+/* Enough room for a late tick to catch up in one read. */
+#define MAX_SETS (4 * DT_PROP(IMU_NODE, fifo_watermark))
+
+/* 1000 / 9.80665 * 1024: m/s^2 to mg, as Q10. */
+#define MS2_TO_MG_Q10 104419LL
+
+/* 180 / pi * 1000: rad/s to mdps. */
+#define RADS_TO_MDPS 57296LL
+
+static const struct device *imu = DEVICE_DT_GET(IMU_NODE);
+
+SENSOR_DT_READ_IODEV(imu_iodev, IMU_NODE, {SENSOR_CHAN_ACCEL_XYZ, 0},
+                     {SENSOR_CHAN_GYRO_XYZ, 0});
+RTIO_DEFINE(imu_rtio, 1, 1);
+
+/* Header plus a FIFO read, with a bit to spare. */
+static uint8_t imu_buf[32 + MAX_SETS * 12] __aligned(8);
+
+static const struct sensor_decoder_api *decoder;
+
+static const struct sensor_trigger fifo_trigger = {
+    .type = SENSOR_TRIG_FIFO_WATERMARK,
+    .chan = SENSOR_CHAN_ALL,
+};
+
+static struct attitude attitude;
+static bool attitude_started;
+
+/* The estimate as the rest of the firmware sees it. */
+static struct k_spinlock lock;
+static struct attitude_state published;
+
+static struct imu_stats stats;
+static uint32_t last_tick;
+/* Powered back up since the last tick. */
+static bool restarted;
+
+/**
+ * @brief Mean of every reading in the buffer for one channel, as q31 with
+ * the decoder's shift.
+ */
+static int mean(enum sensor_channel type, int64_t *out, int8_t *shift)
+{
+    const struct sensor_chan_spec chan = {type, 0};
+    struct sensor_three_axis_data data;
+    int64_t sum[3] = {0};
+    uint32_t fit = 0;
+    uint16_t count;
+    int rc;
+
+    rc = decoder->get_frame_count(imu_buf, chan, &count);
+    if (rc || !count)
+        return rc ? rc : -ENODATA;
+
+    for (uint16_t i = 0; i < count; i++) {
+        if (decoder->decode(imu_buf, chan, &fit, 1, &data) != 1)
+            return -EIO;
+
+        for (int axis = 0; axis < 3; axis++)
+            sum[axis] += data.readings[0].values[axis];
+    }
+
+    for (int axis = 0; axis < 3; axis++) out[axis] = sum[axis] / count;
+    *shift = data.shift;
+
+    return 0;
+}
+
+static int read_sample(struct imu_sample *sample)
+{
+    int64_t gyro[3], accel[3];
+    int8_t gyro_shift, accel_shift;
+    int rc;
+
+    rc = sensor_read(&imu_iodev, &imu_rtio, imu_buf, sizeof(imu_buf));
+    rc = rc ? rc : mean(SENSOR_CHAN_GYRO_XYZ, gyro, &gyro_shift);
+    rc = rc ? rc : mean(SENSOR_CHAN_ACCEL_XYZ, accel, &accel_shift);
+    if (rc)
+        return rc;
+
+    for (int axis = 0; axis < 3; axis++) {
+        sample->gyro_mdps[axis] = (gyro[axis] * RADS_TO_MDPS) >>
+                                  (31 - gyro_shift);
+        sample->accel_mg[axis] = (accel[axis] * MS2_TO_MG_Q10) >>
+                                 (31 - accel_shift + 10);
+    }
+
+    /* Turned over about x, the chip's y and z are the other way round to
+     * the robot's. */
+    if (IS_ENABLED(CONFIG_COMBAT_IMU_UPSIDE_DOWN)) {
+        for (int axis = 1; axis < 3; axis++) {
+            sample->gyro_mdps[axis] = -sample->gyro_mdps[axis];
+            sample->accel_mg[axis] = -sample->accel_mg[axis];
+        }
+    }
+
+    return 0;
+}
+
+static void fifo_handler(const struct device *dev,
+                         const struct sensor_trigger *trig)
+{
+    struct imu_sample sample;
+    k_spinlock_key_t key;
+
+    supervisor_start(SUPERVISOR_TASK_IMU);
+    sample.start = k_cycle_get_32();
+
+    if (read_sample(&sample)) {
+        stats.read_errors++;
+        blackbox_fault(BLACKBOX_FAULT_IMU_READ);
+        supervisor_done(SUPERVISOR_TASK_IMU);
+        return;
+    }
+
+    /* The gap while it was powered down doesn't count. */
+    if (stats.ticks && !restarted) {
+        stats.max_interval_us =
+            MAX(stats.max_interval_us,
+                k_cyc_to_us_ceil32(sample.start - last_tick));
+    }
+    last_tick = sample.start;
+    restarted = false;
+    stats.ticks++;
+
+    /* It could be sitting either way up at power on, or have been turned
+     * over while it was powered down. */
+    if (!attitude_started) {
+        attitude_reset(&attitude, sample.accel_mg);
+        attitude_started = true;
+    }
+    attitude_update(&attitude, sample.gyro_mdps, sample.accel_mg);
+
+    key = k_spin_lock(&lock);
+    published = attitude.state;
+    k_spin_unlock(&lock, key);
+
+#ifdef CONFIG_COMBAT_USB_TELEMETRY
+    int32_t v[9];
+
+    memcpy(&v[0], sample.gyro_mdps, sizeof(sample.gyro_mdps));
+    memcpy(&v[3], sample.accel_mg, sizeof(sample.accel_mg));
+    v[6] = attitude.state.roll;
+    v[7] = attitude.state.pitch;
+    v[8] = attitude.state.inverted;
+    usb_telemetry_send(USB_TELEMETRY_SOURCE_IMU, TELEMETRY_IMU, v);
+#endif
+
+#ifdef CONFIG_COMBAT_BLACKBOX
+    static unsigned record_count;
+
+    if (++record_count >= CONFIG_COMBAT_BLACKBOX_IMU_DIVIDER) {
+        int32_t v[BLACKBOX_MAX_FIELDS];
+
+        memcpy(&v[0], sample.gyro_mdps, sizeof(sample.gyro_mdps));
+        memcpy(&v[3], sample.accel_mg, sizeof(sample.accel_mg));
+        blackbox_record(BLACKBOX_SOURCE_IMU, BLACKBOX_IMU, v);
+        record_count = 0;
+    }
+#endif
+
+#ifdef CONFIG_COMBAT_YAW_CONTROL
+    /* Steering right turns clockwise seen from above, which is negative
+     * about the world's vertical. */
+    yaw_control_tick(&sample,
+                     -attitude_yaw_rate(&attitude, sample.gyro_mdps));
+#endif
+
+    supervisor_done(SUPERVISOR_TASK_IMU);
+}
+
+bool imu_inverted(void)
+{
+    k_spinlock_key_t key;
+    bool inverted;
+
+    key = k_spin_lock(&lock);
+    inverted = published.inverted;
+    k_spin_unlock(&lock, key);
+
+    return inverted;
+}
+
+void imu_get_attitude(struct attitude_state *state)
+{
+    k_spinlock_key_t key;
+
+    key = k_spin_lock(&lock);
+    *state = published;
+    k_spin_unlock(&lock, key);
+}
+
+int imu_set_active(bool active)
+{
+    int rc;
+
+    if (!active) {
+        rc = pm_device_action_run(imu, PM_DEVICE_ACTION_SUSPEND);
+        if (rc && rc != -EALREADY)
+            return rc;
+
+        supervisor_pause(SUPERVISOR_TASK_IMU);
+        return 0;
+    }
+
+    /* Ticks don't start again until the FIFO fills, well inside the
+     * period. */
+    attitude_started = false;
+    restarted = true;
+    supervisor_resume(SUPERVISOR_TASK_IMU);
+
+    rc = pm_device_action_run(imu, PM_DEVICE_ACTION_RESUME);
+
+    return rc == -EALREADY ? 0 : rc;
+}
+
+void imu_get_stats(struct imu_stats *out)
+{
+    /* The loop runs in the IMU driver's cooperative thread, so it can't be
+     * part way through an update when we get to run. */
+    k_sched_lock();
+    memcpy(out, &stats, sizeof(*out));
+    k_sched_unlock();
+}
+
+int imu_init(void)
+{
+    struct attitude_config config;
+    int rc;
+
+    if (!device_is_ready(imu))
+        return -ENODEV;
+
+    rc = sensor_get_decoder(imu, &decoder);
+    if (rc)
+        return rc;
+
+    attitude_config_default(&config);
+    config.rate_hz = IMU_RATE_HZ;
+    config.accel_tau_ms = CONFIG_COMBAT_ATTITUDE_ACCEL_TAU_MS;
+    config.invert_threshold =
+        CONFIG_COMBAT_INVERT_THRESHOLD * ATTITUDE_Q14_ONE / 100;
+    config.invert_ms = CONFIG_COMBAT_INVERT_MS;
+    attitude_init(&attitude, &config);
+
+    rc = sensor_trigger_set(imu, &fifo_trigger, fifo_handler);
+    if (rc)
+        return rc;
+
+    /* A tick is well under a millisecond, and they come every couple. */
+    supervisor_register(SUPERVISOR_TASK_IMU, 20, 100);
+
+    return 0;
+}
@@ -0,0 +1,78 @@
+#ifndef IMU_H
+#define IMU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "attitude.h"
+
+/**
+ * @brief A tick's worth of IMU data, averaged over the FIFO sets read, in
+ * the robot's frame: x forward, y left, z up.
+ */
+struct imu_sample
+{
+    int32_t gyro_mdps[3];
+    int32_t accel_mg[3];
+    /* k_cycle_get_32() when the watermark was handled. */
+    uint32_t start;
+};
+
+struct imu_stats
+{
+    uint32_t ticks;
+    uint32_t read_errors;
+    /* Longest gap between ticks. */
+    uint32_t max_interval_us;
+};
+
+#ifdef CONFIG_COMBAT_IMU
+
+#include <zephyr/devicetree.h>
+
+#define IMU_NODE DT_NODELABEL(accel_gyro)
+
+/* The loop runs each time the gyro FIFO reaches its watermark, so it's
+ * timed by the IMU's clock and nothing else. */
+#define IMU_RATE_HZ \
+    (DT_PROP(IMU_NODE, gyro_odr) / DT_PROP(IMU_NODE, fifo_watermark))
+
+/**
+ * @brief Start reading the IMU on every FIFO watermark.
+ */
+extern int imu_init(void);
+
+/**
+ * @brief True if the robot's upside down, going by the attitude estimate.
+ */
+extern bool imu_inverted(void);
+
+extern void imu_get_attitude(struct attitude_state *state);
+
+extern void imu_get_stats(struct imu_stats *stats);
+
+/**
+ * @brief Power the IMU down, which stops the loop, or bring it back.
+ */
+extern int imu_set_active(bool active);
+
+#else
+
+static inline int imu_init(void)
+{
+    return 0;
+}
+
+static inline bool imu_inverted(void)
+{
+    return false;
+}
+
+static inline int imu_set_active(bool active)
+{
+    return 0;
+}
+
+#endif /* CONFIG_COMBAT_IMU */
+
+#endif /* IMU_H */
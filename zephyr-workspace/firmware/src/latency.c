@@ -0,0 +1,133 @@
+#include "latency.h"
+
+#include <string.h>
+#include <zephyr/kernel.h>
+
+#ifdef CONFIG_SHELL
+#include <zephyr/shell/shell.h>
+#endif
+
+static struct latency_histogram histograms[LATENCY_STAGE_COUNT];
+
+const char *const latency_stage_names[LATENCY_STAGE_COUNT] = {
+    [LATENCY_STAGE_RX] = "rx",
+    [LATENCY_STAGE_FRAME] = "frame",
+    [LATENCY_STAGE_CRC] = "crc",
+    [LATENCY_STAGE_MIXER] = "mixer",
+    [LATENCY_STAGE_PWM] = "pwm",
+};
+
+void latency_record(const struct latency_sample *sample)
+{
+    /* Everything is measured from when the frame started arriving. */
+    for (int i = LATENCY_STAGE_FRAME; i < LATENCY_STAGE_COUNT; i++) {
+        struct latency_histogram *hist = &histograms[i];
+        uint32_t us = k_cyc_to_us_floor32(sample->t[i] -
+                                          sample->t[LATENCY_STAGE_RX]);
+        uint32_t bucket = us / CONFIG_COMBAT_LATENCY_BUCKET_US;
+
+        bucket = MIN(bucket, CONFIG_COMBAT_LATENCY_BUCKETS - 1);
+
+        hist->bucket[bucket]++;
+        hist->count++;
+        hist->max_us = MAX(hist->max_us, us);
+    }
+}
+
+void latency_get(enum latency_stage stage, struct latency_histogram *hist)
+{
+    /* The writer is a cooperative thread, so it can't be part way through
+     * an update when we get to run. */
+    k_sched_lock();
+    memcpy(hist, &histograms[stage], sizeof(*hist));
+    k_sched_unlock();
+}
+
+void latency_reset(void)
+{
+    k_sched_lock();
+    memset(histograms, 0, sizeof(histograms));
+    k_sched_unlock();
+}
+
+uint32_t latency_percentile(const struct latency_histogram *hist,
+                            uint32_t permille)
+{
+    uint32_t want = ((uint64_t)hist->count * permille + 999) / 1000;
+    uint32_t seen = 0;
+
+    if (!hist->count)
+        return 0;
+
+    for (int b = 0; b < CONFIG_COMBAT_LATENCY_BUCKETS - 1; b++) {
+        seen += hist->bucket[b];
+        if (seen >= want) {
+            return MIN((uint32_t)(b + 1) * CONFIG_COMBAT_LATENCY_BUCKET_US,
+                       hist->max_us);
+        }
+    }
+
+    /* Somewhere past the last bucket. */
+    return hist->max_us;
+}
+
+void latency_report(void)
+{
+    struct latency_histogram hist;
+
+    for (int i = LATENCY_STAGE_FRAME; i < LATENCY_STAGE_COUNT; i++) {
+        latency_get(i, &hist);
+
+        printk("latency %s n=%u max=%uus", latency_stage_names[i], hist.count,
+               hist.max_us);
+        for (int b = 0; b < CONFIG_COMBAT_LATENCY_BUCKETS - 1; b++) {
+            if (hist.bucket[b]) {
+                printk(" <%u:%u", (b + 1) * CONFIG_COMBAT_LATENCY_BUCKET_US,
+                       hist.bucket[b]);
+            }
+        }
+        printk(" >=%u:%u",
+               (CONFIG_COMBAT_LATENCY_BUCKETS - 1) *
+                   CONFIG_COMBAT_LATENCY_BUCKET_US,
+               hist.bucket[CONFIG_COMBAT_LATENCY_BUCKETS - 1]);
+        printk("\n");
+    }
+}
+
+#ifdef CONFIG_SHELL
+static int cmd_latency_show(const struct shell *sh, size_t argc, char **argv)
+{
+    struct latency_histogram hist;
+
+    shell_print(sh, "%-6s %8s %7s %7s %7s %7s", "stage", "frames", "p50_us",
+                "p90_us", "p99_us", "max_us");
+
+    for (int i = LATENCY_STAGE_FRAME; i < LATENCY_STAGE_COUNT; i++) {
+        latency_get(i, &hist);
+        shell_print(sh, "%-6s %8u %7u %7u %7u %7u", latency_stage_names[i],
+                    hist.count, latency_percentile(&hist, 500),
+                    latency_percentile(&hist, 900),
+                    latency_percentile(&hist, 990), hist.max_us);
+    }
+
+    shell_print(sh, "From the sync byte arriving, to %u us",
+                CONFIG_COMBAT_LATENCY_BUCKET_US);
+
+    return 0;
+}
+
+static int cmd_latency_reset(const struct shell *sh, size_t argc, char **argv)
+{
+    latency_reset();
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(
+    latency_cmds,
+    SHELL_CMD(show, NULL, "Percentiles of the latency to each stage",
+              cmd_latency_show),
+    SHELL_CMD(reset, NULL, "Start the histograms again", cmd_latency_reset),
+    SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(latency, &latency_cmds, "Radio to motor latency", NULL);
+#endif
@@ -0,0 +1,112 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+#include <zephyr/kernel.h>
+
+#include "drivers/misc/csrf.h"
+
+enum latency_stage
+{
+    /* The sync byte arrived on the wire. */
+    LATENCY_STAGE_RX,
+    /* The whole frame had been received. */
+    LATENCY_STAGE_FRAME,
+    /* The CRC checked out. */
+    LATENCY_STAGE_CRC,
+    /* The mixer had worked out the outputs. */
+    LATENCY_STAGE_MIXER,
+    /* The outputs were written to the hardware. */
+    LATENCY_STAGE_PWM,
+
+    LATENCY_STAGE_COUNT,
+};
+
+/**
+ * @brief Cycle counter timestamps for a frame as it passed through each
+ * stage.
+ */
+struct latency_sample
+{
+    uint32_t t[LATENCY_STAGE_COUNT];
+};
+
+#ifdef CONFIG_COMBAT_LATENCY
+
+/**
+ * @brief Latency from LATENCY_STAGE_RX to one stage.
+ */
+struct latency_histogram
+{
+    uint32_t count;
+    uint32_t max_us;
+    uint32_t bucket[CONFIG_COMBAT_LATENCY_BUCKETS];
+};
+
+/**
+ * @brief Start a sample from the timestamps the radio driver took.
+ */
+static inline void latency_sample_init(struct latency_sample *sample,
+                                       const struct csrf_frame_timestamps *ts)
+{
+    sample->t[LATENCY_STAGE_RX] = ts->rx;
+    sample->t[LATENCY_STAGE_FRAME] = ts->frame;
+    sample->t[LATENCY_STAGE_CRC] = ts->crc;
+}
+
+static inline void latency_mark(struct latency_sample *sample,
+                                enum latency_stage stage)
+{
+    sample->t[stage] = k_cycle_get_32();
+}
+
+/**
+ * @brief Add a complete sample to the histograms.
+ *
+ * Only to be called from the control path, which is the radio and IMU
+ * threads. They're both cooperative, so neither can get in part way
+ * through the other's update, and the histograms aren't locked.
+ */
+extern void latency_record(const struct latency_sample *sample);
+
+/**
+ * @brief Take a copy of the histogram for a stage.
+ */
+extern void latency_get(enum latency_stage stage,
+                        struct latency_histogram *hist);
+
+extern void latency_reset(void);
+
+/**
+ * @brief Latency under which the given share of the frames came in, in
+ * per mille, to the resolution of the buckets.
+ */
+extern uint32_t latency_percentile(const struct latency_histogram *hist,
+                                   uint32_t permille);
+
+extern const char *const latency_stage_names[LATENCY_STAGE_COUNT];
+
+/**
+ * @brief Print every histogram to the console.
+ */
+extern void latency_report(void);
+
+#else
+
+static inline void latency_sample_init(struct latency_sample *sample,
+                                       const struct csrf_frame_timestamps *ts)
+{
+}
+
+static inline void latency_mark(struct latency_sample *sample,
+                                enum latency_stage stage)
+{
+}
+
+static inline void latency_record(const struct latency_sample *sample)
+{
+}
+
+#endif /* CONFIG_COMBAT_LATENCY */
+
+#endif /* LATENCY_H */
@@ -1,126 +1,143 @@
+#include <string.h>
 #include <zephyr/drivers/led.h>
 #include <zephyr/kernel.h>
+#include <zephyr/pm/policy.h>
 
+#include "led_engine.h"
 #include "main.h"
 
 static const struct device *rgb = DEVICE_DT_GET(DT_PATH(rgb_led));
 
-/**
- * @brief A colour in RGB space.
- */
-struct rgb_colour
-{
-    uint8_t r, g, b;
-};
-
-/**
- * @brief A frame in the LED animation.
- */
-struct frame
-{
-    /* The colour to set the LED to. */
-    struct rgb_colour colour;
-    /* How long to stay in this frame. */
-    unsigned duration_ms;
-};
+/* Nothing shows faster than the PWM period. */
+#define PWM_PERIOD_MS \
+    (DT_PWMS_PERIOD(DT_NODELABEL(red_led_pwm)) / NSEC_PER_MSEC)
 
 #define RGB(r_, g_, b_) {.r = r_, .g = g_, .b = b_}
 
-#define LED_PATTERN_BLINK2(colour_, interval_on_, interval_off_) \
-    {                                                            \
-        {.colour = colour_, .duration_ms = interval_on_},        \
-        {                                                        \
-            .colour = RGB(0, 0, 0), .duration_ms = interval_off_ \
-        }                                                        \
+#define PATTERN(frames_, repeat_)                                  \
+    {                                                              \
+        .frames = frames_, .length = ARRAY_SIZE(frames_),          \
+        .repeat = repeat_,                                         \
     }
 
-#define LED_PATTERN_BLINK(colour_, interval_)                \
-    {                                                        \
-        {.colour = colour_, .duration_ms = interval_},       \
-        {                                                    \
-            .colour = RGB(0, 0, 0), .duration_ms = interval_ \
-        }                                                    \
+#define LED_FRAMES_BLINK2(colour_, interval_on_, interval_off_)    \
+    {                                                              \
+        {.colour = colour_, .duration_ms = interval_on_},          \
+        {                                                          \
+            .colour = RGB(0, 0, 0), .duration_ms = interval_off_   \
+        }                                                          \
     }
 
-static const struct frame pattern_init[] = {
-    {.colour = RGB(100, 100, 100), .duration_ms = 500}};
+/* A short flash, and the layer below for the rest. */
+#define LED_FRAMES_OVERLAY(colour_, interval_on_, interval_off_)   \
+    {                                                              \
+        {.colour = colour_, .duration_ms = interval_on_},          \
+        {                                                          \
+            .duration_ms = interval_off_, .flags = LED_FRAME_CLEAR \
+        }                                                          \
+    }
+
+static const struct led_frame frames_init[] = {
+    {.colour = RGB(100, 100, 100)}};
+
+/* Short, so the CPU can stop for most of it. */
+static const struct led_frame frames_no_radio[] =
+    LED_FRAMES_BLINK2(RGB(0, 0, 40), 30, 1000);
+
+static const struct led_frame frames_disarmed[] =
+    LED_FRAMES_BLINK2(RGB(0, 100, 0), 30, 500);
+
+static const struct led_frame frames_armed[] =
+    LED_FRAMES_BLINK2(RGB(100, 0, 0), 30, 100);
 
-static const struct frame pattern_no_radio[] =
-    LED_PATTERN_BLINK2(RGB(0, 0, 100), 30, 1000);
+static const struct led_frame frames_limited[] =
+    LED_FRAMES_OVERLAY(RGB(100, 40, 0), 30, 250);
 
-static const struct frame pattern_disarmed[] =
-    LED_PATTERN_BLINK2(RGB(0, 100, 0), 30, 500);
+static const struct led_frame frames_fault[] =
+    LED_FRAMES_BLINK2(RGB(100, 0, 100), 60, 60);
+
+static const struct led_pattern patterns[] = {
+    [LED_STATE_INIT] = PATTERN(frames_init, 0),
+    [LED_STATE_NO_RADIO] = PATTERN(frames_no_radio, 0),
+    [LED_STATE_DISARMED] = PATTERN(frames_disarmed, 0),
+    [LED_STATE_ARMED] = PATTERN(frames_armed, 0),
+};
+
+static const struct led_pattern overlay_patterns[] = {
+    [LED_OVERLAY_LIMITED] = PATTERN(frames_limited, 0),
+    [LED_OVERLAY_FAULT] = PATTERN(frames_fault, 3),
+};
 
-static const struct frame pattern_armed[] =
-    LED_PATTERN_BLINK2(RGB(100, 0, 0), 30, 100);
+/* The state at the bottom, and the overlays above it in order. */
+#define STATE_LAYER 0
+#define OVERLAY_LAYER(overlay) (1 + (overlay))
 
-static enum led_state current_state = LED_STATE_INIT;
-static const struct frame *current_pattern = NULL;
-static unsigned frame_index = 0;
-static unsigned pattern_length = 0;
-static unsigned time_ms = 0;
+BUILD_ASSERT(OVERLAY_LAYER(LED_OVERLAY_COUNT) <= LED_ENGINE_LAYERS,
+             "Not enough LED layers for the overlays");
 
-static void led_timer_handler(struct k_timer *timer);
-K_TIMER_DEFINE(led_timer, led_timer_handler, NULL);
+static struct k_spinlock lock;
+static struct led_engine engine;
+
+/* The PWM timer stops with the CPU, so it's kept out of stop while the
+ * LED's lit. Only touched by the work. */
+static bool lit;
 
 static void led_work_handler(struct k_work *work);
-K_WORK_DEFINE(led_work, led_work_handler);
+K_WORK_DELAYABLE_DEFINE(led_work, led_work_handler);
 
-static void led_timer_handler(struct k_timer *timer)
+/**
+ * @brief Write the channels that changed, and come back when the next one
+ * does. Nothing runs while the LED's steady.
+ */
+static void led_work_handler(struct k_work *work)
 {
-    k_work_submit(&led_work);
+    uint8_t out[LED_ENGINE_CHANNELS];
+    uint32_t now, next;
+    uint8_t changed;
+    bool pending, on;
+    k_spinlock_key_t key;
+
+    key = k_spin_lock(&lock);
+    now = k_uptime_get_32();
+    pending = led_engine_update(&engine, now, &changed, &next);
+    memcpy(out, engine.out, sizeof(out));
+    k_spin_unlock(&lock, key);
+
+    for (int i = 0; i < LED_ENGINE_CHANNELS; i++) {
+        if (changed & BIT(i))
+            led_set_brightness(rgb, i, out[i]);
+    }
+
+    on = out[0] || out[1] || out[2];
+    if (on && !lit)
+        pm_policy_state_lock_get(PM_STATE_SUSPEND_TO_IDLE, PM_ALL_SUBSTATES);
+    else if (!on && lit)
+        pm_policy_state_lock_put(PM_STATE_SUSPEND_TO_IDLE, PM_ALL_SUBSTATES);
+    lit = on;
+
+    if (pending)
+        k_work_schedule(&led_work, K_MSEC(MAX((int32_t)(next - now), 0)));
 }
 
-static void led_work_handler(struct k_work *work)
+static void set_layer(unsigned layer, const struct led_pattern *pattern)
 {
-    const struct frame *frame = &current_pattern[frame_index];
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    bool changed = led_engine_set(&engine, layer, pattern, k_uptime_get_32());
 
-    led_set_brightness(rgb, 0, frame->colour.r);
-    led_set_brightness(rgb, 1, frame->colour.g);
-    led_set_brightness(rgb, 2, frame->colour.b);
+    k_spin_unlock(&lock, key);
 
-    time_ms += 10;
-    if (time_ms >= frame->duration_ms) {
-        time_ms = 0;
-        frame_index++;
-    }
-
-    if (frame_index >= pattern_length) {
-        frame_index = 0;
-    }
+    if (changed)
+        k_work_reschedule(&led_work, K_NO_WAIT);
 }
 
 void led_set_state(enum led_state state)
 {
-    if (current_state == state) {
-        return;
-    }
-
-    switch (state) {
-        case LED_STATE_NO_RADIO:
-            current_pattern = pattern_no_radio;
-            pattern_length = ARRAY_SIZE(pattern_no_radio);
-            break;
-
-        case LED_STATE_DISARMED:
-            current_pattern = pattern_disarmed;
-            pattern_length = ARRAY_SIZE(pattern_disarmed);
-            break;
-
-        case LED_STATE_ARMED:
-            current_pattern = pattern_armed;
-            pattern_length = ARRAY_SIZE(pattern_armed);
-            break;
-
-        case LED_STATE_INIT:
-        default:
-            current_pattern = pattern_init;
-            pattern_length = ARRAY_SIZE(pattern_init);
-            break;
-    }
+    set_layer(STATE_LAYER, &patterns[state]);
+}
 
-    frame_index = 0;
-    current_state = state;
+void led_set_overlay(enum led_overlay overlay, bool on)
+{
+    set_layer(OVERLAY_LAYER(overlay), on ? &overlay_patterns[overlay] : NULL);
 }
 
 static int led_init(void)
@@ -129,12 +146,8 @@ static int led_init(void)
         return -ENODEV;
     }
 
-    current_pattern = pattern_init;
-    pattern_length = ARRAY_SIZE(pattern_init);
-    frame_index = 0;
-    current_state = LED_STATE_INIT;
-
-    k_timer_start(&led_timer, K_MSEC(10), K_MSEC(10));
+    led_engine_init(&engine, MAX(PWM_PERIOD_MS, 1));
+    led_set_state(LED_STATE_INIT);
 
     return 0;
 }
@@ -0,0 +1,166 @@
+#include "led_engine.h"
+
+#include <stddef.h>
+#include <string.h>
+
+void led_engine_init(struct led_engine *engine, uint32_t min_step)
+{
+    memset(engine, 0, sizeof(*engine));
+    engine->min_step = min_step;
+}
+
+bool led_engine_set(struct led_engine *engine, unsigned layer,
+                    const struct led_pattern *pattern, uint32_t now)
+{
+    struct led_layer *l;
+
+    if (layer >= LED_ENGINE_LAYERS)
+        return false;
+
+    l = &engine->layers[layer];
+    if (l->pattern == pattern)
+        return false;
+
+    l->pattern = pattern;
+    l->index = 0;
+    l->plays = 0;
+    l->frame_start = now;
+
+    return true;
+}
+
+/**
+ * @brief Move on to the frame that's showing now, clearing the layer if
+ * the pattern's finished.
+ */
+static void advance(struct led_layer *layer, uint32_t now)
+{
+    const struct led_pattern *pattern = layer->pattern;
+
+    while (pattern) {
+        uint16_t duration = pattern->frames[layer->index].duration_ms;
+
+        if (!duration || (int32_t)(now - layer->frame_start) < duration)
+            return;
+
+        layer->frame_start += duration;
+        if (++layer->index == pattern->length) {
+            layer->index = 0;
+            if (pattern->repeat && ++layer->plays == pattern->repeat) {
+                layer->pattern = NULL;
+                return;
+            }
+        }
+    }
+}
+
+static const struct led_frame *frame(const struct led_layer *layer)
+{
+    return &layer->pattern->frames[layer->index];
+}
+
+static void soonest(bool *have, uint32_t *next, uint32_t t)
+{
+    if (!*have || (int32_t)(t - *next) < 0)
+        *next = t;
+    *have = true;
+}
+
+/**
+ * @brief A channel part way through a fade from a to b over d, and when
+ * it next changes, if it does.
+ */
+static uint8_t fade(uint8_t a, uint8_t b, uint32_t e, uint32_t d,
+                    uint32_t *step)
+{
+    uint32_t k = a > b ? a - b : b - a;
+    uint32_t s = k * e / d;
+
+    /* The first time k * e / d reaches s + 1. */
+    *step = s < k ? ((s + 1) * d + k - 1) / k : UINT32_MAX;
+
+    return a > b ? a - s : a + s;
+}
+
+static struct led_colour fade_colour(const struct led_engine *engine,
+                                     const struct led_layer *layer,
+                                     uint32_t now, bool *have, uint32_t *next)
+{
+    const struct led_pattern *pattern = layer->pattern;
+    const struct led_frame *to = frame(layer);
+    const struct led_frame *from =
+        &pattern->frames[(layer->index ? layer->index : pattern->length) - 1];
+    uint32_t e = now - layer->frame_start;
+    uint32_t d = to->duration_ms;
+    uint32_t step[LED_ENGINE_CHANNELS], first = UINT32_MAX;
+    struct led_colour colour = {
+        .r = fade(from->colour.r, to->colour.r, e, d, &step[0]),
+        .g = fade(from->colour.g, to->colour.g, e, d, &step[1]),
+        .b = fade(from->colour.b, to->colour.b, e, d, &step[2]),
+    };
+
+    for (int i = 0; i < LED_ENGINE_CHANNELS; i++) {
+        if (step[i] < first)
+            first = step[i];
+    }
+
+    /* The end of the frame is already a change. */
+    if (first != UINT32_MAX) {
+        if (first < e + engine->min_step)
+            first = e + engine->min_step;
+        if (first < d)
+            soonest(have, next, layer->frame_start + first);
+    }
+
+    return colour;
+}
+
+bool led_engine_update(struct led_engine *engine, uint32_t now,
+                       uint8_t *changed, uint32_t *next)
+{
+    struct led_colour colour = {0};
+    const struct led_layer *layer;
+    bool have = false;
+    int shown;
+
+    for (int i = 0; i < LED_ENGINE_LAYERS; i++)
+        advance(&engine->layers[i], now);
+
+    for (shown = LED_ENGINE_LAYERS - 1; shown >= 0; shown--) {
+        layer = &engine->layers[shown];
+        if (layer->pattern && !(frame(layer)->flags & LED_FRAME_CLEAR))
+            break;
+    }
+
+    /* Layers under the one showing can't change anything until they're
+     * uncovered, and they keep time until then. */
+    for (int i = shown > 0 ? shown : 0; i < LED_ENGINE_LAYERS; i++) {
+        layer = &engine->layers[i];
+        if (layer->pattern && frame(layer)->duration_ms)
+            soonest(&have, next,
+                    layer->frame_start + frame(layer)->duration_ms);
+    }
+
+    if (shown >= 0) {
+        layer = &engine->layers[shown];
+        if (frame(layer)->flags & LED_FRAME_FADE && frame(layer)->duration_ms)
+            colour = fade_colour(engine, layer, now, &have, next);
+        else
+            colour = frame(layer)->colour;
+    }
+
+    *changed = 0;
+    if (!engine->out_valid || colour.r != engine->out[0])
+        *changed |= 1 << 0;
+    if (!engine->out_valid || colour.g != engine->out[1])
+        *changed |= 1 << 1;
+    if (!engine->out_valid || colour.b != engine->out[2])
+        *changed |= 1 << 2;
+
+    engine->out[0] = colour.r;
+    engine->out[1] = colour.g;
+    engine->out[2] = colour.b;
+    engine->out_valid = true;
+
+    return have;
+}
@@ -0,0 +1,92 @@
+#ifndef LED_ENGINE_H
+#define LED_ENGINE_H
+
+/*
+ * RGB LED animation engine. Patterns are played on layers, and the top
+ * layer that isn't clear shows. Each update works out the colour, which
+ * channels changed, and when the next one will, so the LED is only
+ * touched when something actually changes: not at all while it's steady,
+ * at frame boundaries while blinking, and a step at a time while fading.
+ *
+ * Times are in milliseconds on a wrapping uint32_t clock, like
+ * k_uptime_get_32(). Not thread safe.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define LED_ENGINE_CHANNELS 3
+#define LED_ENGINE_LAYERS 3
+
+/**
+ * @brief A colour, as brightness in percent for each channel.
+ */
+struct led_colour
+{
+    uint8_t r, g, b;
+};
+
+/* Fade from the previous frame's colour to this one over the frame. */
+#define LED_FRAME_FADE (1 << 0)
+/* Show the layer below for this frame. */
+#define LED_FRAME_CLEAR (1 << 1)
+
+struct led_frame
+{
+    struct led_colour colour;
+    /* How long to stay in this frame, or 0 to stay for good. */
+    uint16_t duration_ms;
+    uint8_t flags;
+};
+
+struct led_pattern
+{
+    const struct led_frame *frames;
+    uint8_t length;
+    /* Times to play it before the layer clears, or 0 to loop for ever. */
+    uint8_t repeat;
+};
+
+struct led_layer
+{
+    const struct led_pattern *pattern;
+    uint8_t index;
+    uint8_t plays;
+    uint32_t frame_start;
+};
+
+struct led_engine
+{
+    struct led_layer layers[LED_ENGINE_LAYERS];
+    /* Least time between fade steps. There's no point going faster than
+     * the PWM period. */
+    uint32_t min_step;
+
+    /* What's on the LED. */
+    uint8_t out[LED_ENGINE_CHANNELS];
+    bool out_valid;
+};
+
+extern void led_engine_init(struct led_engine *engine, uint32_t min_step);
+
+/**
+ * @brief Play a pattern on a layer from now, or clear it with NULL. The
+ * pattern that's already playing carries on where it was.
+ *
+ * @return Whether the layer changed, so it needs an update.
+ */
+extern bool led_engine_set(struct led_engine *engine, unsigned layer,
+                           const struct led_pattern *pattern, uint32_t now);
+
+/**
+ * @brief Work out the colour now, into engine->out.
+ *
+ * @param changed Set to a bitmask of the channels that changed since the
+ * last update.
+ * @param next Set to when the next change is, if there is one.
+ * @return Whether there's a next change.
+ */
+extern bool led_engine_update(struct led_engine *engine, uint32_t now,
+                              uint8_t *changed, uint32_t *next);
+
+#endif /* LED_ENGINE_H */
@@ -0,0 +1,103 @@
+#include "link_monitor.h"
+
+/* Link quality has to come back this far above the limit before the drive
+ * is let off, so it doesn't chatter. */
+#define LQ_HYSTERESIS 10
+
+/* Each interval moves the estimate 1/2^this of the way. */
+#define INTERVAL_SHIFT 3
+
+void link_monitor_config_default(struct link_monitor_config *config)
+{
+    *config = (struct link_monitor_config){
+        .initial_interval = 20000,
+        .min_stop = 20000,
+        .max_stop = 500000,
+        .limit_frames = 3,
+        .stop_frames = 10,
+        .lq_limit = 50,
+        .limit_percent = 50,
+    };
+}
+
+void link_monitor_init(struct link_monitor *mon,
+                       const struct link_monitor_config *config)
+{
+    mon->config = *config;
+    mon->interval_q = config->initial_interval << INTERVAL_SHIFT;
+    mon->last_frame = 0;
+    mon->have_frame = false;
+    mon->lq_low = false;
+    mon->level = LINK_STOPPED;
+}
+
+uint32_t link_monitor_stop_after(const struct link_monitor *mon)
+{
+    uint64_t t = (uint64_t)(mon->interval_q >> INTERVAL_SHIFT) *
+                 mon->config.stop_frames;
+
+    if (t < mon->config.min_stop)
+        t = mon->config.min_stop;
+    if (t > mon->config.max_stop)
+        t = mon->config.max_stop;
+
+    return t;
+}
+
+void link_monitor_frame(struct link_monitor *mon, uint32_t now)
+{
+    uint32_t dt = now - mon->last_frame;
+
+    /* A gap past max_stop is a dropout, not the frame rate. Anything
+     * shorter counts, even if it stopped everything, so a change of packet
+     * rate is picked up within a few frames. */
+    if (mon->have_frame && dt <= mon->config.max_stop)
+        mon->interval_q += dt - (mon->interval_q >> INTERVAL_SHIFT);
+
+    mon->last_frame = now;
+    mon->have_frame = true;
+}
+
+void link_monitor_quality(struct link_monitor *mon, uint8_t lq)
+{
+    if (mon->lq_low)
+        mon->lq_low = lq < mon->config.lq_limit + LQ_HYSTERESIS;
+    else
+        mon->lq_low = lq < mon->config.lq_limit;
+}
+
+enum link_level link_monitor_update(struct link_monitor *mon, uint32_t now,
+                                    uint32_t *next)
+{
+    uint32_t stop_after = link_monitor_stop_after(mon);
+    uint64_t limit_after = (uint64_t)(mon->interval_q >> INTERVAL_SHIFT) *
+                           mon->config.limit_frames;
+    uint32_t since = now - mon->last_frame;
+
+    if (limit_after > stop_after)
+        limit_after = stop_after;
+
+    if (!mon->have_frame || since >= stop_after) {
+        mon->level = LINK_STOPPED;
+    } else if (since >= limit_after) {
+        mon->level = LINK_LIMITED;
+        *next = mon->last_frame + stop_after;
+    } else {
+        mon->level = mon->lq_low ? LINK_LIMITED : LINK_OK;
+        *next = mon->last_frame + limit_after;
+    }
+
+    return mon->level;
+}
+
+uint8_t link_monitor_drive_percent(const struct link_monitor *mon)
+{
+    switch (mon->level) {
+        case LINK_OK:
+            return 100;
+        case LINK_LIMITED:
+            return mon->config.limit_percent;
+        default:
+            return 0;
+    }
+}
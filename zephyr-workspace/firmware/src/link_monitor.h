@@ -0,0 +1,100 @@
+#ifndef LINK_MONITOR_H
+#define LINK_MONITOR_H
+
+/*
+ * Radio link monitor for the failsafe. Learns how often RC frames come,
+ * and says how far to back off when they stop: the drive is limited after
+ * a few missed frames, or when the receiver reports poor link quality, and
+ * everything stops after a few more.
+ *
+ * Times are on whatever wrapping uint32_t clock the caller uses, like
+ * k_cycle_get_32(), as long as max_stop fits in 28 bits.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+enum link_level
+{
+    LINK_OK,
+    /* Frames are late or link quality is poor, so the drive is limited. */
+    LINK_LIMITED,
+    /* Frames have stopped, so everything else has to. */
+    LINK_STOPPED,
+};
+
+struct link_monitor_config
+{
+    /* Time between frames, until it's been measured. */
+    uint32_t initial_interval;
+    /* Never stop sooner than this after the last frame, however fast the
+     * frames come. */
+    uint32_t min_stop;
+    /* Always stop by this long after the last frame, however slow. */
+    uint32_t max_stop;
+    /* Frames that can be missed before the drive is limited, and before
+     * everything stops. */
+    uint8_t limit_frames;
+    uint8_t stop_frames;
+    /* Uplink link quality, in percent, below which the drive is limited. */
+    uint8_t lq_limit;
+    /* What the drive is limited to, in percent. */
+    uint8_t limit_percent;
+};
+
+struct link_monitor
+{
+    struct link_monitor_config config;
+
+    /* Smoothed time between frames, with 3 fractional bits so it settles
+     * on the true interval. */
+    uint32_t interval_q;
+    uint32_t last_frame;
+    bool have_frame;
+    bool lq_low;
+
+    enum link_level level;
+};
+
+/**
+ * @brief The defaults, in microseconds.
+ */
+extern void link_monitor_config_default(struct link_monitor_config *config);
+
+/**
+ * @brief Start off stopped, until the first frame.
+ */
+extern void link_monitor_init(struct link_monitor *mon,
+                              const struct link_monitor_config *config);
+
+/**
+ * @brief An RC frame came in.
+ */
+extern void link_monitor_frame(struct link_monitor *mon, uint32_t now);
+
+/**
+ * @brief The receiver's uplink link quality, in percent.
+ */
+extern void link_monitor_quality(struct link_monitor *mon, uint8_t lq);
+
+/**
+ * @brief Work out the level at now.
+ *
+ * @param next Set to when the level next changes if no more frames come,
+ * unless it's already LINK_STOPPED.
+ */
+extern enum link_level link_monitor_update(struct link_monitor *mon,
+                                           uint32_t now, uint32_t *next);
+
+/**
+ * @brief How long after the last frame everything stops, at the current
+ * frame rate.
+ */
+extern uint32_t link_monitor_stop_after(const struct link_monitor *mon);
+
+/**
+ * @brief The drive limit for the last level worked out, in percent.
+ */
+extern uint8_t link_monitor_drive_percent(const struct link_monitor *mon);
+
+#endif /* LINK_MONITOR_H */
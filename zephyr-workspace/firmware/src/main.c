@@ -1,252 +1,698 @@
 #include "main.h"
 
-#include <math.h>
 #include <string.h>
 #include <zephyr/device.h>
 #include <zephyr/drivers/flash.h>
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/drivers/led.h>
-#include <zephyr/drivers/pwm.h>
 #include <zephyr/drivers/uart.h>
-#include <zephyr/drivers/watchdog.h>
 #include <zephyr/kernel.h>
 
+#include "battery.h"
+#include "blackbox.h"
 #include "drivers/misc/csrf.h"
+#include "drivers/misc/dshot.h"
+#include "drivers/misc/esc_telemetry.h"
+#include "drivers/misc/motors.h"
+#include "failsafe.h"
+#include "imu.h"
+#include "latency.h"
+#include "mixer.h"
+#include "power.h"
+#include "radio_params.h"
+#include "robot_settings.h"
+#include "settings_store.h"
+#include "supervisor.h"
+#include "usb_telemetry.h"
+#include "yaw_control.h"
 
-static const struct device *const wdt = DEVICE_DT_GET(DT_ALIAS(watchdog0));
 
 static const struct device *elrs_radio =
     DEVICE_DT_GET(DT_NODELABEL(elrs_radio));
 
 static const struct device *imu = DEVICE_DT_GET(DT_NODELABEL(accel_gyro));
 
-static const struct pwm_dt_spec esc_pwm = PWM_DT_SPEC_GET(DT_NODELABEL(esc0));
+static const struct device *weapon_esc =
+    DEVICE_DT_GET(DT_NODELABEL(weapon_esc));
 
-static const struct pwm_dt_spec dc_motor_1 = PWM_DT_SPEC_GET(DT_NODELABEL(dc1));
-static const struct pwm_dt_spec dc_motor_2 = PWM_DT_SPEC_GET(DT_NODELABEL(dc2));
-static const struct pwm_dt_spec dc_motor_3 = PWM_DT_SPEC_GET(DT_NODELABEL(dc3));
-static const struct pwm_dt_spec dc_motor_4 = PWM_DT_SPEC_GET(DT_NODELABEL(dc4));
+static const struct device *motors = DEVICE_DT_GET(DT_NODELABEL(motors));
 
-static const struct gpio_dt_spec dc_motor_1_dir =
-    GPIO_DT_SPEC_GET(DT_NODELABEL(dc_dir1), gpios);
+static const struct device *esc_telemetry =
+    DEVICE_DT_GET(DT_NODELABEL(esc_telemetry));
 
-static const struct gpio_dt_spec dc_motor_2_dir =
-    GPIO_DT_SPEC_GET(DT_NODELABEL(dc_dir2), gpios);
+/* Work for sending telemetry back to the transmitter. */
+static void telemetry_work_handler(struct k_work *work);
+K_WORK_DELAYABLE_DEFINE(telemetry_work, telemetry_work_handler);
 
-static const struct gpio_dt_spec dc_motor_3_dir =
-    GPIO_DT_SPEC_GET(DT_NODELABEL(dc_dir3), gpios);
+static k_timeout_t telemetry_interval = K_MSEC(200);
+/* Nobody hears the telemetry without a link, so it only runs with one. */
+static atomic_t radio_up;
 
-static const struct gpio_dt_spec dc_motor_4_dir =
-    GPIO_DT_SPEC_GET(DT_NODELABEL(dc_dir4), gpios);
+static bool armed = false;
 
-static const struct gpio_dt_spec dc_motor_sleep =
-    GPIO_DT_SPEC_GET(DT_NODELABEL(dc_sleep), gpios);
+/* Only changed by the handset after boot. The hot path only sees what's
+ * worked out from them, like the mixer's tables. */
+static struct robot_settings settings;
+static struct robot_settings defaults;
+
+/* The mixer in use, and a spare to build the next one in when the
+ * settings change. */
+static struct mixer mixers[2];
+static atomic_ptr_t active_mixer = ATOMIC_PTR_INIT(&mixers[0]);
+static struct mixer_output rcmix_data;
+
+/* What the weapon ESC was last sent. */
+static uint16_t weapon_out;
+
+/* What the drive was last scaled by for the battery, as Q14. */
+static int32_t battery_gain = MIXER_Q14_ONE;
+
+/* The last frame's latency, when the yaw loop has still to drive the
+ * wheels from it. */
+static struct k_spinlock latency_lock;
+static struct latency_sample pending_latency;
+static bool latency_pending;
+
+/**
+ * @brief The settings from Kconfig, for anything that hasn't been saved.
+ */
+static void default_settings(struct robot_settings *defaults)
+{
+    struct mixer_config config;
+    uint16_t *v = defaults->v;
+
+    mixer_config_default(&config);
+
+    v[ROBOT_SETTING_MIX] = IS_ENABLED(CONFIG_COMBAT_MIXER_ARCADE)
+                               ? MIXER_MODE_ARCADE
+                               : MIXER_MODE_TANK;
+    v[ROBOT_SETTING_INPUT0_CH] = CONFIG_COMBAT_MIXER_INPUT0_CH;
+    v[ROBOT_SETTING_INPUT1_CH] = CONFIG_COMBAT_MIXER_INPUT1_CH;
+    v[ROBOT_SETTING_ARM_CH] = config.arm_ch;
+    v[ROBOT_SETTING_WEAPON_CH] = config.weapon_ch;
+    v[ROBOT_SETTING_EXPO] = CONFIG_COMBAT_MIXER_EXPO;
+    v[ROBOT_SETTING_DEADBAND] = CONFIG_COMBAT_MIXER_DEADBAND;
+    v[ROBOT_SETTING_TRIM_FRONT_LEFT] = CONFIG_COMBAT_MIXER_TRIM_FRONT_LEFT;
+    v[ROBOT_SETTING_TRIM_REAR_LEFT] = CONFIG_COMBAT_MIXER_TRIM_REAR_LEFT;
+    v[ROBOT_SETTING_TRIM_FRONT_RIGHT] = CONFIG_COMBAT_MIXER_TRIM_FRONT_RIGHT;
+    v[ROBOT_SETTING_TRIM_REAR_RIGHT] = CONFIG_COMBAT_MIXER_TRIM_REAR_RIGHT;
+
+    v[ROBOT_SETTING_REVERSE] = 0;
+    for (int w = 0; w < MIXER_NUM_WHEELS; w++)
+        v[ROBOT_SETTING_REVERSE] |= config.reverse[w] << w;
+
+    v[ROBOT_SETTING_DRIVE_LIMIT] = 100;
+    v[ROBOT_SETTING_WEAPON_LIMIT] = 100;
+    v[ROBOT_SETTING_FAILSAFE_MS] = CONFIG_COMBAT_FAILSAFE_MS;
+    v[ROBOT_SETTING_BATTERY_NOMINAL_MV] =
+        CONFIG_COMBAT_MIXER_BATTERY_NOMINAL_MV;
+    v[ROBOT_SETTING_BATTERY_CUTBACK_MV] =
+        CONFIG_COMBAT_MIXER_BATTERY_CUTBACK_MV;
+    v[ROBOT_SETTING_BATTERY_EMPTY_MV] = CONFIG_COMBAT_MIXER_BATTERY_EMPTY_MV;
+
+#ifdef CONFIG_COMBAT_YAW_CONTROL
+    v[ROBOT_SETTING_YAW_KP] = CONFIG_COMBAT_YAW_KP;
+    v[ROBOT_SETTING_YAW_KI] = CONFIG_COMBAT_YAW_KI;
+    v[ROBOT_SETTING_YAW_KD] = CONFIG_COMBAT_YAW_KD;
+    v[ROBOT_SETTING_YAW_KFF] = CONFIG_COMBAT_YAW_KFF;
+#endif
+}
 
-/* Work for killing the motors if the radio stops. */
-static void stop_motors_work_handler(struct k_work *work);
-K_WORK_DELAYABLE_DEFINE(stop_motors_work, stop_motors_work_handler);
+static bool is_armed(void)
+{
+    return armed;
+}
 
-static k_timeout_t stop_motors_timeout = K_MSEC(500);
+/**
+ * @brief Put the settings into effect, at boot and whenever the handset
+ * changes one.
+ *
+ * The new mixer's built in the spare and swapped in whole, so a frame
+ * never sees half of one. The mixer's readers run at a higher priority
+ * than the handset's changes and don't sleep in the middle of a frame, so
+ * nothing's still using the old one by the time it's built over.
+ */
+static void apply_settings(const struct robot_settings *s)
+{
+    struct mixer *next = atomic_ptr_get(&active_mixer) == &mixers[0]
+                             ? &mixers[1]
+                             : &mixers[0];
+    struct mixer_config config;
 
-static bool armed = false;
+    mixer_config_default(&config);
+    config.drive_full_scale = MOTORS_DUTY_MAX;
+    config.battery_cutback_min =
+        CONFIG_COMBAT_MIXER_BATTERY_CUTBACK_MIN * MIXER_Q14_ONE / 100;
+    robot_settings_mixer_config(s, &config);
 
-struct rcmix_data
+    mixer_init(next, &config);
+    atomic_ptr_set(&active_mixer, next);
+
+    failsafe_set_max_ms(s->v[ROBOT_SETTING_FAILSAFE_MS]);
+
+#ifdef CONFIG_COMBAT_YAW_CONTROL
+    struct yaw_gains gains;
+
+    robot_settings_yaw_gains(s, &gains);
+    yaw_control_set_gains(&gains);
+#endif
+}
+
+#ifdef CONFIG_COMBAT_MIXER_BENCHMARK
+/**
+ * @brief Time the mixer for every combination of the stick corners and
+ * centre, and log the best and worst.
+ */
+static void mixer_benchmark(void)
 {
-    uint32_t fleft, rleft;
-    bool fleft_dir, rleft_dir;
+    static const uint16_t positions[] = {0, 1, 512, 1023, 1024, 1025, 1536,
+                                         2047};
+    const struct mixer *mixer = atomic_ptr_get(&active_mixer);
+    struct mixer_output out;
+    uint16_t ch[16];
+    uint32_t best = UINT32_MAX, worst = 0;
+
+    for (size_t i = 0; i < ARRAY_SIZE(ch); i++) ch[i] = 1024;
+
+    for (size_t a = 0; a < ARRAY_SIZE(positions); a++) {
+        for (size_t b = 0; b < ARRAY_SIZE(positions); b++) {
+            unsigned int key;
+            uint32_t start, cycles;
+
+            ch[mixer->input_ch[0]] = positions[a];
+            ch[mixer->input_ch[1]] = positions[b];
+            ch[mixer->arm_ch] = positions[b];
+
+            key = irq_lock();
+            start = k_cycle_get_32();
+            mixer_run(mixer, ch, &out);
+            cycles = k_cycle_get_32() - start;
+            irq_unlock(key);
+
+            best = MIN(best, cycles);
+            worst = MAX(worst, cycles);
+        }
+    }
 
-    uint32_t fright, rright;
-    bool fright_dir, rright_dir;
+    printk("mixer: %u-%u cycles per frame\n", best, worst);
+}
+#endif
 
-    uint32_t weapon_pulse;
-} rcmix_data;
+/**
+ * @brief The mixer's weapon pulse as a DShot throttle.
+ */
+static uint16_t weapon_throttle(const struct mixer_output *mix)
+{
+    /* 1000-2000 us maps straight on to 0-2000. */
+    return (mix->weapon_pulse - MIXER_WEAPON_PULSE_MIN) /
+           ((MIXER_WEAPON_PULSE_MAX - MIXER_WEAPON_PULSE_MIN) /
+            DSHOT_THROTTLE_RANGE);
+}
 
-static void update_channel_data(struct rcmix_data *data,
-                                const struct csrf_channel_data *channels)
+#ifdef CONFIG_COMBAT_WEAPON_PROTECTION
+/* The weapon's been cut, until the throttle comes back to zero. */
+static bool weapon_tripped;
+
+/* Last time the weapon was turning, or wasn't meant to be. */
+static uint32_t weapon_ok_ms;
+
+/**
+ * @brief Cut the weapon if the ESC says it's drawing too much current, or
+ * isn't turning when it should be.
+ *
+ * This runs on every RC frame, and the ESC sends telemetry every few
+ * milliseconds, so a stuck weapon is cut long before anything melts.
+ */
+static uint16_t protect_weapon(uint16_t throttle)
 {
-    /* RC channels run 0-2047.
-     * Weapon ESC is 1000-2000 us.
-     * DC motors are 0-20000 us. */
+    struct esc_telemetry_sample esc;
+    uint32_t now = k_uptime_get_32();
 
-    static unsigned left_ch = 2;
-    static unsigned right_ch = 1;
-    static unsigned arm_btn = 7;
-    static unsigned weapon_ch = 9;
+    if (throttle == 0) {
+        weapon_tripped = false;
+        weapon_ok_ms = now;
+        return 0;
+    }
 
-    float left = channels->ch[left_ch] - 1024;
-    float right = channels->ch[right_ch] - 1024;
-    uint16_t weapon = channels->ch[weapon_ch];
+    if (weapon_tripped)
+        return 0;
 
-    armed = channels->ch[arm_btn] > 1024;
+    /* Without telemetry we can't tell, so leave the weapon alone. */
+    if (esc_telemetry_get(esc_telemetry, &esc)) {
+        weapon_ok_ms = now;
+        return throttle;
+    }
 
-    left = CLAMP(left / 1024.0f, -1.0f, 1.0f);
-    right = CLAMP(right / 1024.0f, -1.0f, 1.0f);
+    if (esc.current > CONFIG_COMBAT_WEAPON_CURRENT_LIMIT * 100) {
+        printk("Weapon cut: %u.%02u A\n", esc.current / 100,
+               esc.current % 100);
+        blackbox_fault(BLACKBOX_FAULT_WEAPON_CUT);
+        led_set_overlay(LED_OVERLAY_FAULT, true);
+        weapon_tripped = true;
+        return 0;
+    }
 
-    data->fleft = (uint32_t)(fabsf(left) * 20000000);
-    data->fleft = CLAMP(data->fleft, 0, 20000000);
+    if (esc.erpm >= CONFIG_COMBAT_WEAPON_STALL_ERPM ||
+        throttle * 100 <
+            CONFIG_COMBAT_WEAPON_STALL_THROTTLE * DSHOT_THROTTLE_RANGE) {
+        weapon_ok_ms = now;
+    } else if (now - weapon_ok_ms > CONFIG_COMBAT_WEAPON_STALL_MS) {
+        printk("Weapon cut: stalled at %u eRPM\n", esc.erpm);
+        blackbox_fault(BLACKBOX_FAULT_WEAPON_CUT);
+        led_set_overlay(LED_OVERLAY_FAULT, true);
+        weapon_tripped = true;
+        return 0;
+    }
 
-    data->fright = (uint32_t)(fabsf(right) * 20000000);
-    data->fright = CLAMP(data->fright, 0, 20000000);
+    return throttle;
+}
+#else
+static inline uint16_t protect_weapon(uint16_t throttle)
+{
+    return throttle;
+}
+#endif
+
+/**
+ * @brief How far to turn the drive up as the pack sags, and back as it
+ * goes flat. The pack's voltage is read without a lock, so this is safe
+ * from the radio and the yaw loop alike.
+ */
+static int32_t drive_battery_gain(const struct mixer *mixer)
+{
+    struct battery_reading battery;
 
-    data->rleft = data->fleft;
-    data->rright = data->fright;
+    battery_get(&battery);
+    battery_gain = mixer_battery_gain(mixer, battery.mv);
 
-    if (left > 0) {
-        data->fleft_dir = false;
-        data->rleft_dir = false;
-    } else {
-        data->fleft_dir = true;
-        data->rleft_dir = true;
+    return battery_gain;
+}
+
+/**
+ * @brief Send the mixer's drive outputs to the motors, all at once.
+ */
+static void set_drive(const struct mixer_output *mix)
+{
+    struct motors_output out;
+
+    /* Here's the mapping between logical channels and PWM channels! */
+    out.duty[0] = mix->drive[MIXER_WHEEL_FRONT_LEFT];
+    out.duty[1] = mix->drive[MIXER_WHEEL_FRONT_RIGHT];
+    out.duty[2] = mix->drive[MIXER_WHEEL_REAR_RIGHT];
+    out.duty[3] = mix->drive[MIXER_WHEEL_REAR_LEFT];
+
+    out.dir[0] = mix->dir[MIXER_WHEEL_FRONT_LEFT];
+    out.dir[1] = !mix->dir[MIXER_WHEEL_FRONT_RIGHT];
+    out.dir[2] = mix->dir[MIXER_WHEEL_REAR_RIGHT];
+    out.dir[3] = !mix->dir[MIXER_WHEEL_REAR_LEFT];
+
+    out.sleep = !(out.duty[0] || out.duty[1] || out.duty[2] || out.duty[3]);
+
+    motors_set(motors, &out);
+}
+
+/**
+ * @brief The drive outputs as black box and telemetry fields.
+ */
+static void drive_fields(const struct mixer_output *mix, int32_t *v)
+{
+    for (int i = 0; i < MIXER_NUM_WHEELS; i++)
+        v[i] = mix->dir[i] ? (int32_t)mix->drive[i] : -(int32_t)mix->drive[i];
+    v[4] = weapon_out;
+    v[5] = armed;
+}
+
+/**
+ * @brief Pass a frame, and the outputs if they were set from it, to the
+ * black box and the USB stream.
+ */
+static void report_frame(const struct csrf_channel_data *channels,
+                         const struct mixer_output *mix)
+{
+    static uint32_t last_rx;
+    struct battery_reading battery;
+    int32_t ch[16], drive[6], link[2], power[3];
+
+    for (int i = 0; i < 16; i++) ch[i] = channels->ch[i];
+    if (mix)
+        drive_fields(mix, drive);
+    link[0] = k_cyc_to_us_floor32(channels->ts.rx - last_rx);
+    link[1] = k_cyc_to_us_floor32(k_cycle_get_32() - channels->ts.rx);
+    last_rx = channels->ts.rx;
+
+    battery_get(&battery);
+    power[0] = battery.mv;
+    power[1] = battery.ma;
+    power[2] = (battery_gain * 100) >> 14;
+
+#ifdef CONFIG_COMBAT_USB_TELEMETRY
+    struct esc_telemetry_sample esc = {0};
+    uint32_t rpm = 0;
+
+    usb_telemetry_send(USB_TELEMETRY_SOURCE_RC, TELEMETRY_CHANNELS, ch);
+    if (mix)
+        usb_telemetry_send(USB_TELEMETRY_SOURCE_RC, TELEMETRY_DRIVE, drive);
+    usb_telemetry_send(USB_TELEMETRY_SOURCE_RC, TELEMETRY_LINK, link);
+    usb_telemetry_send(USB_TELEMETRY_SOURCE_RC, TELEMETRY_BATTERY, power);
+
+    dshot_get_rpm(weapon_esc, &rpm);
+    esc_telemetry_get(esc_telemetry, &esc);
+    usb_telemetry_send(USB_TELEMETRY_SOURCE_RC, TELEMETRY_WEAPON,
+                       (const int32_t[]){weapon_out, rpm, esc.temperature,
+                                         esc.voltage, esc.current});
+#endif
+
+#ifdef CONFIG_COMBAT_BLACKBOX
+    static unsigned count;
+    struct csrf_link_stats radio;
+
+    if (++count >= CONFIG_COMBAT_BLACKBOX_RC_DIVIDER) {
+        failsafe_get_link(&radio);
+
+        blackbox_record(BLACKBOX_SOURCE_RC, BLACKBOX_CHANNELS, ch);
+        if (mix)
+            blackbox_record(BLACKBOX_SOURCE_RC, BLACKBOX_DRIVE, drive);
+        blackbox_record(BLACKBOX_SOURCE_RC, BLACKBOX_LINK, link);
+        blackbox_record(BLACKBOX_SOURCE_RC, BLACKBOX_BATTERY, power);
+        blackbox_record(BLACKBOX_SOURCE_RC, BLACKBOX_RADIO,
+                        (const int32_t[]){
+                            radio.uplink_lq,
+                            radio.uplink_rssi[radio.active_antenna & 1],
+                            radio.uplink_snr,
+                        });
+        count = 0;
     }
+#endif
+}
 
-    if (right > 0) {
-        data->fright_dir = true;
-        data->rright_dir = true;
-    } else {
-        data->fright_dir = false;
-        data->rright_dir = false;
+/**
+ * @brief Record a frame's latency once its drive reaches the PWM, if the
+ * yaw loop's doing the driving.
+ */
+static void record_pending_latency(void)
+{
+    struct latency_sample sample;
+    k_spinlock_key_t key;
+    bool pending;
+
+    key = k_spin_lock(&latency_lock);
+    sample = pending_latency;
+    pending = latency_pending;
+    latency_pending = false;
+    k_spin_unlock(&latency_lock, key);
+
+    if (pending) {
+        latency_mark(&sample, LATENCY_STAGE_PWM);
+        latency_record(&sample);
     }
+}
 
-    const unsigned weapon_pulse_min = 1000000;
-    const unsigned weapon_pulse_max = 2000000;
+/**
+ * @brief Drive the wheels from the yaw loop, with its steering in place of
+ * the stick's.
+ */
+static void drive_closed_loop(const int32_t *in)
+{
+    const struct mixer *mixer = atomic_ptr_get(&active_mixer);
+    int32_t flipped[MIXER_NUM_INPUTS];
+    struct mixer_output out;
+    int32_t v[6];
+
+    /* The loop works in the world's yaw, so it's only the mix that needs
+     * turning over. */
+    if (IS_ENABLED(CONFIG_COMBAT_INVERT_AUTO) && imu_inverted()) {
+        memcpy(flipped, in, sizeof(flipped));
+        mixer_flip(mixer, flipped);
+        in = flipped;
+    }
 
-    data->weapon_pulse = (weapon * 500) + 1000000;
-    data->weapon_pulse =
-        CLAMP(data->weapon_pulse, weapon_pulse_min, weapon_pulse_max);
+    mixer_drive(mixer, in, &out);
+    mixer_limit(&out, failsafe_drive_percent());
+    mixer_battery(mixer, drive_battery_gain(mixer), &out);
+    set_drive(&out);
+    record_pending_latency();
 
-    if (armed) {
-        led_set_state(LED_STATE_ARMED);
-    } else {
-        led_set_state(LED_STATE_DISARMED);
-        data->weapon_pulse = weapon_pulse_min;
+    drive_fields(&out, v);
+    usb_telemetry_send(USB_TELEMETRY_SOURCE_IMU, TELEMETRY_DRIVE, v);
+
+#ifdef CONFIG_COMBAT_BLACKBOX
+    static unsigned count;
+
+    if (++count >= CONFIG_COMBAT_BLACKBOX_IMU_DIVIDER) {
+        blackbox_record(BLACKBOX_SOURCE_IMU, BLACKBOX_DRIVE, v);
+        count = 0;
     }
+#endif
 }
 
-static void csrf_channel_callback(const struct csrf_channel_data *channels)
+/**
+ * @brief Keep the supervisor's idea of how often frames come in step with
+ * the packet rate. Frames later than the failsafe allows should have
+ * stopped everything, which pauses the watch, so if they don't the
+ * failsafe's stuck.
+ */
+static void watch_rc_rate(void)
 {
-    static unsigned count = 0;
+    static uint32_t period_ms;
+    uint32_t stop_ms = failsafe_stop_after_ms();
 
-    update_channel_data(&rcmix_data, channels);
+    if (2 * stop_ms != period_ms) {
+        period_ms = 2 * stop_ms;
+        supervisor_set_period(SUPERVISOR_TASK_RC, period_ms);
+    }
+}
 
-    count++;
-    if (count > 1000) {
-        printk("ch");
-        for (int i = 0; i < 16; i++) {
-            printk(" %d", channels->ch[i]);
-        }
-        printk("\n");
-        count = 0;
+static void csrf_channel_callback(const struct csrf_channel_data *channels)
+{
+    const struct mixer *mixer = atomic_ptr_get(&active_mixer);
+    struct latency_sample latency;
+    int32_t in[MIXER_NUM_INPUTS];
+    struct mixer_limits limits;
+    bool closed_loop;
+    k_spinlock_key_t key;
+
+    /* Back from a failsafe, or the first frame. */
+    supervisor_resume(SUPERVISOR_TASK_RC);
+    supervisor_start(SUPERVISOR_TASK_RC);
+    latency_sample_init(&latency, &channels->ts);
+
+    limits.drive_percent = failsafe_frame(channels->ts.rx);
+    watch_rc_rate();
+    led_set_overlay(LED_OVERLAY_LIMITED, limits.drive_percent < 100);
+
+    limits.flip = IS_ENABLED(CONFIG_COMBAT_INVERT_AUTO) && imu_inverted();
+    limits.battery_gain = drive_battery_gain(mixer);
+    mixer_frame(mixer, channels->ch, &limits, in, &rcmix_data);
+    armed = rcmix_data.armed;
+
+    latency_mark(&latency, LATENCY_STAGE_MIXER);
+
+    /* The yaw loop drives the wheels on its next tick, unless it's off or
+     * the gyro has stopped. It flips the mix itself. */
+    closed_loop = yaw_control_set_sticks(in);
+    if (!closed_loop)
+        set_drive(&rcmix_data);
+
+    weapon_out = protect_weapon(weapon_throttle(&rcmix_data));
+    dshot_set_throttle(weapon_esc, weapon_out);
+
+    /* In closed loop the wheels don't change until the loop's next tick. A
+     * frame that comes before then replaces this one, which never reached
+     * them. */
+    key = k_spin_lock(&latency_lock);
+    pending_latency = latency;
+    latency_pending = closed_loop;
+    k_spin_unlock(&latency_lock, key);
+
+    if (!closed_loop) {
+        latency_mark(&latency, LATENCY_STAGE_PWM);
+        latency_record(&latency);
     }
 
-    k_work_reschedule(&stop_motors_work, stop_motors_timeout);
+    report_frame(channels, closed_loop ? NULL : &rcmix_data);
 
-    if (rcmix_data.fleft == 0 && rcmix_data.rleft == 0 &&
-        rcmix_data.fright == 0 && rcmix_data.rright == 0) {
-        gpio_pin_set_dt(&dc_motor_sleep, 1);
+    if (armed) {
+        led_set_state(LED_STATE_ARMED);
+        power_set_state(POWER_STATE_ARMED);
     } else {
-        gpio_pin_set_dt(&dc_motor_sleep, 0);
+        led_set_state(LED_STATE_DISARMED);
+        power_set_state(POWER_STATE_DISARMED);
     }
 
-    /* Here's the mapping between logical channels and PWM channels! */
-    gpio_pin_set_dt(&dc_motor_1_dir, rcmix_data.fleft_dir);
-    gpio_pin_set_dt(&dc_motor_2_dir, !rcmix_data.fright_dir);
-    gpio_pin_set_dt(&dc_motor_3_dir, rcmix_data.rright_dir);
-    gpio_pin_set_dt(&dc_motor_4_dir, !rcmix_data.rleft_dir);
-
-    pwm_set_pulse_dt(&dc_motor_1, rcmix_data.fleft);
-    pwm_set_pulse_dt(&dc_motor_2, rcmix_data.fright);
-    pwm_set_pulse_dt(&dc_motor_3, rcmix_data.rright);
-    pwm_set_pulse_dt(&dc_motor_4, rcmix_data.rleft);
+    if (!atomic_set(&radio_up, 1)) {
+        supervisor_resume(SUPERVISOR_TASK_TELEMETRY);
+        k_work_schedule(&telemetry_work, K_NO_WAIT);
+    }
 
-    pwm_set_pulse_dt(&esc_pwm, rcmix_data.weapon_pulse);
+    power_rc_frame();
+    supervisor_done(SUPERVISOR_TASK_RC);
 }
 
-static void stop_motors_work_handler(struct k_work *work)
+/**
+ * @brief Stop everything when the radio does, from the failsafe thread.
+ */
+static void stop_everything(void)
 {
-    pwm_set_pulse_dt(&dc_motor_1, 0);
-    pwm_set_pulse_dt(&dc_motor_2, 0);
-    pwm_set_pulse_dt(&dc_motor_3, 0);
-    pwm_set_pulse_dt(&dc_motor_4, 0);
+    const struct motors_output stop = {.sleep = true};
 
-    pwm_set_pulse_dt(&esc_pwm, 1000000);
+    yaw_control_stop();
+    motors_set(motors, &stop);
+    blackbox_fault(BLACKBOX_FAULT_RADIO_LOST);
 
+    weapon_out = 0;
+    dshot_set_throttle(weapon_esc, 0);
+
+    led_set_overlay(LED_OVERLAY_LIMITED, false);
     led_set_state(LED_STATE_NO_RADIO);
+    power_set_state(POWER_STATE_NO_RADIO);
+    supervisor_pause(SUPERVISOR_TASK_RC);
+
+    /* The telemetry stops at its next run. */
+    atomic_clear(&radio_up);
+    supervisor_pause(SUPERVISOR_TASK_TELEMETRY);
 }
 
-static void init_watchdog(void)
+static void telemetry_work_handler(struct k_work *work)
 {
-    const unsigned wdt_min = 0;
-    const unsigned wdt_max = 3000;
+    bool inverted = false;
 
-    int rc;
+    supervisor_start(SUPERVISOR_TASK_TELEMETRY);
 
-    if (!device_is_ready(wdt)) {
-        printk("%s: device not ready.\n", wdt->name);
-        return;
-    }
+#ifdef CONFIG_COMBAT_IMU
+    struct attitude_state state;
+    /* cdeg to the 100 urad CRSF wants: pi / 18000 * 10000, as Q10. */
+    const int32_t cdeg_to_crsf = 1787;
 
-    struct wdt_timeout_cfg wdt_config = {
-        /* Reset SoC when watchdog timer expires. */
-        .flags = WDT_FLAG_RESET_SOC,
+    imu_get_attitude(&state);
+    inverted = state.inverted;
 
-        /* Expire watchdog after max window */
-        .window.min = wdt_min,
-        .window.max = wdt_max,
-    };
+    csrf_send_attitude(elrs_radio,
+                       &(const struct csrf_attitude){
+                           .pitch = (state.pitch * cdeg_to_crsf) >> 10,
+                           .roll = (state.roll * cdeg_to_crsf) >> 10,
+                       });
+#endif
 
-    rc = wdt_install_timeout(wdt, &wdt_config);
-    if (rc < 0) {
-        printk("Failed to configure WDT.");
-        return;
+    /* This only queues the frame - the radio driver sends it when there's
+     * a gap in the control data. */
+    if (inverted) {
+        csrf_send_flight_mode(elrs_radio, armed ? "ARMED INV" : "SAFE INV");
+    } else {
+        csrf_send_flight_mode(elrs_radio, armed ? "ARMED" : "SAFE");
     }
 
-    rc = wdt_setup(wdt, WDT_OPT_PAUSE_HALTED_BY_DBG);
-    if (rc < 0) {
-        printk("Failed to setup WDT.");
-        return;
-    }
+    supervisor_done(SUPERVISOR_TASK_TELEMETRY);
+    if (atomic_get(&radio_up))
+        k_work_schedule(&telemetry_work, telemetry_interval);
 }
 
 int main(void)
 {
-    init_watchdog();
+    /* First, so a hang anywhere after this resets. */
+    if (supervisor_init()) {
+        printk("Watchdog not running\n");
+    }
+
+    /* Before anything's printed, since it brings up the USB console. */
+    if (power_init()) {
+        printk("USB failed to start\n");
+    }
 
     if (!device_is_ready(elrs_radio)) {
         printk("ELRS radio device not ready\n");
     }
 
+    if (!device_is_ready(motors)) {
+        printk("Motors not ready\n");
+    }
+
+    if (!device_is_ready(weapon_esc)) {
+        printk("Weapon ESC not ready\n");
+    }
+
+    if (!device_is_ready(esc_telemetry)) {
+        printk("ESC telemetry not ready\n");
+    }
+
     if (!device_is_ready(imu)) {
         printk("IMU not ready\n");
     }
 
     printk("Hello, world!\n");
 
-    csrf_set_channel_callback(elrs_radio, csrf_channel_callback);
+    default_settings(&defaults);
+    settings = defaults;
+    if (settings_store_init(&settings, is_armed)) {
+        printk("Settings failed to load, using the defaults\n");
+    }
+
+    if (blackbox_init()) {
+        printk("Black box failed to start\n");
+    }
+
+    if (usb_telemetry_init()) {
+        printk("USB telemetry failed to start\n");
+    }
+
+    if (yaw_control_init(drive_closed_loop)) {
+        printk("Yaw control failed to start, steering open loop\n");
+    }
+
+    if (failsafe_init(elrs_radio, stop_everything)) {
+        printk("Failsafe has no link statistics\n");
+    }
+
+    /* After the yaw loop, which takes its gains from here, and the
+     * failsafe, which takes its longest wait. */
+    apply_settings(&settings);
+
+#ifdef CONFIG_COMBAT_MIXER_BENCHMARK
+    mixer_benchmark();
+#endif
+
+    if (battery_init()) {
+        printk("Battery not sampled, drive not compensated\n");
+    }
+
+    /* After the yaw loop, which it ticks. */
+    if (imu_init()) {
+        printk("IMU loop failed to start\n");
+    }
 
     /* Zero out our speeds until we've got control data. */
     memset(&rcmix_data, 0, sizeof(rcmix_data));
-    rcmix_data.weapon_pulse = 1000000;
-
-    gpio_pin_set_dt(&dc_motor_sleep, 1);
+    rcmix_data.weapon_pulse = MIXER_WEAPON_PULSE_MIN;
 
-    gpio_pin_set_dt(&dc_motor_1_dir, 0);
-    gpio_pin_set_dt(&dc_motor_2_dir, 0);
-    gpio_pin_set_dt(&dc_motor_3_dir, 0);
-    gpio_pin_set_dt(&dc_motor_4_dir, 0);
+    /* Watched at the packet rate while there's a link, and not while
+     * there isn't - the failsafe deals with that. */
+    supervisor_register(SUPERVISOR_TASK_RC, 20,
+                        2 * CONFIG_COMBAT_FAILSAFE_MS);
+    supervisor_pause(SUPERVISOR_TASK_RC);
+    csrf_set_channel_callback(elrs_radio, csrf_channel_callback);
 
-    pwm_set_pulse_dt(&dc_motor_1, 0);
-    pwm_set_pulse_dt(&dc_motor_2, 0);
-    pwm_set_pulse_dt(&dc_motor_3, 0);
-    pwm_set_pulse_dt(&dc_motor_4, 0);
+    if (radio_params_init(elrs_radio, &settings, &defaults, apply_settings)) {
+        printk("Settings can't be changed from the handset\n");
+    }
 
-    pwm_set_pulse_dt(&esc_pwm, 1000000);
+    /* The motors start asleep, with nothing on the outputs. */
+    dshot_set_throttle(weapon_esc, 0);
 
     led_set_state(LED_STATE_NO_RADIO);
+    power_set_state(POWER_STATE_NO_RADIO);
+
+    /* The system workqueue has to keep up as well, while the telemetry's
+     * running. The first frame starts it. */
+    supervisor_register(SUPERVISOR_TASK_TELEMETRY, 100, 1000);
+    supervisor_pause(SUPERVISOR_TASK_TELEMETRY);
 
+#if defined(CONFIG_COMBAT_LATENCY) && CONFIG_COMBAT_LATENCY_REPORT_INTERVAL > 0
     while (1) {
-        wdt_feed(wdt, 0);
-        k_sleep(K_SECONDS(1));
+        k_sleep(K_SECONDS(CONFIG_COMBAT_LATENCY_REPORT_INTERVAL));
+        latency_report();
     }
+#endif
 
+    /* Everything else runs in its own thread, so there's nothing left for
+     * this one to do. */
     return 0;
 }
@@ -1,6 +1,8 @@
 #ifndef MAIN_H
 #define MAIN_H
 
+#include <stdbool.h>
+
 enum led_state
 {
     /* Just powered on. */
@@ -13,6 +15,20 @@ enum led_state
     LED_STATE_ARMED,
 };
 
+/**
+ * @brief Patterns shown over the state's, highest last.
+ */
+enum led_overlay
+{
+    /* The failsafe is limiting the drive. */
+    LED_OVERLAY_LIMITED,
+    /* Something went wrong. Flashes a few times. */
+    LED_OVERLAY_FAULT,
+
+    LED_OVERLAY_COUNT,
+};
+
 extern void led_set_state(enum led_state state);
+extern void led_set_overlay(enum led_overlay overlay, bool on);
 
 #endif /* MAIN_H */
@@ -0,0 +1,242 @@
+#include "mixer.h"
+
+#include <string.h>
+
+#define CURVE_SHIFT 7
+
+static inline int32_t clamp32(int32_t v, int32_t lo, int32_t hi)
+{
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+void mixer_config_default(struct mixer_config *config)
+{
+    *config = (struct mixer_config){
+        .mode = MIXER_MODE_TANK,
+        .input_ch = {2, 1},
+        .arm_ch = 7,
+        .weapon_ch = 9,
+        .expo = 0,
+        .deadband = 0,
+        .trim = {MIXER_Q14_ONE, MIXER_Q14_ONE, MIXER_Q14_ONE, MIXER_Q14_ONE},
+        .reverse = {true, true, false, false},
+        .drive_full_scale = 20000000,
+        .weapon_pulse_max = MIXER_WEAPON_PULSE_MAX,
+        .battery_cutback_min = MIXER_Q14_ONE,
+    };
+}
+
+/**
+ * @brief Work out one point on the stick curve.
+ *
+ * The deadband is cut out of the middle and the rest stretched to cover the
+ * full range, then expo is a blend of x and x^3.
+ */
+static uint16_t curve_point(int32_t x, int32_t expo, int32_t deadband)
+{
+    int64_t x3;
+
+    if (x <= deadband)
+        return 0;
+
+    x = (int64_t)(x - deadband) * MIXER_Q15_ONE / (MIXER_Q15_ONE - deadband);
+    x3 = ((int64_t)x * x * x) >> 30;
+
+    return x + (((x3 - x) * expo) >> 15);
+}
+
+void mixer_init(struct mixer *mixer, const struct mixer_config *config)
+{
+    static const int32_t tank[MIXER_NUM_WHEELS][MIXER_NUM_INPUTS] = {
+        [MIXER_WHEEL_FRONT_LEFT] = {MIXER_Q14_ONE, 0},
+        [MIXER_WHEEL_REAR_LEFT] = {MIXER_Q14_ONE, 0},
+        [MIXER_WHEEL_FRONT_RIGHT] = {0, MIXER_Q14_ONE},
+        [MIXER_WHEEL_REAR_RIGHT] = {0, MIXER_Q14_ONE},
+    };
+    static const int32_t arcade[MIXER_NUM_WHEELS][MIXER_NUM_INPUTS] = {
+        [MIXER_WHEEL_FRONT_LEFT] = {MIXER_Q14_ONE, MIXER_Q14_ONE},
+        [MIXER_WHEEL_REAR_LEFT] = {MIXER_Q14_ONE, MIXER_Q14_ONE},
+        [MIXER_WHEEL_FRONT_RIGHT] = {MIXER_Q14_ONE, -MIXER_Q14_ONE},
+        [MIXER_WHEEL_REAR_RIGHT] = {MIXER_Q14_ONE, -MIXER_Q14_ONE},
+    };
+    const int32_t(*base)[MIXER_NUM_INPUTS] =
+        config->mode == MIXER_MODE_ARCADE ? arcade : tank;
+    int32_t expo = clamp32(config->expo, 0, MIXER_Q15_ONE);
+    int32_t deadband = clamp32(config->deadband, 0, MIXER_Q15_ONE - 1);
+
+    /* Keeping the weights to +/-1 means a wheel's sum fits in 32 bits. */
+    for (int w = 0; w < MIXER_NUM_WHEELS; w++) {
+        int32_t trim = clamp32(config->trim[w], 0, MIXER_Q14_ONE);
+
+        for (int i = 0; i < MIXER_NUM_INPUTS; i++)
+            mixer->matrix[w][i] = (base[w][i] * trim) >> 14;
+
+        mixer->reverse[w] = config->reverse[w];
+    }
+
+    for (int i = 0; i < MIXER_CURVE_POINTS; i++)
+        mixer->curve[i] = curve_point(i << CURVE_SHIFT, expo, deadband);
+    mixer->curve[MIXER_CURVE_POINTS] = mixer->curve[MIXER_CURVE_POINTS - 1];
+
+    for (int i = 0; i < MIXER_NUM_INPUTS; i++)
+        mixer->input_ch[i] = config->input_ch[i];
+
+    mixer->mode = config->mode;
+    mixer->arm_ch = config->arm_ch;
+    mixer->weapon_ch = config->weapon_ch;
+    mixer->drive_full_scale = config->drive_full_scale;
+    mixer->weapon_pulse_max = config->weapon_pulse_max;
+
+    mixer->battery_nominal_mv = config->battery_nominal_mv;
+    mixer->battery_cutback_mv = config->battery_cutback_mv;
+    /* Empty has to be below where the cutback starts. */
+    mixer->battery_empty_mv =
+        config->battery_empty_mv < config->battery_cutback_mv
+            ? config->battery_empty_mv
+            : config->battery_cutback_mv - 1;
+    mixer->battery_cutback_min =
+        clamp32(config->battery_cutback_min, 0, MIXER_Q14_ONE);
+}
+
+int32_t mixer_curve(const struct mixer *mixer, int32_t x)
+{
+    uint32_t a = x < 0 ? -x : x;
+    uint32_t i = a >> CURVE_SHIFT;
+    uint32_t frac = a & ((1 << CURVE_SHIFT) - 1);
+    int32_t lo = mixer->curve[i];
+    int32_t y = lo + (((mixer->curve[i + 1] - lo) * frac) >> CURVE_SHIFT);
+
+    return x < 0 ? -y : y;
+}
+
+static inline void mix_wheel(const struct mixer *mixer, const int32_t *in,
+                             int w, struct mixer_output *out)
+{
+    int32_t v = (mixer->matrix[w][0] * in[0] + mixer->matrix[w][1] * in[1]) >>
+                14;
+    uint32_t a;
+
+    v = clamp32(v, -MIXER_Q15_ONE, MIXER_Q15_ONE);
+    a = v < 0 ? -v : v;
+
+    out->drive[w] = ((uint64_t)a * mixer->drive_full_scale) >> 15;
+    out->dir[w] = (v > 0) != mixer->reverse[w];
+}
+
+void mixer_sticks(const struct mixer *mixer, const uint16_t *ch, int32_t *in)
+{
+    /* RC channels are 0-2047, centred on 1024. As Q15 that's -1 to just
+     * under 1. */
+    in[0] = mixer_curve(mixer, ((int32_t)ch[mixer->input_ch[0]] - 1024) * 32);
+    in[1] = mixer_curve(mixer, ((int32_t)ch[mixer->input_ch[1]] - 1024) * 32);
+}
+
+void mixer_drive(const struct mixer *mixer, const int32_t *in,
+                 struct mixer_output *out)
+{
+    mix_wheel(mixer, in, MIXER_WHEEL_FRONT_LEFT, out);
+    mix_wheel(mixer, in, MIXER_WHEEL_REAR_LEFT, out);
+    mix_wheel(mixer, in, MIXER_WHEEL_FRONT_RIGHT, out);
+    mix_wheel(mixer, in, MIXER_WHEEL_REAR_RIGHT, out);
+}
+
+void mixer_flip(const struct mixer *mixer, int32_t *in)
+{
+    int32_t left = in[0];
+
+    if (mixer->mode == MIXER_MODE_ARCADE) {
+        in[0] = -in[0];
+    } else {
+        in[0] = -in[1];
+        in[1] = -left;
+    }
+}
+
+void mixer_weapon(const struct mixer *mixer, const uint16_t *ch,
+                  struct mixer_output *out)
+{
+    uint32_t weapon;
+
+    /* Weapon ESC is 1000-2000 us, and held at the bottom unless armed. */
+    out->armed = ch[mixer->arm_ch] > 1024;
+
+    weapon = ch[mixer->weapon_ch] * 500 + MIXER_WEAPON_PULSE_MIN;
+    weapon = weapon > mixer->weapon_pulse_max ? mixer->weapon_pulse_max
+                                              : weapon;
+    out->weapon_pulse = out->armed ? weapon : MIXER_WEAPON_PULSE_MIN;
+}
+
+int32_t mixer_battery_gain(const struct mixer *mixer, uint32_t battery_mv)
+{
+    uint64_t gain = MIXER_Q14_ONE;
+    uint32_t above;
+    int32_t cut;
+
+    if (!battery_mv)
+        return MIXER_Q14_ONE;
+
+    if (mixer->battery_nominal_mv) {
+        gain = ((uint64_t)mixer->battery_nominal_mv << 14) / battery_mv;
+        gain = gain > MIXER_BATTERY_GAIN_MAX ? MIXER_BATTERY_GAIN_MAX : gain;
+    }
+
+    if (battery_mv < mixer->battery_cutback_mv) {
+        above = battery_mv > mixer->battery_empty_mv
+                    ? battery_mv - mixer->battery_empty_mv
+                    : 0;
+        cut = mixer->battery_cutback_min +
+              (int64_t)(MIXER_Q14_ONE - mixer->battery_cutback_min) * above /
+                  (mixer->battery_cutback_mv - mixer->battery_empty_mv);
+        gain = (gain * cut) >> 14;
+    }
+
+    return gain;
+}
+
+void mixer_battery(const struct mixer *mixer, int32_t gain,
+                   struct mixer_output *out)
+{
+    uint64_t drive;
+
+    for (int w = 0; w < MIXER_NUM_WHEELS; w++) {
+        drive = ((uint64_t)out->drive[w] * gain) >> 14;
+        out->drive[w] = drive > mixer->drive_full_scale
+                            ? mixer->drive_full_scale
+                            : drive;
+    }
+}
+
+void mixer_limit(struct mixer_output *out, uint8_t percent)
+{
+    if (percent >= 100)
+        return;
+
+    for (int w = 0; w < MIXER_NUM_WHEELS; w++)
+        out->drive[w] = out->drive[w] * percent / 100;
+}
+
+void mixer_frame(const struct mixer *mixer, const uint16_t *ch,
+                 const struct mixer_limits *limits, int32_t *in,
+                 struct mixer_output *out)
+{
+    int32_t drive_in[MIXER_NUM_INPUTS];
+
+    mixer_sticks(mixer, ch, in);
+    memcpy(drive_in, in, sizeof(drive_in));
+    if (limits->flip)
+        mixer_flip(mixer, drive_in);
+    mixer_drive(mixer, drive_in, out);
+    mixer_limit(out, limits->drive_percent);
+    mixer_battery(mixer, limits->battery_gain, out);
+    mixer_weapon(mixer, ch, out);
+}
+
+void mixer_run(const struct mixer *mixer, const uint16_t *ch,
+               struct mixer_output *out)
+{
+    int32_t in[MIXER_NUM_INPUTS];
+
+    mixer_sticks(mixer, ch, in);
+    mixer_drive(mixer, in, out);
+    mixer_weapon(mixer, ch, out);
+}
@@ -0,0 +1,230 @@
+#ifndef MIXER_H
+#define MIXER_H
+
+/*
+ * Drive mixer. Takes the RC channels to wheel pulses and directions with
+ * integer arithmetic only, and has no loops or data dependent branches on
+ * the way, so it takes the same time for every frame.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* 1.0 in the Q14 matrix weights and trims. */
+#define MIXER_Q14_ONE (1 << 14)
+
+/* 1.0 in the Q15 stick positions. */
+#define MIXER_Q15_ONE (1 << 15)
+
+/* Points in the stick curve, evenly spread over 0 to full stick. */
+#define MIXER_CURVE_POINTS 257
+
+#define MIXER_NUM_INPUTS 2
+
+enum mixer_wheel
+{
+    MIXER_WHEEL_FRONT_LEFT,
+    MIXER_WHEEL_REAR_LEFT,
+    MIXER_WHEEL_FRONT_RIGHT,
+    MIXER_WHEEL_REAR_RIGHT,
+
+    MIXER_NUM_WHEELS,
+};
+
+enum mixer_mode
+{
+    /* Input 0 drives the left wheels and input 1 the right. */
+    MIXER_MODE_TANK,
+    /* Input 0 is throttle and input 1 is steering. */
+    MIXER_MODE_ARCADE,
+};
+
+struct mixer_config
+{
+    enum mixer_mode mode;
+
+    /* RC channels for the two stick inputs, the arm switch and the weapon. */
+    uint8_t input_ch[MIXER_NUM_INPUTS];
+    uint8_t arm_ch;
+    uint8_t weapon_ch;
+
+    /* Expo, from 0 (linear) to MIXER_Q15_ONE (cubic). */
+    int32_t expo;
+    /* Stick movement that's ignored around the centre, as Q15. */
+    int32_t deadband;
+
+    /* Per-wheel gain as Q14, to even out motors that don't match. Trims
+     * can only slow a wheel down, up to MIXER_Q14_ONE. */
+    int32_t trim[MIXER_NUM_WHEELS];
+    /* Wheels whose direction output is the other way round. */
+    bool reverse[MIXER_NUM_WHEELS];
+
+    /* Drive output at full speed - a duty cycle, or a pulse length. */
+    uint32_t drive_full_scale;
+    /* Weapon pulse at full stick, up to MIXER_WEAPON_PULSE_MAX. */
+    uint32_t weapon_pulse_max;
+
+    /* The pack voltage the drive's set up for, in mV. The duty's scaled by
+     * this over the pack's voltage, so the motors see the same voltage as
+     * it sags, or 0 to leave it alone. */
+    uint32_t battery_nominal_mv;
+    /* Below battery_cutback_mv the drive's cut back in a straight line to
+     * battery_cutback_min at battery_empty_mv, so a flat pack isn't run
+     * into the ground. 0 for no cutback. */
+    uint32_t battery_cutback_mv;
+    uint32_t battery_empty_mv;
+    /* Drive left at empty, as Q14. */
+    int32_t battery_cutback_min;
+};
+
+/**
+ * @brief Everything the mixer works out from the config, ready for the hot
+ * path.
+ */
+struct mixer
+{
+    /* Input to wheel weights as Q14, with the trims already applied. */
+    int32_t matrix[MIXER_NUM_WHEELS][MIXER_NUM_INPUTS];
+    /* Stick curve for positive stick positions. There's an extra point past
+     * the end so full stick doesn't need a special case. */
+    uint16_t curve[MIXER_CURVE_POINTS + 1];
+
+    enum mixer_mode mode;
+    uint8_t input_ch[MIXER_NUM_INPUTS];
+    uint8_t arm_ch;
+    uint8_t weapon_ch;
+    bool reverse[MIXER_NUM_WHEELS];
+    uint32_t drive_full_scale;
+    uint32_t weapon_pulse_max;
+    uint32_t battery_nominal_mv;
+    uint32_t battery_cutback_mv;
+    uint32_t battery_empty_mv;
+    int32_t battery_cutback_min;
+};
+
+struct mixer_output
+{
+    /* 0 to drive_full_scale. */
+    uint32_t drive[MIXER_NUM_WHEELS];
+    bool dir[MIXER_NUM_WHEELS];
+
+    uint32_t weapon_pulse;
+    bool armed;
+};
+
+#define MIXER_WEAPON_PULSE_MIN 1000000
+#define MIXER_WEAPON_PULSE_MAX 2000000
+
+/* Sag compensation gives up past doubling the duty, where the pack's too
+ * far gone to be worth it. */
+#define MIXER_BATTERY_GAIN_MAX (2 * MIXER_Q14_ONE)
+
+/**
+ * @brief What a frame's mix depends on besides the channels.
+ */
+struct mixer_limits
+{
+    /* Upside down, so the sticks are turned round. */
+    bool flip;
+    /* How far the drive can go for the link, in percent. */
+    uint8_t drive_percent;
+    /* From mixer_battery_gain(). */
+    int32_t battery_gain;
+};
+
+/**
+ * @brief Fill in a config that matches the original tank mix: no expo, no
+ * deadband, no trims, the left wheels reversed and a 20 ms full scale in ns.
+ */
+extern void mixer_config_default(struct mixer_config *config);
+
+/**
+ * @brief Build the matrix and curve tables from a config.
+ *
+ * This can be called again to change the config, but not while mixer_run()
+ * might be using the same mixer.
+ */
+extern void mixer_init(struct mixer *mixer, const struct mixer_config *config);
+
+/**
+ * @brief Mix one frame of channels.
+ *
+ * @param ch All 16 RC channels, 0-2047.
+ */
+extern void mixer_run(const struct mixer *mixer, const uint16_t *ch,
+                      struct mixer_output *out);
+
+/**
+ * @brief The two stick inputs from a frame of channels, as Q15 after the
+ * curve.
+ */
+extern void mixer_sticks(const struct mixer *mixer, const uint16_t *ch,
+                         int32_t *in);
+
+/**
+ * @brief Mix stick inputs to the wheels, leaving the weapon and arm state
+ * in the output alone.
+ *
+ * This is the second half of mixer_run(), for when something else has a say
+ * in the inputs first.
+ */
+extern void mixer_drive(const struct mixer *mixer, const int32_t *in,
+                        struct mixer_output *out);
+
+/**
+ * @brief Turn stick inputs round for a robot that's upside down, so it
+ * still drives the way the sticks say seen from above.
+ *
+ * Upside down, every wheel drives the robot backwards and the sides are
+ * swapped. In arcade that comes down to reversing the throttle; in tank
+ * each stick drives the other side, reversed.
+ */
+extern void mixer_flip(const struct mixer *mixer, int32_t *in);
+
+/**
+ * @brief The weapon and arm state from a frame of channels, leaving the
+ * wheels in the output alone.
+ */
+extern void mixer_weapon(const struct mixer *mixer, const uint16_t *ch,
+                         struct mixer_output *out);
+
+/**
+ * @brief How much to scale the drive by for the pack's voltage, as Q14:
+ * up as it sags, to keep the motors' voltage where it'd be at the nominal
+ * voltage, and down in the cutback.
+ *
+ * @param battery_mv The pack's voltage, or 0 if it's not known, which
+ * leaves the drive alone.
+ */
+extern int32_t mixer_battery_gain(const struct mixer *mixer,
+                                  uint32_t battery_mv);
+
+/**
+ * @brief Scale the wheels' drive by a gain from mixer_battery_gain(), up
+ * to the full scale.
+ */
+extern void mixer_battery(const struct mixer *mixer, int32_t gain,
+                          struct mixer_output *out);
+
+/**
+ * @brief Hold the wheels' drive back to a percentage of what it was.
+ */
+extern void mixer_limit(struct mixer_output *out, uint8_t percent);
+
+/**
+ * @brief Mix one frame of channels the way the robot drives off them:
+ * flipped if it's upside down, limited for the link and scaled for the
+ * battery, and the weapon.
+ *
+ * @param in The sticks, as they were before any flip.
+ */
+extern void mixer_frame(const struct mixer *mixer, const uint16_t *ch,
+                        const struct mixer_limits *limits, int32_t *in,
+                        struct mixer_output *out);
+
+/**
+ * @brief Stick position as Q15 after the curve, for a signed Q15 input.
+ */
+extern int32_t mixer_curve(const struct mixer *mixer, int32_t x);
+
+#endif /* MIXER_H */
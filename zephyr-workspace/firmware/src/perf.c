@@ -0,0 +1,306 @@
+/*
+ * The perf command on the console: each thread's share of the CPU and the
+ * most of its stack it's used, the radio's interrupts and frames, the
+ * control loops' timing and the radio to motor latency. It only reads
+ * counters that are kept anyway, so it costs nothing until it's asked.
+ *
+ * Rates are measured over a window, 1 s unless it's given in ms, with the
+ * console waiting meanwhile.
+ */
+
+#include <drivers/misc/csrf.h>
+#include <stddef.h>
+#include <zephyr/device.h>
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+
+#include "latency.h"
+#include "supervisor.h"
+
+#define DEFAULT_WINDOW_MS 1000
+
+static const struct device *elrs_radio =
+    DEVICE_DT_GET(DT_NODELABEL(elrs_radio));
+
+/**
+ * @brief A thread's run time at the start of the window.
+ */
+struct thread_sample
+{
+    const struct k_thread *thread;
+    uint64_t cycles;
+};
+
+static struct thread_sample samples[CONFIG_COMBAT_PERF_MAX_THREADS];
+static size_t num_samples;
+
+struct thread_report
+{
+    const struct shell *sh;
+    uint64_t window_cycles;
+};
+
+static int get_window(const struct shell *sh, size_t argc, char **argv,
+                      uint32_t *ms)
+{
+    int err = 0;
+
+    *ms = DEFAULT_WINDOW_MS;
+    if (argc > 1)
+        *ms = shell_strtoul(argv[1], 10, &err);
+
+    if (err || *ms == 0) {
+        shell_error(sh, "Window should be a number of ms");
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+static void sample_thread(const struct k_thread *thread, void *user_data)
+{
+    k_thread_runtime_stats_t stats;
+
+    if (num_samples == ARRAY_SIZE(samples))
+        return;
+
+    k_thread_runtime_stats_get((k_tid_t)thread, &stats);
+    samples[num_samples].thread = thread;
+    samples[num_samples].cycles = stats.execution_cycles;
+    num_samples++;
+}
+
+static void report_thread(const struct k_thread *thread, void *user_data)
+{
+    const struct thread_report *report = user_data;
+    k_thread_runtime_stats_t stats;
+    const char *name = k_thread_name_get((k_tid_t)thread);
+    char addr[12];
+    size_t size = thread->stack_info.size;
+    size_t unused;
+    uint32_t permille = 0;
+
+    if (!name || !name[0]) {
+        snprintk(addr, sizeof(addr), "%p", thread);
+        name = addr;
+    }
+
+    k_thread_runtime_stats_get((k_tid_t)thread, &stats);
+    for (size_t i = 0; i < num_samples; i++) {
+        if (samples[i].thread == thread) {
+            permille = (stats.execution_cycles - samples[i].cycles) * 1000 /
+                       MAX(report->window_cycles, 1);
+            break;
+        }
+    }
+
+    if (k_thread_stack_space_get(thread, &unused)) {
+        shell_print(report->sh, "%-16s %4d %3u.%u %6u %6s", name,
+                    thread->base.prio, permille / 10, permille % 10,
+                    (unsigned)size, "-");
+        return;
+    }
+
+    shell_print(report->sh, "%-16s %4d %3u.%u %6u %6u %5u", name,
+                thread->base.prio, permille / 10, permille % 10,
+                (unsigned)size, (unsigned)(size - unused),
+                (unsigned)((size - unused) * 100 / MAX(size, 1)));
+}
+
+/**
+ * @brief Each thread's share of the CPU over the window, and the most of
+ * its stack it's ever used.
+ */
+static int cmd_perf_threads(const struct shell *sh, size_t argc, char **argv)
+{
+    k_thread_runtime_stats_t before, after;
+    struct thread_report report = {.sh = sh};
+    uint32_t window_ms;
+    uint32_t busy;
+
+    if (get_window(sh, argc, argv, &window_ms))
+        return -EINVAL;
+
+    num_samples = 0;
+    k_thread_runtime_stats_all_get(&before);
+    k_thread_foreach(sample_thread, NULL);
+    k_msleep(window_ms);
+    k_thread_runtime_stats_all_get(&after);
+
+    report.window_cycles = after.execution_cycles - before.execution_cycles;
+    busy = (report.window_cycles - (after.idle_cycles - before.idle_cycles)) *
+           1000 / MAX(report.window_cycles, 1);
+
+    shell_print(sh, "%-16s %4s %5s %6s %6s %5s", "thread", "prio", "cpu_%",
+                "stack", "used", "used%");
+    k_thread_foreach_unlocked(report_thread, &report);
+    shell_print(sh, "CPU busy %u.%u%% over %u ms", busy / 10, busy % 10,
+                window_ms);
+
+    return 0;
+}
+
+static const struct
+{
+    const char *name;
+    size_t offset;
+} radio_counters[] = {
+    {"rx_irqs", offsetof(struct csrf_stats, rx_irqs)},
+    {"rx_octets", offsetof(struct csrf_stats, rx_octets)},
+    {"rx_overflow", offsetof(struct csrf_stats, rx_overflow)},
+    {"rx_errors", offsetof(struct csrf_stats, rx_errors)},
+    {"frames", offsetof(struct csrf_stats, frames)},
+    {"bad_crc", offsetof(struct csrf_stats, bad_crc)},
+    {"bad_len", offsetof(struct csrf_stats, bad_len)},
+    {"unhandled", offsetof(struct csrf_stats, unhandled)},
+    {"noise", offsetof(struct csrf_stats, noise)},
+    {"tx_full", offsetof(struct csrf_stats, tx_full)},
+};
+
+static uint32_t radio_counter(const struct csrf_stats *stats, size_t i)
+{
+    return *(const uint32_t *)((const uint8_t *)stats +
+                               radio_counters[i].offset);
+}
+
+/**
+ * @brief The radio driver's counters since it started, and their rates
+ * over the window.
+ */
+static int cmd_perf_radio(const struct shell *sh, size_t argc, char **argv)
+{
+    struct csrf_stats before, after;
+    uint32_t window_ms, delta;
+    int rc;
+
+    if (get_window(sh, argc, argv, &window_ms))
+        return -EINVAL;
+
+    rc = csrf_get_stats(elrs_radio, &before);
+    if (rc) {
+        shell_error(sh, "No radio counters (%d)", rc);
+        return rc;
+    }
+    k_msleep(window_ms);
+    csrf_get_stats(elrs_radio, &after);
+
+    shell_print(sh, "%-12s %10s %8s", "counter", "total", "per_s");
+    for (size_t i = 0; i < ARRAY_SIZE(radio_counters); i++) {
+        delta = radio_counter(&after, i) - radio_counter(&before, i);
+        shell_print(sh, "%-12s %10u %8u", radio_counters[i].name,
+                    radio_counter(&after, i),
+                    (uint32_t)((uint64_t)delta * 1000 / window_ms));
+    }
+
+    return 0;
+}
+
+/**
+ * @brief How often each supervised loop ran over the window and how long
+ * it took on average, with the worst since boot.
+ */
+static int cmd_perf_loop(const struct shell *sh, size_t argc, char **argv)
+{
+    struct task_monitor_stats before[SUPERVISOR_TASK_COUNT];
+    struct task_monitor_stats after;
+    bool watched[SUPERVISOR_TASK_COUNT];
+    uint32_t window_ms, runs;
+
+    if (get_window(sh, argc, argv, &window_ms))
+        return -EINVAL;
+
+    /* Some loops aren't built in, or didn't start. */
+    for (int i = 0; i < SUPERVISOR_TASK_COUNT; i++)
+        watched[i] = !supervisor_get_stats(i, &before[i]);
+    k_msleep(window_ms);
+
+    shell_print(sh, "%-10s %8s %8s %10s %10s %8s", "loop", "rate_hz",
+                "mean_us", "wcet_us", "max_gap_us", "misses");
+
+    for (int i = 0; i < SUPERVISOR_TASK_COUNT; i++) {
+        if (!watched[i] || supervisor_get_stats(i, &after))
+            continue;
+
+        runs = after.runs - before[i].runs;
+        shell_print(sh, "%-10s %8u %8u %10u %10u %8u",
+                    supervisor_task_names[i],
+                    (uint32_t)((uint64_t)runs * 1000 / window_ms),
+                    runs ? (uint32_t)((after.busy - before[i].busy) / runs)
+                         : 0,
+                    after.wcet, after.max_gap, after.misses);
+    }
+
+    return 0;
+}
+
+#ifdef CONFIG_COMBAT_LATENCY
+/* Too big for the shell's stack. */
+static struct latency_histogram latency_before[LATENCY_STAGE_COUNT];
+
+/**
+ * @brief Take off what a histogram had at the start of the window. If
+ * it's been reset since, all of it's from the window.
+ */
+static void latency_since(struct latency_histogram *hist,
+                          const struct latency_histogram *before)
+{
+    for (int b = 0; b < CONFIG_COMBAT_LATENCY_BUCKETS; b++) {
+        if (hist->bucket[b] < before->bucket[b])
+            return;
+    }
+
+    hist->count -= before->count;
+    for (int b = 0; b < CONFIG_COMBAT_LATENCY_BUCKETS; b++)
+        hist->bucket[b] -= before->bucket[b];
+}
+
+/**
+ * @brief The latency from the sync byte to each stage, for the frames in
+ * the window, with the worst since boot.
+ */
+static int cmd_perf_latency(const struct shell *sh, size_t argc, char **argv)
+{
+    struct latency_histogram hist;
+    uint32_t window_ms;
+
+    if (get_window(sh, argc, argv, &window_ms))
+        return -EINVAL;
+
+    for (int i = LATENCY_STAGE_FRAME; i < LATENCY_STAGE_COUNT; i++)
+        latency_get(i, &latency_before[i]);
+    k_msleep(window_ms);
+
+    shell_print(sh, "%-6s %8s %7s %7s %7s %7s", "stage", "frames",
+                "p50_us", "p90_us", "p99_us", "max_us");
+
+    for (int i = LATENCY_STAGE_FRAME; i < LATENCY_STAGE_COUNT; i++) {
+        latency_get(i, &hist);
+        latency_since(&hist, &latency_before[i]);
+        shell_print(sh, "%-6s %8u %7u %7u %7u %7u", latency_stage_names[i],
+                    hist.count, latency_percentile(&hist, 500),
+                    latency_percentile(&hist, 900),
+                    latency_percentile(&hist, 990), hist.max_us);
+    }
+
+    return 0;
+}
+#endif
+
+SHELL_STATIC_SUBCMD_SET_CREATE(
+    perf_cmds,
+    SHELL_CMD_ARG(threads, NULL,
+                  "CPU use and stack high water per thread [window ms]",
+                  cmd_perf_threads, 1, 1),
+    SHELL_CMD_ARG(radio, NULL,
+                  "Radio interrupts, frames, rejects and overflows "
+                  "[window ms]",
+                  cmd_perf_radio, 1, 1),
+    SHELL_CMD_ARG(loop, NULL, "Control loop rates and run times [window ms]",
+                  cmd_perf_loop, 1, 1),
+    SHELL_COND_CMD_ARG(CONFIG_COMBAT_LATENCY, latency, NULL,
+                       "Radio to motor latency percentiles [window ms]",
+                       cmd_perf_latency, 1, 1),
+    SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(perf, &perf_cmds, "Where the CPU and stacks are going",
+                   NULL);
@@ -0,0 +1,274 @@
+#include "power.h"
+
+#include <errno.h>
+#include <zephyr/device.h>
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/pm/device.h>
+#include <zephyr/pm/pm.h>
+#include <zephyr/pm/policy.h>
+
+#ifdef CONFIG_USB_DEVICE_STACK
+#include <zephyr/usb/usb_device.h>
+#endif
+
+#ifdef CONFIG_SHELL
+#include <zephyr/shell/shell.h>
+#endif
+
+#include "battery.h"
+#include "blackbox.h"
+#include "imu.h"
+
+static const struct device *weapon_esc =
+    DEVICE_DT_GET(DT_NODELABEL(weapon_esc));
+
+/* Stop mode, every substate the devicetree lets us use. */
+#define STOP_STATE PM_STATE_SUSPEND_TO_IDLE
+
+static struct k_spinlock lock;
+static struct power_account acc;
+
+/* What the robot's asked for, which is put in place by the work. Nothing
+ * to start with, so the first state's always put in place. */
+static enum power_state wanted = POWER_STATE_COUNT;
+
+/* The locks this holds to keep the CPU out of stop: one for a state that
+ * needs it running, which is held from boot until main says otherwise,
+ * and one while USB's in use. */
+static bool state_locked;
+#ifdef CONFIG_USB_DEVICE_STACK
+static bool usb_locked;
+#endif
+
+static void power_work_handler(struct k_work *work);
+K_WORK_DELAYABLE_DEFINE(power_work, power_work_handler);
+
+static uint64_t now_us(void)
+{
+    return k_cyc_to_us_floor64(k_cycle_get_64());
+}
+
+static uint64_t idle_us(void)
+{
+    k_thread_runtime_stats_t stats;
+
+    k_thread_runtime_stats_all_get(&stats);
+
+    return k_cyc_to_us_floor64(stats.idle_cycles);
+}
+
+static void set_locked(bool *locked, bool on)
+{
+    if (on && !*locked)
+        pm_policy_state_lock_get(STOP_STATE, PM_ALL_SUBSTATES);
+    else if (!on && *locked)
+        pm_policy_state_lock_put(STOP_STATE, PM_ALL_SUBSTATES);
+
+    *locked = on;
+}
+
+static void set_device(const struct device *dev, bool on)
+{
+    int rc = pm_device_action_run(dev, on ? PM_DEVICE_ACTION_RESUME
+                                          : PM_DEVICE_ACTION_SUSPEND);
+
+    if (rc && rc != -EALREADY)
+        printk("Power: %s failed to %s (%d)\n", dev->name,
+               on ? "resume" : "suspend", rc);
+}
+
+/**
+ * @brief Put the wanted state's policy in place, from the system
+ * workqueue since powering things up and down can block.
+ */
+static void power_work_handler(struct k_work *work)
+{
+    const struct power_policy *policy;
+    enum power_state state;
+    k_spinlock_key_t key;
+
+    key = k_spin_lock(&lock);
+    state = wanted;
+    k_spin_unlock(&lock, key);
+
+    policy = &power_policies[state];
+
+    set_device(weapon_esc, policy->esc);
+    if (imu_set_active(policy->imu))
+        printk("Power: IMU failed to %s\n", policy->imu ? "resume" : "stop");
+    blackbox_set_active(policy->flash);
+    battery_set_active(policy->battery);
+
+    key = k_spin_lock(&lock);
+    power_account_state(&acc, state, now_us(), idle_us());
+    /* Unless it's changed again while that was going on, in which case
+     * this runs again. */
+    if (policy->stop && wanted == state)
+        set_locked(&state_locked, false);
+    k_spin_unlock(&lock, key);
+}
+
+void power_set_state(enum power_state state)
+{
+    const struct power_policy *policy = &power_policies[state];
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    bool changed = state != wanted;
+
+    wanted = state;
+    /* Before anything gets the chance to stop the CPU. */
+    if (!policy->stop)
+        set_locked(&state_locked, true);
+    k_spin_unlock(&lock, key);
+
+    if (changed)
+        k_work_reschedule(&power_work,
+                          policy->stop
+                              ? K_MSEC(CONFIG_COMBAT_POWER_IDLE_DELAY_MS)
+                              : K_NO_WAIT);
+}
+
+void power_rc_frame(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    power_account_frame(&acc, now_us());
+    k_spin_unlock(&lock, key);
+}
+
+void power_get_stats(enum power_state state, struct power_stats *stats)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    power_account_get(&acc, state, now_us(), idle_us(), stats);
+    k_spin_unlock(&lock, key);
+}
+
+/* These run in the idle thread with interrupts locked, and as it comes
+ * back out, before anything else runs. */
+static void stop_entry(enum pm_state state)
+{
+    k_spinlock_key_t key;
+
+    if (state != STOP_STATE)
+        return;
+
+    key = k_spin_lock(&lock);
+    power_account_stop(&acc, now_us());
+    k_spin_unlock(&lock, key);
+}
+
+static void stop_exit(enum pm_state state)
+{
+    k_spinlock_key_t key;
+
+    if (state != STOP_STATE)
+        return;
+
+    key = k_spin_lock(&lock);
+    power_account_wake(&acc, now_us());
+    k_spin_unlock(&lock, key);
+}
+
+static struct pm_notifier notifier = {
+    .state_entry = stop_entry,
+    .state_exit = stop_exit,
+};
+
+#ifdef CONFIG_USB_DEVICE_STACK
+/**
+ * @brief Stop would drop the USB connection, so it's kept out while the
+ * host's using it. Unplugged, the bus goes quiet and it's suspended.
+ */
+static void usb_status(enum usb_dc_status_code status, const uint8_t *param)
+{
+    k_spinlock_key_t key;
+
+    switch (status) {
+        case USB_DC_RESET:
+        case USB_DC_CONNECTED:
+        case USB_DC_CONFIGURED:
+        case USB_DC_RESUME:
+            key = k_spin_lock(&lock);
+            set_locked(&usb_locked, true);
+            k_spin_unlock(&lock, key);
+            break;
+        case USB_DC_SUSPEND:
+        case USB_DC_DISCONNECTED:
+            key = k_spin_lock(&lock);
+            set_locked(&usb_locked, false);
+            k_spin_unlock(&lock, key);
+            break;
+        default:
+            break;
+    }
+}
+#endif
+
+/**
+ * @brief Keep the CPU out of stop while everything's starting up.
+ */
+static int power_boot(void)
+{
+    set_locked(&state_locked, true);
+
+    return 0;
+}
+
+SYS_INIT(power_boot, PRE_KERNEL_1, 0);
+
+int power_init(void)
+{
+    struct power_config config;
+
+    power_config_default(&config);
+    /* Everything's powered at boot, which is the disarmed policy. */
+    power_account_init(&acc, &config, POWER_STATE_DISARMED, now_us(),
+                       idle_us());
+    pm_notifier_register(&notifier);
+
+#ifdef CONFIG_USB_DEVICE_STACK
+    return usb_enable(usb_status);
+#else
+    return 0;
+#endif
+}
+
+#ifdef CONFIG_SHELL
+static int cmd_power(const struct shell *sh, size_t argc, char **argv)
+{
+    struct power_stats stats;
+    uint64_t run, sleep;
+
+    shell_print(sh, "%-9s %7s %5s %7s %6s %8s %6s %6s %11s", "state",
+                "time_s", "run_%", "sleep_%", "stop_%", "stops", "est_ua",
+                "wakes", "wake_max_us");
+
+    for (int i = 0; i < POWER_STATE_COUNT; i++) {
+        power_get_stats(i, &stats);
+        if (!stats.time_us) {
+            shell_print(sh, "%-9s %7u", power_state_names[i], 0);
+            continue;
+        }
+
+        run = stats.time_us - MIN(stats.idle_us, stats.time_us);
+        sleep = stats.idle_us - MIN(stats.stop_us, stats.idle_us);
+        shell_print(sh, "%-9s %7u %5u %7u %6u %8u %6u %6u %11u",
+                    power_state_names[i], (uint32_t)(stats.time_us / 1000000),
+                    (uint32_t)(run * 100 / stats.time_us),
+                    (uint32_t)(sleep * 100 / stats.time_us),
+                    (uint32_t)(stats.stop_us * 100 / stats.time_us),
+                    stats.stops,
+                    power_estimate_ua(&acc.config, i, &stats), stats.wakes,
+                    stats.wake_max_us);
+    }
+
+    shell_print(sh, "est_ua is the MCU, IMU and flash from datasheet figures");
+
+    return 0;
+}
+
+SHELL_CMD_REGISTER(power, NULL,
+                   "Time and estimated current in each state, and wake times",
+                   cmd_power);
+#endif
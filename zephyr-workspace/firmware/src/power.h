@@ -0,0 +1,33 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include "power_policy.h"
+
+/**
+ * @brief Start USB and start counting where the time goes. Until this is
+ * called the CPU never stops.
+ */
+extern int power_init(void);
+
+/**
+ * @brief The robot's changed state. Safe from an ISR, and does nothing if
+ * it's the same as before.
+ *
+ * Anything the new state needs is back straight away. Powering down waits
+ * for CONFIG_COMBAT_POWER_IDLE_DELAY_MS in case the radio comes back.
+ */
+extern void power_set_state(enum power_state state);
+
+/**
+ * @brief An RC frame has reached the outputs, for timing the wake from
+ * stop.
+ */
+extern void power_rc_frame(void);
+
+/**
+ * @brief A state's stats so far.
+ */
+extern void power_get_stats(enum power_state state,
+                            struct power_stats *stats);
+
+#endif /* POWER_H */
@@ -0,0 +1,129 @@
+#include "power_policy.h"
+
+#include <string.h>
+
+const char *const power_state_names[POWER_STATE_COUNT] = {
+    [POWER_STATE_NO_RADIO] = "no_radio",
+    [POWER_STATE_DISARMED] = "disarmed",
+    [POWER_STATE_ARMED] = "armed",
+};
+
+/* With the drive live, the IMU runs the yaw loop, the ESC has to keep
+ * getting frames to stay armed, and the black box is recording. Stop mode
+ * would freeze the motor timers and DMA. */
+const struct power_policy power_policies[POWER_STATE_COUNT] = {
+    [POWER_STATE_NO_RADIO] = {.stop = true},
+    [POWER_STATE_DISARMED] = {.imu = true, .esc = true, .flash = true,
+                              .battery = true},
+    [POWER_STATE_ARMED] = {.imu = true, .esc = true, .flash = true,
+                           .battery = true},
+};
+
+void power_config_default(struct power_config *config)
+{
+    config->run_ua = 6700;
+    config->sleep_ua = 1900;
+    config->stop_ua = 10;
+    config->imu_on_ua = 1250;
+    config->imu_off_ua = 6;
+    config->flash_on_ua = 50;
+    config->flash_off_ua = 1;
+}
+
+void power_account_init(struct power_account *acc,
+                        const struct power_config *config,
+                        enum power_state state, uint64_t now_us,
+                        uint64_t idle_us)
+{
+    memset(acc, 0, sizeof(*acc));
+    acc->config = *config;
+    acc->state = state;
+    acc->mark_us = now_us;
+    acc->mark_idle_us = idle_us;
+}
+
+/**
+ * @brief Add the time since the mark to the current state.
+ */
+static void add_up(struct power_account *acc, uint64_t now_us,
+                   uint64_t idle_us)
+{
+    struct power_stats *stats = &acc->stats[acc->state];
+
+    stats->time_us += now_us - acc->mark_us;
+    stats->idle_us += idle_us - acc->mark_idle_us;
+    acc->mark_us = now_us;
+    acc->mark_idle_us = idle_us;
+}
+
+void power_account_state(struct power_account *acc, enum power_state state,
+                         uint64_t now_us, uint64_t idle_us)
+{
+    add_up(acc, now_us, idle_us);
+    acc->state = state;
+}
+
+void power_account_stop(struct power_account *acc, uint64_t now_us)
+{
+    acc->stopped = true;
+    acc->stop_start_us = now_us;
+    acc->stats[acc->state].stops++;
+}
+
+void power_account_wake(struct power_account *acc, uint64_t now_us)
+{
+    if (!acc->stopped)
+        return;
+
+    acc->stopped = false;
+    acc->stats[acc->state].stop_us += now_us - acc->stop_start_us;
+    acc->woken = true;
+    acc->wake_us = now_us;
+}
+
+void power_account_frame(struct power_account *acc, uint64_t now_us)
+{
+    struct power_stats *stats = &acc->stats[acc->state];
+    uint64_t latency = now_us - acc->wake_us;
+
+    if (!acc->woken)
+        return;
+
+    acc->woken = false;
+    stats->wakes++;
+    if (latency > stats->wake_max_us)
+        stats->wake_max_us = latency > UINT32_MAX ? UINT32_MAX : latency;
+}
+
+void power_account_get(struct power_account *acc, enum power_state state,
+                       uint64_t now_us, uint64_t idle_us,
+                       struct power_stats *stats)
+{
+    if (state == acc->state)
+        add_up(acc, now_us, idle_us);
+
+    *stats = acc->stats[state];
+}
+
+uint32_t power_estimate_ua(const struct power_config *config,
+                           enum power_state state,
+                           const struct power_stats *stats)
+{
+    const struct power_policy *policy = &power_policies[state];
+    uint64_t idle, stop, charge;
+
+    if (!stats->time_us)
+        return 0;
+
+    /* The idle time is sampled from another clock, so it can come out a
+     * touch over. */
+    idle = stats->idle_us < stats->time_us ? stats->idle_us : stats->time_us;
+    stop = stats->stop_us < idle ? stats->stop_us : idle;
+
+    charge = (stats->time_us - idle) * config->run_ua +
+             (idle - stop) * config->sleep_ua + stop * config->stop_ua;
+
+    return charge / stats->time_us +
+           (policy->imu ? config->imu_on_ua : config->imu_off_ua) +
+           (policy->flash ? config->flash_on_ua : config->flash_off_ua);
+}
@@ -0,0 +1,138 @@
+#ifndef POWER_POLICY_H
+#define POWER_POLICY_H
+
+/*
+ * What can be powered down in each of the robot's states, and where the
+ * time goes in each: running, idle with the CPU asleep, and idle with it
+ * stopped. From that it estimates the current drawn by the parts that the
+ * policy controls, and it times how long the first RC frame after a stop
+ * takes to reach the outputs.
+ *
+ * Times are in microseconds since boot, as 64 bits so they don't wrap.
+ * Not thread safe.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+enum power_state
+{
+    /* No radio link, so the outputs are off and nothing's moving. */
+    POWER_STATE_NO_RADIO,
+    /* The drive's live, but not the weapon. */
+    POWER_STATE_DISARMED,
+    POWER_STATE_ARMED,
+
+    POWER_STATE_COUNT,
+};
+
+struct power_policy
+{
+    /* The CPU can go into stop mode when it's idle, not just sleep. */
+    bool stop;
+    /* These stay powered. */
+    bool imu;
+    bool esc;
+    bool flash;
+    /* The battery's sampled, which wakes the CPU every few ms. */
+    bool battery;
+};
+
+extern const char *const power_state_names[POWER_STATE_COUNT];
+extern const struct power_policy power_policies[POWER_STATE_COUNT];
+
+/**
+ * @brief Currents for the estimate, in microamps.
+ */
+struct power_config
+{
+    /* The MCU running, asleep and stopped. */
+    uint32_t run_ua;
+    uint32_t sleep_ua;
+    uint32_t stop_ua;
+    /* The IMU and black box flash, powered and powered down. */
+    uint32_t imu_on_ua;
+    uint32_t imu_off_ua;
+    uint32_t flash_on_ua;
+    uint32_t flash_off_ua;
+};
+
+struct power_stats
+{
+    uint64_t time_us;
+    /* Of that, the CPU was idle, and of that, stopped. */
+    uint64_t idle_us;
+    uint64_t stop_us;
+    uint32_t stops;
+    /* RC frames that came in while stopped, and the longest one of them
+     * took from the wake up to the outputs. */
+    uint32_t wakes;
+    uint32_t wake_max_us;
+};
+
+struct power_account
+{
+    struct power_config config;
+    enum power_state state;
+
+    /* When the state's time was last added up, and the idle time then. */
+    uint64_t mark_us;
+    uint64_t mark_idle_us;
+
+    bool stopped;
+    uint64_t stop_start_us;
+    /* Woke from a stop, and no RC frame since. */
+    bool woken;
+    uint64_t wake_us;
+
+    struct power_stats stats[POWER_STATE_COUNT];
+};
+
+/**
+ * @brief The STM32L412 at 80 MHz, the LSM6DS3 at 1.66 kHz and the W25Q32,
+ * from their datasheets.
+ */
+extern void power_config_default(struct power_config *config);
+
+/**
+ * @param idle_us The CPU's idle time since boot.
+ */
+extern void power_account_init(struct power_account *acc,
+                               const struct power_config *config,
+                               enum power_state state, uint64_t now_us,
+                               uint64_t idle_us);
+
+/**
+ * @brief The policy for another state has been put in place.
+ */
+extern void power_account_state(struct power_account *acc,
+                                enum power_state state, uint64_t now_us,
+                                uint64_t idle_us);
+
+/**
+ * @brief The CPU's going into stop mode, and it's come out again.
+ */
+extern void power_account_stop(struct power_account *acc, uint64_t now_us);
+extern void power_account_wake(struct power_account *acc, uint64_t now_us);
+
+/**
+ * @brief An RC frame has reached the outputs.
+ */
+extern void power_account_frame(struct power_account *acc, uint64_t now_us);
+
+/**
+ * @brief A state's stats, up to now if it's the current one.
+ */
+extern void power_account_get(struct power_account *acc,
+                              enum power_state state, uint64_t now_us,
+                              uint64_t idle_us, struct power_stats *stats);
+
+/**
+ * @brief The average current in a state, in microamps, or 0 if it's not
+ * been in it.
+ */
+extern uint32_t power_estimate_ua(const struct power_config *config,
+                                  enum power_state state,
+                                  const struct power_stats *stats);
+
+#endif /* POWER_POLICY_H */
@@ -0,0 +1,102 @@
+#include "radio_params.h"
+
+#include <string.h>
+#include <zephyr/kernel.h>
+
+#include "csrf_params.h"
+#include "drivers/misc/csrf.h"
+#include "settings_store.h"
+
+/**
+ * @brief A device protocol frame, waiting for the parameter thread.
+ */
+struct request
+{
+    uint8_t type;
+    uint8_t len;
+    uint8_t payload[CSRF_MAX_PAYLOAD_LEN];
+};
+
+K_MSGQ_DEFINE(requests, sizeof(struct request),
+              CONFIG_COMBAT_RADIO_PARAMS_QUEUE_SIZE, 4);
+
+static const struct device *radio_dev;
+static radio_params_apply_t apply_fn;
+static struct csrf_params params;
+
+static K_THREAD_STACK_DEFINE(thread_stack,
+                             CONFIG_COMBAT_RADIO_PARAMS_STACK_SIZE);
+static struct k_thread thread;
+
+/**
+ * @brief Queue a request, from the CSRF thread, in between RC frames.
+ */
+static void device_callback(uint8_t type, const uint8_t *payload, size_t len)
+{
+    struct request req;
+
+    if (payload[0] != CSRF_PARAMS_ADDR_FLIGHT_CONTROLLER &&
+        payload[0] != CSRF_PARAMS_ADDR_BROADCAST)
+        return;
+
+    req.type = type;
+    req.len = len;
+    memcpy(req.payload, payload, len);
+
+    /* If the thread's behind this is dropped, and the handset asks
+     * again. */
+    k_msgq_put(&requests, &req, K_NO_WAIT);
+}
+
+static void params_thread(void *p1, void *p2, void *p3)
+{
+    uint8_t reply[CSRF_PARAMS_MAX_REPLY];
+    struct request req;
+    uint8_t reply_type;
+    bool changed;
+    size_t len;
+
+    while (1) {
+        k_msgq_get(&requests, &req, K_FOREVER);
+
+        len = csrf_params_handle(&params, req.type, req.payload, req.len,
+                                 &reply_type, reply, &changed);
+
+        /* This shares the telemetry slots after each RC frame. If they're
+         * all taken the reply's dropped, and the handset asks again. */
+        if (len)
+            csrf_send_frame(radio_dev, reply_type, reply, len);
+
+        if (changed) {
+            apply_fn(params.settings);
+            settings_store_save(params.settings);
+        }
+
+        /* However fast the handset asks, leave room for the telemetry. */
+        k_sleep(K_MSEC(CONFIG_COMBAT_RADIO_PARAMS_INTERVAL_MS));
+    }
+}
+
+int radio_params_init(const struct device *radio,
+                      struct robot_settings *settings,
+                      const struct robot_settings *defaults,
+                      radio_params_apply_t apply)
+{
+    k_tid_t tid;
+
+    radio_dev = radio;
+    apply_fn = apply;
+    params.addr = CSRF_PARAMS_ADDR_FLIGHT_CONTROLLER;
+    params.name = CONFIG_COMBAT_RADIO_PARAMS_NAME;
+    params.settings = settings;
+    params.defaults = defaults;
+
+    tid = k_thread_create(&thread, thread_stack,
+                          K_THREAD_STACK_SIZEOF(thread_stack), params_thread,
+                          NULL, NULL, NULL,
+                          K_PRIO_PREEMPT(CONFIG_COMBAT_RADIO_PARAMS_PRIORITY),
+                          0, K_NO_WAIT);
+    k_thread_name_set(tid, "radio_params");
+
+    return csrf_set_device_callback(radio, device_callback);
+}
@@ -0,0 +1,40 @@
+#ifndef RADIO_PARAMS_H
+#define RADIO_PARAMS_H
+
+#include <zephyr/device.h>
+
+#include "robot_settings.h"
+
+/**
+ * @brief Puts changed settings into effect. Called from the parameter
+ * thread.
+ */
+typedef void (*radio_params_apply_t)(const struct robot_settings *settings);
+
+#ifdef CONFIG_COMBAT_RADIO_PARAMS
+
+/**
+ * @brief Let the handset read and change the settings over CRSF.
+ *
+ * Changes are put into effect with apply, and saved.
+ *
+ * @param settings Only changed by the parameter thread from now on.
+ */
+extern int radio_params_init(const struct device *radio,
+                             struct robot_settings *settings,
+                             const struct robot_settings *defaults,
+                             radio_params_apply_t apply);
+
+#else
+
+static inline int radio_params_init(const struct device *radio,
+                                    struct robot_settings *settings,
+                                    const struct robot_settings *defaults,
+                                    radio_params_apply_t apply)
+{
+    return 0;
+}
+
+#endif /* CONFIG_COMBAT_RADIO_PARAMS */
+
+#endif /* RADIO_PARAMS_H */
@@ -0,0 +1,130 @@
+#include "robot_settings.h"
+
+/* Version and count. */
+#define HEADER_SIZE 2
+
+const struct robot_setting_info robot_settings_info[ROBOT_SETTINGS_COUNT] = {
+    [ROBOT_SETTING_MIX] = {"Mix", "", MIXER_MODE_TANK, MIXER_MODE_ARCADE},
+    [ROBOT_SETTING_INPUT0_CH] = {"Stick 1 ch", "", 0, 15},
+    [ROBOT_SETTING_INPUT1_CH] = {"Stick 2 ch", "", 0, 15},
+    [ROBOT_SETTING_ARM_CH] = {"Arm ch", "", 0, 15},
+    [ROBOT_SETTING_WEAPON_CH] = {"Weapon ch", "", 0, 15},
+    [ROBOT_SETTING_EXPO] = {"Expo", "%", 0, 100},
+    [ROBOT_SETTING_DEADBAND] = {"Deadband", "%", 0, 50},
+    [ROBOT_SETTING_TRIM_FRONT_LEFT] = {"Trim FL", "%", 0, 100},
+    [ROBOT_SETTING_TRIM_REAR_LEFT] = {"Trim RL", "%", 0, 100},
+    [ROBOT_SETTING_TRIM_FRONT_RIGHT] = {"Trim FR", "%", 0, 100},
+    [ROBOT_SETTING_TRIM_REAR_RIGHT] = {"Trim RR", "%", 0, 100},
+    [ROBOT_SETTING_REVERSE] = {"Reverse", "", 0, (1 << MIXER_NUM_WHEELS) - 1},
+    [ROBOT_SETTING_DRIVE_LIMIT] = {"Drive limit", "%", 10, 100},
+    [ROBOT_SETTING_WEAPON_LIMIT] = {"Weapon limit", "%", 0, 100},
+    [ROBOT_SETTING_FAILSAFE_MS] = {"Failsafe", "ms", 50, 2000},
+    [ROBOT_SETTING_YAW_KP] = {"Yaw P", "", 0, 60000},
+    [ROBOT_SETTING_YAW_KI] = {"Yaw I", "", 0, 60000},
+    [ROBOT_SETTING_YAW_KD] = {"Yaw D", "", 0, 60000},
+    [ROBOT_SETTING_YAW_KFF] = {"Yaw FF", "", 0, 60000},
+    [ROBOT_SETTING_BATTERY_NOMINAL_MV] = {"Nominal batt", "mV", 0, 30000},
+    [ROBOT_SETTING_BATTERY_CUTBACK_MV] = {"Cutback batt", "mV", 0, 30000},
+    [ROBOT_SETTING_BATTERY_EMPTY_MV] = {"Empty batt", "mV", 0, 30000},
+};
+
+static bool in_range(int i, uint16_t v)
+{
+    return v >= robot_settings_info[i].min && v <= robot_settings_info[i].max;
+}
+
+bool robot_settings_check(const struct robot_settings *settings)
+{
+    for (int i = 0; i < ROBOT_SETTINGS_COUNT; i++) {
+        if (!in_range(i, settings->v[i]))
+            return false;
+    }
+
+    return true;
+}
+
+size_t robot_settings_encode(const struct robot_settings *settings,
+                             uint8_t *out)
+{
+    uint8_t *p = out;
+
+    *p++ = ROBOT_SETTINGS_VERSION;
+    *p++ = ROBOT_SETTINGS_COUNT;
+    for (int i = 0; i < ROBOT_SETTINGS_COUNT; i++) {
+        *p++ = settings->v[i];
+        *p++ = settings->v[i] >> 8;
+    }
+
+    return p - out;
+}
+
+int robot_settings_decode(const uint8_t *in, size_t len,
+                          struct robot_settings *settings)
+{
+    int count, taken = 0;
+
+    /* There's only been one version so far. When a setting changes what it
+     * means, older versions get converted here. */
+    if (len < HEADER_SIZE || in[0] != ROBOT_SETTINGS_VERSION)
+        return -1;
+
+    /* Newer firmware's settings may have been cut short to the ones this
+     * firmware knows. */
+    count = in[1] < ROBOT_SETTINGS_COUNT ? in[1] : ROBOT_SETTINGS_COUNT;
+    if (len < HEADER_SIZE + 2 * (size_t)count)
+        return -1;
+
+    for (int i = 0; i < count; i++) {
+        const uint8_t *p = &in[HEADER_SIZE + 2 * i];
+        uint16_t v = p[0] | (p[1] << 8);
+
+        if (in_range(i, v)) {
+            settings->v[i] = v;
+            taken++;
+        }
+    }
+
+    return taken;
+}
+
+void robot_settings_mixer_config(const struct robot_settings *settings,
+                                 struct mixer_config *config)
+{
+    const uint16_t *v = settings->v;
+
+    config->mode = v[ROBOT_SETTING_MIX];
+    config->input_ch[0] = v[ROBOT_SETTING_INPUT0_CH];
+    config->input_ch[1] = v[ROBOT_SETTING_INPUT1_CH];
+    config->arm_ch = v[ROBOT_SETTING_ARM_CH];
+    config->weapon_ch = v[ROBOT_SETTING_WEAPON_CH];
+    config->expo = v[ROBOT_SETTING_EXPO] * MIXER_Q15_ONE / 100;
+    config->deadband = v[ROBOT_SETTING_DEADBAND] * MIXER_Q15_ONE / 100;
+
+    for (int w = 0; w < MIXER_NUM_WHEELS; w++) {
+        config->trim[w] =
+            v[ROBOT_SETTING_TRIM_FRONT_LEFT + w] * MIXER_Q14_ONE / 100;
+        config->reverse[w] = v[ROBOT_SETTING_REVERSE] & (1 << w);
+    }
+
+    config->drive_full_scale = (uint64_t)config->drive_full_scale *
+                               v[ROBOT_SETTING_DRIVE_LIMIT] / 100;
+    config->weapon_pulse_max =
+        MIXER_WEAPON_PULSE_MIN +
+        (MIXER_WEAPON_PULSE_MAX - MIXER_WEAPON_PULSE_MIN) / 100 *
+            v[ROBOT_SETTING_WEAPON_LIMIT];
+
+    config->battery_nominal_mv = v[ROBOT_SETTING_BATTERY_NOMINAL_MV];
+    config->battery_cutback_mv = v[ROBOT_SETTING_BATTERY_CUTBACK_MV];
+    config->battery_empty_mv = v[ROBOT_SETTING_BATTERY_EMPTY_MV];
+}
+
+void robot_settings_yaw_gains(const struct robot_settings *settings,
+                              struct yaw_gains *gains)
+{
+    const uint16_t *v = settings->v;
+
+    gains->kp = v[ROBOT_SETTING_YAW_KP] * YAW_Q12_ONE / 1000;
+    gains->ki = v[ROBOT_SETTING_YAW_KI] * YAW_Q12_ONE / 1000;
+    gains->kd = v[ROBOT_SETTING_YAW_KD] * YAW_Q12_ONE / 1000;
+    gains->kff = v[ROBOT_SETTING_YAW_KFF] * YAW_Q12_ONE / 1000;
+}
@@ -0,0 +1,120 @@
+#ifndef ROBOT_SETTINGS_H
+#define ROBOT_SETTINGS_H
+
+/*
+ * The settings that can be changed without a reflash, and how they're laid
+ * out in flash.
+ *
+ * Every setting is a uint16_t with a range. Stored settings are the schema
+ * version, how many settings there are, then each one little endian in the
+ * order of enum robot_setting. New settings only ever go on the end, so
+ * settings saved by older firmware are read as far as they go and the rest
+ * take their defaults, and ones saved by newer firmware just have some on
+ * the end that are ignored. The version only changes if a setting changes
+ * what it means. A setting that's out of range takes its default.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mixer.h"
+#include "yaw_pid.h"
+
+#define ROBOT_SETTINGS_VERSION 1
+
+enum robot_setting
+{
+    /* enum mixer_mode. */
+    ROBOT_SETTING_MIX,
+    /* RC channels, 0-15. */
+    ROBOT_SETTING_INPUT0_CH,
+    ROBOT_SETTING_INPUT1_CH,
+    ROBOT_SETTING_ARM_CH,
+    ROBOT_SETTING_WEAPON_CH,
+    ROBOT_SETTING_EXPO,
+    ROBOT_SETTING_DEADBAND,
+    ROBOT_SETTING_TRIM_FRONT_LEFT,
+    ROBOT_SETTING_TRIM_REAR_LEFT,
+    ROBOT_SETTING_TRIM_FRONT_RIGHT,
+    ROBOT_SETTING_TRIM_REAR_RIGHT,
+    /* A bit for each wheel, in enum mixer_wheel order. */
+    ROBOT_SETTING_REVERSE,
+    /* Drive at full stick, and weapon at full throttle. */
+    ROBOT_SETTING_DRIVE_LIMIT,
+    ROBOT_SETTING_WEAPON_LIMIT,
+    /* The longest the radio can be quiet before everything stops. */
+    ROBOT_SETTING_FAILSAFE_MS,
+    /* Yaw loop gains, in thousandths. */
+    ROBOT_SETTING_YAW_KP,
+    ROBOT_SETTING_YAW_KI,
+    ROBOT_SETTING_YAW_KD,
+    ROBOT_SETTING_YAW_KFF,
+    /* The pack voltage the drive's held at, and the cutback below it. 0 is
+     * off. */
+    ROBOT_SETTING_BATTERY_NOMINAL_MV,
+    ROBOT_SETTING_BATTERY_CUTBACK_MV,
+    ROBOT_SETTING_BATTERY_EMPTY_MV,
+
+    ROBOT_SETTINGS_COUNT,
+};
+
+struct robot_setting_info
+{
+    const char *name;
+    const char *unit;
+    uint16_t min;
+    uint16_t max;
+};
+
+extern const struct robot_setting_info
+    robot_settings_info[ROBOT_SETTINGS_COUNT];
+
+struct robot_settings
+{
+    uint16_t v[ROBOT_SETTINGS_COUNT];
+};
+
+/* Version, count and the settings. */
+#define ROBOT_SETTINGS_MAX_SIZE (2 + 2 * ROBOT_SETTINGS_COUNT)
+
+/**
+ * @brief Whether every setting is in its range.
+ */
+extern bool robot_settings_check(const struct robot_settings *settings);
+
+/**
+ * @brief Pack settings for the flash.
+ *
+ * @param out Room for ROBOT_SETTINGS_MAX_SIZE octets.
+ * @return The length used.
+ */
+extern size_t robot_settings_encode(const struct robot_settings *settings,
+                                    uint8_t *out);
+
+/**
+ * @brief Unpack settings from the flash, over the defaults.
+ *
+ * @param settings The defaults on the way in. Settings that aren't stored,
+ * or are out of range, are left alone.
+ * @return How many settings were taken from the flash, or -1 if it isn't a
+ * version this firmware can read, in which case none were.
+ */
+extern int robot_settings_decode(const uint8_t *in, size_t len,
+                                 struct robot_settings *settings);
+
+/**
+ * @brief Fill in the mixer's config from the settings.
+ *
+ * @param config A config to start from, with the unlimited drive full scale.
+ */
+extern void robot_settings_mixer_config(const struct robot_settings *settings,
+                                        struct mixer_config *config);
+
+/**
+ * @brief The yaw loop's gains from the settings.
+ */
+extern void robot_settings_yaw_gains(const struct robot_settings *settings,
+                                     struct yaw_gains *gains);
+
+#endif /* ROBOT_SETTINGS_H */
@@ -0,0 +1,118 @@
+#include "settings_store.h"
+
+#include <zephyr/drivers/flash.h>
+#include <zephyr/fs/nvs.h>
+#include <zephyr/kernel.h>
+#include <zephyr/storage/flash_map.h>
+
+BUILD_ASSERT(FIXED_PARTITION_EXISTS(storage_partition),
+             "Settings need a storage_partition in the devicetree");
+
+/* All the settings go in one NVS entry, so they're always written
+ * together. */
+#define SETTINGS_ID 1
+
+static struct nvs_fs fs;
+static settings_store_armed_t armed_fn;
+
+/* What's waiting to be written. */
+static struct k_spinlock lock;
+static struct robot_settings pending;
+static bool dirty;
+
+static void save_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(save_work, save_work_handler);
+
+int settings_store_init(struct robot_settings *settings,
+                        settings_store_armed_t armed)
+{
+    uint8_t buf[ROBOT_SETTINGS_MAX_SIZE];
+    struct flash_pages_info info;
+    int rc;
+
+    fs.flash_device = FIXED_PARTITION_DEVICE(storage_partition);
+    if (!device_is_ready(fs.flash_device))
+        return -ENODEV;
+
+    fs.offset = FIXED_PARTITION_OFFSET(storage_partition);
+    rc = flash_get_page_info_by_offs(fs.flash_device, fs.offset, &info);
+    if (rc)
+        return rc;
+
+    fs.sector_size = info.size;
+    fs.sector_count = FIXED_PARTITION_SIZE(storage_partition) / info.size;
+
+    rc = nvs_mount(&fs);
+    if (rc)
+        return rc;
+
+    armed_fn = armed;
+
+    /* Newer firmware may have saved more settings than fit, but the ones
+     * this firmware knows come first. */
+    rc = nvs_read(&fs, SETTINGS_ID, buf, sizeof(buf));
+    if (rc == -ENOENT)
+        return 0;
+    if (rc < 0)
+        return rc;
+
+    rc = robot_settings_decode(buf, MIN((size_t)rc, sizeof(buf)), settings);
+    if (rc < 0)
+        return -EINVAL;
+
+    printk("Settings: %d of %d loaded\n", rc, ROBOT_SETTINGS_COUNT);
+
+    return 0;
+}
+
+int settings_store_save(const struct robot_settings *settings)
+{
+    k_spinlock_key_t key;
+
+    if (!robot_settings_check(settings))
+        return -EINVAL;
+
+    if (!armed_fn)
+        return -ENODEV;
+
+    key = k_spin_lock(&lock);
+    pending = *settings;
+    dirty = true;
+    k_spin_unlock(&lock, key);
+
+    /* Start the wait again, so a run of changes is one write. */
+    k_work_reschedule(&save_work,
+                      K_MSEC(CONFIG_COMBAT_SETTINGS_SAVE_DELAY_MS));
+
+    return 0;
+}
+
+static void save_work_handler(struct k_work *work)
+{
+    uint8_t buf[ROBOT_SETTINGS_MAX_SIZE];
+    k_spinlock_key_t key;
+    size_t len;
+    int rc;
+
+    /* Erasing the internal flash stalls the CPU for tens of ms, which the
+     * radio and the IMU loop can't take while the robot's live. */
+    if (armed_fn()) {
+        k_work_reschedule(&save_work,
+                          K_MSEC(CONFIG_COMBAT_SETTINGS_SAVE_DELAY_MS));
+        return;
+    }
+
+    key = k_spin_lock(&lock);
+    if (!dirty) {
+        k_spin_unlock(&lock, key);
+        return;
+    }
+    len = robot_settings_encode(&pending, buf);
+    dirty = false;
+    k_spin_unlock(&lock, key);
+
+    /* NVS skips the write if nothing's changed. */
+    rc = nvs_write(&fs, SETTINGS_ID, buf, len);
+    if (rc < 0)
+        printk("Settings save failed: %d\n", rc);
+}
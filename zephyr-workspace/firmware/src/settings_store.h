@@ -0,0 +1,52 @@
+#ifndef SETTINGS_STORE_H
+#define SETTINGS_STORE_H
+
+#include <errno.h>
+#include <stdbool.h>
+
+#include "robot_settings.h"
+
+/**
+ * @brief Says whether the robot's armed, so nothing's written to the flash
+ * while it is.
+ */
+typedef bool (*settings_store_armed_t)(void);
+
+#ifdef CONFIG_COMBAT_SETTINGS
+
+/**
+ * @brief Mount the settings partition and load what's saved.
+ *
+ * @param settings The defaults on the way in, and the saved settings on the
+ * way out. If nothing can be read they're left as the defaults.
+ */
+extern int settings_store_init(struct robot_settings *settings,
+                               settings_store_armed_t armed);
+
+/**
+ * @brief Save settings, some time later.
+ *
+ * Saves close together are written once, and not until the robot's
+ * disarmed, so this is safe to call from anywhere and never touches the
+ * flash itself.
+ *
+ * @return -EINVAL if any setting is out of range.
+ */
+extern int settings_store_save(const struct robot_settings *settings);
+
+#else
+
+static inline int settings_store_init(struct robot_settings *settings,
+                                      settings_store_armed_t armed)
+{
+    return 0;
+}
+
+static inline int settings_store_save(const struct robot_settings *settings)
+{
+    return -ENOTSUP;
+}
+
+#endif /* CONFIG_COMBAT_SETTINGS */
+
+#endif /* SETTINGS_STORE_H */
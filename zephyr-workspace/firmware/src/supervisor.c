@@ -0,0 +1,223 @@
+#include "supervisor.h"
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/watchdog.h>
+#include <zephyr/kernel.h>
+
+#ifdef CONFIG_SHELL
+#include <zephyr/shell/shell.h>
+#endif
+
+#include "blackbox.h"
+#include "main.h"
+#include "usb_telemetry.h"
+
+static const struct device *const wdt = DEVICE_DT_GET(DT_ALIAS(watchdog0));
+
+const char *const supervisor_task_names[SUPERVISOR_TASK_COUNT] = {
+    [SUPERVISOR_TASK_RC] = "rc",
+    [SUPERVISOR_TASK_IMU] = "imu",
+    [SUPERVISOR_TASK_BLACKBOX] = "blackbox",
+    [SUPERVISOR_TASK_TELEMETRY] = "telemetry",
+};
+
+static struct k_spinlock lock;
+static struct task_monitor tasks[SUPERVISOR_TASK_COUNT];
+
+static int wdt_channel = -1;
+
+static K_THREAD_STACK_DEFINE(thread_stack,
+                             CONFIG_COMBAT_SUPERVISOR_STACK_SIZE);
+static struct k_thread thread;
+
+void supervisor_register(enum supervisor_task task, uint32_t deadline_ms,
+                         uint32_t period_ms)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    task_monitor_register(&tasks[task], k_ms_to_cyc_ceil32(deadline_ms),
+                          k_ms_to_cyc_ceil32(period_ms), k_cycle_get_32());
+    k_spin_unlock(&lock, key);
+}
+
+void supervisor_start(enum supervisor_task task)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    task_monitor_start(&tasks[task], k_cycle_get_32());
+    k_spin_unlock(&lock, key);
+}
+
+void supervisor_done(enum supervisor_task task)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    task_monitor_done(&tasks[task], k_cycle_get_32());
+    k_spin_unlock(&lock, key);
+}
+
+void supervisor_pause(enum supervisor_task task)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    task_monitor_pause(&tasks[task]);
+    k_spin_unlock(&lock, key);
+}
+
+void supervisor_resume(enum supervisor_task task)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    task_monitor_resume(&tasks[task], k_cycle_get_32());
+    k_spin_unlock(&lock, key);
+}
+
+void supervisor_set_period(enum supervisor_task task, uint32_t period_ms)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    task_monitor_set_period(&tasks[task], k_ms_to_cyc_ceil32(period_ms));
+    k_spin_unlock(&lock, key);
+}
+
+int supervisor_get_stats(enum supervisor_task task,
+                         struct task_monitor_stats *stats)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    bool registered = tasks[task].registered;
+
+    *stats = tasks[task].stats;
+    k_spin_unlock(&lock, key);
+
+    if (!registered)
+        return -ENOENT;
+
+    stats->wcet = k_cyc_to_us_ceil32(stats->wcet);
+    stats->max_gap = k_cyc_to_us_ceil32(stats->max_gap);
+    stats->busy = k_cyc_to_us_floor64(stats->busy);
+
+    return 0;
+}
+
+static void report(void)
+{
+#ifdef CONFIG_COMBAT_USB_TELEMETRY
+    struct task_monitor_stats stats;
+
+    for (int i = 0; i < SUPERVISOR_TASK_COUNT; i++) {
+        if (supervisor_get_stats(i, &stats))
+            continue;
+
+        usb_telemetry_send(USB_TELEMETRY_SOURCE_SUPERVISOR, TELEMETRY_TASK,
+                           (const int32_t[]){i, stats.runs, stats.misses,
+                                             stats.wcet, stats.max_gap});
+    }
+#endif
+}
+
+/**
+ * @brief Feed the watchdog while every task keeps to its deadlines.
+ *
+ * This runs at the lowest priority, so a thread that never lets go of the
+ * CPU stops it feeding too.
+ */
+static void supervisor_thread(void *p1, void *p2, void *p3)
+{
+    uint32_t missed, now;
+    k_spinlock_key_t key;
+
+    while (1) {
+        missed = 0;
+
+        key = k_spin_lock(&lock);
+        now = k_cycle_get_32();
+        for (int i = 0; i < SUPERVISOR_TASK_COUNT; i++) {
+            if (!task_monitor_check(&tasks[i], now))
+                missed |= BIT(i);
+        }
+        k_spin_unlock(&lock, key);
+
+        if (!missed) {
+            if (wdt_channel >= 0)
+                wdt_feed(wdt, wdt_channel);
+        } else {
+            blackbox_fault(BLACKBOX_FAULT_DEADLINE);
+            led_set_overlay(LED_OVERLAY_FAULT, true);
+            for (int i = 0; i < SUPERVISOR_TASK_COUNT; i++) {
+                if (missed & BIT(i))
+                    printk("Supervisor: %s missed its deadline\n",
+                           supervisor_task_names[i]);
+            }
+        }
+
+        report();
+
+        k_sleep(K_MSEC(CONFIG_COMBAT_SUPERVISOR_INTERVAL_MS));
+    }
+}
+
+static int init_watchdog(void)
+{
+    struct wdt_timeout_cfg config = {
+        /* Reset SoC when watchdog timer expires. */
+        .flags = WDT_FLAG_RESET_SOC,
+        .window.min = 0,
+        .window.max = CONFIG_COMBAT_SUPERVISOR_WATCHDOG_MS,
+    };
+    int rc;
+
+    if (!device_is_ready(wdt))
+        return -ENODEV;
+
+    rc = wdt_install_timeout(wdt, &config);
+    if (rc < 0)
+        return rc;
+
+    wdt_channel = rc;
+
+    return wdt_setup(wdt, WDT_OPT_PAUSE_HALTED_BY_DBG);
+}
+
+int supervisor_init(void)
+{
+    k_tid_t tid;
+    int rc;
+
+    rc = init_watchdog();
+
+    tid = k_thread_create(&thread, thread_stack,
+                          K_THREAD_STACK_SIZEOF(thread_stack),
+                          supervisor_thread, NULL, NULL, NULL,
+                          K_PRIO_PREEMPT(CONFIG_COMBAT_SUPERVISOR_PRIORITY), 0,
+                          K_NO_WAIT);
+    k_thread_name_set(tid, "supervisor");
+
+    return rc;
+}
+
+#ifdef CONFIG_SHELL
+static int cmd_tasks(const struct shell *sh, size_t argc, char **argv)
+{
+    struct task_monitor_stats stats;
+    uint32_t deadline;
+
+    shell_print(sh, "%-10s %10s %8s %10s %11s %10s", "task", "runs", "misses",
+                "wcet_us", "deadline_us", "max_gap_us");
+
+    for (int i = 0; i < SUPERVISOR_TASK_COUNT; i++) {
+        if (supervisor_get_stats(i, &stats))
+            continue;
+
+        deadline = k_cyc_to_us_ceil32(tasks[i].deadline);
+        shell_print(sh, "%-10s %10u %8u %10u %11u %10u",
+                    supervisor_task_names[i], stats.runs, stats.misses,
+                    stats.wcet, deadline, stats.max_gap);
+    }
+
+    return 0;
+}
+
+SHELL_CMD_REGISTER(tasks, NULL,
+                   "Supervised tasks: deadline misses and worst case times",
+                   cmd_tasks);
+#endif
@@ -0,0 +1,75 @@
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+
+#include <stdint.h>
+
+#include "task_monitor.h"
+
+/**
+ * @brief The tasks that have to keep running for the watchdog to be fed.
+ * Each one only starts being watched once it registers.
+ */
+enum supervisor_task
+{
+    /* The radio callback, from the RC frame to the outputs. */
+    SUPERVISOR_TASK_RC,
+    /* The IMU loop, and the yaw loop it runs. */
+    SUPERVISOR_TASK_IMU,
+    /* The black box recorder thread. */
+    SUPERVISOR_TASK_BLACKBOX,
+    /* Telemetry to the radio, which runs on the system workqueue. */
+    SUPERVISOR_TASK_TELEMETRY,
+
+    SUPERVISOR_TASK_COUNT,
+};
+
+extern const char *const supervisor_task_names[SUPERVISOR_TASK_COUNT];
+
+/**
+ * @brief Set up the watchdog and start the thread that feeds it.
+ */
+extern int supervisor_init(void);
+
+/**
+ * @brief Start watching a task.
+ *
+ * @param deadline_ms Longest a run can take.
+ * @param period_ms Longest between runs, or 0 if it only runs when there's
+ * something to do.
+ */
+extern void supervisor_register(enum supervisor_task task,
+                                uint32_t deadline_ms, uint32_t period_ms);
+
+/**
+ * @brief A run of the task is starting, from the task itself.
+ */
+extern void supervisor_start(enum supervisor_task task);
+
+/**
+ * @brief The run's finished.
+ */
+extern void supervisor_done(enum supervisor_task task);
+
+/**
+ * @brief The task's been powered down on purpose, so stop expecting it to
+ * run every period until it's resumed.
+ */
+extern void supervisor_pause(enum supervisor_task task);
+
+extern void supervisor_resume(enum supervisor_task task);
+
+/**
+ * @brief For a task whose rate changes while it's running.
+ */
+extern void supervisor_set_period(enum supervisor_task task,
+                                  uint32_t period_ms);
+
+/**
+ * @brief A task's counters, with the times in microseconds.
+ *
+ * @return 0, or -ENOENT if the task's never registered.
+ */
+extern int supervisor_get_stats(enum supervisor_task task,
+                                struct task_monitor_stats *stats);
+
+#endif /* SUPERVISOR_H */
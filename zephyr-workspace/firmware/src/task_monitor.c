@@ -0,0 +1,101 @@
+#include "task_monitor.h"
+
+#include <string.h>
+
+void task_monitor_register(struct task_monitor *task, uint32_t deadline,
+                           uint32_t period, uint32_t now)
+{
+    memset(task, 0, sizeof(*task));
+    task->deadline = deadline;
+    task->period = period;
+    task->start = now;
+    task->registered = true;
+}
+
+/**
+ * @brief Counted once per start, so a run that's overdue and the long gap
+ * it leaves are one miss.
+ */
+static void miss(struct task_monitor *task)
+{
+    if (!task->late)
+        task->stats.misses++;
+    task->late = true;
+    task->missed = true;
+}
+
+void task_monitor_start(struct task_monitor *task, uint32_t now)
+{
+    uint32_t gap = now - task->start;
+
+    if (!task->registered)
+        return;
+
+    if (task->period && !task->paused) {
+        if (task->stats.runs && gap > task->stats.max_gap)
+            task->stats.max_gap = gap;
+        if (gap > task->period)
+            miss(task);
+    }
+
+    task->start = now;
+    task->running = true;
+    task->late = false;
+    task->stats.runs++;
+}
+
+void task_monitor_done(struct task_monitor *task, uint32_t now)
+{
+    uint32_t took = now - task->start;
+
+    if (!task->registered || !task->running)
+        return;
+
+    task->stats.busy += took;
+    if (took > task->stats.wcet)
+        task->stats.wcet = took;
+    if (took > task->deadline)
+        miss(task);
+
+    task->running = false;
+}
+
+void task_monitor_pause(struct task_monitor *task)
+{
+    task->paused = true;
+}
+
+void task_monitor_resume(struct task_monitor *task, uint32_t now)
+{
+    if (!task->paused)
+        return;
+
+    task->paused = false;
+    if (!task->running)
+        task->start = now;
+}
+
+void task_monitor_set_period(struct task_monitor *task, uint32_t period)
+{
+    task->period = period;
+}
+
+bool task_monitor_check(struct task_monitor *task, uint32_t now)
+{
+    uint32_t since = now - task->start;
+    bool ok;
+
+    if (!task->registered)
+        return true;
+
+    /* Stuck part way through a run, or not run when it should have. */
+    if (task->running ? since > task->deadline
+                      : task->period && !task->paused &&
+                            since > task->period)
+        miss(task);
+
+    ok = !task->missed;
+    task->missed = false;
+
+    return ok;
+}
@@ -0,0 +1,90 @@
+#ifndef TASK_MONITOR_H
+#define TASK_MONITOR_H
+
+/*
+ * Deadline tracking for the supervisor. Each task marks the start and end
+ * of every run. A run has to finish within the task's deadline, and a
+ * periodic task has to start again within its period. The supervisor
+ * checks every task now and then, and only feeds the watchdog if none has
+ * missed a deadline since the last check or is overdue right now.
+ *
+ * Times are on whatever wrapping uint32_t clock the caller uses, like
+ * k_cycle_get_32(), as long as deadlines and periods fit in 31 bits. Not
+ * thread safe.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct task_monitor_stats
+{
+    uint32_t runs;
+    /* Runs that went over the deadline, and gaps over the period. */
+    uint32_t misses;
+    /* Worst case execution time, the longest a run has taken. */
+    uint32_t wcet;
+    /* Longest from one start to the next, for periodic tasks. */
+    uint32_t max_gap;
+    /* Time spent running, over every run, for the average. */
+    uint64_t busy;
+};
+
+struct task_monitor
+{
+    bool registered;
+    /* Longest a run can take. */
+    uint32_t deadline;
+    /* Longest between starts, or 0 if it only runs when there's something
+     * to do. */
+    uint32_t period;
+
+    /* Powered down on purpose, so the period doesn't count. */
+    bool paused;
+
+    bool running;
+    uint32_t start;
+    /* A miss has already been counted since the last start. */
+    bool late;
+    /* Missed since the last check. */
+    bool missed;
+
+    struct task_monitor_stats stats;
+};
+
+/**
+ * @brief Start watching a task. A periodic task's first period starts
+ * now.
+ */
+extern void task_monitor_register(struct task_monitor *task,
+                                  uint32_t deadline, uint32_t period,
+                                  uint32_t now);
+
+extern void task_monitor_start(struct task_monitor *task, uint32_t now);
+
+extern void task_monitor_done(struct task_monitor *task, uint32_t now);
+
+/**
+ * @brief Stop expecting a periodic task to run, until it's resumed. Runs
+ * still have to meet the deadline.
+ */
+extern void task_monitor_pause(struct task_monitor *task);
+
+/**
+ * @brief Expect it again, with its next period starting now.
+ */
+extern void task_monitor_resume(struct task_monitor *task, uint32_t now);
+
+/**
+ * @brief Change how long it can go between starts, from the next check.
+ * The period it's in already isn't moved on.
+ */
+extern void task_monitor_set_period(struct task_monitor *task,
+                                    uint32_t period);
+
+/**
+ * @brief Whether the task has met every deadline since the last check, and
+ * isn't late now. Tasks that aren't registered always have.
+ */
+extern bool task_monitor_check(struct task_monitor *task, uint32_t now);
+
+#endif /* TASK_MONITOR_H */
@@ -0,0 +1,189 @@
+#include "telemetry_frame.h"
+
+#include <string.h>
+
+/* Type, sequence and time. */
+#define PACKET_HEADER 6
+
+const struct telemetry_type_info telemetry_types[TELEMETRY_TYPE_COUNT] = {
+    [TELEMETRY_INFO] = {"info", 2, "cycles_per_sec,dropped"},
+    [TELEMETRY_CHANNELS] = {"channels", 16,
+                            "ch0,ch1,ch2,ch3,ch4,ch5,ch6,ch7,"
+                            "ch8,ch9,ch10,ch11,ch12,ch13,ch14,ch15"},
+    /* Duty is negative when the wheel's direction output is low. */
+    [TELEMETRY_DRIVE] = {"drive", 6, "fl,rl,fr,rr,weapon,armed"},
+    [TELEMETRY_IMU] = {"imu", 9,
+                       "gx_mdps,gy_mdps,gz_mdps,ax_mg,ay_mg,az_mg,"
+                       "roll_cdeg,pitch_cdeg,inverted"},
+    [TELEMETRY_LINK] = {"link", 2, "gap_us,latency_us"},
+    [TELEMETRY_YAW] = {"yaw", 7, "setpoint,measured,p,i,d,ff,output"},
+    [TELEMETRY_WEAPON] = {"weapon", 5,
+                          "throttle,rpm,esc_temp_c,esc_10mv,esc_10ma"},
+    [TELEMETRY_TASK] = {"task", 5, "task,runs,misses,wcet_us,max_gap_us"},
+    /* The drive's gain for the pack, in percent. */
+    [TELEMETRY_BATTERY] = {"battery", 3, "mv,ma,drive_pct"},
+};
+
+size_t telemetry_cobs_encode(const uint8_t *in, size_t len, uint8_t *out)
+{
+    size_t code_pos = 0, pos = 1;
+    uint8_t code = 1;
+
+    for (size_t i = 0; i < len; i++) {
+        if (in[i]) {
+            out[pos++] = in[i];
+            code++;
+        }
+
+        /* Each code octet says how far it is to the next zero, up to a
+         * block of 254. */
+        if (!in[i] || code == 0xff) {
+            out[code_pos] = code;
+            code_pos = pos++;
+            code = 1;
+        }
+    }
+    out[code_pos] = code;
+
+    return pos;
+}
+
+int telemetry_cobs_decode(const uint8_t *in, size_t len, uint8_t *out)
+{
+    size_t pos = 0, i = 0;
+
+    while (i < len) {
+        uint8_t code = in[i++];
+
+        if (code == 0 || i + code - 1 > len)
+            return -1;
+
+        for (int k = 1; k < code; k++) {
+            if (in[i] == 0)
+                return -1;
+            out[pos++] = in[i++];
+        }
+
+        /* A full block doesn't end in a zero, and nor does the packet. */
+        if (code != 0xff && i < len)
+            out[pos++] = 0;
+    }
+
+    return pos;
+}
+
+size_t telemetry_frame_encode(const struct telemetry_packet *pkt,
+                              uint8_t *out)
+{
+    uint8_t buf[TELEMETRY_MAX_PACKET];
+    uint8_t *p = buf;
+    size_t len;
+
+    *p++ = pkt->type;
+    *p++ = pkt->seq;
+    for (int b = 0; b < 32; b += 8) *p++ = pkt->cycles >> b;
+
+    for (int i = 0; i < telemetry_types[pkt->type].fields; i++) {
+        for (int b = 0; b < 32; b += 8) *p++ = (uint32_t)pkt->v[i] >> b;
+    }
+
+    len = telemetry_cobs_encode(buf, p - buf, out);
+    out[len++] = 0;
+
+    return len;
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+bool telemetry_frame_decode(const uint8_t *frame, size_t len,
+                            struct telemetry_packet *pkt)
+{
+    uint8_t buf[TELEMETRY_MAX_FRAME];
+    int n;
+
+    if (len > TELEMETRY_MAX_FRAME - 1)
+        return false;
+
+    n = telemetry_cobs_decode(frame, len, buf);
+    if (n < PACKET_HEADER || buf[0] >= TELEMETRY_TYPE_COUNT ||
+        n != PACKET_HEADER + 4 * telemetry_types[buf[0]].fields)
+        return false;
+
+    pkt->type = buf[0];
+    pkt->seq = buf[1];
+    pkt->cycles = get_le32(&buf[2]);
+    for (int i = 0; i < telemetry_types[pkt->type].fields; i++)
+        pkt->v[i] = (int32_t)get_le32(&buf[PACKET_HEADER + 4 * i]);
+
+    return true;
+}
+
+void telemetry_ring_init(struct telemetry_ring *ring, uint8_t *buf,
+                         uint32_t size)
+{
+    ring->buf = buf;
+    ring->mask = size - 1;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->dropped, 0);
+    memset(ring->seq, 0, sizeof(ring->seq));
+}
+
+bool telemetry_ring_put(struct telemetry_ring *ring, enum telemetry_type type,
+                        uint32_t cycles, const int32_t *v)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    uint8_t frame[TELEMETRY_MAX_FRAME];
+    struct telemetry_packet pkt;
+    uint32_t offset = head & ring->mask;
+    size_t len, first;
+
+    pkt.type = type;
+    /* Counted even if it's dropped, so the host sees the gap. */
+    pkt.seq = ring->seq[type]++;
+    pkt.cycles = cycles;
+    memcpy(pkt.v, v, telemetry_types[type].fields * sizeof(pkt.v[0]));
+
+    len = telemetry_frame_encode(&pkt, frame);
+    if (ring->mask + 1 - (head - tail) < len) {
+        /* Only the producer writes this, so it doesn't need to be an
+         * atomic add. */
+        atomic_store_explicit(
+            &ring->dropped,
+            atomic_load_explicit(&ring->dropped, memory_order_relaxed) + 1,
+            memory_order_relaxed);
+        return false;
+    }
+
+    first = ring->mask + 1 - offset;
+    first = len < first ? len : first;
+    memcpy(&ring->buf[offset], frame, first);
+    memcpy(ring->buf, &frame[first], len - first);
+
+    atomic_store_explicit(&ring->head, head + len, memory_order_release);
+
+    return true;
+}
+
+size_t telemetry_ring_peek(struct telemetry_ring *ring, const uint8_t **data)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint32_t offset = tail & ring->mask;
+    uint32_t contiguous = ring->mask + 1 - offset;
+
+    *data = &ring->buf[offset];
+
+    return head - tail < contiguous ? head - tail : contiguous;
+}
+
+void telemetry_ring_consume(struct telemetry_ring *ring, size_t len)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    atomic_store_explicit(&ring->tail, tail + len, memory_order_release);
+}
@@ -0,0 +1,155 @@
+#ifndef TELEMETRY_FRAME_H
+#define TELEMETRY_FRAME_H
+
+/*
+ * Binary telemetry frames for the USB stream, and the rings they wait in.
+ *
+ * A packet is a type, a sequence number, a k_cycle_get_32() timestamp and
+ * the type's fields, each 32 bits little endian. Packets are COBS encoded
+ * and end in a zero, so the host can start reading anywhere and be in step
+ * from the next zero.
+ *
+ * tools/telemetry_decode builds this file as well, so the robot and the
+ * decoder can't disagree about the format.
+ */
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TELEMETRY_MAX_FIELDS 16
+
+/* Type, sequence, time and the fields. */
+#define TELEMETRY_MAX_PACKET (1 + 1 + 4 + 4 * TELEMETRY_MAX_FIELDS)
+
+/* COBS adds an octet at the start and one every 254, then the zero. */
+#define TELEMETRY_MAX_FRAME (TELEMETRY_MAX_PACKET + 2 + 1)
+
+enum telemetry_type
+{
+    /* Once a second: the cycle counter's rate, and packets dropped so
+     * far. */
+    TELEMETRY_INFO,
+    TELEMETRY_CHANNELS,
+    TELEMETRY_DRIVE,
+    TELEMETRY_IMU,
+    TELEMETRY_LINK,
+    TELEMETRY_YAW,
+    TELEMETRY_WEAPON,
+    /* One for each supervised task, a few times a second. */
+    TELEMETRY_TASK,
+    /* With each RC frame. */
+    TELEMETRY_BATTERY,
+
+    TELEMETRY_TYPE_COUNT,
+};
+
+struct telemetry_type_info
+{
+    const char *name;
+    uint8_t fields;
+    /* Comma separated, for a CSV header. */
+    const char *columns;
+};
+
+extern const struct telemetry_type_info telemetry_types[TELEMETRY_TYPE_COUNT];
+
+struct telemetry_packet
+{
+    uint8_t type;
+    /* Counts up for each packet of a type, so gaps show up. */
+    uint8_t seq;
+    uint32_t cycles;
+    int32_t v[TELEMETRY_MAX_FIELDS];
+};
+
+/**
+ * @brief Whole frames waiting to go out.
+ *
+ * A single producer and a single consumer, and no locks, like the black
+ * box rings. The producer only moves head once a whole frame is in, so the
+ * consumer never sees half of one, and a frame that won't fit is dropped
+ * rather than making the producer wait.
+ */
+struct telemetry_ring
+{
+    uint8_t *buf;
+    uint32_t mask;
+
+    atomic_uint head;
+    atomic_uint tail;
+    atomic_uint dropped;
+
+    /* Only touched by the producer. */
+    uint8_t seq[TELEMETRY_TYPE_COUNT];
+};
+
+/**
+ * @brief COBS encode a packet, without the zero on the end.
+ *
+ * @param out Room for len + len / 254 + 1 octets.
+ * @return The length of the encoded packet.
+ */
+extern size_t telemetry_cobs_encode(const uint8_t *in, size_t len,
+                                    uint8_t *out);
+
+/**
+ * @brief Undo telemetry_cobs_encode().
+ *
+ * @param out Room for len octets.
+ * @return The length of the packet, or -1 if it isn't valid COBS.
+ */
+extern int telemetry_cobs_decode(const uint8_t *in, size_t len,
+                                 uint8_t *out);
+
+/**
+ * @brief Build and COBS encode a packet, zero and all.
+ *
+ * @param out Room for TELEMETRY_MAX_FRAME octets.
+ * @return The length of the frame.
+ */
+extern size_t telemetry_frame_encode(const struct telemetry_packet *pkt,
+                                     uint8_t *out);
+
+/**
+ * @brief Decode a frame, without its zero.
+ *
+ * @return False if it isn't a valid packet.
+ */
+extern bool telemetry_frame_decode(const uint8_t *frame, size_t len,
+                                   struct telemetry_packet *pkt);
+
+/**
+ * @brief Set up an empty ring.
+ *
+ * @param size Octets in buf, a power of two.
+ */
+extern void telemetry_ring_init(struct telemetry_ring *ring, uint8_t *buf,
+                                uint32_t size);
+
+/**
+ * @brief Queue a packet, from the producer.
+ *
+ * @param v As many fields as telemetry_types[] says for the type.
+ * @return False if there wasn't room and it was dropped.
+ */
+extern bool telemetry_ring_put(struct telemetry_ring *ring,
+                               enum telemetry_type type, uint32_t cycles,
+                               const int32_t *v);
+
+/**
+ * @brief The frames waiting, from the consumer, as far as the end of the
+ * buffer.
+ *
+ * @return The number of octets at *data.
+ */
+extern size_t telemetry_ring_peek(struct telemetry_ring *ring,
+                                  const uint8_t **data);
+
+/**
+ * @brief Done with some of what telemetry_ring_peek() gave.
+ */
+extern void telemetry_ring_consume(struct telemetry_ring *ring, size_t len);
+
+#endif /* TELEMETRY_FRAME_H */
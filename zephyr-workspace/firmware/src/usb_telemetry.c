@@ -0,0 +1,145 @@
+#include "usb_telemetry.h"
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/uart.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+
+BUILD_ASSERT(IS_POWER_OF_TWO(CONFIG_COMBAT_USB_TELEMETRY_RING_SIZE),
+             "The USB telemetry ring size has to be a power of two");
+
+#define RING_SIZE CONFIG_COMBAT_USB_TELEMETRY_RING_SIZE
+
+/* The stream thread's own packets go in a ring after the sources'. */
+#define INFO_RING USB_TELEMETRY_SOURCE_COUNT
+#define NUM_RINGS (USB_TELEMETRY_SOURCE_COUNT + 1)
+
+static const struct device *const uart =
+    DEVICE_DT_GET(DT_NODELABEL(cdc_acm_uart1));
+
+static uint8_t rc_buf[RING_SIZE];
+static uint8_t imu_buf[RING_SIZE];
+static uint8_t supervisor_buf[256];
+static uint8_t info_buf[64];
+
+/* Set up statically, so packets can be sent before the thread's
+ * started. */
+static struct telemetry_ring rings[NUM_RINGS] = {
+    [USB_TELEMETRY_SOURCE_RC] = {.buf = rc_buf, .mask = RING_SIZE - 1},
+    [USB_TELEMETRY_SOURCE_IMU] = {.buf = imu_buf, .mask = RING_SIZE - 1},
+    [USB_TELEMETRY_SOURCE_SUPERVISOR] = {.buf = supervisor_buf,
+                                         .mask = sizeof(supervisor_buf) - 1},
+    [INFO_RING] = {.buf = info_buf, .mask = sizeof(info_buf) - 1},
+};
+
+/* The ring being sent from. */
+static int current;
+
+/* Whether the host has the port open. */
+static atomic_t port_open;
+
+static K_THREAD_STACK_DEFINE(thread_stack,
+                             CONFIG_COMBAT_USB_TELEMETRY_STACK_SIZE);
+static struct k_thread thread;
+
+void usb_telemetry_send(enum usb_telemetry_source source,
+                        enum telemetry_type type, const int32_t *v)
+{
+    if (!atomic_get(&port_open))
+        return;
+
+    telemetry_ring_put(&rings[source], type, k_cycle_get_32(), v);
+}
+
+/**
+ * @brief Hand as much as the USB stack will take.
+ *
+ * Each ring only holds whole frames, so a ring is sent until it's empty
+ * before moving on, and frames from different rings never get mixed up.
+ */
+static void send(void)
+{
+    for (int empty = 0; empty < NUM_RINGS;) {
+        const uint8_t *data;
+        size_t len;
+        int sent;
+
+        len = telemetry_ring_peek(&rings[current], &data);
+        if (!len) {
+            current = (current + 1) % NUM_RINGS;
+            empty++;
+            continue;
+        }
+
+        /* Carry on from here next time if the USB buffer's full. */
+        sent = uart_fifo_fill(uart, data, len);
+        if (sent <= 0)
+            return;
+
+        telemetry_ring_consume(&rings[current], sent);
+        empty = 0;
+    }
+}
+
+static void discard(void)
+{
+    for (int i = 0; i < NUM_RINGS; i++) {
+        const uint8_t *data;
+        size_t len;
+
+        while ((len = telemetry_ring_peek(&rings[i], &data)))
+            telemetry_ring_consume(&rings[i], len);
+    }
+}
+
+static void stream_thread(void *p1, void *p2, void *p3)
+{
+    uint32_t last_info = k_uptime_get_32();
+
+    while (1) {
+        uint32_t dtr = 0;
+
+        uart_line_ctrl_get(uart, UART_LINE_CTRL_DTR, &dtr);
+        atomic_set(&port_open, dtr);
+
+        if (!dtr) {
+            /* Start afresh when the host comes back. */
+            discard();
+            current = 0;
+            k_sleep(K_MSEC(100));
+            continue;
+        }
+
+        if (k_uptime_get_32() - last_info >= 1000) {
+            int32_t v[2] = {sys_clock_hw_cycles_per_sec(), 0};
+
+            for (int i = 0; i < USB_TELEMETRY_SOURCE_COUNT; i++)
+                v[1] += rings[i].dropped;
+
+            telemetry_ring_put(&rings[INFO_RING], TELEMETRY_INFO,
+                               k_cycle_get_32(), v);
+            last_info = k_uptime_get_32();
+        }
+
+        send();
+
+        k_sleep(K_MSEC(CONFIG_COMBAT_USB_TELEMETRY_POLL_MS));
+    }
+}
+
+int usb_telemetry_init(void)
+{
+    k_tid_t tid;
+
+    if (!device_is_ready(uart))
+        return -ENODEV;
+
+    tid = k_thread_create(&thread, thread_stack,
+                          K_THREAD_STACK_SIZEOF(thread_stack), stream_thread,
+                          NULL, NULL, NULL,
+                          K_PRIO_PREEMPT(CONFIG_COMBAT_USB_TELEMETRY_PRIORITY),
+                          0, K_NO_WAIT);
+    k_thread_name_set(tid, "usb_telemetry");
+
+    return 0;
+}
@@ -0,0 +1,55 @@
+#ifndef USB_TELEMETRY_H
+#define USB_TELEMETRY_H
+
+#include <stdint.h>
+
+#include "telemetry_frame.h"
+
+/**
+ * @brief Where packets come from. Each source has its own ring with a
+ * single producer, so a source must only ever be sent from one thread.
+ */
+enum usb_telemetry_source
+{
+    /* The radio callback. */
+    USB_TELEMETRY_SOURCE_RC,
+    /* The IMU loop, and the yaw loop it runs. */
+    USB_TELEMETRY_SOURCE_IMU,
+    /* The supervisor thread. */
+    USB_TELEMETRY_SOURCE_SUPERVISOR,
+
+    USB_TELEMETRY_SOURCE_COUNT,
+};
+
+#ifdef CONFIG_COMBAT_USB_TELEMETRY
+
+/**
+ * @brief Start streaming to the telemetry CDC ACM port.
+ */
+extern int usb_telemetry_init(void);
+
+/**
+ * @brief Queue a packet. This never blocks or formats any text, and nothing
+ * is queued while the port is closed.
+ *
+ * @param v As many fields as telemetry_types[] says for the type.
+ */
+extern void usb_telemetry_send(enum usb_telemetry_source source,
+                               enum telemetry_type type, const int32_t *v);
+
+#else
+
+static inline int usb_telemetry_init(void)
+{
+    return 0;
+}
+
+static inline void usb_telemetry_send(enum usb_telemetry_source source,
+                                      enum telemetry_type type,
+                                      const int32_t *v)
+{
+}
+
+#endif /* CONFIG_COMBAT_USB_TELEMETRY */
+
+#endif /* USB_TELEMETRY_H */
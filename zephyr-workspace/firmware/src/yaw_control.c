@@ -0,0 +1,143 @@
+#include "yaw_control.h"
+
+#include <string.h>
+#include <zephyr/kernel.h>
+
+#include "usb_telemetry.h"
+
+BUILD_ASSERT(IMU_RATE_HZ >= 500, "Yaw control needs to run at 500 Hz or more");
+
+/* If there's been no tick for this long, the gyro has stopped. */
+#define STALE_MS 10
+
+static yaw_control_drive_t drive_fn;
+static struct yaw_pid pid;
+
+/* Shared with the RC and tuning paths. */
+static struct k_spinlock lock;
+static int32_t sticks[MIXER_NUM_INPUTS];
+static bool active;
+static struct yaw_gains gains;
+static bool gains_changed;
+
+static struct yaw_control_stats stats;
+/* In ms since boot, as the 32-bit cycle counter wraps within a minute. */
+static int64_t last_tick;
+static bool ticked;
+
+void yaw_control_tick(const struct imu_sample *sample, int32_t yaw_mdps)
+{
+    int32_t in[MIXER_NUM_INPUTS];
+    struct yaw_terms terms;
+    k_spinlock_key_t key;
+    uint32_t cycles;
+    bool run;
+
+    key = k_spin_lock(&lock);
+    if (gains_changed) {
+        yaw_pid_set_gains(&pid, &gains);
+        gains_changed = false;
+    }
+    memcpy(in, sticks, sizeof(in));
+    run = active;
+    last_tick = k_uptime_get();
+    ticked = true;
+    k_spin_unlock(&lock, key);
+
+    /* With the sticks centred the robot sits still with the motors off,
+     * the same as without the loop. */
+    if (!run || (in[0] == 0 && in[1] == 0)) {
+        yaw_pid_reset(&pid, yaw_mdps);
+        if (run)
+            drive_fn(in);
+        return;
+    }
+
+    in[1] = yaw_pid_run(&pid, in[1], yaw_mdps, &terms);
+    drive_fn(in);
+
+    usb_telemetry_send(USB_TELEMETRY_SOURCE_IMU, TELEMETRY_YAW,
+                       (const int32_t[]){terms.setpoint, terms.measured,
+                                         terms.p, terms.i, terms.d, terms.ff,
+                                         terms.output});
+
+    cycles = k_cycle_get_32() - sample->start;
+    stats.terms = terms;
+    stats.max_cycles = MAX(stats.max_cycles, cycles);
+    if (k_cyc_to_us_ceil32(cycles) > CONFIG_COMBAT_YAW_BUDGET_US)
+        stats.overruns++;
+}
+
+bool yaw_control_set_sticks(const int32_t *in)
+{
+    k_spinlock_key_t key;
+    bool running;
+
+    key = k_spin_lock(&lock);
+    memcpy(sticks, in, sizeof(sticks));
+    active = true;
+    if (ticked && k_uptime_get() - last_tick >= STALE_MS)
+        ticked = false;
+    running = ticked;
+    k_spin_unlock(&lock, key);
+
+    return running;
+}
+
+void yaw_control_stop(void)
+{
+    k_spinlock_key_t key;
+
+    key = k_spin_lock(&lock);
+    active = false;
+    k_spin_unlock(&lock, key);
+}
+
+void yaw_control_set_gains(const struct yaw_gains *new_gains)
+{
+    k_spinlock_key_t key;
+
+    key = k_spin_lock(&lock);
+    gains = *new_gains;
+    gains_changed = true;
+    k_spin_unlock(&lock, key);
+}
+
+void yaw_control_get_gains(struct yaw_gains *out)
+{
+    k_spinlock_key_t key;
+
+    key = k_spin_lock(&lock);
+    *out = gains;
+    k_spin_unlock(&lock, key);
+}
+
+void yaw_control_get_stats(struct yaw_control_stats *out)
+{
+    /* The loop runs in the IMU driver's cooperative thread, so it can't be
+     * part way through an update when we get to run. */
+    k_sched_lock();
+    memcpy(out, &stats, sizeof(*out));
+    k_sched_unlock();
+}
+
+int yaw_control_init(yaw_control_drive_t drive)
+{
+    struct yaw_config config;
+
+    yaw_config_default(&config);
+    config.gains.kp = CONFIG_COMBAT_YAW_KP * YAW_Q12_ONE / 1000;
+    config.gains.ki = CONFIG_COMBAT_YAW_KI * YAW_Q12_ONE / 1000;
+    config.gains.kd = CONFIG_COMBAT_YAW_KD * YAW_Q12_ONE / 1000;
+    config.gains.kff = CONFIG_COMBAT_YAW_KFF * YAW_Q12_ONE / 1000;
+    config.rate_hz = IMU_RATE_HZ;
+    config.max_rate_mdps = CONFIG_COMBAT_YAW_MAX_RATE * 1000;
+    config.i_limit = CONFIG_COMBAT_YAW_I_LIMIT * YAW_Q15_ONE / 100;
+    config.d_cutoff_hz = CONFIG_COMBAT_YAW_D_CUTOFF_HZ;
+
+    yaw_pid_init(&pid, &config);
+    gains = config.gains;
+    drive_fn = drive;
+
+    return 0;
+}
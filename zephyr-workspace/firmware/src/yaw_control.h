@@ -0,0 +1,85 @@
+#ifndef YAW_CONTROL_H
+#define YAW_CONTROL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "imu.h"
+#include "mixer.h"
+#include "yaw_pid.h"
+
+/**
+ * @brief Drives the wheels from a pair of stick inputs, as Q15 throttle and
+ * steering.
+ */
+typedef void (*yaw_control_drive_t)(const int32_t *in);
+
+struct yaw_control_stats
+{
+    /* Longest a tick took, from the FIFO watermark to the motors. */
+    uint32_t max_cycles;
+    /* Ticks that went over CONFIG_COMBAT_YAW_BUDGET_US. */
+    uint32_t overruns;
+
+    /* What the controller did on the last tick. */
+    struct yaw_terms terms;
+};
+
+#ifdef CONFIG_COMBAT_YAW_CONTROL
+
+/**
+ * @brief Set up the controller. It runs from the IMU loop.
+ *
+ * @param drive Called from the loop with the stick inputs, with the
+ * steering replaced by the controller's output.
+ */
+extern int yaw_control_init(yaw_control_drive_t drive);
+
+/**
+ * @brief Run one tick, from the IMU loop.
+ *
+ * @param yaw_mdps Yaw rate, positive the way positive steering turns.
+ */
+extern void yaw_control_tick(const struct imu_sample *sample,
+                             int32_t yaw_mdps);
+
+/**
+ * @brief Hand the loop a new frame of stick inputs.
+ *
+ * @return True if the loop will drive the wheels, false if the caller has
+ * to because the gyro isn't running.
+ */
+extern bool yaw_control_set_sticks(const int32_t *in);
+
+/**
+ * @brief Stop driving the wheels until the next set of sticks.
+ */
+extern void yaw_control_stop(void);
+
+/**
+ * @brief Change the gains. They're picked up on the next tick.
+ */
+extern void yaw_control_set_gains(const struct yaw_gains *gains);
+extern void yaw_control_get_gains(struct yaw_gains *gains);
+
+extern void yaw_control_get_stats(struct yaw_control_stats *stats);
+
+#else
+
+static inline int yaw_control_init(yaw_control_drive_t drive)
+{
+    return 0;
+}
+
+static inline bool yaw_control_set_sticks(const int32_t *in)
+{
+    return false;
+}
+
+static inline void yaw_control_stop(void)
+{
+}
+
+#endif /* CONFIG_COMBAT_YAW_CONTROL */
+
+#endif /* YAW_CONTROL_H */
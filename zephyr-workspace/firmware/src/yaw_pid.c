@@ -0,0 +1,109 @@
+#include "yaw_pid.h"
+
+#include <stddef.h>
+
+/* Measured rates are clamped to this, so a spin far past the maximum rate
+ * can't overflow anything. */
+#define MEAS_LIMIT (4 * YAW_Q15_ONE)
+
+static inline int32_t clamp32(int32_t v, int32_t lo, int32_t hi)
+{
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+void yaw_config_default(struct yaw_config *config)
+{
+    *config = (struct yaw_config){
+        .gains =
+            {
+                .kp = 3 * YAW_Q12_ONE,
+                .ki = 12 * YAW_Q12_ONE,
+                .kd = 0,
+                .kff = YAW_Q12_ONE / 2,
+            },
+        .rate_hz = 500,
+        .max_rate_mdps = 720000,
+        .i_limit = YAW_Q15_ONE / 2,
+        .d_cutoff_hz = 80,
+    };
+}
+
+void yaw_pid_set_gains(struct yaw_pid *pid, const struct yaw_gains *gains)
+{
+    pid->kp = gains->kp;
+    pid->ki_tick = ((int64_t)gains->ki << 8) / pid->rate_hz;
+    pid->kd_tick = gains->kd * (int32_t)pid->rate_hz;
+    pid->kff = gains->kff;
+}
+
+void yaw_pid_init(struct yaw_pid *pid, const struct yaw_config *config)
+{
+    /* A first order filter: alpha = w / (w + rate), with w = 2 pi fc. */
+    int64_t w = 6283LL * config->d_cutoff_hz;
+
+    pid->rate_hz = config->rate_hz ? config->rate_hz : 1;
+    pid->meas_scale = ((int64_t)YAW_Q15_ONE << 16) / config->max_rate_mdps;
+    pid->i_limit = clamp32(config->i_limit, 0, YAW_Q15_ONE) << 8;
+    pid->d_alpha = w ? (w << 15) / (w + 1000LL * pid->rate_hz) : YAW_Q15_ONE;
+
+    yaw_pid_set_gains(pid, &config->gains);
+    yaw_pid_reset(pid, 0);
+}
+
+static inline int32_t measured(const struct yaw_pid *pid, int32_t gyro_mdps)
+{
+    return clamp32(((int64_t)gyro_mdps * pid->meas_scale) >> 16, -MEAS_LIMIT,
+                   MEAS_LIMIT);
+}
+
+void yaw_pid_reset(struct yaw_pid *pid, int32_t gyro_mdps)
+{
+    pid->integral = 0;
+    pid->prev_meas = measured(pid, gyro_mdps);
+    pid->d_filtered = 0;
+}
+
+int32_t yaw_pid_run(struct yaw_pid *pid, int32_t setpoint, int32_t gyro_mdps,
+                    struct yaw_terms *terms)
+{
+    int32_t meas = measured(pid, gyro_mdps);
+    int32_t err = clamp32(setpoint, -YAW_Q15_ONE, YAW_Q15_ONE) - meas;
+    int32_t p, d, ff, step, sum, out;
+    int32_t integral = pid->integral;
+
+    ff = ((int64_t)pid->kff * setpoint) >> 12;
+    p = ((int64_t)pid->kp * err) >> 12;
+
+    /* Derivative on the measurement, so a step in the setpoint doesn't
+     * kick the output. */
+    d = ((int64_t)pid->kd_tick * (pid->prev_meas - meas)) >> 12;
+    pid->d_filtered += ((int64_t)(d - pid->d_filtered) * pid->d_alpha) >> 15;
+    pid->prev_meas = meas;
+    d = pid->d_filtered;
+
+    /* Anti-windup: don't integrate further into saturation, and never past
+     * the limit. */
+    step = ((int64_t)pid->ki_tick * err) >> 12;
+    sum = ff + p + (integral >> 8) + d;
+    step = (sum > YAW_Q15_ONE && step > 0) || (sum < -YAW_Q15_ONE && step < 0)
+               ? 0
+               : step;
+    integral = clamp32(integral + step, -pid->i_limit, pid->i_limit);
+    pid->integral = integral;
+
+    out = clamp32(ff + p + (integral >> 8) + d, -YAW_Q15_ONE, YAW_Q15_ONE);
+
+    if (terms) {
+        *terms = (struct yaw_terms){
+            .setpoint = setpoint,
+            .measured = meas,
+            .p = p,
+            .i = integral >> 8,
+            .d = d,
+            .ff = ff,
+            .output = out,
+        };
+    }
+
+    return out;
+}
@@ -0,0 +1,125 @@
+#ifndef YAW_PID_H
+#define YAW_PID_H
+
+/*
+ * Yaw rate controller. Tracks a yaw rate setpoint from the steering stick
+ * with a fixed-point PID plus feed-forward, and gives back a steering
+ * command for the mixer.
+ *
+ * The step has no loops and only clamps for branches, so it takes the same
+ * time every tick.
+ */
+
+#include <stdint.h>
+
+/* 1.0 in the Q12 gains. */
+#define YAW_Q12_ONE (1 << 12)
+
+/* 1.0 in the Q15 setpoints and outputs, which are fractions of full stick
+ * and of the configured maximum rate. */
+#define YAW_Q15_ONE (1 << 15)
+
+/**
+ * @brief Gains, as Q12. Rates are normalised to the maximum rate first, so
+ * a kp of 1.0 gives full steering for an error of the maximum rate.
+ */
+struct yaw_gains
+{
+    /* Steering per unit of rate error. */
+    int32_t kp;
+    /* Steering per unit of rate error, per second. */
+    int32_t ki;
+    /* Steering per unit of rate change per second, so in seconds. */
+    int32_t kd;
+    /* Steering per unit of setpoint, straight through. */
+    int32_t kff;
+};
+
+struct yaw_config
+{
+    struct yaw_gains gains;
+
+    /* How often yaw_pid_run() is called. */
+    uint32_t rate_hz;
+    /* Yaw rate at full stick, in millidegrees per second. */
+    int32_t max_rate_mdps;
+    /* Most the integral term can contribute, as Q15. */
+    int32_t i_limit;
+    /* Cutoff of the filter on the derivative term, or 0 for none. */
+    uint32_t d_cutoff_hz;
+};
+
+/**
+ * @brief The gains as they're used each tick, and the controller's state.
+ */
+struct yaw_pid
+{
+    int32_t kp;
+    /* ki / rate_hz, as Q20. */
+    int32_t ki_tick;
+    /* kd * rate_hz, as Q12. */
+    int32_t kd_tick;
+    int32_t kff;
+
+    uint32_t rate_hz;
+    /* Q15 rate per mdps, as Q16. */
+    int32_t meas_scale;
+    /* Integral limit as Q23. */
+    int32_t i_limit;
+    /* Derivative filter coefficient, as Q15. */
+    int32_t d_alpha;
+
+    /* Integral term as Q23, so slow integration isn't lost to rounding. */
+    int32_t integral;
+    int32_t prev_meas;
+    int32_t d_filtered;
+};
+
+/**
+ * @brief What the controller did on the last tick, for tuning.
+ */
+struct yaw_terms
+{
+    int32_t setpoint;
+    int32_t measured;
+    int32_t p, i, d, ff;
+    int32_t output;
+};
+
+/**
+ * @brief A starting point for a small two wheel drive robot.
+ */
+extern void yaw_config_default(struct yaw_config *config);
+
+extern void yaw_pid_init(struct yaw_pid *pid, const struct yaw_config *config);
+
+/**
+ * @brief Change the gains without a bump in the output.
+ *
+ * The integral is held as output, not as accumulated error, so it carries
+ * on from where it was. Not to be called while yaw_pid_run() might be
+ * using the same controller.
+ */
+extern void yaw_pid_set_gains(struct yaw_pid *pid,
+                              const struct yaw_gains *gains);
+
+/**
+ * @brief Forget the integral and derivative history, for when the
+ * controller hasn't been driving the motors.
+ */
+extern void yaw_pid_reset(struct yaw_pid *pid, int32_t gyro_mdps);
+
+/**
+ * @brief Run one tick.
+ *
+ * @param setpoint Yaw rate wanted, as Q15 of the maximum rate.
+ * @param gyro_mdps Yaw rate measured, in millidegrees per second. Positive
+ * is the way positive steering turns the robot.
+ * @param terms Filled in with the workings if not NULL.
+ *
+ * @return Steering, as Q15 clamped to +/-1.
+ */
+extern int32_t yaw_pid_run(struct yaw_pid *pid, int32_t setpoint,
+                           int32_t gyro_mdps, struct yaw_terms *terms);
+
+#endif /* YAW_PID_H */
@@ -0,0 +1,199 @@
+/*
+ * The battery's sampling on the ADC emulator, the way the robot runs it:
+ * the divider and current sensor's outputs set with
+ * adc_emul_const_value_set(), then the filtered voltage and current read
+ * back once it's settled, and while it's following the pack down. Then the
+ * reading put through the mixer, for the drive to be turned up as the pack
+ * sags and cut back as it goes flat.
+ *
+ *     west build -b native_sim firmware/tests/app/battery -t run
+ */
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/adc.h>
+#include <zephyr/drivers/adc/adc_emul.h>
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+#include "battery.h"
+#include "mixer.h"
+
+#define BATTERY_NODE DT_NODELABEL(battery)
+
+#define FULL_OHMS DT_PROP(BATTERY_NODE, full_ohms)
+#define OUTPUT_OHMS DT_PROP(BATTERY_NODE, output_ohms)
+#define CURRENT_ZERO_MV DT_PROP(BATTERY_NODE, current_zero_mv)
+#define CURRENT_MV_PER_AMP DT_PROP(BATTERY_NODE, current_mv_per_amp)
+
+#define TAU_MS CONFIG_COMBAT_BATTERY_TAU_MS
+
+/* Long enough for the filter to be within a LSB of a step. */
+#define SETTLE_MS (10 * TAU_MS)
+
+/* What the mixer's set up for, a 4S pack. */
+#define NOMINAL_MV 16000
+#define CUTBACK_MV 14000
+#define EMPTY_MV 12800
+#define CUTBACK_MIN 25
+
+static const struct adc_dt_spec voltage_ch =
+    ADC_DT_SPEC_GET_BY_NAME(BATTERY_NODE, voltage);
+static const struct adc_dt_spec current_ch =
+    ADC_DT_SPEC_GET_BY_NAME(BATTERY_NODE, current);
+
+/* How far off a reading can be: a couple of the ADC's LSBs, and the
+ * divider's output only being set to the mV. The current's published in
+ * 10 mA steps. */
+static uint32_t mv_within;
+static int32_t ma_within;
+
+static struct mixer mixer;
+
+/**
+ * @brief Put the pack at mv, with ma coming out of it.
+ */
+static void set_pack(uint32_t mv, int32_t ma)
+{
+    zassert_ok(adc_emul_const_value_set(voltage_ch.dev,
+                                        voltage_ch.channel_id,
+                                        mv * OUTPUT_OHMS / FULL_OHMS));
+    zassert_ok(adc_emul_const_value_set(
+        current_ch.dev, current_ch.channel_id,
+        CURRENT_ZERO_MV + ma * CURRENT_MV_PER_AMP / 1000));
+}
+
+static void check_reading(uint32_t mv, int32_t ma)
+{
+    struct battery_reading reading;
+
+    battery_get(&reading);
+    zassert_within(reading.mv, mv, mv_within, "%u mV for %u", reading.mv,
+                   mv);
+    zassert_within(reading.ma, ma, ma_within, "%d mA for %d", reading.ma, ma);
+}
+
+ZTEST(battery, test_settle)
+{
+    struct battery_stats stats;
+
+    set_pack(15200, 12000);
+    k_msleep(SETTLE_MS);
+    check_reading(15200, 12000);
+
+    /* Charging, for a robot that's being pushed. */
+    set_pack(16400, -2000);
+    k_msleep(SETTLE_MS);
+    check_reading(16400, -2000);
+
+    /* The stats are since boot, so they take in the other tests too. */
+    battery_get_stats(&stats);
+    zassert_true(stats.samples > 2 * SETTLE_MS * USEC_PER_MSEC /
+                                     CONFIG_COMBAT_BATTERY_INTERVAL_US);
+    zassert_true(stats.min_mv <= 15200 + mv_within);
+    zassert_true(stats.max_ma >= 12000 - ma_within);
+}
+
+ZTEST(battery, test_follow)
+{
+    struct battery_reading reading;
+
+    /* One time constant into a 2 V sag, it's most of the way down. */
+    set_pack(14000, 30000);
+    k_msleep(TAU_MS);
+
+    battery_get(&reading);
+    zassert_true(reading.mv < NOMINAL_MV - 1000 &&
+                     reading.mv > NOMINAL_MV - 1500,
+                 "%u mV after %d ms", reading.mv, TAU_MS);
+
+    k_msleep(SETTLE_MS);
+    check_reading(14000, 30000);
+}
+
+ZTEST(battery, test_stop)
+{
+    struct battery_reading reading;
+
+    /* Stopped, it reads 0 mV, which the mixer leaves alone. */
+    battery_set_active(false);
+    k_msleep(TAU_MS);
+    battery_get(&reading);
+    zassert_equal(reading.mv, 0);
+    zassert_equal(mixer_battery_gain(&mixer, reading.mv), MIXER_Q14_ONE);
+
+    battery_set_active(true);
+    k_msleep(SETTLE_MS);
+    check_reading(NOMINAL_MV, 0);
+}
+
+ZTEST(battery, test_mixer_gain)
+{
+    static const struct
+    {
+        uint32_t mv;
+        double gain;
+    } steps[] = {
+        /* Fresh off the charger, the drive's turned down. */
+        {16800, (double)NOMINAL_MV / 16800},
+        {NOMINAL_MV, 1.0},
+        /* Sagging, it's turned up to keep the motors' voltage. */
+        {14400, (double)NOMINAL_MV / 14400},
+        /* Half way from the cutback to empty, and past empty. */
+        {13400, (double)NOMINAL_MV / 13400 * (0.25 + 0.75 * 600 / 1200)},
+        {12000, (double)NOMINAL_MV / 12000 * 0.25},
+    };
+    struct battery_reading reading;
+    int32_t gain;
+
+    for (size_t i = 0; i < ARRAY_SIZE(steps); i++) {
+        set_pack(steps[i].mv, 0);
+        k_msleep(SETTLE_MS);
+        battery_get(&reading);
+
+        /* Within 2%, which takes in a reading mv_within out on the
+         * cutback's slope. */
+        gain = mixer_battery_gain(&mixer, reading.mv);
+        zassert_within(gain, steps[i].gain * MIXER_Q14_ONE,
+                       MIXER_Q14_ONE / 50, "gain %d at %u mV", gain,
+                       reading.mv);
+    }
+}
+
+static void *setup(void)
+{
+    struct mixer_config config;
+    uint32_t vref_mv = adc_ref_internal(voltage_ch.dev);
+
+    zassert_true(adc_is_ready_dt(&voltage_ch));
+
+    mv_within =
+        2 * vref_mv * FULL_OHMS / (OUTPUT_OHMS << voltage_ch.resolution) +
+        DIV_ROUND_UP(FULL_OHMS, OUTPUT_OHMS) + 1;
+    ma_within =
+        2 * vref_mv * 1000 / (CURRENT_MV_PER_AMP << current_ch.resolution) +
+        11;
+
+    set_pack(NOMINAL_MV, 0);
+    zassert_ok(battery_init());
+
+    mixer_config_default(&config);
+    config.battery_nominal_mv = NOMINAL_MV;
+    config.battery_cutback_mv = CUTBACK_MV;
+    config.battery_empty_mv = EMPTY_MV;
+    config.battery_cutback_min = CUTBACK_MIN * MIXER_Q14_ONE / 100;
+    mixer_init(&mixer, &config);
+
+    return NULL;
+}
+
+/**
+ * @brief Each test starts from a settled pack at the nominal voltage, with
+ * nothing being drawn.
+ */
+static void before(void *fixture)
+{
+    set_pack(NOMINAL_MV, 0);
+    k_msleep(SETTLE_MS);
+}
+
+ZTEST_SUITE(battery, NULL, setup, before, NULL, NULL);
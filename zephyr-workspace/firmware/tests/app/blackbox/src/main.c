@@ -0,0 +1,221 @@
+/*
+ * The black box log on the simulated flash, through the flash map the way
+ * the recorder thread uses it: written, mounted again as it would be after
+ * a power cycle, and read back. Then written all the way round the
+ * partition and mounted again, to check it carries on where it left off.
+ *
+ *     west build -b native_sim firmware/tests/app/blackbox -t run
+ */
+
+#include <string.h>
+#include <zephyr/drivers/flash.h>
+#include <zephyr/kernel.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/ztest.h>
+
+#include "blackbox_log.h"
+
+/* The recorder's erase size, for the W25Q32. The simulated flash's has to
+ * go into it. */
+#define SECTOR_SIZE 4096
+
+#define RECORDS 2000
+
+static const struct flash_area *area;
+static struct blackbox_flash flash;
+static struct blackbox_log blackbox;
+
+static struct blackbox_record written[RECORDS];
+static uint8_t page[BLACKBOX_PAGE_SIZE];
+
+static uint32_t rng_state = 0x12345678;
+
+static uint32_t rng(void)
+{
+    /* xorshift32, so runs are repeatable. */
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static int area_read(void *ctx, uint32_t offset, void *buf, size_t len)
+{
+    return flash_area_read(ctx, offset, buf, len);
+}
+
+static int area_write(void *ctx, uint32_t offset, const void *buf, size_t len)
+{
+    return flash_area_write(ctx, offset, buf, len);
+}
+
+static int area_erase(void *ctx, uint32_t offset, size_t len)
+{
+    return flash_area_erase(ctx, offset, len);
+}
+
+/**
+ * @brief Something like what the robot logs: each type in turn, a ms or
+ * two apart, with the values wandering.
+ */
+static void make_record(struct blackbox_record *rec, uint32_t i)
+{
+    static int32_t v[BLACKBOX_MAX_FIELDS];
+
+    rec->time_us = i * 1000 + rng() % 1000;
+    rec->type = i % BLACKBOX_TYPE_COUNT;
+    for (int f = 0; f < BLACKBOX_MAX_FIELDS; f++) {
+        v[f] += (int32_t)(rng() % 64) - 32;
+        rec->v[f] = f < blackbox_fields[rec->type] ? v[f] : 0;
+    }
+}
+
+static bool same(const struct blackbox_record *a,
+                 const struct blackbox_record *b)
+{
+    return a->type == b->type && a->time_us == b->time_us &&
+           !memcmp(a->v, b->v, blackbox_fields[a->type] * sizeof(a->v[0]));
+}
+
+/**
+ * @brief Read the pages from start up to end back out of the flash, and
+ * check they hold the records written, in order.
+ *
+ * @return How many records there were.
+ */
+static uint32_t read_back(uint32_t start, uint32_t end, uint16_t session,
+                          const struct blackbox_record *want)
+{
+    struct blackbox_page_info info;
+    struct blackbox_reader reader;
+    struct blackbox_record rec;
+    uint32_t count = 0;
+
+    for (uint32_t off = start; off < end; off += BLACKBOX_PAGE_SIZE) {
+        zassert_ok(flash_area_read(area, off, page, sizeof(page)));
+        zassert_true(blackbox_page_check(page, &info), "bad page at 0x%x",
+                     off);
+        zassert_equal(info.session, session, "page at 0x%x", off);
+
+        blackbox_reader_init(&reader, page);
+        while (blackbox_reader_next(&reader, &rec)) {
+            zassert_true(count < RECORDS, "more records than written");
+            zassert_true(same(&rec, &want[count]), "record %u differs",
+                         count);
+            count++;
+        }
+    }
+
+    return count;
+}
+
+ZTEST(blackbox, test_remount)
+{
+    uint32_t end;
+
+    /* An empty partition starts a new log at the beginning. */
+    zassert_ok(blackbox_log_mount(&blackbox, &flash));
+    zassert_equal(blackbox.session, 0);
+    zassert_equal(blackbox.next, 0);
+
+    for (uint32_t i = 0; i < RECORDS; i++) {
+        make_record(&written[i], i);
+        zassert_ok(blackbox_log_append(&blackbox, &written[i]));
+    }
+    zassert_ok(blackbox_log_flush(&blackbox));
+    zassert_equal(blackbox.stats.errors, 0);
+    end = blackbox.next;
+
+    /* Found again after a power cycle, with the next session to go after
+     * the last page. */
+    zassert_ok(blackbox_log_mount(&blackbox, &flash));
+    zassert_equal(blackbox.session, 1);
+    zassert_equal(blackbox.next, end);
+    zassert_equal(blackbox.seq, end / BLACKBOX_PAGE_SIZE);
+
+    zassert_equal(read_back(0, end, 0, written), RECORDS);
+
+    /* The new session goes after it, and the old one's left alone. */
+    for (uint32_t i = 0; i < RECORDS / 2; i++) {
+        make_record(&written[i], i);
+        zassert_ok(blackbox_log_append(&blackbox, &written[i]));
+    }
+    zassert_ok(blackbox_log_flush(&blackbox));
+
+    zassert_equal(read_back(end, blackbox.next, 1, written), RECORDS / 2);
+}
+
+ZTEST(blackbox, test_wrap)
+{
+    struct blackbox_record rec;
+    struct blackbox_page_info info;
+    uint32_t next, seq, ahead;
+    uint16_t session;
+
+    zassert_ok(blackbox_log_mount(&blackbox, &flash));
+
+    /* Round the partition and half way round again. */
+    for (uint32_t i = 0; blackbox.stats.pages < 3 * flash.size /
+                                                   BLACKBOX_PAGE_SIZE / 2;
+         i++) {
+        make_record(&rec, i);
+        zassert_ok(blackbox_log_append(&blackbox, &rec));
+    }
+    zassert_ok(blackbox_log_flush(&blackbox));
+    zassert_equal(blackbox.stats.errors, 0);
+
+    next = blackbox.next;
+    seq = blackbox.seq;
+    session = blackbox.session;
+
+    zassert_ok(blackbox_log_mount(&blackbox, &flash));
+    zassert_equal(blackbox.next, next);
+    zassert_equal(blackbox.seq, seq);
+    zassert_equal(blackbox.session, session + 1);
+
+    /* The page just written is the newest, and the next sector still has
+     * the pages written there a whole partition ago. */
+    zassert_ok(flash_area_read(area,
+                               (next + flash.size - BLACKBOX_PAGE_SIZE) %
+                                   flash.size,
+                               page, sizeof(page)));
+    zassert_true(blackbox_page_check(page, &info));
+    zassert_equal(info.seq, seq - 1);
+
+    ahead = ROUND_UP(next, SECTOR_SIZE) - next;
+    zassert_ok(flash_area_read(area, (next + ahead) % flash.size, page,
+                               sizeof(page)));
+    zassert_true(blackbox_page_check(page, &info));
+    zassert_equal(info.seq, seq - (flash.size - ahead) / BLACKBOX_PAGE_SIZE);
+}
+
+static void *setup(void)
+{
+    struct flash_pages_info info;
+
+    zassert_ok(flash_area_open(FIXED_PARTITION_ID(blackbox_partition),
+                               &area));
+    zassert_ok(flash_get_page_info_by_offs(area->fa_dev, area->fa_off,
+                                           &info));
+    zassert_equal(SECTOR_SIZE % info.size, 0, "%zu byte erase", info.size);
+
+    flash.ctx = (void *)area;
+    flash.read = area_read;
+    flash.write = area_write;
+    flash.erase = area_erase;
+    flash.size = area->fa_size;
+    flash.sector_size = SECTOR_SIZE;
+
+    return NULL;
+}
+
+/**
+ * @brief Each test starts from blank flash, whatever's left in flash.bin
+ * from the last run.
+ */
+static void before(void *fixture)
+{
+    zassert_ok(flash_area_erase(area, 0, area->fa_size));
+}
+
+ZTEST_SUITE(blackbox, NULL, setup, before, NULL, NULL);
@@ -0,0 +1,339 @@
+/*
+ * Cycle counts for the pure C parts of the radio to motor hot path: the
+ * CRC, channel unpacking, the parser, and a frame's octets parsed, unpacked
+ * and put through mixer_frame(). The driver's thread, the robot's channel
+ * callback and what it does besides mixing - the failsafe, yaw loop,
+ * telemetry and latency stamping - aren't in these numbers.
+ *
+ * Run with twister, or on its own:
+ *
+ *     west build -b native_sim firmware/tests/benchmarks/hot_path -t run
+ *
+ * Each result is a line of CSV, after a header line:
+ *
+ *     bench,<name>,<octets>,<runs>,<min cycles>,<mean>,<max>,<min ns>
+ *
+ * with the cost of timing nothing taken off. Octets is how many went
+ * through in each run, where that means anything. On the robot the cycles
+ * come from the DWT cycle counter, with interrupts off for each run.
+ */
+
+#include <string.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/uart.h>
+#include <zephyr/kernel.h>
+#include <zephyr/timing/timing.h>
+#include <zephyr/ztest.h>
+
+#include "csrf_channels.h"
+#include "csrf_parser.h"
+#include "mixer.h"
+
+#define RUNS 1000
+
+#define RC_FRAME_LEN (4 + CSRF_RC_CHANNELS_PAYLOAD_LEN)
+
+/* Back to back, as a receiver running ahead of the thread would leave
+ * them. */
+#define BURST_FRAMES 16
+
+/* Smaller than a frame, so every frame straddles two chunks. */
+#define SPLIT_CHUNK 13
+
+static uint64_t overhead;
+
+static uint8_t burst[BURST_FRAMES * RC_FRAME_LEN];
+static uint8_t long_frame[CSRF_MAX_FRAME_LEN];
+
+static struct csrf_parser parser;
+static struct mixer mixer;
+
+/* What the handlers got, so the work can't be optimised away. */
+static uint16_t channels[CSRF_NUM_CHANNELS];
+static struct mixer_output mix;
+static volatile uint32_t frames_seen;
+static volatile uint8_t crc_sink;
+static volatile uint32_t stamp_sink;
+
+typedef void (*bench_fn_t)(void);
+
+/**
+ * @brief Time a function, one run at a time, and print the result.
+ */
+static void bench(const char *name, size_t octets, bench_fn_t fn)
+{
+    uint64_t min = UINT64_MAX, max = 0, total = 0;
+
+    for (int i = 0; i < RUNS; i++) {
+        timing_t start, end;
+        unsigned int key;
+        uint64_t cycles;
+
+        key = irq_lock();
+        start = timing_counter_get();
+        fn();
+        end = timing_counter_get();
+        irq_unlock(key);
+
+        cycles = timing_cycles_get(&start, &end);
+        cycles = cycles > overhead ? cycles - overhead : 0;
+
+        min = MIN(min, cycles);
+        max = MAX(max, cycles);
+        total += cycles;
+    }
+
+    printk("bench,%s,%u,%u,%llu,%llu,%llu,%llu\n", name, (unsigned)octets,
+           RUNS, (unsigned long long)min, (unsigned long long)(total / RUNS),
+           (unsigned long long)max,
+           (unsigned long long)timing_cycles_to_ns(min));
+}
+
+static void nothing(void)
+{
+}
+
+/**
+ * @brief An RC frame as the receiver sends it, with the sticks somewhere
+ * off centre.
+ */
+static void make_rc_frame(uint8_t *buf, int n)
+{
+    uint16_t ch[CSRF_NUM_CHANNELS];
+
+    for (int i = 0; i < CSRF_NUM_CHANNELS; i++)
+        ch[i] = (172 + n * 97 + i * 113) % 1640 + 172;
+
+    buf[0] = CSRF_ADDR_FLIGHT_CONTROLLER;
+    buf[1] = RC_FRAME_LEN - 2;
+    buf[2] = CSRF_FRAME_RC_CHANNELS;
+    csrf_pack_rc_channels(ch, &buf[3]);
+    buf[RC_FRAME_LEN - 1] = csrf_crc8(&buf[2], RC_FRAME_LEN - 3);
+}
+
+/* The CRC, over an RC frame's type and payload and over the longest
+ * frame. */
+
+static void crc8_rc(void)
+{
+    crc_sink = csrf_crc8(&burst[2], RC_FRAME_LEN - 3);
+}
+
+static void crc8_table_rc(void)
+{
+    crc_sink = csrf_crc8_table(&burst[2], RC_FRAME_LEN - 3);
+}
+
+static void crc8_slice4_rc(void)
+{
+    crc_sink = csrf_crc8_slice4(&burst[2], RC_FRAME_LEN - 3);
+}
+
+static void crc8_long(void)
+{
+    crc_sink = csrf_crc8(long_frame, sizeof(long_frame));
+}
+
+static void crc8_table_long(void)
+{
+    crc_sink = csrf_crc8_table(long_frame, sizeof(long_frame));
+}
+
+static void crc8_slice4_long(void)
+{
+    crc_sink = csrf_crc8_slice4(long_frame, sizeof(long_frame));
+}
+
+ZTEST(hot_path, test_crc8)
+{
+    zassert_equal(csrf_crc8(&burst[2], RC_FRAME_LEN - 2), 0,
+                  "CRC of a good frame and its CRC should be 0");
+    zassert_equal(csrf_crc8_table(long_frame, sizeof(long_frame)),
+                  csrf_crc8_slice4(long_frame, sizeof(long_frame)));
+
+    bench("crc8", RC_FRAME_LEN - 3, crc8_rc);
+    bench("crc8_table", RC_FRAME_LEN - 3, crc8_table_rc);
+    bench("crc8_slice4", RC_FRAME_LEN - 3, crc8_slice4_rc);
+    bench("crc8", sizeof(long_frame), crc8_long);
+    bench("crc8_table", sizeof(long_frame), crc8_table_long);
+    bench("crc8_slice4", sizeof(long_frame), crc8_slice4_long);
+}
+
+static void unpack(void)
+{
+    csrf_unpack_rc_channels(&burst[3], channels);
+}
+
+ZTEST(hot_path, test_unpack)
+{
+    bench("unpack_rc_channels", CSRF_RC_CHANNELS_PAYLOAD_LEN, unpack);
+}
+
+/* The parser, with a handler that only counts. */
+
+static void count_frame(void *user_data, const struct csrf_frame *frame)
+{
+    frames_seen++;
+}
+
+static const struct csrf_frame_handler count_handlers[] = {
+    {CSRF_FRAME_RC_CHANNELS, CSRF_RC_CHANNELS_PAYLOAD_LEN,
+     CSRF_RC_CHANNELS_PAYLOAD_LEN, count_frame},
+};
+
+static void parse_burst(void)
+{
+    csrf_parser_feed(&parser, burst, sizeof(burst), 0);
+}
+
+static void parse_split(void)
+{
+    for (size_t i = 0; i < sizeof(burst); i += SPLIT_CHUNK) {
+        csrf_parser_feed(&parser, &burst[i],
+                         MIN(SPLIT_CHUNK, sizeof(burst) - i), 0);
+    }
+}
+
+ZTEST(hot_path, test_parser)
+{
+    csrf_parser_init(&parser, count_handlers, ARRAY_SIZE(count_handlers),
+                     NULL, NULL);
+
+    frames_seen = 0;
+    bench("parser_burst", sizeof(burst), parse_burst);
+    zassert_equal(frames_seen, RUNS * BURST_FRAMES);
+
+    frames_seen = 0;
+    bench("parser_split", sizeof(burst), parse_split);
+    zassert_equal(frames_seen, RUNS * BURST_FRAMES);
+    zassert_equal(parser.stats.bad_crc + parser.stats.noise, 0);
+}
+
+/* One frame through a stand-in for the driver's RC channels handler: it
+ * unpacks and stamps like the driver, then calls the function under test
+ * instead of the robot's callback. */
+
+static void (*channel_callback)(const uint16_t *ch);
+
+static void handle_rc_channels(void *user_data, const struct csrf_frame *frame)
+{
+    csrf_unpack_rc_channels(frame->payload, channels);
+    stamp_sink = k_cycle_get_32();
+    channel_callback(channels);
+}
+
+static const struct csrf_frame_handler rc_handlers[] = {
+    {CSRF_FRAME_RC_CHANNELS, CSRF_RC_CHANNELS_PAYLOAD_LEN,
+     CSRF_RC_CHANNELS_PAYLOAD_LEN, handle_rc_channels},
+};
+
+static void count_channels(const uint16_t *ch)
+{
+    frames_seen++;
+}
+
+/**
+ * @brief The mix the robot's channel callback does, with the link limiting
+ * the drive and the pack sagging.
+ */
+static void mix_channels(const uint16_t *ch)
+{
+    struct mixer_limits limits = {
+        .drive_percent = 80,
+        .battery_gain = mixer_battery_gain(&mixer, 7000),
+    };
+    int32_t in[MIXER_NUM_INPUTS];
+
+    mixer_frame(&mixer, ch, &limits, in, &mix);
+    frames_seen++;
+}
+
+static void parse_one(void)
+{
+    csrf_parser_feed(&parser, burst, RC_FRAME_LEN, 0);
+}
+
+ZTEST(hot_path, test_callback)
+{
+    csrf_parser_init(&parser, rc_handlers, ARRAY_SIZE(rc_handlers), NULL,
+                     NULL);
+
+    frames_seen = 0;
+    channel_callback = count_channels;
+    bench("parse_unpack", RC_FRAME_LEN, parse_one);
+    zassert_equal(frames_seen, RUNS);
+
+    frames_seen = 0;
+    channel_callback = mix_channels;
+    bench("parse_unpack_mix", RC_FRAME_LEN, parse_one);
+    zassert_equal(frames_seen, RUNS);
+    zassert_true(mix.drive[0] || mix.drive[1], "Frame should drive");
+}
+
+#if DT_NODE_HAS_COMPAT(DT_CHOSEN(zephyr_console), zephyr_cdc_acm_uart)
+/**
+ * @brief The console's on USB, so the results would be lost until the
+ * host opens the port.
+ */
+static void wait_for_host(void)
+{
+    const struct device *console = DEVICE_DT_GET(DT_CHOSEN(zephyr_console));
+    uint32_t dtr = 0;
+
+    while (!dtr) {
+        uart_line_ctrl_get(console, UART_LINE_CTRL_DTR, &dtr);
+        k_sleep(K_MSEC(100));
+    }
+}
+#else
+static inline void wait_for_host(void)
+{
+}
+#endif
+
+static void *hot_path_setup(void)
+{
+    struct mixer_config config;
+
+    wait_for_host();
+
+    for (int i = 0; i < BURST_FRAMES; i++)
+        make_rc_frame(&burst[i * RC_FRAME_LEN], i);
+    for (size_t i = 0; i < sizeof(long_frame); i++)
+        long_frame[i] = i * 37 + 11;
+
+    mixer_config_default(&config);
+    config.mode = MIXER_MODE_ARCADE;
+    config.expo = MIXER_Q15_ONE / 4;
+    config.deadband = MIXER_Q15_ONE / 50;
+    config.battery_nominal_mv = 7400;
+    config.battery_cutback_mv = 6600;
+    config.battery_empty_mv = 6000;
+    config.battery_cutback_min = MIXER_Q14_ONE / 4;
+    mixer_init(&mixer, &config);
+
+    timing_init();
+    timing_start();
+
+    printk("bench,name,octets,runs,min_cycles,mean_cycles,max_cycles,"
+           "min_ns\n");
+
+    /* Timing nothing, which everything else has taken off. */
+    bench("overhead", 0, nothing);
+    overhead = UINT64_MAX;
+    for (int i = 0; i < RUNS; i++) {
+        timing_t start = timing_counter_get();
+        timing_t end = timing_counter_get();
+
+        overhead = MIN(overhead, timing_cycles_get(&start, &end));
+    }
+
+    return NULL;
+}
+
+static void hot_path_teardown(void *fixture)
+{
+    timing_stop();
+}
+
+ZTEST_SUITE(hot_path, NULL, hot_path_setup, NULL, NULL, hot_path_teardown);
@@ -0,0 +1,265 @@
+/*
+ * The LSM6DS3 driver against its I2C emulator: the output registers
+ * through sample_fetch() and channel_get(), the FIFO drained each time it
+ * reaches the watermark, and reads through RTIO and the decoder, with the
+ * FIFO part full and after it's overflowed.
+ *
+ * The emulator's output registers are set once, and its FIFO fills from
+ * them at the gyro rate, so every set that comes out should be the same.
+ *
+ *     west build -b native_sim firmware/tests/drivers/lsm6ds3 -t run
+ */
+
+#include <string.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/emul.h>
+#include <zephyr/drivers/emul_sensor.h>
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/kernel.h>
+#include <zephyr/rtio/rtio.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/ztest.h>
+
+#include "lsm6ds3.h"
+
+#define IMU_NODE DT_NODELABEL(accel_gyro)
+
+#define WATERMARK DT_PROP(IMU_NODE, fifo_watermark)
+
+BUILD_ASSERT(WATERMARK > 0, "The test needs the IMU's FIFO");
+
+/* Everything the FIFO can hold, so one read always empties it. */
+#define MAX_SETS (LSM6DS3_FIFO_WORDS / LSM6DS3_WORDS_PER_SET)
+
+/* How many watermarks to drain. */
+#define DRAINS 50
+
+static const struct device *imu = DEVICE_DT_GET(IMU_NODE);
+static const struct emul *emul = EMUL_DT_GET(IMU_NODE);
+
+SENSOR_DT_READ_IODEV(imu_iodev, IMU_NODE, {SENSOR_CHAN_ACCEL_XYZ, 0},
+                     {SENSOR_CHAN_GYRO_XYZ, 0});
+RTIO_DEFINE(imu_rtio, 1, 1);
+
+static uint8_t imu_buf[sizeof(struct lsm6ds3_encoded) +
+                       MAX_SETS * sizeof(struct lsm6ds3_sample)] __aligned(8);
+
+/* What the outputs are set to, in the order the FIFO has them: gyro in
+ * urad/s, then accel in um/s^2. */
+static const enum sensor_channel channels[6] = {
+    SENSOR_CHAN_GYRO_X,  SENSOR_CHAN_GYRO_Y,  SENSOR_CHAN_GYRO_Z,
+    SENSOR_CHAN_ACCEL_X, SENSOR_CHAN_ACCEL_Y, SENSOR_CHAN_ACCEL_Z,
+};
+static const int32_t micro[6] = {
+    500000, -1250000, 3000000, 1500000, -2000000, 9806650,
+};
+
+/* One LSB of each, in the same units, from the emulator. */
+static int64_t lsb[6];
+
+/* The outputs as the FIFO should have them. */
+static struct lsm6ds3_sample want;
+
+static const struct sensor_trigger fifo_trigger = {
+    .type = SENSOR_TRIG_FIFO_WATERMARK,
+    .chan = SENSOR_CHAN_ALL,
+};
+
+/* What the watermark handler found, from the driver's thread. */
+static struct
+{
+    uint32_t drains;
+    uint32_t fewest;
+    uint32_t most;
+    uint32_t wrong;
+    uint32_t overruns;
+    uint32_t errors;
+} drain;
+
+static struct lsm6ds3_sample drained[MAX_SETS];
+static K_SEM_DEFINE(drained_all, 0, 1);
+
+static int64_t q31_to_micro(q31_t value, int8_t shift)
+{
+    return ((int64_t)value * 1000000) >> (31 - shift);
+}
+
+static void fifo_handler(const struct device *dev,
+                         const struct sensor_trigger *trig)
+{
+    bool overrun;
+    int count;
+
+    count = lsm6ds3_fifo_read(dev, drained, ARRAY_SIZE(drained), &overrun);
+    if (count < 0) {
+        drain.errors++;
+        return;
+    }
+
+    drain.drains++;
+    drain.fewest = MIN(drain.fewest, (uint32_t)count);
+    drain.most = MAX(drain.most, (uint32_t)count);
+    drain.overruns += overrun;
+    for (int i = 0; i < count; i++)
+        drain.wrong += memcmp(&drained[i], &want, sizeof(want)) != 0;
+
+    if (drain.drains == DRAINS)
+        k_sem_give(&drained_all);
+}
+
+/**
+ * @brief Every set in the buffer, one channel at a time, has to decode to
+ * the outputs, one period after the last.
+ */
+static void check_decode(const struct sensor_decoder_api *decoder,
+                         enum sensor_channel type, int first)
+{
+    const struct lsm6ds3_encoded *enc = (const void *)imu_buf;
+    const struct sensor_chan_spec chan = {type, 0};
+    struct sensor_three_axis_data data;
+    uint64_t last_ns = 0;
+    uint32_t fit = 0;
+
+    for (uint16_t i = 0; i < enc->count; i++) {
+        zassert_equal(decoder->decode(imu_buf, chan, &fit, 1, &data), 1,
+                      "set %u didn't decode", i);
+
+        for (int axis = 0; axis < 3; axis++) {
+            zassert_within(
+                q31_to_micro(data.readings[0].values[axis], data.shift),
+                micro[first + axis], lsb[first + axis],
+                "set %u channel %d", i, first + axis);
+        }
+
+        if (i > 0)
+            zassert_equal(data.header.base_timestamp_ns - last_ns,
+                          enc->period_ns, "set %u out of step", i);
+        last_ns = data.header.base_timestamp_ns;
+    }
+
+    zassert_equal(decoder->decode(imu_buf, chan, &fit, 1, &data), 0,
+                  "decoded past the end");
+    zassert_equal(last_ns, enc->timestamp_ns, "last set isn't the newest");
+}
+
+ZTEST(lsm6ds3, test_fetch)
+{
+    struct sensor_value val[3];
+
+    zassert_ok(sensor_sample_fetch(imu));
+
+    zassert_ok(sensor_channel_get(imu, SENSOR_CHAN_GYRO_XYZ, val));
+    for (int axis = 0; axis < 3; axis++)
+        zassert_within(sensor_value_to_micro(&val[axis]), micro[axis],
+                       lsb[axis], "gyro axis %d", axis);
+
+    zassert_ok(sensor_channel_get(imu, SENSOR_CHAN_ACCEL_XYZ, val));
+    for (int axis = 0; axis < 3; axis++)
+        zassert_within(sensor_value_to_micro(&val[axis]), micro[3 + axis],
+                       lsb[3 + axis], "accel axis %d", axis);
+
+    /* One axis on its own is the same. */
+    zassert_ok(sensor_channel_get(imu, SENSOR_CHAN_ACCEL_Z, val));
+    zassert_within(sensor_value_to_micro(&val[0]), micro[5], lsb[5]);
+
+    zassert_equal(sensor_sample_fetch_chan(imu, SENSOR_CHAN_DIE_TEMP),
+                  -ENOTSUP);
+    zassert_equal(sensor_channel_get(imu, SENSOR_CHAN_DIE_TEMP, val),
+                  -ENOTSUP);
+}
+
+ZTEST(lsm6ds3, test_watermark)
+{
+    memset(&drain, 0, sizeof(drain));
+    drain.fewest = UINT32_MAX;
+
+    /* From empty, so the first watermark's like the rest. */
+    zassert_ok(lsm6ds3_fifo_config(imu, WATERMARK));
+    zassert_ok(sensor_trigger_set(imu, &fifo_trigger, fifo_handler));
+
+    /* A watermark comes every couple of ms at 1.66 kHz. */
+    zassert_ok(k_sem_take(&drained_all, K_MSEC(DRAINS * 10)),
+               "only %u watermarks", drain.drains);
+    zassert_ok(sensor_trigger_set(imu, &fifo_trigger, NULL));
+
+    zassert_equal(drain.errors, 0, "%u reads failed", drain.errors);
+    zassert_equal(drain.overruns, 0);
+    zassert_equal(drain.wrong, 0, "%u sets weren't the outputs",
+                  drain.wrong);
+
+    /* Each one's drained before the next watermark's worth comes in. */
+    zassert_equal(drain.fewest, WATERMARK);
+    zassert_true(drain.most < 2 * WATERMARK, "%u sets in one drain",
+                 drain.most);
+}
+
+ZTEST(lsm6ds3, test_read_decode)
+{
+    const struct lsm6ds3_encoded *enc = (const void *)imu_buf;
+    const uint32_t period_ns = lsm6ds3_odr_period_ns(LSM6DS3_ODR_MAX);
+    const struct sensor_decoder_api *decoder;
+    uint16_t count;
+
+    zassert_ok(sensor_get_decoder(imu, &decoder));
+
+    /* 10 ms of sets. */
+    zassert_ok(lsm6ds3_fifo_config(imu, WATERMARK));
+    k_sleep(K_MSEC(10));
+
+    zassert_ok(sensor_read(&imu_iodev, &imu_rtio, imu_buf, sizeof(imu_buf)));
+    zassert_ok(decoder->get_frame_count(
+        imu_buf, (struct sensor_chan_spec){SENSOR_CHAN_GYRO_XYZ, 0}, &count));
+    zassert_within(count, 10 * NSEC_PER_MSEC / period_ns, 1, "%u sets",
+                   count);
+    zassert_equal(enc->period_ns, period_ns);
+    zassert_false(decoder->has_trigger(imu_buf, SENSOR_TRIG_FIFO_WATERMARK));
+    zassert_false(decoder->has_trigger(imu_buf, SENSOR_TRIG_FIFO_FULL));
+
+    check_decode(decoder, SENSOR_CHAN_GYRO_XYZ, 0);
+    check_decode(decoder, SENSOR_CHAN_ACCEL_XYZ, 3);
+
+    /* Left for longer than the FIFO lasts, it comes back full, with the
+     * overrun flagged and the sets still lined up. */
+    k_sleep(K_MSEC(500));
+
+    zassert_ok(sensor_read(&imu_iodev, &imu_rtio, imu_buf, sizeof(imu_buf)));
+    zassert_true(enc->count >= MAX_SETS - 1, "%u sets", enc->count);
+    zassert_true(decoder->has_trigger(imu_buf, SENSOR_TRIG_FIFO_FULL));
+
+    check_decode(decoder, SENSOR_CHAN_GYRO_XYZ, 0);
+    check_decode(decoder, SENSOR_CHAN_ACCEL_XYZ, 3);
+}
+
+/**
+ * @brief Set the emulator's outputs, and read them back the way the FIFO
+ * will have them.
+ */
+static void *setup(void)
+{
+    zassert_true(device_is_ready(imu));
+
+    for (size_t i = 0; i < ARRAY_SIZE(channels); i++) {
+        const struct sensor_chan_spec chan = {channels[i], 0};
+        q31_t lower, upper, epsilon, value;
+        int8_t shift;
+
+        zassert_ok(emul_sensor_backend_get_sample_range(
+            emul, chan, &lower, &upper, &epsilon, &shift));
+        lsb[i] = q31_to_micro(epsilon, shift) + 1;
+
+        value = ((int64_t)micro[i] << (31 - shift)) / 1000000;
+        zassert_ok(
+            emul_sensor_backend_set_channel(emul, chan, &value, shift));
+    }
+
+    zassert_ok(lsm6ds3_reg_read(imu, LSM6DS3_REG_OUTX_L_G, (uint8_t *)&want,
+                                sizeof(want)));
+    for (int axis = 0; axis < 3; axis++) {
+        want.gyro[axis] = sys_le16_to_cpu(want.gyro[axis]);
+        want.accel[axis] = sys_le16_to_cpu(want.accel[axis]);
+    }
+
+    return NULL;
+}
+
+ZTEST_SUITE(lsm6ds3, NULL, setup, NULL, NULL, NULL);
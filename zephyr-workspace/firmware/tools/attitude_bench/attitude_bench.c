@@ -0,0 +1,284 @@
+/*
+ * Host-side checks and benchmarks for the attitude estimator, against a
+ * simulated robot being knocked about.
+ *
+ * Build and run from the firmware directory:
+ *
+ *     cc -O2 -Isrc -o attitude_bench tools/attitude_bench/attitude_bench.c \
+ *         src/attitude.c -lm
+ *     ./attitude_bench
+ *
+ * The exit code is non-zero if any check fails.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../bench.h"
+#include "attitude.h"
+
+#define RATE_HZ (1660 / 3)
+
+/**
+ * @brief Uniform noise, +/- half of pp.
+ */
+static double noise(double pp)
+{
+    return pp * ((double)(rng() & 0xffff) / 0xffff - 0.5);
+}
+
+/**
+ * @brief The robot, as the true up vector in its own frame.
+ */
+struct robot
+{
+    double up[3];
+    /* Body rates, in dps. */
+    double rate[3];
+    /* Gyro bias, in dps. */
+    double bias[3];
+    /* Gyro and accelerometer noise, peak to peak. */
+    double gyro_noise;
+    double accel_noise;
+    /* Extra acceleration this tick, in g, as from a hit. */
+    double shove[3];
+};
+
+static void robot_init(struct robot *robot, double roll_deg)
+{
+    double roll = roll_deg * M_PI / 180;
+
+    *robot = (struct robot){
+        .up = {0, sin(roll), cos(roll)},
+        .gyro_noise = 1,
+        .accel_noise = 20,
+    };
+}
+
+/**
+ * @brief Move the robot on a tick, and read its sensors.
+ */
+static void robot_step(struct robot *robot, int32_t *gyro, int32_t *accel)
+{
+    const int steps = 10;
+    const double dt = 1.0 / RATE_HZ / steps;
+    double *u = robot->up;
+    double n;
+
+    for (int s = 0; s < steps; s++) {
+        double w[3], next[3];
+
+        for (int i = 0; i < 3; i++) w[i] = robot->rate[i] * M_PI / 180 * dt;
+
+        next[0] = u[0] + u[1] * w[2] - u[2] * w[1];
+        next[1] = u[1] + u[2] * w[0] - u[0] * w[2];
+        next[2] = u[2] + u[0] * w[1] - u[1] * w[0];
+
+        n = sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+        for (int i = 0; i < 3; i++) u[i] = next[i] / n;
+    }
+
+    for (int i = 0; i < 3; i++) {
+        gyro[i] = lround((robot->rate[i] + robot->bias[i] +
+                          noise(robot->gyro_noise)) *
+                         1000);
+        accel[i] = lround(u[i] * 1000 + robot->shove[i] * 1000 +
+                          noise(robot->accel_noise));
+    }
+}
+
+static void run(struct attitude *att, struct robot *robot, int ticks)
+{
+    int32_t gyro[3], accel[3];
+
+    for (int t = 0; t < ticks; t++) {
+        robot_step(robot, gyro, accel);
+        attitude_update(att, gyro, accel);
+    }
+}
+
+static void init(struct attitude *att)
+{
+    struct attitude_config config;
+
+    attitude_config_default(&config);
+    config.rate_hz = RATE_HZ;
+    attitude_init(att, &config);
+}
+
+static void check_atan2(void)
+{
+    int32_t worst = 0;
+
+    for (int deg10 = -1800; deg10 < 1800; deg10++) {
+        double a = deg10 * M_PI / 1800;
+
+        for (int mag = 1; mag <= 1 << 20; mag <<= 5) {
+            int32_t y = lround(sin(a) * mag * 1000);
+            int32_t x = lround(cos(a) * mag * 1000);
+            int32_t want = lround(atan2(y, x) * 18000 / M_PI);
+            int32_t err = abs(attitude_atan2(y, x) - want);
+
+            /* +-180 are the same angle. */
+            if (err > 18000)
+                err = 36000 - err;
+            worst = err > worst ? err : worst;
+        }
+    }
+
+    check(worst <= 10, "atan2: more than 0.1 degrees out");
+    printf("atan2,worst error %d cdeg\n", worst);
+}
+
+static void check_static(void)
+{
+    struct attitude att;
+    struct robot robot;
+
+    init(&att);
+    robot_init(&robot, 30);
+
+    /* From the default of level, it has to find 30 degrees on its own. */
+    run(&att, &robot, 3 * RATE_HZ);
+    check(abs(att.state.roll - 3000) < 100, "static: roll");
+    check(abs(att.state.pitch) < 100, "static: pitch");
+    check(!att.state.inverted, "static: inverted");
+
+    /* A bad gyro bias is held off by the accelerometer. */
+    init(&att);
+    robot_init(&robot, 0);
+    robot.bias[0] = 3;
+    robot.bias[1] = -3;
+    run(&att, &robot, 60 * RATE_HZ);
+    check(abs(att.state.roll) < 300 && abs(att.state.pitch) < 300,
+          "static: bias drift");
+    check(att.state.flips == 0, "static: bias flip");
+    printf("static,bias 3 dps,roll %d cdeg,pitch %d cdeg after 60 s\n",
+           att.state.roll, att.state.pitch);
+}
+
+/**
+ * @brief Thrown over by a hit. The accelerometer is junk all the way
+ * through, so the gyro has to carry it.
+ */
+static void check_flip(void)
+{
+    struct attitude att;
+    struct robot robot;
+    int32_t gyro[3], accel[3];
+    int detect = -1, flip_ticks = RATE_HZ * 180 / 1500;
+
+    init(&att);
+    robot_init(&robot, 0);
+    run(&att, &robot, RATE_HZ);
+
+    robot.rate[0] = 1500;
+    for (int t = 0; t < 2 * RATE_HZ; t++) {
+        if (t == flip_ticks) {
+            for (int i = 0; i < 3; i++) robot.rate[i] = 0;
+        }
+        for (int i = 0; i < 3; i++)
+            robot.shove[i] = t < flip_ticks + 20 ? noise(8) : 0;
+
+        robot_step(&robot, gyro, accel);
+        attitude_update(&att, gyro, accel);
+
+        if (detect < 0 && att.state.inverted)
+            detect = t;
+    }
+
+    check(robot.up[2] < -0.99, "flip: sim didn't flip");
+    check(att.state.inverted && att.state.flips == 1, "flip: not detected");
+    check(detect >= 0 && detect < flip_ticks + RATE_HZ / 50,
+          "flip: more than 20 ms after landing");
+    check(att.state.accel_rejects > 0, "flip: hit not rejected");
+    check(abs(abs(att.state.roll) - 18000) < 300, "flip: roll");
+    printf("flip,1500 dps,detected %.0f ms in,landed at %.0f ms\n",
+           detect * 1000.0 / RATE_HZ, flip_ticks * 1000.0 / RATE_HZ);
+
+    /* The world's yaw is the other way round in the robot's frame now. */
+    gyro[0] = gyro[1] = 0;
+    gyro[2] = 100000;
+    check(abs(attitude_yaw_rate(&att, gyro) + 100000) < 2000,
+          "flip: yaw rate");
+
+    /* Landing upside down is picked up at once from a reset. */
+    init(&att);
+    accel[0] = 0;
+    accel[1] = 30;
+    accel[2] = -990;
+    attitude_reset(&att, accel);
+    check(att.state.inverted, "flip: reset");
+}
+
+/**
+ * @brief Sat on its side, right on the threshold, it mustn't keep flipping
+ * the controls over.
+ */
+static void check_chatter(void)
+{
+    struct attitude att;
+    struct robot robot;
+
+    init(&att);
+    robot_init(&robot, 90);
+    robot.gyro_noise = 20;
+    robot.accel_noise = 200;
+    run(&att, &robot, 10 * RATE_HZ);
+
+    check(att.state.flips == 0, "chatter: flipped on its side");
+
+    /* Rocking across the threshold for a few ms at a time doesn't count
+     * either. */
+    init(&att);
+    robot_init(&robot, 100);
+    run(&att, &robot, RATE_HZ);
+    for (int r = 0; r < 100; r++) {
+        robot.rate[0] = (r & 1) ? -400 : 400;
+        run(&att, &robot, 3);
+    }
+    check(att.state.flips == 0, "chatter: rocking");
+}
+
+static volatile int32_t sink;
+
+static void bench(void)
+{
+    const unsigned reps = 5000000;
+    struct attitude att;
+    int32_t gyro[256][3], accel[256][3];
+    double start, ns;
+
+    for (int i = 0; i < 256; i++) {
+        for (int a = 0; a < 3; a++) {
+            gyro[i][a] = (int32_t)(rng() % 200000) - 100000;
+            accel[i][a] = (int32_t)(rng() % 1000) - 500;
+        }
+    }
+
+    init(&att);
+
+    start = now_s();
+    for (unsigned r = 0; r < reps; r++) {
+        attitude_update(&att, gyro[r & 255], accel[r & 255]);
+        sink = att.state.roll;
+    }
+    ns = (now_s() - start) * 1e9 / reps;
+
+    printf("update,%.1f ns/tick\n", ns);
+}
+
+int main(void)
+{
+    check_atan2();
+    check_static();
+    check_flip();
+    check_chatter();
+    bench();
+
+    printf("%s\n", fails ? "FAILED" : "OK");
+
+    return fails ? 1 : 0;
+}
@@ -0,0 +1,183 @@
+/*
+ * Host-side checks for the battery monitor: the voltage and current
+ * against a float model of the divider and sensor, how much the filter
+ * takes out of a noisy reading and how fast it follows a sag, and the
+ * lowest voltage and highest current it keeps.
+ *
+ * The ADC's simulated the way the firmware uses it: a 12 bit reading of
+ * each channel every interval, with noise on it.
+ *
+ * Build and run from the firmware directory:
+ *
+ *     cc -O2 -Isrc -o battery_test tools/battery_test/battery_test.c \
+ *         src/battery_monitor.c -lm
+ *     ./battery_test
+ *
+ * The exit code is non-zero if any check fails.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../bench.h"
+#include "battery_monitor.h"
+
+/* The board's: 10k over 1k5, and a 40 mV/A hall sensor centred on half
+ * the reference. */
+static const struct battery_monitor_config board = {
+    .vref_mv = 3300,
+    .resolution = 12,
+    .full_ohms = 11500,
+    .output_ohms = 1500,
+    .current_zero_mv = 1650,
+    .current_mv_per_amp = 40,
+    .interval_us = 2000,
+    .tau_us = 20000,
+};
+
+/**
+ * @brief What the ADC reads for a pack voltage and current, with up to
+ * noise counts either way.
+ */
+static uint16_t adc_voltage(double mv, int noise)
+{
+    double pin = mv * board.output_ohms / board.full_ohms;
+    int raw = lround(pin * 4096 / board.vref_mv);
+
+    if (noise)
+        raw += (int)(rng() % (2 * noise + 1)) - noise;
+
+    return raw < 0 ? 0 : (raw > 4095 ? 4095 : raw);
+}
+
+static uint16_t adc_current(double ma, int noise)
+{
+    double pin = board.current_zero_mv + ma * board.current_mv_per_amp / 1000;
+    int raw = lround(pin * 4096 / board.vref_mv);
+
+    if (noise)
+        raw += (int)(rng() % (2 * noise + 1)) - noise;
+
+    return raw < 0 ? 0 : (raw > 4095 ? 4095 : raw);
+}
+
+/**
+ * @brief Steady readings come out as the divider and sensor say, to
+ * within a count.
+ */
+static void check_scale(void)
+{
+    struct battery_monitor_config none = board;
+    struct battery_monitor mon;
+    struct battery_reading reading;
+    /* One count at the pin is this much at the pack, and in current. */
+    const double count_mv = 3300.0 / 4096 * 11500 / 1500;
+    const double count_ma = 3300.0 / 4096 / 40 * 1000;
+    double worst_mv = 0, worst_ma = 0;
+
+    battery_monitor_init(&mon, &board);
+    battery_monitor_get(&mon, &reading);
+    check(reading.mv == 0 && reading.ma == 0, "scale: before a reading");
+
+    for (int mv = 6000; mv <= 25000; mv += 100) {
+        uint16_t v = adc_voltage(mv, 0);
+        double expect = v * 3300.0 / 4096 * 11500 / 1500;
+
+        battery_monitor_init(&mon, &board);
+        battery_monitor_sample(&mon, v, adc_current(0, 0));
+        battery_monitor_get(&mon, &reading);
+        worst_mv = fmax(worst_mv, fabs(reading.mv - expect));
+    }
+
+    for (int ma = -20000; ma <= 40000; ma += 250) {
+        uint16_t c = adc_current(ma, 0);
+        double expect = (c * 3300.0 / 4096 - 1650) / 40 * 1000;
+
+        battery_monitor_init(&mon, &board);
+        battery_monitor_sample(&mon, adc_voltage(12000, 0), c);
+        battery_monitor_get(&mon, &reading);
+        worst_ma = fmax(worst_ma, fabs(reading.ma - expect));
+    }
+
+    /* Rounded down, at the pin and again at the pack. */
+    check(worst_mv < 1.01, "scale: voltage");
+    check(worst_ma < 1.01, "scale: current");
+
+    /* No sensor, no current. */
+    none.current_mv_per_amp = 0;
+    battery_monitor_init(&mon, &none);
+    battery_monitor_sample(&mon, adc_voltage(12000, 0), 4095);
+    battery_monitor_get(&mon, &reading);
+    check(reading.ma == 0 && mon.stats.max_ma == 0, "scale: no sensor");
+
+    printf("scale,%.1f mV/count,%.1f mA/count,worst %.2f mV,%.2f mA\n",
+           count_mv, count_ma, worst_mv, worst_ma);
+}
+
+/**
+ * @brief A steady pack with noise on the ADC, and a sag when the drive
+ * pulls hard: the noise is filtered out and the sag followed inside a few
+ * time constants.
+ */
+static void check_filter(void)
+{
+    struct battery_monitor mon;
+    struct battery_reading reading;
+    double sum = 0, sum2 = 0, raw_sum2 = 0, mean, sd, raw_sd;
+    int n = 0, settle = -1;
+
+    battery_monitor_init(&mon, &board);
+    for (int i = 0; i < 10000; i++) {
+        uint16_t v = adc_voltage(12000, 8);
+        double raw_mv = v * 3300.0 / 4096 * 11500 / 1500;
+
+        battery_monitor_sample(&mon, v, adc_current(2000, 8));
+        if (i < 1000)
+            continue;
+
+        battery_monitor_get(&mon, &reading);
+        sum += reading.mv;
+        sum2 += (double)reading.mv * reading.mv;
+        raw_sum2 += (raw_mv - 12000) * (raw_mv - 12000);
+        n++;
+    }
+
+    mean = sum / n;
+    sd = sqrt(sum2 / n - mean * mean);
+    raw_sd = sqrt(raw_sum2 / n);
+
+    check(fabs(mean - 12000) < 15, "filter: steady voltage");
+    check(sd < raw_sd / 3, "filter: noise");
+
+    /* A 2 V sag and 30 A draw, held. */
+    for (int i = 0; i < 100; i++) {
+        battery_monitor_sample(&mon, adc_voltage(10000, 8),
+                               adc_current(30000, 8));
+        battery_monitor_get(&mon, &reading);
+        if (settle < 0 && reading.mv < 10000 + 2000 / 20)
+            settle = (i + 1) * board.interval_us;
+    }
+
+    check(settle > 0 && settle <= 4 * (int)board.tau_us, "filter: slow");
+    check(abs((int)reading.mv - 10000) < 30, "filter: sag level");
+    check(abs(reading.ma - 30000) < 150, "filter: sag current");
+    check(mon.stats.min_mv <= reading.mv && mon.stats.min_mv > 9900,
+          "filter: min voltage");
+    check(mon.stats.max_ma >= reading.ma && mon.stats.max_ma < 30500,
+          "filter: max current");
+
+    printf("filter,noise %.1f mV from %.1f mV,sag 95%% in %d us\n", sd,
+           raw_sd, settle);
+}
+
+int main(void)
+{
+    check_scale();
+    check_filter();
+
+    printf("%s\n", fails ? "FAILED" : "OK");
+
+    return fails ? 1 : 0;
+}
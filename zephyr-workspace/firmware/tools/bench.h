@@ -0,0 +1,43 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+/*
+ * What the host tests and benches have in common: counting the checks that
+ * fail, a clock to time things with, and random numbers that are the same
+ * every run. Each one is a single file, so these are all static.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+static int fails;
+
+static inline void check(int ok, const char *what)
+{
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        fails++;
+    }
+}
+
+static uint32_t rng_state = 0x12345678;
+
+static inline uint32_t rng(void)
+{
+    /* xorshift32, so runs are repeatable. */
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static inline double now_s(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#endif /* BENCH_H */
@@ -0,0 +1,540 @@
+/*
+ * Host-side checks and benchmarks for the black box log, on a simulated
+ * NOR flash that can lose power part way through a write or erase.
+ *
+ * Build and run from the firmware directory:
+ *
+ *     cc -O2 -Isrc -o blackbox_bench tools/blackbox_bench/blackbox_bench.c \
+ *         src/blackbox_log.c
+ *     ./blackbox_bench
+ *
+ * The exit code is non-zero if any check fails.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../bench.h"
+#include "blackbox_log.h"
+
+#define SECTOR_SIZE 4096
+#define MAX_SECTORS 64
+
+/**
+ * @brief NOR flash: programming only clears bits, and only an erase sets
+ * them again.
+ */
+struct sim
+{
+    uint8_t mem[MAX_SECTORS * SECTOR_SIZE];
+    uint32_t erases[MAX_SECTORS];
+    /* Programming a bit that wasn't erased. */
+    uint32_t overwrites;
+
+    /* Octets until the power goes, or -1. What's left of the write is
+     * scrambled, and the erase it lands in is left part done. */
+    int32_t power;
+    bool dead;
+};
+
+static int sim_read(void *ctx, uint32_t offset, void *buf, size_t len)
+{
+    struct sim *sim = ctx;
+
+    memcpy(buf, &sim->mem[offset], len);
+    return 0;
+}
+
+static int sim_write(void *ctx, uint32_t offset, const void *buf, size_t len)
+{
+    struct sim *sim = ctx;
+    const uint8_t *src = buf;
+
+    if (sim->dead)
+        return -EIO;
+
+    for (size_t i = 0; i < len; i++) {
+        uint8_t v = src[i];
+
+        if (sim->power >= 0 && sim->power-- == 0) {
+            sim->dead = true;
+            /* Whatever got into the cells, for the rest of the page. */
+            for (; i < len; i++) sim->mem[offset + i] &= rng();
+            return -EIO;
+        }
+
+        if (v & ~sim->mem[offset + i])
+            sim->overwrites++;
+        sim->mem[offset + i] &= v;
+    }
+
+    return 0;
+}
+
+static int sim_erase(void *ctx, uint32_t offset, size_t len)
+{
+    struct sim *sim = ctx;
+
+    if (sim->dead)
+        return -EIO;
+
+    for (size_t s = 0; s < len; s += SECTOR_SIZE) {
+        sim->erases[(offset + s) / SECTOR_SIZE]++;
+
+        if (sim->power >= 0 && (sim->power -= SECTOR_SIZE) < 0) {
+            /* Half erased. */
+            sim->dead = true;
+            for (size_t i = 0; i < SECTOR_SIZE; i += 2)
+                sim->mem[offset + s + i] = 0xff;
+            return -EIO;
+        }
+
+        memset(&sim->mem[offset + s], 0xff, SECTOR_SIZE);
+    }
+
+    return 0;
+}
+
+static struct sim sim;
+
+static struct blackbox_flash flash = {
+    .ctx = &sim,
+    .read = sim_read,
+    .write = sim_write,
+    .erase = sim_erase,
+    .sector_size = SECTOR_SIZE,
+};
+
+static void sim_init(uint32_t sectors)
+{
+    memset(&sim, 0, sizeof(sim));
+    /* Straight from the factory. */
+    memset(sim.mem, 0xff, sizeof(sim.mem));
+    sim.power = -1;
+    flash.size = sectors * SECTOR_SIZE;
+}
+
+/**
+ * @brief Power back on.
+ */
+static void sim_restore(void)
+{
+    sim.power = -1;
+    sim.dead = false;
+}
+
+/**
+ * @brief What the robot logs: channels, drive and link at 250 Hz, and the
+ * IMU every 4th tick.
+ */
+struct stream
+{
+    uint32_t rc_us;
+    uint32_t imu_us;
+    int32_t stick[2];
+};
+
+static void stream_next(struct stream *st, struct blackbox_record *rec)
+{
+    static unsigned rc_phase;
+
+    memset(rec, 0, sizeof(*rec));
+
+    if (st->imu_us < st->rc_us) {
+        rec->type = BLACKBOX_IMU;
+        rec->time_us = st->imu_us;
+        for (int i = 0; i < 3; i++) {
+            rec->v[i] = (int32_t)(rng() % 2001) - 1000;
+            rec->v[3 + i] = (i == 2 ? 1000 : 0) + (int32_t)(rng() % 41) - 20;
+        }
+        st->imu_us += 4 * 1000000 / 553;
+        return;
+    }
+
+    rec->time_us = st->rc_us;
+
+    switch (rc_phase++ % 3) {
+    case 0:
+        rec->type = BLACKBOX_CHANNELS;
+        /* Sticks wander, the switches sit still. */
+        for (int s = 0; s < 2; s++) {
+            st->stick[s] += (int32_t)(rng() % 9) - 4;
+            st->stick[s] = st->stick[s] < -800 ? -800 : st->stick[s];
+            st->stick[s] = st->stick[s] > 800 ? 800 : st->stick[s];
+        }
+        for (int i = 0; i < 16; i++) rec->v[i] = 992;
+        rec->v[1] = 992 + st->stick[1];
+        rec->v[2] = 992 + st->stick[0];
+        rec->v[7] = 1811;
+        break;
+
+    case 1:
+        rec->type = BLACKBOX_DRIVE;
+        for (int i = 0; i < 4; i++)
+            rec->v[i] = st->stick[i / 2] * (20000000 / 800);
+        rec->v[4] = 0;
+        rec->v[5] = 1;
+        break;
+
+    default:
+        rec->type = BLACKBOX_LINK;
+        rec->v[0] = 4000 + (int32_t)(rng() % 21) - 10;
+        rec->v[1] = 300 + (int32_t)(rng() % 101) - 50;
+        st->rc_us += 4000;
+        break;
+    }
+}
+
+/**
+ * @brief Anything goes, including jumps right across the range.
+ */
+static void random_record(struct blackbox_record *rec, uint32_t *time_us)
+{
+    memset(rec, 0, sizeof(*rec));
+    rec->type = rng() % BLACKBOX_TYPE_COUNT;
+    *time_us += (rng() & 7) ? rng() % 5000 : rng();
+    rec->time_us = *time_us;
+    for (int i = 0; i < blackbox_fields[rec->type]; i++) {
+        switch (rng() % 4) {
+        case 0:
+            rec->v[i] = (int32_t)rng();
+            break;
+        case 1:
+            rec->v[i] = (rng() & 1) ? INT32_MAX : INT32_MIN;
+            break;
+        default:
+            rec->v[i] = (int32_t)(rng() % 64) - 32;
+            break;
+        }
+    }
+}
+
+static bool same(const struct blackbox_record *a,
+                 const struct blackbox_record *b)
+{
+    return a->type == b->type && a->time_us == b->time_us &&
+           !memcmp(a->v, b->v, blackbox_fields[a->type] * sizeof(a->v[0]));
+}
+
+struct found_page
+{
+    uint32_t offset;
+    struct blackbox_page_info info;
+};
+
+static int by_seq(const void *a, const void *b)
+{
+    const struct found_page *pa = a, *pb = b;
+
+    return pa->info.seq < pb->info.seq ? -1 : pa->info.seq > pb->info.seq;
+}
+
+/**
+ * @brief Read back every good page in the flash, oldest first, the way a
+ * dump tool would.
+ *
+ * @return Number of records.
+ */
+static size_t read_back(struct blackbox_record *out, size_t max,
+                        uint32_t *pages, uint32_t *bad)
+{
+    static struct found_page found[MAX_SECTORS * SECTOR_SIZE /
+                                   BLACKBOX_PAGE_SIZE];
+    size_t n = 0, count = 0;
+
+    *bad = 0;
+    for (uint32_t off = 0; off < flash.size; off += BLACKBOX_PAGE_SIZE) {
+        const uint8_t *page = &sim.mem[off];
+        struct blackbox_page_info info;
+        bool blank = true;
+
+        if (blackbox_page_check(page, &info)) {
+            found[n].offset = off;
+            found[n++].info = info;
+            continue;
+        }
+
+        for (int i = 0; i < BLACKBOX_PAGE_SIZE; i++) blank &= page[i] == 0xff;
+        *bad += !blank;
+    }
+
+    qsort(found, n, sizeof(found[0]), by_seq);
+
+    for (size_t p = 0; p < n; p++) {
+        struct blackbox_reader reader;
+        struct blackbox_record rec;
+
+        blackbox_reader_init(&reader, &sim.mem[found[p].offset]);
+        while (blackbox_reader_next(&reader, &rec)) {
+            if (count < max)
+                out[count] = rec;
+            count++;
+        }
+    }
+
+    *pages = n;
+    return count;
+}
+
+static void check_ring(void)
+{
+    struct blackbox_record buf[8], rec = {0};
+    const struct blackbox_record *got;
+    struct blackbox_ring ring;
+    uint32_t pushed = 0, popped = 0;
+    bool ok = true;
+
+    blackbox_ring_init(&ring, buf, 8);
+    check(blackbox_ring_peek(&ring) == NULL, "ring: not empty");
+
+    for (int i = 0; i < 8; i++) {
+        rec.time_us = pushed++;
+        check(blackbox_ring_push(&ring, &rec), "ring: push");
+    }
+    rec.time_us = 99;
+    check(!blackbox_ring_push(&ring, &rec), "ring: overfilled");
+    check(ring.dropped == 1, "ring: drop count");
+
+    /* Round and round, never letting it fill. */
+    for (int i = 0; i < 1000; i++) {
+        got = blackbox_ring_peek(&ring);
+        ok &= got && got->time_us == popped++;
+        blackbox_ring_pop(&ring);
+
+        rec.time_us = pushed++;
+        ok &= blackbox_ring_push(&ring, &rec);
+    }
+    while ((got = blackbox_ring_peek(&ring))) {
+        ok &= got->time_us == popped++;
+        blackbox_ring_pop(&ring);
+    }
+
+    check(ok && popped == pushed, "ring: order");
+}
+
+static struct blackbox_record want[200000], got[200000];
+
+static void check_roundtrip(void)
+{
+    struct blackbox_log log;
+    uint32_t time_us = 0, pages, bad;
+    size_t n = 5000, count;
+    bool ok = true;
+
+    sim_init(MAX_SECTORS);
+    check(blackbox_log_mount(&log, &flash) == 0, "roundtrip: mount");
+    check(log.session == 0 && log.next == 0, "roundtrip: not a new log");
+
+    for (size_t i = 0; i < n; i++) {
+        random_record(&want[i], &time_us);
+        ok &= blackbox_log_append(&log, &want[i]) == 0;
+    }
+    ok &= blackbox_log_flush(&log) == 0;
+    check(ok, "roundtrip: append");
+
+    count = read_back(got, n, &pages, &bad);
+    check(count == n && bad == 0, "roundtrip: record count");
+    for (size_t i = 0; ok && i < count; i++) ok &= same(&want[i], &got[i]);
+    check(ok, "roundtrip: records differ");
+    check(sim.overwrites == 0, "roundtrip: wrote over unerased flash");
+
+    printf("roundtrip,random,%.1f octets/record\n",
+           (double)pages * BLACKBOX_PAGE_SIZE / n);
+}
+
+/**
+ * @brief How long the flash lasts with what the robot really logs.
+ */
+static void check_density(void)
+{
+    struct blackbox_log log;
+    struct blackbox_record rec;
+    struct stream st = {0};
+    uint32_t pages, bad;
+    size_t n = 0, count;
+    bool ok = true;
+
+    sim_init(MAX_SECTORS);
+    blackbox_log_mount(&log, &flash);
+
+    while (st.rc_us < 60 * 1000000 && n < sizeof(want) / sizeof(want[0])) {
+        stream_next(&st, &rec);
+        want[n++] = rec;
+        ok &= blackbox_log_append(&log, &rec) == 0;
+    }
+    blackbox_log_flush(&log);
+
+    count = read_back(got, n, &pages, &bad);
+    /* The flash is smaller than a minute's worth, so only the end of it is
+     * still there. */
+    for (size_t i = 0; ok && i < count; i++)
+        ok &= same(&want[n - count + i], &got[i]);
+    check(ok && count > 0, "density: records differ");
+
+    printf("density,%.1f octets/record,%.0f octets/s,%.0f s in 4 MiB\n",
+           (double)log.stats.pages * BLACKBOX_PAGE_SIZE / n,
+           (double)log.stats.pages * BLACKBOX_PAGE_SIZE / 60,
+           4194304.0 / (log.stats.pages * BLACKBOX_PAGE_SIZE / 60.0));
+}
+
+/**
+ * @brief Cut the power at every point in a flush, in the middle of a page
+ * and at the start of a sector, and check nothing that was already written
+ * is lost, either then or after the next session.
+ */
+static void check_power_cut(void)
+{
+    struct blackbox_log log;
+    struct blackbox_record rec;
+    uint32_t time_us = 0, pages, bad;
+    size_t count, before;
+    int cuts = 0;
+    bool ok = true;
+
+    for (int point = 0; point < 2 * SECTOR_SIZE + 600; point += 97) {
+        /* Start the session so the cut lands on a sector boundary half the
+         * time. */
+        uint32_t lead = (point & 1) ? 3 : SECTOR_SIZE / BLACKBOX_PAGE_SIZE - 1;
+        uint16_t session;
+
+        sim_init(8);
+        blackbox_log_mount(&log, &flash);
+        for (uint32_t p = 0; p < lead;) {
+            random_record(&rec, &time_us);
+            blackbox_log_append(&log, &rec);
+            p = log.stats.pages;
+        }
+        blackbox_log_flush(&log);
+        before = read_back(got, 0, &pages, &bad);
+
+        /* The power goes during the next write. */
+        sim.power = point;
+        while (!sim.dead) {
+            random_record(&rec, &time_us);
+            blackbox_log_append(&log, &rec);
+        }
+        sim_restore();
+        cuts++;
+
+        count = read_back(got, 0, &pages, &bad);
+        ok &= count >= before && bad <= 1;
+
+        /* Carry on after it in a new session. */
+        session = log.session;
+        blackbox_log_mount(&log, &flash);
+        ok &= log.session == session + 1;
+        before = count;
+        for (int i = 0; i < 500; i++) {
+            random_record(&rec, &time_us);
+            ok &= blackbox_log_append(&log, &rec) == 0;
+        }
+        blackbox_log_flush(&log);
+        count = read_back(got, 0, &pages, &bad);
+        ok &= count == before + 500 && bad <= 1;
+        ok &= sim.overwrites == 0;
+
+        /* And the one after that still finds the end. */
+        session = log.session;
+        blackbox_log_mount(&log, &flash);
+        ok &= log.session == session + 1;
+    }
+
+    check(ok, "power cut: lost data");
+    printf("power cut,%d cuts survived\n", cuts);
+}
+
+/**
+ * @brief Go round the flash a few times, with a reboot now and then, and
+ * check every sector has been erased the same number of times.
+ */
+static void check_wear(void)
+{
+    const uint32_t sectors = 16;
+    struct blackbox_log log;
+    struct blackbox_record rec;
+    struct blackbox_page_info info;
+    uint32_t time_us = 0, lo = UINT32_MAX, hi = 0, last_seq = 0, n = 0;
+    bool ok = true;
+
+    sim_init(sectors);
+    blackbox_log_mount(&log, &flash);
+
+    while (log.stats.pages + n < 10 * sectors * SECTOR_SIZE /
+                                     BLACKBOX_PAGE_SIZE) {
+        random_record(&rec, &time_us);
+        ok &= blackbox_log_append(&log, &rec) == 0;
+
+        if (rng() % 20000 == 0) {
+            blackbox_log_flush(&log);
+            n += log.stats.pages;
+            blackbox_log_mount(&log, &flash);
+        }
+    }
+    blackbox_log_flush(&log);
+    check(ok, "wear: append");
+
+    for (uint32_t s = 0; s < sectors; s++) {
+        lo = sim.erases[s] < lo ? sim.erases[s] : lo;
+        hi = sim.erases[s] > hi ? sim.erases[s] : hi;
+    }
+    check(hi - lo <= 1, "wear: uneven");
+
+    /* The pages are in order all the way round, apart from where it's up
+     * to. */
+    n = 0;
+    for (uint32_t off = 0; off < flash.size; off += BLACKBOX_PAGE_SIZE) {
+        if (!blackbox_page_check(&sim.mem[off], &info))
+            continue;
+        n += off && info.seq != last_seq + 1;
+        last_seq = info.seq;
+    }
+    check(n <= 1, "wear: pages out of order");
+    check(sim.overwrites == 0, "wear: wrote over unerased flash");
+
+    printf("wear,%u-%u erases per sector\n", lo, hi);
+}
+
+static volatile uint32_t sink;
+
+static void bench(void)
+{
+    struct blackbox_log log;
+    struct blackbox_record rec[1024];
+    struct stream st = {0};
+    const unsigned reps = 2000000;
+    double start, ns;
+
+    for (int i = 0; i < 1024; i++) stream_next(&st, &rec[i]);
+
+    sim_init(MAX_SECTORS);
+    blackbox_log_mount(&log, &flash);
+
+    start = now_s();
+    for (unsigned r = 0; r < reps; r++) {
+        /* Keep the times going forward across the wrap. */
+        rec[r & 1023].time_us += (r & 1023) ? 0 : 4096 * 1000;
+        blackbox_log_append(&log, &rec[r & 1023]);
+    }
+    ns = (now_s() - start) * 1e9 / reps;
+    sink = log.seq;
+
+    printf("append,%.1f ns/record,including %u page writes\n", ns,
+           log.stats.pages);
+}
+
+int main(void)
+{
+    check_ring();
+    check_roundtrip();
+    check_density();
+    check_power_cut();
+    check_wear();
+    bench();
+
+    printf("%s\n", fails ? "FAILED" : "OK");
+
+    return fails ? 1 : 0;
+}
@@ -0,0 +1,548 @@
+/*
+ * Host-side benchmarks and checks for the CSRF frame parser and channel
+ * unpacking.
+ *
+ * Build and run from the firmware directory:
+ *
+ *     cc -O2 -Idrivers/misc/csrf -o csrf_bench \
+ *         tools/csrf_bench/csrf_bench.c drivers/misc/csrf/csrf_parser.c \
+ *         drivers/misc/csrf/csrf_channels.c drivers/misc/csrf/csrf_crc.c
+ *     ./csrf_bench
+ *
+ * Adding -fsanitize=address,undefined is worthwhile when changing the
+ * parser. The exit code is non-zero if any check fails.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../bench.h"
+#include "csrf_channels.h"
+#include "csrf_parser.h"
+
+/* An octet takes 10 bits on the wire at 420 kbaud. */
+#define OCTET_NS (10 * 1000000000ull / 420000)
+
+#define RC_FRAME_LEN (2 + 1 + 22 + 1)
+
+static unsigned frames_seen;
+
+static void handle_rc(void *user_data, const struct csrf_frame *frame)
+{
+    (void)user_data;
+    (void)frame;
+    frames_seen++;
+}
+
+static const struct csrf_frame_handler handlers[] = {
+    {CSRF_FRAME_RC_CHANNELS, 22, 22, handle_rc},
+};
+
+static size_t make_rc_frame(uint8_t *buf, uint8_t addr)
+{
+    buf[0] = addr;
+    buf[1] = RC_FRAME_LEN - 2;
+    buf[2] = CSRF_FRAME_RC_CHANNELS;
+    for (int i = 0; i < 22; i++) buf[3 + i] = rng();
+    buf[RC_FRAME_LEN - 1] = csrf_crc8(&buf[2], RC_FRAME_LEN - 3);
+
+    return RC_FRAME_LEN;
+}
+
+/**
+ * @brief Feed a stream in chunks of random sizes, like the UART would.
+ */
+static void feed_chunked(struct csrf_parser *parser, const uint8_t *buf,
+                         size_t len, size_t max_chunk)
+{
+    size_t i = 0;
+
+    while (i < len) {
+        size_t n = 1 + rng() % max_chunk;
+
+        if (n > len - i)
+            n = len - i;
+
+        csrf_parser_feed(parser, &buf[i], n, 0);
+        i += n;
+    }
+}
+
+static void bench_throughput(void)
+{
+    static const uint8_t addrs[] = {CSRF_ADDR_FLIGHT_CONTROLLER,
+                                    CSRF_ADDR_RADIO_TRANSMITTER,
+                                    CSRF_ADDR_CRSF_TRANSMITTER};
+    const unsigned num_frames = 4096;
+    const unsigned reps = 200;
+    struct csrf_parser parser;
+    uint8_t *stream = malloc(num_frames * RC_FRAME_LEN);
+    size_t len = 0;
+    double start, elapsed;
+
+    for (unsigned i = 0; i < num_frames; i++)
+        len += make_rc_frame(&stream[len], addrs[i % 3]);
+
+    csrf_parser_init(&parser, handlers, 1, NULL, NULL);
+    frames_seen = 0;
+
+    /* One frame per chunk, as the idle-line interrupt delivers them. */
+    start = now_s();
+    for (unsigned r = 0; r < reps; r++) {
+        for (size_t i = 0; i < len; i += RC_FRAME_LEN)
+            csrf_parser_feed(&parser, &stream[i], RC_FRAME_LEN, 0);
+    }
+    elapsed = now_s() - start;
+
+    check(frames_seen == num_frames * reps, "throughput: frames lost");
+    printf("throughput,frame_per_chunk,%.0f frames/s\n",
+           num_frames * reps / elapsed);
+
+    /* Random chunking exercises the stitching path. */
+    frames_seen = 0;
+    start = now_s();
+    for (unsigned r = 0; r < reps; r++)
+        feed_chunked(&parser, stream, len, 16);
+    elapsed = now_s() - start;
+
+    check(frames_seen == num_frames * reps, "throughput: chunked frames lost");
+    printf("throughput,chunked,%.0f frames/s\n", num_frames * reps / elapsed);
+
+    free(stream);
+}
+
+/**
+ * @brief Measure how long it takes to find the next good frame after a
+ * burst of noise, in octets and in time on the wire.
+ */
+static void bench_resync(void)
+{
+    const unsigned trials = 20000;
+    unsigned long total_octets = 0;
+    unsigned worst_octets = 0;
+    unsigned lost = 0;
+
+    for (unsigned t = 0; t < trials; t++) {
+        struct csrf_parser parser;
+        uint8_t stream[16 + 64 + 4 * RC_FRAME_LEN];
+        size_t len = 0, good_start;
+        size_t noise = 1 + rng() % 64;
+
+        csrf_parser_init(&parser, handlers, 1, NULL, NULL);
+
+        /* A frame, a burst of noise with plenty of fake sync bytes and then
+         * the good frames we're trying to recover. */
+        len += make_rc_frame(&stream[len], CSRF_ADDR_FLIGHT_CONTROLLER);
+        for (size_t i = 0; i < noise; i++) {
+            stream[len++] = (rng() % 4) ? rng() : CSRF_ADDR_FLIGHT_CONTROLLER;
+        }
+
+        good_start = len;
+        for (int i = 0; i < 3; i++)
+            len += make_rc_frame(&stream[len], CSRF_ADDR_FLIGHT_CONTROLLER);
+
+        /* Feed an octet at a time so we know when the frame comes out. */
+        frames_seen = 0;
+        size_t i;
+        for (i = 0; i < len; i++) {
+            csrf_parser_feed(&parser, &stream[i], 1, 0);
+            if (frames_seen >= 2)
+                break;
+        }
+
+        if (frames_seen < 2) {
+            lost++;
+            continue;
+        }
+
+        /* Octets past the end of the first good frame after the noise. */
+        unsigned octets = i + 1 - (good_start + RC_FRAME_LEN);
+        total_octets += octets;
+        if (octets > worst_octets)
+            worst_octets = octets;
+    }
+
+    printf("resync,mean,%.1f octets,%.1f us\n",
+           (double)total_octets / (trials - lost),
+           (double)total_octets / (trials - lost) * OCTET_NS / 1000);
+    printf("resync,worst,%u octets,%.1f us\n", worst_octets,
+           worst_octets * OCTET_NS / 1000.0);
+    printf("resync,frames_lost,%u of %u\n", lost, trials);
+}
+
+/* Each frame's sync stamp, in the order they came out. */
+static uint32_t stamps[64];
+static unsigned num_stamps;
+
+static void handle_rc_stamp(void *user_data, const struct csrf_frame *frame)
+{
+    (void)user_data;
+    if (num_stamps < 64)
+        stamps[num_stamps++] = frame->sync_stamp;
+}
+
+static const struct csrf_frame_handler stamp_handlers[] = {
+    {CSRF_FRAME_RC_CHANNELS, 22, 22, handle_rc_stamp},
+};
+
+/**
+ * @brief Check each frame's sync stamp is when its sync byte arrived,
+ * worked out from the chunk's stamp, however the stream's chopped up and
+ * after a fake frame has to be searched again.
+ */
+static void check_stamps(void)
+{
+    const uint32_t octet_time = 7;
+    const uint32_t base = 0xfffff000;
+    uint8_t stream[32 * (2 + RC_FRAME_LEN)];
+    uint32_t want[32];
+    struct csrf_parser parser;
+    size_t len = 0, i = 0;
+
+    for (int f = 0; f < 32; f++) {
+        /* A sync and length that start a frame that can't pass its CRC,
+         * with the real frame inside it. */
+        if (f % 3 == 1) {
+            stream[len++] = CSRF_ADDR_FLIGHT_CONTROLLER;
+            stream[len++] = RC_FRAME_LEN - 2;
+        }
+        want[f] = base + len * octet_time;
+        len += make_rc_frame(&stream[len], CSRF_ADDR_FLIGHT_CONTROLLER);
+    }
+
+    csrf_parser_init(&parser, stamp_handlers, 1, NULL, NULL);
+    csrf_parser_set_octet_time(&parser, octet_time);
+    num_stamps = 0;
+
+    while (i < len) {
+        size_t n = 1 + rng() % 40;
+
+        if (n > len - i)
+            n = len - i;
+
+        csrf_parser_feed(&parser, &stream[i], n, base + i * octet_time);
+        i += n;
+    }
+
+    check(num_stamps == 32, "stamps: frames lost");
+    for (unsigned f = 0; f < num_stamps && f < 32; f++)
+        check(stamps[f] == want[f], "stamps: sync stamp");
+}
+
+/* Every payload the fuzzer gets back from the parser. */
+static uint8_t delivered[80][22];
+static unsigned num_delivered;
+
+static void handle_rc_fuzz(void *user_data, const struct csrf_frame *frame)
+{
+    (void)user_data;
+    if (num_delivered < 80)
+        memcpy(delivered[num_delivered++], frame->payload, 22);
+}
+
+static const struct csrf_frame_handler fuzz_handlers[] = {
+    {CSRF_FRAME_RC_CHANNELS, 22, 22, handle_rc_fuzz},
+};
+
+/**
+ * @brief Throw corrupted streams at the parser.
+ *
+ * Every untouched frame should come out, unless misframed data happened to
+ * pass the CRC and swallowed it. An 8-bit CRC lets about 1 in 256 misframed
+ * candidates through, so those false accepts are counted rather than
+ * treated as failures.
+ */
+static void fuzz(void)
+{
+    const unsigned trials = 2000;
+    unsigned long sent = 0, lost = 0, false_accepts = 0, corrupted = 0;
+
+    for (unsigned t = 0; t < trials; t++) {
+        struct csrf_parser parser;
+        uint8_t stream[67 * RC_FRAME_LEN];
+        size_t starts[67];
+        uint8_t corrupt[67] = {0};
+        size_t len = 0;
+        unsigned trial_lost = 0, trial_false = 0;
+
+        for (int f = 0; f < 64; f++) {
+            size_t start = len;
+
+            starts[f] = start;
+            len += make_rc_frame(&stream[len], CSRF_ADDR_FLIGHT_CONTROLLER);
+
+            switch (rng() % 8) {
+                case 0:
+                    /* Flip a bit. */
+                    stream[start + rng() % RC_FRAME_LEN] ^= 1 << (rng() % 8);
+                    corrupt[f] = 1;
+                    break;
+                case 1:
+                    /* Truncate the frame. */
+                    len = start + 1 + rng() % (RC_FRAME_LEN - 1);
+                    corrupt[f] = 1;
+                    break;
+                default:
+                    break;
+            }
+
+            corrupted += corrupt[f];
+        }
+
+        /* The link carries on after the frames we're checking, so a bogus
+         * length at the end doesn't leave the last good frame stuck. */
+        for (int f = 64; f < 67; f++) {
+            starts[f] = len;
+            len += make_rc_frame(&stream[len], CSRF_ADDR_FLIGHT_CONTROLLER);
+        }
+
+        csrf_parser_init(&parser, fuzz_handlers, 1, NULL, NULL);
+        num_delivered = 0;
+        feed_chunked(&parser, stream, len, 32);
+
+        for (unsigned d = 0; d < num_delivered; d++) {
+            int found = 0;
+
+            for (int f = 0; f < 67 && !found; f++) {
+                found = !corrupt[f] &&
+                        !memcmp(delivered[d], &stream[starts[f] + 3], 22);
+            }
+            trial_false += !found;
+        }
+
+        /* Misframed data with some other type can pass the CRC too. */
+        trial_false += parser.stats.unhandled;
+
+        for (int f = 0; f < 64; f++) {
+            int found = 0;
+
+            if (corrupt[f])
+                continue;
+
+            for (unsigned d = 0; d < num_delivered && !found; d++)
+                found = !memcmp(delivered[d], &stream[starts[f] + 3], 22);
+
+            sent++;
+            trial_lost += !found;
+        }
+
+        check(!trial_lost || trial_false, "fuzz: good frame lost");
+
+        lost += trial_lost;
+        false_accepts += trial_false;
+    }
+
+    /* Pure noise shouldn't crash or read out of bounds. */
+    for (unsigned t = 0; t < trials; t++) {
+        struct csrf_parser parser;
+        uint8_t noise[512];
+
+        for (size_t i = 0; i < sizeof(noise); i++) noise[i] = rng();
+
+        csrf_parser_init(&parser, handlers, 1, NULL, NULL);
+        feed_chunked(&parser, noise, sizeof(noise), 64);
+    }
+
+    printf("fuzz,good_frames,%lu sent,%lu lost\n", sent, lost);
+    printf("fuzz,false_accepts,%lu per %lu corrupted frames\n", false_accepts,
+           corrupted);
+}
+
+/**
+ * @brief The channel unpacking loop the driver used to have.
+ */
+static void unpack_loop(const uint8_t *payload, uint16_t *ch)
+{
+    for (int i = 0; i < 16; i++) {
+        uint32_t byte_index = (i * 11) / 8;
+        uint32_t bit_offset = (i * 11) % 8;
+
+        uint16_t val = (payload[byte_index] >> bit_offset) |
+                       (payload[byte_index + 1] << (8 - bit_offset));
+
+        if (bit_offset > 5)
+            val |= payload[byte_index + 2] << (16 - bit_offset);
+
+        ch[i] = val & 0x07ff;
+    }
+}
+
+/**
+ * @brief Reference packer - one bit at a time, LSB first.
+ */
+static void pack_bits(uint8_t *buf, size_t len, const uint16_t *values,
+                      unsigned count, unsigned bits)
+{
+    unsigned pos = 0;
+
+    memset(buf, 0, len);
+    for (unsigned i = 0; i < count; i++) {
+        for (unsigned b = 0; b < bits; b++, pos++) {
+            if (values[i] & (1u << b))
+                buf[pos / 8] |= 1u << (pos % 8);
+        }
+    }
+}
+
+/**
+ * @brief Reference conversion from a subset value to the 11 bit scale.
+ */
+static uint16_t subset_reference(uint32_t v, unsigned bits)
+{
+    double us = 988.0 + v * 1024.0 / (1u << bits);
+    double rc = (us - 881.0) / 0.62477120195241;
+
+    return rc > 2047 ? 2047 : (uint16_t)rc;
+}
+
+static volatile uint16_t unpack_sink;
+
+static void bench_unpack(void)
+{
+    const unsigned reps = 2000000;
+    uint8_t payload[CSRF_RC_CHANNELS_PAYLOAD_LEN];
+    uint8_t packed[CSRF_RC_CHANNELS_PAYLOAD_LEN];
+    uint16_t values[16], ch[16];
+    double start, loop_ns, unrolled_ns;
+    unsigned errors = 0, pack_errors = 0;
+
+    /* Every value in every channel, with random neighbours. */
+    for (int c = 0; c < 16; c++) {
+        for (uint32_t v = 0; v < 2048; v++) {
+            for (int i = 0; i < 16; i++) values[i] = rng() & 0x07ff;
+            values[c] = v;
+
+            pack_bits(payload, sizeof(payload), values, 16, 11);
+            csrf_unpack_rc_channels(payload, ch);
+            errors += memcmp(ch, values, sizeof(ch)) != 0;
+
+            csrf_pack_rc_channels(values, packed);
+            pack_errors += memcmp(packed, payload, sizeof(payload)) != 0;
+        }
+    }
+    check(!errors, "unpack: round trip");
+    check(!pack_errors, "pack: against the reference");
+
+    /* Every resolution, first channel and channel count. */
+    errors = 0;
+    for (unsigned bits = 10; bits <= 13; bits++) {
+        for (unsigned first = 0; first < 16; first++) {
+            for (unsigned count = 1; first + count <= 16; count++) {
+                uint8_t subset[1 + (16 * 13 + 7) / 8];
+                size_t len = 1 + (count * bits + 7) / 8;
+                uint16_t expected[16];
+
+                for (int t = 0; t < 64; t++) {
+                    for (unsigned i = 0; i < count; i++)
+                        values[i] = rng() & ((1u << bits) - 1);
+
+                    /* Make sure we hit both ends of the range. */
+                    if (t == 0)
+                        values[0] = 0;
+                    if (t == 1)
+                        values[0] = (1u << bits) - 1;
+
+                    subset[0] = first | (bits - 10) << 5;
+                    pack_bits(&subset[1], len - 1, values, count, bits);
+
+                    for (int i = 0; i < 16; i++) ch[i] = expected[i] = i;
+                    for (unsigned i = 0; i < count; i++) {
+                        expected[first + i] =
+                            subset_reference(values[i], bits);
+                    }
+
+                    if (csrf_unpack_subset_rc_channels(subset, len, ch) <
+                        (int)count) {
+                        errors++;
+                        continue;
+                    }
+
+                    /* Allow a count either way for the fixed point. */
+                    for (int i = 0; i < 16; i++)
+                        errors += abs(ch[i] - expected[i]) > 1;
+                }
+            }
+        }
+    }
+    check(!errors, "unpack: subset round trip");
+
+    for (size_t i = 0; i < sizeof(payload); i++) payload[i] = rng();
+
+    start = now_s();
+    for (unsigned r = 0; r < reps; r++) {
+        payload[0] = r;
+        unpack_loop(payload, ch);
+        unpack_sink = ch[r & 15];
+    }
+    loop_ns = (now_s() - start) * 1e9 / reps;
+
+    start = now_s();
+    for (unsigned r = 0; r < reps; r++) {
+        payload[0] = r;
+        csrf_unpack_rc_channels(payload, ch);
+        unpack_sink = ch[r & 15];
+    }
+    unrolled_ns = (now_s() - start) * 1e9 / reps;
+
+    printf("unpack,loop,%.1f ns/frame\n", loop_ns);
+    printf("unpack,unrolled,%.1f ns/frame\n", unrolled_ns);
+}
+
+static volatile uint8_t crc_sink;
+
+static void bench_crc_run(const char *name,
+                          uint8_t (*crc8)(const uint8_t *, size_t),
+                          const uint8_t *buf, size_t len)
+{
+    const unsigned reps = 4000000;
+    double start, elapsed;
+
+    start = now_s();
+    for (unsigned r = 0; r < reps; r++) crc_sink = crc8(&buf[r & 1], len);
+    elapsed = now_s() - start;
+
+    printf("crc,%s,%zu octets,%.0f Moctets/s\n", name, len,
+           reps * len / elapsed / 1e6);
+}
+
+/**
+ * @brief Check the software CRC backends agree, and time them. The STM32
+ * CRC unit can only be timed on the robot - see
+ * CONFIG_DAN_CSRF_CRC_BENCHMARK.
+ */
+static void bench_crc(void)
+{
+    uint8_t buf[CSRF_MAX_FRAME_LEN + 1];
+    unsigned errors = 0;
+
+    for (unsigned t = 0; t < 100000; t++) {
+        size_t len = rng() % sizeof(buf);
+
+        for (size_t i = 0; i < len; i++) buf[i] = rng();
+        errors += csrf_crc8_table(buf, len) != csrf_crc8_slice4(buf, len);
+    }
+    check(!errors, "crc: slice-by-4 disagrees with the table");
+
+    for (size_t i = 0; i < sizeof(buf); i++) buf[i] = rng();
+
+    bench_crc_run("table", csrf_crc8_table, buf, 23);
+    bench_crc_run("slice4", csrf_crc8_slice4, buf, 23);
+    bench_crc_run("table", csrf_crc8_table, buf, CSRF_MAX_FRAME_LEN - 1);
+    bench_crc_run("slice4", csrf_crc8_slice4, buf, CSRF_MAX_FRAME_LEN - 1);
+}
+
+int main(void)
+{
+    bench_throughput();
+    bench_resync();
+    check_stamps();
+    fuzz();
+    bench_unpack();
+    bench_crc();
+
+    printf("%s\n", fails ? "FAILED" : "OK");
+
+    return fails ? 1 : 0;
+}
@@ -0,0 +1,276 @@
+/*
+ * Host-side checks for the CRSF parameters: pings, every entry the handset
+ * can read, and writes, good and bad.
+ *
+ * Build and run from the firmware directory:
+ *
+ *     cc -O2 -Isrc -o csrf_params_test \
+ *         tools/csrf_params_test/csrf_params_test.c src/csrf_params.c \
+ *         src/robot_settings.c src/mixer.c
+ *     ./csrf_params_test
+ *
+ * The exit code is non-zero if any check fails.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../bench.h"
+#include "csrf_params.h"
+
+/* The handset, as the ELRS Lua script sends from it. */
+#define HANDSET 0xea
+
+static struct robot_settings settings, defaults;
+
+static const struct csrf_params params = {
+    .addr = CSRF_PARAMS_ADDR_FLIGHT_CONTROLLER,
+    .name = "Combat robot",
+    .settings = &settings,
+    .defaults = &defaults,
+};
+
+static void reset(void)
+{
+    for (int i = 0; i < ROBOT_SETTINGS_COUNT; i++)
+        defaults.v[i] = robot_settings_info[i].min;
+    defaults.v[ROBOT_SETTING_DRIVE_LIMIT] = 100;
+    defaults.v[ROBOT_SETTING_YAW_KP] = 1500;
+    settings = defaults;
+}
+
+static size_t handle(uint8_t type, const uint8_t *payload, size_t len,
+                     uint8_t *reply_type, uint8_t *reply, bool *changed)
+{
+    /* Fill it, so anything left unwritten shows up. */
+    memset(reply, 0xa5, CSRF_PARAMS_MAX_REPLY);
+    *reply_type = 0;
+
+    return csrf_params_handle(&params, type, payload, len, reply_type, reply,
+                              changed);
+}
+
+static uint32_t get_be(const uint8_t **p, int size)
+{
+    uint32_t v = 0;
+
+    while (size--) v = (v << 8) | *(*p)++;
+    return v;
+}
+
+static void check_ping(void)
+{
+    uint8_t reply[CSRF_PARAMS_MAX_REPLY];
+    uint8_t reply_type;
+    bool changed;
+    size_t len;
+    const uint8_t *p;
+
+    reset();
+
+    len = handle(CSRF_FRAME_DEVICE_PING,
+                 (const uint8_t[]){CSRF_PARAMS_ADDR_BROADCAST, HANDSET}, 2,
+                 &reply_type, reply, &changed);
+    check(len > 0 && reply_type == CSRF_FRAME_DEVICE_INFO && !changed,
+          "ping: broadcast not answered");
+    check(reply[0] == HANDSET &&
+              reply[1] == CSRF_PARAMS_ADDR_FLIGHT_CONTROLLER,
+          "ping: addresses");
+    check(!strcmp((const char *)&reply[2], "Combat robot"), "ping: name");
+    p = &reply[2 + strlen("Combat robot") + 1];
+    check(p + 14 == reply + len, "ping: length");
+    p += 12;
+    check(p[0] == ROBOT_SETTINGS_COUNT && p[1] == 0, "ping: count");
+
+    len = handle(CSRF_FRAME_DEVICE_PING,
+                 (const uint8_t[]){CSRF_PARAMS_ADDR_FLIGHT_CONTROLLER,
+                                   HANDSET},
+                 2, &reply_type, reply, &changed);
+    check(len > 0 && reply_type == CSRF_FRAME_DEVICE_INFO,
+          "ping: ours not answered");
+
+    len = handle(CSRF_FRAME_DEVICE_PING, (const uint8_t[]){0xee, HANDSET}, 2,
+                 &reply_type, reply, &changed);
+    check(len == 0, "ping: another device's answered");
+
+    len = handle(CSRF_FRAME_DEVICE_PING, (const uint8_t[]){0}, 1,
+                 &reply_type, reply, &changed);
+    check(len == 0, "ping: short answered");
+}
+
+/**
+ * @brief Read every entry back the way the Lua script does, and check it
+ * against the table.
+ */
+static void check_entries(void)
+{
+    uint8_t reply[CSRF_PARAMS_MAX_REPLY];
+    uint8_t reply_type;
+    bool changed;
+    size_t len;
+    const uint8_t *p;
+    bool ok = true;
+
+    reset();
+
+    /* The folder holding everything else. */
+    len = handle(CSRF_FRAME_PARAMETER_READ,
+                 (const uint8_t[]){CSRF_PARAMS_ADDR_FLIGHT_CONTROLLER,
+                                   HANDSET, 0, 0},
+                 4, &reply_type, reply, &changed);
+    check(len > 0 && len <= CSRF_PARAMS_MAX_REPLY &&
+              reply_type == CSRF_FRAME_PARAMETER_ENTRY,
+          "entries: folder not answered");
+    check(reply[0] == HANDSET && reply[2] == 0 && reply[3] == 0 &&
+              reply[4] == 0 && reply[5] == CSRF_PARAM_FOLDER,
+          "entries: folder header");
+    p = &reply[6] + strlen((const char *)&reply[6]) + 1;
+    for (int i = 1; i <= ROBOT_SETTINGS_COUNT; i++) ok &= *p++ == i;
+    check(ok && *p++ == 0xff && p == reply + len, "entries: folder children");
+
+    for (int id = 1; id <= ROBOT_SETTINGS_COUNT; id++) {
+        const struct robot_setting_info *info = &robot_settings_info[id - 1];
+        int size;
+
+        settings.v[id - 1] = info->max;
+        len = handle(CSRF_FRAME_PARAMETER_READ,
+                     (const uint8_t[]){CSRF_PARAMS_ADDR_FLIGHT_CONTROLLER,
+                                       HANDSET, id, 0},
+                     4, &reply_type, reply, &changed);
+        if (len == 0 || len > CSRF_PARAMS_MAX_REPLY) {
+            printf("FAIL: entries: %s is %zu octets\n", info->name, len);
+            fails++;
+            continue;
+        }
+
+        ok = reply[2] == id && reply[3] == 0 && reply[4] == 0;
+        p = &reply[6];
+        ok &= !strcmp((const char *)p, info->name);
+        p += strlen(info->name) + 1;
+
+        switch (reply[5]) {
+            case CSRF_PARAM_TEXT_SELECTION: {
+                unsigned options = 1;
+
+                for (; *p; p++) options += *p == ';';
+                p++;
+                ok &= info->min == 0 && info->max == options - 1;
+                size = 1;
+                break;
+            }
+            case CSRF_PARAM_UINT8:
+                ok &= info->max <= 0xff;
+                size = 1;
+                break;
+            case CSRF_PARAM_UINT16:
+                ok &= info->max > 0xff;
+                size = 2;
+                break;
+            default:
+                ok = false;
+                size = 1;
+                break;
+        }
+
+        ok &= get_be(&p, size) == info->max;
+        ok &= get_be(&p, size) == info->min;
+        ok &= get_be(&p, size) == info->max;
+        ok &= get_be(&p, size) == defaults.v[id - 1];
+        ok &= !strcmp((const char *)p, info->unit);
+        p += strlen(info->unit) + 1;
+        ok &= p == reply + len;
+
+        if (!ok) {
+            printf("FAIL: entries: %s\n", info->name);
+            fails++;
+        }
+    }
+
+    len = handle(CSRF_FRAME_PARAMETER_READ,
+                 (const uint8_t[]){CSRF_PARAMS_ADDR_FLIGHT_CONTROLLER,
+                                   HANDSET, ROBOT_SETTINGS_COUNT + 1, 0},
+                 4, &reply_type, reply, &changed);
+    check(len == 0, "entries: past the end answered");
+
+    len = handle(CSRF_FRAME_PARAMETER_READ,
+                 (const uint8_t[]){CSRF_PARAMS_ADDR_FLIGHT_CONTROLLER,
+                                   HANDSET, 1, 1},
+                 4, &reply_type, reply, &changed);
+    check(len == 0, "entries: second chunk answered");
+
+    len = handle(CSRF_FRAME_PARAMETER_READ,
+                 (const uint8_t[]){0xee, HANDSET, 1, 0}, 4, &reply_type,
+                 reply, &changed);
+    check(len == 0, "entries: another device's answered");
+}
+
+static bool write_param(uint8_t dest, int setting, const uint8_t *value,
+                        size_t size)
+{
+    uint8_t payload[8] = {dest, HANDSET, setting + 1};
+    uint8_t reply[CSRF_PARAMS_MAX_REPLY];
+    uint8_t reply_type;
+    bool changed;
+
+    memcpy(&payload[3], value, size);
+    check(handle(CSRF_FRAME_PARAMETER_WRITE, payload, 3 + size, &reply_type,
+                 reply, &changed) == 0,
+          "writes: answered");
+
+    return changed;
+}
+
+static void check_writes(void)
+{
+    const uint8_t fc = CSRF_PARAMS_ADDR_FLIGHT_CONTROLLER;
+    struct robot_settings before;
+
+    reset();
+
+    check(write_param(fc, ROBOT_SETTING_DEADBAND, (const uint8_t[]){20}, 1) &&
+              settings.v[ROBOT_SETTING_DEADBAND] == 20,
+          "writes: u8");
+    check(!write_param(fc, ROBOT_SETTING_DEADBAND, (const uint8_t[]){20}, 1),
+          "writes: unchanged value reported");
+    check(write_param(fc, ROBOT_SETTING_FAILSAFE_MS,
+                      (const uint8_t[]){0x03, 0xe8}, 2) &&
+              settings.v[ROBOT_SETTING_FAILSAFE_MS] == 1000,
+          "writes: u16");
+    check(write_param(fc, ROBOT_SETTING_MIX,
+                      (const uint8_t[]){MIXER_MODE_ARCADE}, 1) &&
+              settings.v[ROBOT_SETTING_MIX] == MIXER_MODE_ARCADE,
+          "writes: selection");
+
+    before = settings;
+    check(!write_param(fc, ROBOT_SETTING_DEADBAND, (const uint8_t[]){51}, 1),
+          "writes: out of range taken");
+    check(!write_param(fc, ROBOT_SETTING_FAILSAFE_MS,
+                       (const uint8_t[]){0, 10}, 2),
+          "writes: below range taken");
+    check(!write_param(fc, ROBOT_SETTING_MIX, (const uint8_t[]){2}, 1),
+          "writes: no such option taken");
+    check(!write_param(fc, ROBOT_SETTING_FAILSAFE_MS,
+                       (const uint8_t[]){0x03}, 1),
+          "writes: short taken");
+    check(!write_param(0xee, ROBOT_SETTING_DEADBAND, (const uint8_t[]){5}, 1),
+          "writes: another device's taken");
+    check(!write_param(fc, -1, (const uint8_t[]){5}, 1),
+          "writes: folder taken");
+    check(!write_param(fc, ROBOT_SETTINGS_COUNT, (const uint8_t[]){5}, 1),
+          "writes: past the end taken");
+    check(!memcmp(&before, &settings, sizeof(before)),
+          "writes: bad writes changed something");
+}
+
+int main(void)
+{
+    check_ping();
+    check_entries();
+    check_writes();
+
+    printf("%s\n", fails ? "FAILED" : "OK");
+
+    return fails ? 1 : 0;
+}
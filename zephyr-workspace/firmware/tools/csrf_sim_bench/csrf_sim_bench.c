@@ -0,0 +1,250 @@
+/*
+ * Host-side checks for the simulated ELRS receiver the native_sim build
+ * plays to the driver: its frames go through the real parser and channel
+ * unpacking, on a clean line, with dropouts and with bit errors, to check
+ * it sends what it says it does and that the link quality it reports adds
+ * up. Then timed.
+ *
+ * Build and run from the firmware directory:
+ *
+ *     cc -O2 -Idrivers/misc/csrf -o csrf_sim_bench \
+ *         tools/csrf_sim_bench/csrf_sim_bench.c drivers/misc/csrf/csrf_sim.c \
+ *         drivers/misc/csrf/csrf_parser.c drivers/misc/csrf/csrf_channels.c \
+ *         drivers/misc/csrf/csrf_crc.c
+ *     ./csrf_sim_bench
+ *
+ * The exit code is non-zero if any check fails.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../bench.h"
+#include "csrf_channels.h"
+#include "csrf_parser.h"
+#include "csrf_sim.h"
+
+#define LINK_STATISTICS 0x14
+
+/* What the parser let through. */
+static struct
+{
+    unsigned rc;
+    /* RC frames whose channels aren't the ones sent. */
+    unsigned wrong;
+    unsigned link_stats;
+    unsigned lq_sum;
+} got;
+
+static uint16_t sent_ch[CSRF_NUM_CHANNELS];
+
+static void handle_rc(void *user_data, const struct csrf_frame *frame)
+{
+    uint16_t ch[CSRF_NUM_CHANNELS];
+
+    (void)user_data;
+    csrf_unpack_rc_channels(frame->payload, ch);
+    got.rc++;
+    got.wrong += memcmp(ch, sent_ch, sizeof(ch)) != 0;
+}
+
+static void handle_link_stats(void *user_data, const struct csrf_frame *frame)
+{
+    (void)user_data;
+    got.link_stats++;
+    got.lq_sum += frame->payload[2];
+}
+
+static const struct csrf_frame_handler handlers[] = {
+    {CSRF_FRAME_RC_CHANNELS, 22, 22, handle_rc},
+    {LINK_STATISTICS, 10, 10, handle_link_stats},
+};
+
+/**
+ * @brief Run a receiver for a number of slots into a parser, one slot per
+ * chunk as the idle-line interrupt would deliver them.
+ *
+ * @return The total of the gaps, in us.
+ */
+static uint64_t run(struct csrf_sim *sim, struct csrf_parser *parser,
+                    unsigned slots, uint32_t *min_gap, uint32_t *max_gap)
+{
+    uint8_t buf[CSRF_SIM_MAX_OCTETS];
+    uint64_t total = 0;
+    uint32_t gap;
+    size_t len;
+
+    memset(&got, 0, sizeof(got));
+    csrf_parser_init(parser, handlers, 2, NULL, NULL);
+    *min_gap = UINT32_MAX;
+    *max_gap = 0;
+
+    for (unsigned i = 0; i < slots; i++) {
+        /* A new stick position now and then. */
+        if (i % 7 == 0) {
+            for (int c = 0; c < CSRF_NUM_CHANNELS; c++)
+                sent_ch[c] = (i * 37 + c * 101) & 0x07ff;
+            csrf_sim_set_channels(sim, sent_ch);
+        }
+
+        len = csrf_sim_next(sim, buf, &gap);
+        if (len)
+            csrf_parser_feed(parser, buf, len, 0);
+
+        total += gap;
+        *min_gap = gap < *min_gap ? gap : *min_gap;
+        *max_gap = gap > *max_gap ? gap : *max_gap;
+    }
+
+    return total;
+}
+
+/**
+ * @brief Every frame arrives intact at the rate asked for, with the
+ * channels it was given, and the link's perfect.
+ */
+static void check_clean(void)
+{
+    const struct csrf_sim_config config = {
+        .rate_hz = 500,
+        .jitter_us = 50,
+        .link_stats_interval = 10,
+    };
+    const unsigned slots = 100000;
+    struct csrf_sim sim;
+    struct csrf_parser parser;
+    uint32_t min_gap, max_gap;
+    double rate;
+
+    csrf_sim_init(&sim, &config, 1);
+    rate = slots * 1e6 / run(&sim, &parser, slots, &min_gap, &max_gap);
+
+    check(sim.stats.frames == slots && !sim.stats.dropped,
+          "clean: frames sent");
+    check(got.rc == slots && !got.wrong, "clean: frames received");
+    check(got.link_stats == slots / 10 && got.lq_sum == 100 * got.link_stats,
+          "clean: link statistics");
+    check(!parser.stats.bad_crc && !parser.stats.noise, "clean: noise");
+    check(fabs(rate - 500) < 1, "clean: rate");
+    check(min_gap >= 2000 - 50 && max_gap <= 2000 + 50, "clean: jitter");
+
+    printf("clean,%.1f Hz,gaps %u-%u us,%u octets\n", rate, min_gap,
+           max_gap, sim.stats.octets);
+}
+
+/**
+ * @brief Dropouts lose the share of frames they should, and the link
+ * quality the receiver reports says so.
+ */
+static void check_dropouts(void)
+{
+    const struct csrf_sim_config config = {
+        .rate_hz = 150,
+        .drop_percent = 10,
+        .drop_burst = 4,
+        .link_stats_interval = 25,
+    };
+    const unsigned slots = 200000;
+    struct csrf_sim sim;
+    struct csrf_parser parser;
+    uint32_t min_gap, max_gap;
+    /* A dropout starts after 1 / p - 1 good slots on average, and then
+     * loses drop_burst. */
+    const double expect = 4 / (1 / 0.1 - 1 + 4);
+    double lost, lq;
+
+    csrf_sim_init(&sim, &config, 2);
+    run(&sim, &parser, slots, &min_gap, &max_gap);
+
+    lost = (double)sim.stats.dropped / slots;
+    lq = got.link_stats ? (double)got.lq_sum / got.link_stats : 0;
+
+    check(sim.stats.frames + sim.stats.dropped == slots,
+          "dropouts: slots add up");
+    check(got.rc == sim.stats.frames && !got.wrong,
+          "dropouts: frames received");
+    check(fabs(lost - expect) < 0.02, "dropouts: share lost");
+    /* Link statistics are lost with the slot they're in, which is more
+     * likely in a bad window, so they read a little high. */
+    check(lq >= (1 - lost) * 100 - 1 && lq <= (1 - lost) * 100 + 6,
+          "dropouts: link quality");
+
+    printf("dropouts,lost %.1f%% expecting %.1f%%,lq %.1f%%\n", lost * 100,
+           expect * 100, lq);
+}
+
+/**
+ * @brief Bit errors on the line are caught by the CRC, and the frames
+ * they don't touch still get through.
+ */
+static void check_noise(void)
+{
+    const struct csrf_sim_config config = {
+        .rate_hz = 250,
+        .bit_error_ppm = 500,
+        .link_stats_interval = 10,
+    };
+    const unsigned slots = 200000;
+    struct csrf_sim sim;
+    struct csrf_parser parser;
+    uint32_t min_gap, max_gap;
+    unsigned clean;
+
+    csrf_sim_init(&sim, &config, 3);
+    run(&sim, &parser, slots, &min_gap, &max_gap);
+
+    clean = slots - sim.stats.corrupted;
+
+    check(sim.stats.corrupted > 0, "noise: no errors");
+    check(got.rc >= clean && got.rc < slots, "noise: frames received");
+    /* CRC8 lets about 1 in 256 bad frames through. */
+    check(got.wrong * 64 < sim.stats.corrupted, "noise: bad frames accepted");
+    check(parser.stats.bad_crc > 0, "noise: CRC errors");
+
+    printf("noise,%u of %u slots hit,%u frames through,%u wrong,%u bad "
+           "CRCs\n",
+           sim.stats.corrupted, slots, got.rc, got.wrong,
+           parser.stats.bad_crc);
+}
+
+static volatile size_t sink;
+
+static void bench(void)
+{
+    const struct csrf_sim_config config = {
+        .rate_hz = 500,
+        .jitter_us = 20,
+        .bit_error_ppm = 10,
+        .drop_percent = 1,
+        .drop_burst = 3,
+        .link_stats_interval = 10,
+    };
+    const unsigned reps = 2000000;
+    uint8_t buf[CSRF_SIM_MAX_OCTETS];
+    struct csrf_sim sim;
+    uint32_t gap;
+    double start, ns;
+
+    csrf_sim_init(&sim, &config, 4);
+
+    start = now_s();
+    for (unsigned r = 0; r < reps; r++) sink += csrf_sim_next(&sim, buf, &gap);
+    ns = (now_s() - start) * 1e9 / reps;
+
+    printf("slot,%.1f ns\n", ns);
+}
+
+int main(void)
+{
+    check_clean();
+    check_dropouts();
+    check_noise();
+    bench();
+
+    printf("%s\n", fails ? "FAILED" : "OK");
+
+    return fails ? 1 : 0;
+}
@@ -0,0 +1,216 @@
+/*
+ * Host-side checks and benchmarks for DShot frame encoding and the
+ * bidirectional telemetry decoder.
+ *
+ * Build and run from the firmware directory:
+ *
+ *     cc -O2 -Idrivers/misc/dshot -o dshot_bench \
+ *         tools/dshot_bench/dshot_bench.c drivers/misc/dshot/dshot_frame.c
+ *     ./dshot_bench
+ *
+ * The exit code is non-zero if any check fails.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "../bench.h"
+#include "dshot_frame.h"
+
+/* DShot600 from an 80 MHz timer clock, as on the robot. */
+#define BIT_PERIOD 133
+#define T1 (BIT_PERIOD * 3 / 4)
+#define T0 (BIT_PERIOD * 3 / 8)
+#define TELEMETRY_BIT_Q8 (BIT_PERIOD * 256 * 4 / 5)
+
+struct golden_frame
+{
+    uint16_t value;
+    bool telemetry;
+    bool inverted;
+    const char *bits;
+};
+
+/* Worked out by hand from the DShot spec, not from dshot_frame(). */
+static const struct golden_frame golden_frames[] = {
+    {1046, false, false, "1000001011000110"},
+    {1046, false, true, "1000001011001001"},
+    {0, false, false, "0000000000000000"},
+    {0, false, true, "0000000000001111"},
+    {48, false, false, "0000011000000110"},
+    {2047, true, false, "1111111111111111"},
+    {2047, true, true, "1111111111110000"},
+    {1, true, false, "0000000000110011"},
+};
+
+static void check_frames(void)
+{
+    for (size_t i = 0; i < sizeof(golden_frames) / sizeof(golden_frames[0]);
+         i++) {
+        const struct golden_frame *g = &golden_frames[i];
+        uint16_t frame = dshot_frame(g->value, g->telemetry, g->inverted);
+        uint16_t buf[DSHOT_BUF_LEN];
+        int ok = 1;
+
+        dshot_frame_to_ccr(frame, T0, T1, buf);
+
+        for (int b = 0; b < DSHOT_FRAME_BITS; b++)
+            ok &= buf[b] == (g->bits[b] == '1' ? T1 : T0);
+        for (int b = DSHOT_FRAME_BITS; b < DSHOT_BUF_LEN; b++)
+            ok &= buf[b] == 0;
+
+        check(ok, "frame: bitstream differs from golden");
+    }
+
+    check(T1 == 99 && T0 == 49, "frame: DShot600 compare values");
+}
+
+/* Nibble to 5 bit GCR symbol, from the bidirectional DShot spec. */
+static const uint8_t gcr_encode[16] = {
+    0x19, 0x1b, 0x12, 0x13, 0x1d, 0x15, 0x16, 0x17,
+    0x1a, 0x09, 0x0a, 0x0b, 0x1e, 0x0d, 0x0e, 0x0f,
+};
+
+/**
+ * @brief What an ESC would send for a 12 bit telemetry value: the start bit
+ * and four GCR symbols, with a 1 wherever the line changes.
+ */
+static uint32_t esc_reply(uint16_t value)
+{
+    uint32_t v = value << 4;
+    uint32_t gcr = 1;
+
+    v |= ~(value ^ (value >> 4) ^ (value >> 8)) & 0x0f;
+
+    for (int i = 3; i >= 0; i--)
+        gcr = gcr << 5 | gcr_encode[(v >> (i * 4)) & 0x0f];
+
+    return gcr;
+}
+
+/**
+ * @brief Capture times of each change on the line, with some jitter and
+ * starting wherever the timer happens to be.
+ */
+static size_t reply_edges(uint32_t gcr, uint16_t start, int jitter,
+                          uint16_t *edges)
+{
+    size_t count = 0;
+
+    for (int bit = 0; bit < DSHOT_TELEMETRY_BITS; bit++) {
+        int j = jitter ? (int)(rng() % (2 * jitter + 1)) - jitter : 0;
+
+        if (gcr & (1u << (DSHOT_TELEMETRY_BITS - 1 - bit)))
+            edges[count++] = start + (bit * TELEMETRY_BIT_Q8 >> 8) + j;
+    }
+
+    return count;
+}
+
+static int decode(const uint16_t *edges, size_t count, uint16_t *value)
+{
+    uint32_t gcr;
+
+    if (dshot_edges_to_gcr(edges, count, TELEMETRY_BIT_Q8, &gcr))
+        return -1;
+
+    return dshot_gcr_to_value(gcr, value);
+}
+
+static void check_telemetry(void)
+{
+    /* 1000 us period, worked out by hand: 500 << 1 is 0x3f4, checksum 7. */
+    static const uint16_t golden_bits[] = {0, 1, 4, 5, 7, 8, 9, 10,
+                                           11, 12, 13, 15, 16, 18, 19, 20};
+    uint16_t edges[DSHOT_TELEMETRY_MAX_EDGES + 1];
+    uint16_t value;
+    size_t count;
+    unsigned errors = 0;
+
+    check(esc_reply(0x3f4) == 0x19bfb7, "telemetry: golden reply");
+
+    count = sizeof(golden_bits) / sizeof(golden_bits[0]);
+    for (size_t i = 0; i < count; i++)
+        edges[i] = 1000 + (golden_bits[i] * TELEMETRY_BIT_Q8 >> 8);
+
+    check(decode(edges, count, &value) == 0 && value == 0x3f4,
+          "telemetry: golden decode");
+    check(dshot_value_to_erpm(value) == 60000, "telemetry: golden eRPM");
+    check(dshot_value_to_erpm(0x0fff) == 0, "telemetry: stopped");
+
+    /* Every value, with up to a quarter of a bit of jitter and the timer
+     * wrapping part way through. */
+    for (uint32_t v = 0; v < 0x1000; v++) {
+        uint16_t start = 0xfff0 - (rng() & 0x7ff);
+
+        count = reply_edges(esc_reply(v), start, BIT_PERIOD / 5, edges);
+        errors += decode(edges, count, &value) != 0 || value != v;
+    }
+    check(!errors, "telemetry: round trip");
+
+    /* Every single bit error has to be caught: it changes one symbol, which
+     * either isn't valid or changes one nibble and so the checksum. */
+    errors = 0;
+    for (uint32_t v = 0; v < 0x1000; v++) {
+        for (int bit = 0; bit < DSHOT_TELEMETRY_BITS - 1; bit++) {
+            count = reply_edges(esc_reply(v) ^ (1u << bit), 0, 0, edges);
+            errors += decode(edges, count, &value) == 0;
+        }
+    }
+    check(!errors, "telemetry: bit error accepted");
+
+    /* Too many edges or runs that don't add up are rejected outright. */
+    for (int i = 0; i < DSHOT_TELEMETRY_MAX_EDGES + 1; i++)
+        edges[i] = i * BIT_PERIOD;
+    check(decode(edges, DSHOT_TELEMETRY_MAX_EDGES + 1, &value) != 0,
+          "telemetry: too many edges");
+    edges[1] = edges[0] + 30 * BIT_PERIOD;
+    check(decode(edges, 2, &value) != 0, "telemetry: overlong run");
+    check(decode(edges, 0, &value) != 0, "telemetry: no edges");
+
+    printf("telemetry,%u values checked\n", 0x1000);
+}
+
+static volatile uint32_t sink;
+
+static void bench(void)
+{
+    const unsigned reps = 10000000;
+    static uint16_t edges[256][DSHOT_TELEMETRY_MAX_EDGES];
+    static size_t counts[256];
+    uint16_t buf[DSHOT_BUF_LEN];
+    uint16_t value;
+    double start, encode_ns, decode_ns;
+
+    for (int i = 0; i < 256; i++)
+        counts[i] = reply_edges(esc_reply(rng() & 0x0fff), rng(), 10,
+                                edges[i]);
+
+    start = now_s();
+    for (unsigned r = 0; r < reps; r++) {
+        dshot_frame_to_ccr(dshot_frame(r & 0x07ff, false, true), T0, T1, buf);
+        sink = buf[r & 15];
+    }
+    encode_ns = (now_s() - start) * 1e9 / reps;
+
+    start = now_s();
+    for (unsigned r = 0; r < reps; r++) {
+        if (decode(edges[r & 255], counts[r & 255], &value) == 0)
+            sink = dshot_value_to_erpm(value);
+    }
+    decode_ns = (now_s() - start) * 1e9 / reps;
+
+    printf("frame,encode,%.1f ns/frame\n", encode_ns);
+    printf("telemetry,decode,%.1f ns/reply\n", decode_ns);
+}
+
+int main(void)
+{
+    check_frames();
+    check_telemetry();
+    bench();
+
+    printf("%s\n", fails ? "FAILED" : "OK");
+
+    return fails ? 1 : 0;
+}
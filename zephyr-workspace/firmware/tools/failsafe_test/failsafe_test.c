@@ -0,0 +1,266 @@
+/*
+ * Host-side checks for the failsafe's link monitor: how soon it limits the
+ * drive and stops at different packet rates, that lost and jittery frames
+ * don't set it off, link quality, and a change of packet rate.
+ *
+ * The frames and the failsafe timer are simulated the way the firmware
+ * runs them: the monitor is only checked when a frame comes in and when
+ * the time it asked to be woken at comes round.
+ *
+ * Build and run from the firmware directory:
+ *
+ *     cc -O2 -Isrc -o failsafe_test tools/failsafe_test/failsafe_test.c \
+ *         src/link_monitor.c
+ *     ./failsafe_test
+ *
+ * The exit code is non-zero if any check fails.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../bench.h"
+#include "link_monitor.h"
+
+/**
+ * @brief The monitor with the firmware's timer around it.
+ */
+struct sim
+{
+    struct link_monitor mon;
+    uint32_t now;
+    /* When the timer fires, if it's running. */
+    uint32_t timer_at;
+    bool watching;
+
+    /* Times the level went to LINK_LIMITED and LINK_STOPPED. */
+    unsigned limits;
+    unsigned stops;
+    uint32_t limited_at;
+    uint32_t stopped_at;
+};
+
+static void sim_init(struct sim *sim, uint32_t start)
+{
+    struct link_monitor_config config;
+
+    link_monitor_config_default(&config);
+    link_monitor_init(&sim->mon, &config);
+    sim->now = start;
+    sim->watching = false;
+    sim->limits = 0;
+    sim->stops = 0;
+}
+
+static void sim_level(struct sim *sim, enum link_level was)
+{
+    if (sim->mon.level == was)
+        return;
+
+    if (sim->mon.level == LINK_LIMITED) {
+        sim->limits++;
+        sim->limited_at = sim->now;
+    } else if (sim->mon.level == LINK_STOPPED) {
+        sim->stops++;
+        sim->stopped_at = sim->now;
+    }
+}
+
+/**
+ * @brief Run the timer up to t.
+ */
+static void sim_run(struct sim *sim, uint32_t t)
+{
+    while (sim->watching && (int32_t)(sim->timer_at - t) <= 0) {
+        enum link_level was = sim->mon.level;
+        uint32_t next;
+
+        sim->now = sim->timer_at;
+        if (link_monitor_update(&sim->mon, sim->now, &next) == LINK_STOPPED)
+            sim->watching = false;
+        else
+            sim->timer_at = next;
+        sim_level(sim, was);
+    }
+    sim->now = t;
+}
+
+static void sim_frame(struct sim *sim, uint32_t t)
+{
+    enum link_level was;
+    uint32_t next;
+
+    sim_run(sim, t);
+
+    was = sim->mon.level;
+    link_monitor_frame(&sim->mon, t);
+    link_monitor_update(&sim->mon, t, &next);
+    if (!sim->watching && sim->mon.level != LINK_STOPPED) {
+        sim->timer_at = next;
+        sim->watching = true;
+    }
+    sim_level(sim, was);
+}
+
+/**
+ * @brief Frames every interval_us, then none, and how long until the drive
+ * is limited and everything stops.
+ */
+static void check_rate(uint32_t interval_us, uint32_t limit_us,
+                       uint32_t stop_us, uint32_t max_stop_us, uint32_t start)
+{
+    struct sim sim;
+    uint32_t t = start, last;
+    char what[64];
+
+    sim_init(&sim, t);
+    sim.mon.config.max_stop = max_stop_us;
+    for (int i = 0; i < 200; i++, t += interval_us) sim_frame(&sim, t);
+    last = t - interval_us;
+
+    snprintf(what, sizeof(what), "rate %u us: went off while frames came",
+             interval_us);
+    check(sim.limits == 0 && sim.stops == 0, what);
+
+    sim_run(&sim, last + 3000000);
+
+    snprintf(what, sizeof(what), "rate %u us: limit after %u us", interval_us,
+             sim.limited_at - last);
+    check(sim.limits == 1 && sim.limited_at - last + 2 >= limit_us &&
+              sim.limited_at - last <= limit_us + 2,
+          what);
+    snprintf(what, sizeof(what), "rate %u us: stop after %u us", interval_us,
+             sim.stopped_at - last);
+    check(sim.stops == 1 && sim.stopped_at - last + 2 >= stop_us &&
+              sim.stopped_at - last <= stop_us + 2,
+          what);
+
+    printf("rate,%u us,limit %u us,stop %u us\n", interval_us,
+           sim.limited_at - last, sim.stopped_at - last);
+
+    /* The next frame brings it straight back. */
+    sim_frame(&sim, last + 4000000);
+    snprintf(what, sizeof(what), "rate %u us: didn't come back", interval_us);
+    check(sim.mon.level == LINK_OK &&
+              link_monitor_drive_percent(&sim.mon) == 100,
+          what);
+}
+
+static void check_rates(void)
+{
+    struct sim sim;
+    uint32_t next;
+
+    sim_init(&sim, 0);
+    check(link_monitor_update(&sim.mon, 1000, &next) == LINK_STOPPED &&
+              link_monitor_drive_percent(&sim.mon) == 0,
+          "rates: not stopped before the first frame");
+
+    /* 500 Hz stops at the shortest. */
+    check_rate(2000, 6000, 20000, 500000, 0);
+    check_rate(6667, 20001, 66670, 500000, 0);
+    check_rate(20000, 60000, 200000, 500000, 0);
+    check_rate(40000, 120000, 400000, 500000, 0);
+
+    /* However slow, it stops by the longest. */
+    check_rate(40000, 120000, 200000, 200000, 0);
+
+    /* Past the clock wrapping. */
+    check_rate(2000, 6000, 20000, 500000, UINT32_MAX - 100000);
+}
+
+/**
+ * @brief Lost frames and jitter at 150 Hz that shouldn't do anything.
+ */
+static void check_noise(void)
+{
+    struct sim sim;
+    uint32_t t = 0;
+
+    sim_init(&sim, t);
+    for (int i = 0; i < 100000; i++) {
+        t += 6667;
+        /* Every other frame lost at worst, and +-30% jitter. */
+        if (i % 2 == 0 || rng() % 4)
+            sim_frame(&sim, t - 2000 + rng() % 4000);
+    }
+    sim_run(&sim, t);
+    check(sim.limits == 0 && sim.stops == 0, "noise: went off");
+
+    /* Three in a row lost limits the drive, but doesn't stop it. */
+    sim_init(&sim, 0);
+    t = 0;
+    for (int i = 0; i < 200; i++) {
+        t += 6667;
+        if (i < 100 || i > 103)
+            sim_frame(&sim, t);
+    }
+    check(sim.limits == 1 && sim.stops == 0 && sim.mon.level == LINK_OK,
+          "noise: three lost");
+}
+
+static void check_quality(void)
+{
+    struct sim sim;
+    uint32_t t = 0;
+
+    sim_init(&sim, t);
+    for (int i = 0; i < 200; i++, t += 4000) sim_frame(&sim, t);
+
+    link_monitor_quality(&sim.mon, 49);
+    sim_frame(&sim, t);
+    check(sim.mon.level == LINK_LIMITED &&
+              link_monitor_drive_percent(&sim.mon) == 50,
+          "quality: poor link not limited");
+
+    /* It has to come back past the limit before it's let off. */
+    link_monitor_quality(&sim.mon, 55);
+    sim_frame(&sim, t += 4000);
+    check(sim.mon.level == LINK_LIMITED, "quality: let off too soon");
+
+    link_monitor_quality(&sim.mon, 60);
+    sim_frame(&sim, t += 4000);
+    check(sim.mon.level == LINK_OK, "quality: not let off");
+
+    /* A poor link still stops on time when the frames go. */
+    link_monitor_quality(&sim.mon, 10);
+    sim_frame(&sim, t += 4000);
+    sim_run(&sim, t + 1000000);
+    check(sim.mon.level == LINK_STOPPED && sim.stopped_at - t == 40000,
+          "quality: didn't stop");
+}
+
+/**
+ * @brief The packet rate dropping from 500 Hz to 50 Hz on the handset.
+ */
+static void check_rate_change(void)
+{
+    struct sim sim;
+    uint32_t t = 0;
+    unsigned stops;
+
+    sim_init(&sim, t);
+    for (int i = 0; i < 500; i++, t += 2000) sim_frame(&sim, t);
+    for (int i = 0; i < 30; i++, t += 20000) sim_frame(&sim, t);
+    stops = sim.stops;
+    for (int i = 0; i < 500; i++, t += 20000) sim_frame(&sim, t);
+
+    printf("rate change,%u stops,stop %u us\n", stops,
+           link_monitor_stop_after(&sim.mon));
+    check(stops <= 10 && sim.stops == stops, "rate change: kept stopping");
+    check(link_monitor_stop_after(&sim.mon) >= 190000,
+          "rate change: not picked up");
+}
+
+int main(void)
+{
+    check_rates();
+    check_noise();
+    check_quality();
+    check_rate_change();
+
+    printf("%s\n", fails ? "FAILED" : "OK");
+
+    return fails ? 1 : 0;
+}
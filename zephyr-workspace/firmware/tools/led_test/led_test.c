@@ -0,0 +1,274 @@
+/*
+ * Host-side checks for the LED animation engine: a steady colour, blinks,
+ * fades, overlays on top of the state's pattern and overlays that finish,
+ * and the clock wrapping, with how often each one wakes up and writes a
+ * channel.
+ *
+ * The LED and the work item are simulated the way the firmware runs
+ * them: the engine's only updated when a pattern's set and at the time it
+ * asked to be woken at, and only the channels that changed are written.
+ *
+ * Build and run from the firmware directory:
+ *
+ *     cc -O2 -Isrc -o led_test tools/led_test/led_test.c \
+ *         src/led_engine.c
+ *     ./led_test
+ *
+ * The exit code is non-zero if any check fails.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../bench.h"
+#include "led_engine.h"
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+/* The firmware's patterns. */
+static const struct led_frame frames_init[] = {
+    {.colour = {100, 100, 100}}};
+static const struct led_frame frames_no_radio[] = {
+    {.colour = {0, 0, 40}, .duration_ms = 800, .flags = LED_FRAME_FADE},
+    {.colour = {0, 0, 0}, .duration_ms = 800, .flags = LED_FRAME_FADE}};
+static const struct led_frame frames_disarmed[] = {
+    {.colour = {0, 100, 0}, .duration_ms = 30},
+    {.colour = {0, 0, 0}, .duration_ms = 500}};
+static const struct led_frame frames_limited[] = {
+    {.colour = {100, 40, 0}, .duration_ms = 30},
+    {.duration_ms = 250, .flags = LED_FRAME_CLEAR}};
+static const struct led_frame frames_fault[] = {
+    {.colour = {100, 0, 100}, .duration_ms = 60},
+    {.colour = {0, 0, 0}, .duration_ms = 60}};
+
+#define PATTERN(frames_, repeat_) \
+    {.frames = frames_, .length = ARRAY_SIZE(frames_), .repeat = repeat_}
+
+static const struct led_pattern init = PATTERN(frames_init, 0);
+static const struct led_pattern no_radio = PATTERN(frames_no_radio, 0);
+static const struct led_pattern disarmed = PATTERN(frames_disarmed, 0);
+static const struct led_pattern limited = PATTERN(frames_limited, 0);
+static const struct led_pattern fault = PATTERN(frames_fault, 3);
+
+/* The PWM period. */
+#define MIN_STEP 20
+
+/**
+ * @brief The engine, the work item that runs it and the LED.
+ */
+struct sim
+{
+    struct led_engine engine;
+    uint32_t now;
+    /* When the work runs, if it's scheduled. */
+    uint32_t work_at;
+    bool pending;
+
+    uint8_t led[LED_ENGINE_CHANNELS];
+    unsigned wakes;
+    unsigned writes;
+};
+
+static void sim_init(struct sim *sim, uint32_t start)
+{
+    led_engine_init(&sim->engine, MIN_STEP);
+    sim->now = start;
+    sim->pending = false;
+    sim->wakes = 0;
+    sim->writes = 0;
+}
+
+static void sim_work(struct sim *sim)
+{
+    uint8_t changed;
+    uint32_t next;
+
+    sim->wakes++;
+    sim->pending = led_engine_update(&sim->engine, sim->now, &changed, &next);
+    for (int i = 0; i < LED_ENGINE_CHANNELS; i++) {
+        if (changed & (1 << i)) {
+            sim->led[i] = sim->engine.out[i];
+            sim->writes++;
+        }
+    }
+
+    if (sim->pending) {
+        check((int32_t)(next - sim->now) > 0, "asked to wake in the past");
+        sim->work_at = next;
+    }
+}
+
+/**
+ * @brief Run the work up to t.
+ */
+static void sim_run(struct sim *sim, uint32_t t)
+{
+    while (sim->pending && (int32_t)(sim->work_at - t) <= 0) {
+        sim->now = sim->work_at;
+        sim_work(sim);
+    }
+    sim->now = t;
+}
+
+static void sim_set(struct sim *sim, unsigned layer,
+                    const struct led_pattern *pattern)
+{
+    if (led_engine_set(&sim->engine, layer, pattern, sim->now))
+        sim_work(sim);
+}
+
+static int led_is(const struct sim *sim, int r, int g, int b)
+{
+    return sim->led[0] == r && sim->led[1] == g && sim->led[2] == b;
+}
+
+static void check_steady(void)
+{
+    struct sim sim;
+
+    sim_init(&sim, 0);
+    sim_set(&sim, 0, &init);
+    sim_run(&sim, 60000);
+
+    check(led_is(&sim, 100, 100, 100), "steady: colour");
+    check(!sim.pending, "steady: still waking");
+    check(sim.wakes == 1 && sim.writes == 3, "steady: wakes");
+
+    /* Setting it again doesn't do anything. */
+    sim_set(&sim, 0, &init);
+    check(sim.wakes == 1, "steady: set again");
+
+    printf("steady,%.1f wakes/s,%.1f writes/s\n", sim.wakes / 60.0,
+           sim.writes / 60.0);
+}
+
+static void check_blink(uint32_t start)
+{
+    struct sim sim;
+    int bad = 0;
+
+    sim_init(&sim, start);
+    sim_set(&sim, 0, &disarmed);
+    for (uint32_t t = 0; t < 53000; t++) {
+        sim_run(&sim, start + t);
+        bad += !led_is(&sim, 0, t % 530 < 30 ? 100 : 0, 0);
+    }
+
+    check(!bad, "blink: wrong colour");
+    /* Twice a cycle, and only green changes after the first. */
+    check(sim.wakes == 200, "blink: wakes");
+    check(sim.writes == 202, "blink: writes");
+
+    printf("blink,%.1f wakes/s,%.1f writes/s\n", sim.wakes / 53.0,
+           sim.writes / 53.0);
+}
+
+static void check_fade(void)
+{
+    struct sim sim;
+    uint32_t last_write = 0;
+    unsigned writes = 0;
+    int worst = 0, top = 0, bad_step = 0;
+
+    sim_init(&sim, 0);
+    sim_set(&sim, 0, &no_radio);
+    for (uint32_t t = 0; t < 16000; t++) {
+        int phase = t % 1600;
+        int ideal = phase < 800 ? phase * 40 / 800 : (1600 - phase) * 40 / 800;
+        int err;
+
+        sim_run(&sim, t);
+        err = abs(sim.led[2] - ideal);
+        if (err > worst)
+            worst = err;
+        if (sim.led[2] > top)
+            top = sim.led[2];
+
+        if (sim.writes != writes) {
+            if (t && t - last_write < MIN_STEP)
+                bad_step++;
+            last_write = t;
+            writes = sim.writes;
+        }
+    }
+
+    check(worst <= 2, "fade: off the line");
+    check(top == 40, "fade: didn't get to the top");
+    check(!bad_step, "fade: stepped faster than the PWM");
+    check(sim.led[0] == 0 && sim.led[1] == 0, "fade: other channels");
+    /* One write per step, 80 steps a cycle. */
+    check(sim.writes <= 10 * 80 + 3, "fade: writes");
+
+    printf("fade,%.1f wakes/s,%.1f writes/s,worst %d%%\n", sim.wakes / 16.0,
+           sim.writes / 16.0, worst);
+}
+
+static void check_overlays(void)
+{
+    struct sim sim;
+    unsigned wakes;
+    int bad = 0;
+
+    /* A flash over the steady state, which shows between. */
+    sim_init(&sim, 0);
+    sim_set(&sim, 0, &init);
+    sim_run(&sim, 1000);
+    sim_set(&sim, 1, &limited);
+    for (uint32_t t = 0; t < 28000; t++) {
+        sim_run(&sim, 1000 + t);
+        bad += t % 280 < 30 ? !led_is(&sim, 100, 40, 0)
+                            : !led_is(&sim, 100, 100, 100);
+    }
+    check(!bad, "overlay: wrong colour");
+    check(sim.wakes == 1 + 200, "overlay: wakes");
+
+    /* Setting it every frame doesn't restart it. */
+    wakes = sim.wakes;
+    for (int i = 0; i < 100; i++) sim_set(&sim, 1, &limited);
+    check(sim.wakes == wakes, "overlay: restarted");
+
+    sim_set(&sim, 1, NULL);
+    check(led_is(&sim, 100, 100, 100) && !sim.pending,
+          "overlay: not cleared");
+
+    /* A fault over a blink, which hides it, flashes three times and goes.
+     * The blink underneath keeps time. */
+    sim_init(&sim, 0);
+    sim_set(&sim, 0, &disarmed);
+    sim_run(&sim, 5300);
+    sim_set(&sim, 2, &fault);
+    wakes = sim.wakes;
+    for (uint32_t t = 5300; t < 5300 + 360; t++) {
+        sim_run(&sim, t);
+        bad += (t - 5300) % 120 < 60 ? !led_is(&sim, 100, 0, 100)
+                                     : !led_is(&sim, 0, 0, 0);
+    }
+    check(!bad, "fault: wrong colour");
+    check(sim.wakes - wakes == 5, "fault: woke for the blink under it");
+
+    for (uint32_t t = 5660; t < 10600; t++) {
+        sim_run(&sim, t);
+        bad += !led_is(&sim, 0, t % 530 < 30 ? 100 : 0, 0);
+    }
+    check(!bad, "fault: blink didn't come back in time");
+    check(sim.engine.layers[2].pattern == NULL, "fault: didn't finish");
+
+    /* And again, once it's finished. */
+    sim_set(&sim, 2, &fault);
+    check(led_is(&sim, 100, 0, 100), "fault: didn't start again");
+}
+
+int main(void)
+{
+    check_steady();
+    check_blink(0);
+    /* Past the clock wrapping. */
+    check_blink(UINT32_MAX - 20000);
+    check_fade();
+    check_overlays();
+
+    printf("%s\n", fails ? "FAILED" : "OK");
+
+    return fails ? 1 : 0;
+}
@@ -0,0 +1,426 @@
+/*
+ * Host-side checks and benchmarks for the drive mixer.
+ *
+ * Build and run from the firmware directory:
+ *
+ *     cc -O2 -Isrc -o mixer_bench tools/mixer_bench/mixer_bench.c \
+ *         src/mixer.c -lm
+ *     ./mixer_bench
+ *
+ * The exit code is non-zero if any check fails.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../bench.h"
+#include "mixer.h"
+
+#define CLAMP(v, lo, hi) ((v) < (lo) ? (lo) : ((v) > (hi) ? (hi) : (v)))
+
+/* A float only has 24 bits of mantissa, so near 20 ms the reference can be
+ * out by a couple of ns. */
+#define PULSE_TOLERANCE_NS 2
+
+/**
+ * @brief The float tank mix main.c used to have.
+ */
+static void mix_float(const uint16_t *channels, struct mixer_output *out)
+{
+    float left = channels[2] - 1024;
+    float right = channels[1] - 1024;
+    uint16_t weapon = channels[9];
+
+    out->armed = channels[7] > 1024;
+
+    left = CLAMP(left / 1024.0f, -1.0f, 1.0f);
+    right = CLAMP(right / 1024.0f, -1.0f, 1.0f);
+
+    out->drive[MIXER_WHEEL_FRONT_LEFT] = (uint32_t)(fabsf(left) * 20000000);
+    out->drive[MIXER_WHEEL_FRONT_RIGHT] = (uint32_t)(fabsf(right) * 20000000);
+    out->drive[MIXER_WHEEL_REAR_LEFT] = out->drive[MIXER_WHEEL_FRONT_LEFT];
+    out->drive[MIXER_WHEEL_REAR_RIGHT] = out->drive[MIXER_WHEEL_FRONT_RIGHT];
+
+    out->dir[MIXER_WHEEL_FRONT_LEFT] = !(left > 0);
+    out->dir[MIXER_WHEEL_REAR_LEFT] = !(left > 0);
+    out->dir[MIXER_WHEEL_FRONT_RIGHT] = right > 0;
+    out->dir[MIXER_WHEEL_REAR_RIGHT] = right > 0;
+
+    out->weapon_pulse = (weapon * 500) + 1000000;
+    out->weapon_pulse = CLAMP(out->weapon_pulse, 1000000u, 2000000u);
+
+    if (!out->armed)
+        out->weapon_pulse = 1000000;
+}
+
+static int outputs_match(const struct mixer_output *a,
+                         const struct mixer_output *b)
+{
+    for (int w = 0; w < MIXER_NUM_WHEELS; w++) {
+        if (llabs((long long)a->drive[w] - b->drive[w]) > PULSE_TOLERANCE_NS)
+            return 0;
+        if (a->drive[w] && a->dir[w] != b->dir[w])
+            return 0;
+    }
+
+    return a->armed == b->armed && a->weapon_pulse == b->weapon_pulse;
+}
+
+/**
+ * @brief The default config has to give the same outputs as the float mix,
+ * for every stick position.
+ */
+static void check_against_float(void)
+{
+    struct mixer_config config;
+    struct mixer mixer;
+    struct mixer_output got, want;
+    uint16_t ch[16];
+    unsigned errors = 0;
+
+    mixer_config_default(&config);
+    mixer_init(&mixer, &config);
+
+    for (int i = 0; i < 16; i++) ch[i] = 1024;
+
+    for (uint32_t left = 0; left < 2048; left++) {
+        for (uint32_t right = 0; right < 2048; right++) {
+            ch[2] = left;
+            ch[1] = right;
+            ch[7] = rng() & 0x07ff;
+            ch[9] = rng() & 0x07ff;
+
+            mixer_run(&mixer, ch, &got);
+            mix_float(ch, &want);
+            errors += !outputs_match(&got, &want);
+        }
+    }
+    check(!errors, "float: tank mix differs");
+
+    /* Every weapon position, armed and not. */
+    errors = 0;
+    for (uint32_t weapon = 0; weapon < 2048; weapon++) {
+        for (int arm = 0; arm < 2; arm++) {
+            ch[9] = weapon;
+            ch[7] = arm ? 1025 : 1024;
+
+            mixer_run(&mixer, ch, &got);
+            mix_float(ch, &want);
+            errors += !outputs_match(&got, &want);
+        }
+    }
+    check(!errors, "float: weapon differs");
+
+    printf("float,tank,%u stick pairs checked\n", 2048 * 2048);
+}
+
+static void check_arcade(void)
+{
+    struct mixer_config config;
+    struct mixer mixer;
+    struct mixer_output out;
+    uint16_t ch[16];
+
+    mixer_config_default(&config);
+    config.mode = MIXER_MODE_ARCADE;
+    mixer_init(&mixer, &config);
+
+    for (int i = 0; i < 16; i++) ch[i] = 1024;
+
+    /* Full throttle, no steering: everything forward at full speed. */
+    ch[config.input_ch[0]] = 0;
+    mixer_run(&mixer, ch, &out);
+    for (int w = 0; w < MIXER_NUM_WHEELS; w++)
+        check(out.drive[w] == 20000000, "arcade: straight line");
+    check(out.dir[MIXER_WHEEL_FRONT_LEFT] == out.dir[MIXER_WHEEL_REAR_LEFT] &&
+              out.dir[MIXER_WHEEL_FRONT_LEFT] !=
+                  out.dir[MIXER_WHEEL_FRONT_RIGHT],
+          "arcade: straight line directions");
+
+    /* Steering only spins on the spot, so the sides go the same way as far
+     * as the direction pins are concerned. */
+    ch[config.input_ch[0]] = 1024;
+    ch[config.input_ch[1]] = 2047;
+    mixer_run(&mixer, ch, &out);
+    check(out.drive[MIXER_WHEEL_FRONT_LEFT] ==
+              out.drive[MIXER_WHEEL_FRONT_RIGHT],
+          "arcade: spin speeds");
+    check(out.dir[MIXER_WHEEL_FRONT_LEFT] == out.dir[MIXER_WHEEL_FRONT_RIGHT],
+          "arcade: spin directions");
+
+    /* Full throttle and full steering saturates one side and stops the
+     * other. */
+    ch[config.input_ch[0]] = 2047;
+    mixer_run(&mixer, ch, &out);
+    check(out.drive[MIXER_WHEEL_FRONT_LEFT] == 20000000, "arcade: saturate");
+    check(out.drive[MIXER_WHEEL_FRONT_RIGHT] < 20000, "arcade: cancel");
+}
+
+static void check_curve(void)
+{
+    struct mixer_config config;
+    struct mixer mixer;
+    struct mixer_output out;
+    uint16_t ch[16];
+    int32_t prev = -MIXER_Q15_ONE - 1;
+    unsigned errors = 0;
+
+    mixer_config_default(&config);
+    config.expo = MIXER_Q15_ONE / 2;
+    config.deadband = MIXER_Q15_ONE / 20;
+    mixer_init(&mixer, &config);
+
+    for (int32_t x = -MIXER_Q15_ONE; x <= MIXER_Q15_ONE; x++) {
+        int32_t y = mixer_curve(&mixer, x);
+
+        errors += y < prev || y != -mixer_curve(&mixer, -x);
+        prev = y;
+    }
+    check(!errors, "curve: not monotonic and symmetric");
+    check(mixer_curve(&mixer, 0) == 0, "curve: centre");
+    check(mixer_curve(&mixer, MIXER_Q15_ONE) == MIXER_Q15_ONE, "curve: top");
+    /* The edge of the deadband is only as sharp as the table steps. */
+    check(mixer_curve(&mixer, MIXER_Q15_ONE / 20 - (MIXER_Q15_ONE >> 8)) == 0,
+          "curve: deadband");
+    check(mixer_curve(&mixer, MIXER_Q15_ONE / 2) < MIXER_Q15_ONE / 2,
+          "curve: expo");
+
+    for (int i = 0; i < 16; i++) ch[i] = 1024;
+    ch[config.input_ch[0]] = 1024 + 40;
+    mixer_run(&mixer, ch, &out);
+    check(out.drive[MIXER_WHEEL_FRONT_LEFT] == 0, "curve: deadband pulse");
+
+    /* Trims scale a wheel down. */
+    mixer_config_default(&config);
+    config.trim[MIXER_WHEEL_REAR_RIGHT] = MIXER_Q14_ONE / 2;
+    mixer_init(&mixer, &config);
+
+    ch[config.input_ch[1]] = 0;
+    mixer_run(&mixer, ch, &out);
+    check(out.drive[MIXER_WHEEL_FRONT_RIGHT] == 20000000, "trim: untrimmed");
+    check(out.drive[MIXER_WHEEL_REAR_RIGHT] == 10000000, "trim: half");
+}
+
+/**
+ * @brief Upside down, a stick has to turn the robot the same way seen from
+ * above, so the wheels that drive are the other side's, the other way.
+ */
+static void check_flip(void)
+{
+    struct mixer_config config;
+    struct mixer mixer;
+    struct mixer_output up, down;
+    uint16_t ch[16];
+    int32_t in[MIXER_NUM_INPUTS];
+
+    mixer_config_default(&config);
+    mixer_init(&mixer, &config);
+
+    for (int i = 0; i < 16; i++) ch[i] = 1024;
+    ch[config.input_ch[0]] = 2047;
+
+    mixer_sticks(&mixer, ch, in);
+    mixer_drive(&mixer, in, &up);
+    mixer_flip(&mixer, in);
+    mixer_drive(&mixer, in, &down);
+
+    check(down.drive[MIXER_WHEEL_FRONT_LEFT] == 0 &&
+              down.drive[MIXER_WHEEL_FRONT_RIGHT] ==
+                  up.drive[MIXER_WHEEL_FRONT_LEFT],
+          "flip: tank sides");
+    /* Left and right wheels are reversed differently, so the same wheel
+     * speed the other way is the same direction pin. */
+    check(down.dir[MIXER_WHEEL_FRONT_RIGHT] == up.dir[MIXER_WHEEL_FRONT_LEFT],
+          "flip: tank direction");
+
+    /* Arcade just reverses the throttle and leaves the steering. */
+    config.mode = MIXER_MODE_ARCADE;
+    mixer_init(&mixer, &config);
+    in[0] = MIXER_Q15_ONE / 2;
+    in[1] = MIXER_Q15_ONE / 4;
+    mixer_flip(&mixer, in);
+    check(in[0] == -MIXER_Q15_ONE / 2 && in[1] == MIXER_Q15_ONE / 4,
+          "flip: arcade");
+}
+
+/**
+ * @brief Sag compensation holds the motors' voltage at the nominal, the
+ * cutback takes over near empty, and neither goes past full scale.
+ */
+static void check_battery(void)
+{
+    struct mixer_config config;
+    struct mixer mixer;
+    struct mixer_output out;
+    int worst = 0;
+
+    mixer_config_default(&config);
+    config.battery_nominal_mv = 11100;
+    config.battery_cutback_mv = 10200;
+    config.battery_empty_mv = 9600;
+    config.battery_cutback_min = MIXER_Q14_ONE / 4;
+    mixer_init(&mixer, &config);
+
+    check(mixer_battery_gain(&mixer, 0) == MIXER_Q14_ONE,
+          "battery: unknown voltage");
+
+    /* Duty times the pack's voltage stays at the nominal, down to the
+     * cutback. */
+    for (uint32_t mv = 12600; mv >= 10200; mv -= 10) {
+        int32_t gain = mixer_battery_gain(&mixer, mv);
+        int err = abs((int)((int64_t)gain * mv >> 14) - 11100);
+
+        if (err > worst)
+            worst = err;
+    }
+    check(worst <= 1, "battery: motor voltage");
+
+    /* Then straight down to a quarter of that at empty, and no further. */
+    check(mixer_battery_gain(&mixer, 9900) ==
+              ((11100ll << 14) / 9900 * (MIXER_Q14_ONE * 5 / 8) >> 14),
+          "battery: half way through the cutback");
+    check(mixer_battery_gain(&mixer, 9600) ==
+              ((11100ll << 14) / 9600 * (MIXER_Q14_ONE / 4) >> 14),
+          "battery: empty");
+    check(mixer_battery_gain(&mixer, 5000) ==
+              (MIXER_BATTERY_GAIN_MAX * (MIXER_Q14_ONE / 4) >> 14),
+          "battery: flat");
+
+    /* Full stick can't go over full scale. */
+    for (int w = 0; w < MIXER_NUM_WHEELS; w++)
+        out.drive[w] = config.drive_full_scale / (w + 1);
+    mixer_battery(&mixer, mixer_battery_gain(&mixer, 10500), &out);
+    check(out.drive[0] == config.drive_full_scale,
+          "battery: over full scale");
+    check(out.drive[3] == ((uint64_t)config.drive_full_scale / 4 *
+                               mixer_battery_gain(&mixer, 10500) >>
+                           14),
+          "battery: scaled");
+
+    /* Cutback on its own, and an empty above the cutback. */
+    config.battery_nominal_mv = 0;
+    config.battery_empty_mv = 11000;
+    mixer_init(&mixer, &config);
+    check(mixer_battery_gain(&mixer, 12000) == MIXER_Q14_ONE,
+          "battery: cutback only, full");
+    check(mixer_battery_gain(&mixer, 10199) == MIXER_Q14_ONE / 4,
+          "battery: cutback only, empty");
+
+    printf("battery,worst motor voltage error %d mV\n", worst);
+}
+
+/**
+ * @brief A whole frame's mix is the same as the steps it's made of, and
+ * with no limits the same as mixer_run().
+ */
+static void check_frame(void)
+{
+    struct mixer_config config;
+    struct mixer mixer;
+    struct mixer_output got, want;
+    struct mixer_limits limits = {.drive_percent = 100,
+                                  .battery_gain = MIXER_Q14_ONE};
+    int32_t in[MIXER_NUM_INPUTS], want_in[MIXER_NUM_INPUTS];
+    uint16_t ch[16];
+    unsigned errors = 0;
+
+    mixer_config_default(&config);
+    config.mode = MIXER_MODE_ARCADE;
+    config.expo = MIXER_Q15_ONE / 4;
+    config.battery_nominal_mv = 7400;
+    mixer_init(&mixer, &config);
+
+    /* So the padding compares equal. */
+    memset(&got, 0, sizeof(got));
+    memset(&want, 0, sizeof(want));
+
+    for (int f = 0; f < 10000; f++) {
+        for (int i = 0; i < 16; i++) ch[i] = rng() & 0x07ff;
+
+        limits.flip = false;
+        limits.drive_percent = 100;
+        limits.battery_gain = MIXER_Q14_ONE;
+        mixer_frame(&mixer, ch, &limits, in, &got);
+        mixer_run(&mixer, ch, &want);
+        errors += memcmp(&got, &want, sizeof(got)) != 0;
+
+        limits.flip = f & 1;
+        limits.drive_percent = rng() % 101;
+        limits.battery_gain = mixer_battery_gain(&mixer, 6000 + rng() % 2400);
+        mixer_frame(&mixer, ch, &limits, in, &got);
+
+        mixer_sticks(&mixer, ch, want_in);
+        errors += memcmp(in, want_in, sizeof(in)) != 0;
+        if (limits.flip)
+            mixer_flip(&mixer, want_in);
+        mixer_drive(&mixer, want_in, &want);
+        mixer_limit(&want, limits.drive_percent);
+        mixer_battery(&mixer, limits.battery_gain, &want);
+        mixer_weapon(&mixer, ch, &want);
+        errors += memcmp(&got, &want, sizeof(got)) != 0;
+    }
+    check(!errors, "frame: not the same as its steps");
+
+    for (int w = 0; w < MIXER_NUM_WHEELS; w++)
+        want.drive[w] = 1000000 * (w + 1);
+    mixer_limit(&want, 50);
+    check(want.drive[0] == 500000 && want.drive[3] == 2000000,
+          "frame: limit");
+}
+
+static volatile uint32_t mix_sink;
+
+static void bench_mix(void)
+{
+    const unsigned reps = 20000000;
+    struct mixer_config config;
+    struct mixer mixer;
+    struct mixer_output out;
+    uint16_t frames[256][16];
+    double start, float_ns, fixed_ns;
+
+    for (int f = 0; f < 256; f++) {
+        for (int i = 0; i < 16; i++) frames[f][i] = rng() & 0x07ff;
+    }
+
+    mixer_config_default(&config);
+    config.mode = MIXER_MODE_ARCADE;
+    config.expo = MIXER_Q15_ONE / 3;
+    config.deadband = MIXER_Q15_ONE / 50;
+    mixer_init(&mixer, &config);
+
+    start = now_s();
+    for (unsigned r = 0; r < reps; r++) {
+        mix_float(frames[r & 255], &out);
+        mix_sink = out.drive[r & 3];
+    }
+    float_ns = (now_s() - start) * 1e9 / reps;
+
+    start = now_s();
+    for (unsigned r = 0; r < reps; r++) {
+        mixer_run(&mixer, frames[r & 255], &out);
+        mix_sink = out.drive[r & 3];
+    }
+    fixed_ns = (now_s() - start) * 1e9 / reps;
+
+    printf("mix,float_tank,%.1f ns/frame\n", float_ns);
+    printf("mix,fixed_arcade_expo,%.1f ns/frame\n", fixed_ns);
+}
+
+int main(void)
+{
+    check_against_float();
+    check_arcade();
+    check_curve();
+    check_flip();
+    check_battery();
+    check_frame();
+    bench_mix();
+
+    printf("%s\n", fails ? "FAILED" : "OK");
+
+    return fails ? 1 : 0;
+}
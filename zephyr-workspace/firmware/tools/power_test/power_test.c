@@ -0,0 +1,239 @@
+/*
+ * Host-side checks for the power accounting: where the time goes in each
+ * state, the time adding up across state changes, the wake latency only
+ * being taken from the first frame after a stop, and the current
+ * estimate, with what each state would draw if it never stopped.
+ *
+ * The CPU is simulated the way the firmware runs with no radio: woken by
+ * each RC frame the receiver still sends, running for a while, then idle
+ * and stopped until the next one.
+ *
+ * Build and run from the firmware directory:
+ *
+ *     cc -O2 -Isrc -o power_test tools/power_test/power_test.c \
+ *         src/power_policy.c
+ *     ./power_test
+ *
+ * The exit code is non-zero if any check fails.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../bench.h"
+#include "power_policy.h"
+
+/**
+ * @brief The CPU's clock and idle time.
+ */
+struct sim
+{
+    struct power_account acc;
+    uint64_t now;
+    uint64_t idle;
+};
+
+static void sim_init(struct sim *sim, enum power_state state)
+{
+    struct power_config config;
+
+    power_config_default(&config);
+    sim->now = 1000;
+    sim->idle = 0;
+    power_account_init(&sim->acc, &config, state, sim->now, sim->idle);
+}
+
+static void sim_run(struct sim *sim, uint64_t us)
+{
+    sim->now += us;
+}
+
+static void sim_sleep(struct sim *sim, uint64_t us)
+{
+    sim->now += us;
+    sim->idle += us;
+}
+
+static void sim_stop(struct sim *sim, uint64_t us)
+{
+    power_account_stop(&sim->acc, sim->now);
+    sim_sleep(sim, us);
+    power_account_wake(&sim->acc, sim->now);
+}
+
+static void sim_get(struct sim *sim, enum power_state state,
+                    struct power_stats *stats)
+{
+    power_account_get(&sim->acc, state, sim->now, sim->idle, stats);
+}
+
+/**
+ * @brief A frame every 4 ms that takes 50-100 us to handle, and stopped
+ * the rest of the time.
+ */
+static void check_no_radio(void)
+{
+    struct sim sim;
+    struct power_stats stats;
+    uint64_t run = 0;
+    uint32_t worst = 0;
+
+    sim_init(&sim, POWER_STATE_NO_RADIO);
+    for (int i = 0; i < 100000; i++) {
+        uint32_t took = 50 + rng() % 50;
+
+        sim_stop(&sim, 4000 - took);
+        sim_run(&sim, took);
+        power_account_frame(&sim.acc, sim.now);
+        run += took;
+        if (took > worst)
+            worst = took;
+    }
+    sim_get(&sim, POWER_STATE_NO_RADIO, &stats);
+
+    check(stats.time_us == 400000000, "no radio: time");
+    check(stats.time_us - stats.idle_us == run, "no radio: run time");
+    check(stats.stop_us == stats.idle_us, "no radio: stop time");
+    check(stats.stops == 100000 && stats.wakes == 100000,
+          "no radio: stops");
+    check(stats.wake_max_us == worst, "no radio: wake latency");
+
+    printf("no radio,%.2f%% run,%.2f%% stop,%u ua,max wake %u us\n",
+           100.0 * (stats.time_us - stats.idle_us) / stats.time_us,
+           100.0 * stats.stop_us / stats.time_us,
+           power_estimate_ua(&sim.acc.config, POWER_STATE_NO_RADIO, &stats),
+           stats.wake_max_us);
+}
+
+/**
+ * @brief Time is added to whichever state's policy was in place, and
+ * reading a state's stats part way through doesn't count it twice.
+ */
+static void check_states(void)
+{
+    struct sim sim;
+    struct power_stats stats, again;
+
+    sim_init(&sim, POWER_STATE_DISARMED);
+    sim_run(&sim, 1000);
+    sim_sleep(&sim, 3000);
+
+    sim_get(&sim, POWER_STATE_DISARMED, &stats);
+    sim_get(&sim, POWER_STATE_DISARMED, &again);
+    check(stats.time_us == 4000 && again.time_us == 4000 &&
+              again.idle_us == 3000,
+          "states: counted twice");
+
+    power_account_state(&sim.acc, POWER_STATE_ARMED, sim.now, sim.idle);
+    sim_run(&sim, 2000);
+    sim_sleep(&sim, 2000);
+    power_account_state(&sim.acc, POWER_STATE_NO_RADIO, sim.now, sim.idle);
+    sim_stop(&sim, 10000);
+
+    sim_get(&sim, POWER_STATE_DISARMED, &stats);
+    check(stats.time_us == 4000 && stats.idle_us == 3000,
+          "states: disarmed");
+    sim_get(&sim, POWER_STATE_ARMED, &stats);
+    check(stats.time_us == 4000 && stats.idle_us == 2000 &&
+              stats.stops == 0,
+          "states: armed");
+    sim_get(&sim, POWER_STATE_NO_RADIO, &stats);
+    check(stats.time_us == 10000 && stats.stop_us == 10000 &&
+              stats.stops == 1,
+          "states: no radio");
+
+    /* Back again, and it carries on from where it was. */
+    power_account_state(&sim.acc, POWER_STATE_DISARMED, sim.now, sim.idle);
+    sim_run(&sim, 1000);
+    sim_get(&sim, POWER_STATE_DISARMED, &stats);
+    check(stats.time_us == 5000 && stats.idle_us == 3000,
+          "states: didn't carry on");
+}
+
+/**
+ * @brief Only a frame that follows a stop is a wake, and a wake without
+ * a stop isn't.
+ */
+static void check_wakes(void)
+{
+    struct sim sim;
+    struct power_stats stats;
+
+    sim_init(&sim, POWER_STATE_NO_RADIO);
+    power_account_frame(&sim.acc, sim.now);
+    power_account_wake(&sim.acc, sim.now);
+    power_account_frame(&sim.acc, sim.now + 5000);
+
+    sim_stop(&sim, 1000);
+    sim_run(&sim, 80);
+    power_account_frame(&sim.acc, sim.now);
+    sim_run(&sim, 4000);
+    power_account_frame(&sim.acc, sim.now);
+
+    sim_get(&sim, POWER_STATE_NO_RADIO, &stats);
+    check(stats.wakes == 1 && stats.wake_max_us == 80, "wakes: counted");
+
+    /* A stop that another interrupt woke up. */
+    sim_stop(&sim, 1000);
+    sim_sleep(&sim, 500);
+    power_account_frame(&sim.acc, sim.now);
+    sim_get(&sim, POWER_STATE_NO_RADIO, &stats);
+    check(stats.wakes == 2 && stats.wake_max_us == 500,
+          "wakes: other interrupt");
+}
+
+/**
+ * @brief The estimate for each state, against it never stopping and
+ * everything left on.
+ */
+static void check_estimate(void)
+{
+    struct power_config config;
+    struct power_stats stats = {0};
+    uint32_t ua, awake_ua;
+
+    power_config_default(&config);
+    check(power_estimate_ua(&config, POWER_STATE_ARMED, &stats) == 0,
+          "estimate: no time");
+
+    /* Flat out. */
+    stats.time_us = 1000000;
+    ua = power_estimate_ua(&config, POWER_STATE_ARMED, &stats);
+    check(ua == config.run_ua + config.imu_on_ua + config.flash_on_ua,
+          "estimate: running");
+
+    /* Idle a bit more than the time, from the clocks being apart. */
+    stats.idle_us = 1000010;
+    ua = power_estimate_ua(&config, POWER_STATE_ARMED, &stats);
+    check(ua == config.sleep_ua + config.imu_on_ua + config.flash_on_ua,
+          "estimate: idle over");
+
+    /* With no radio, 2% running and the rest stopped. */
+    stats.idle_us = 980000;
+    stats.stop_us = 980000;
+    ua = power_estimate_ua(&config, POWER_STATE_NO_RADIO, &stats);
+    check(ua == (20000ull * config.run_ua + 980000ull * config.stop_ua) /
+                        1000000 +
+                    config.imu_off_ua + config.flash_off_ua,
+          "estimate: no radio");
+
+    /* And if it only slept, with everything on. */
+    stats.stop_us = 0;
+    awake_ua = power_estimate_ua(&config, POWER_STATE_DISARMED, &stats);
+    check(awake_ua > 10 * ua, "estimate: not much saved");
+
+    printf("estimate,%u ua stopped,%u ua asleep\n", ua, awake_ua);
+}
+
+int main(void)
+{
+    check_no_radio();
+    check_states();
+    check_wakes();
+    check_estimate();
+
+    printf("%s\n", fails ? "FAILED" : "OK");
+
+    return fails ? 1 : 0;
+}
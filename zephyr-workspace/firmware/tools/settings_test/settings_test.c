@@ -0,0 +1,203 @@
+/*
+ * Host-side checks for the settings schema: saving and loading, settings
+ * from older and newer firmware, and what gets into the mixer.
+ *
+ * Build and run from the firmware directory:
+ *
+ *     cc -O2 -Isrc -o settings_test tools/settings_test/settings_test.c \
+ *         src/robot_settings.c src/mixer.c
+ *     ./settings_test
+ *
+ * The exit code is non-zero if any check fails.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../bench.h"
+#include "robot_settings.h"
+
+/**
+ * @brief The firmware's defaults, as main.c builds them with the Kconfig
+ * defaults.
+ */
+static void defaults(struct robot_settings *s)
+{
+    for (int i = 0; i < ROBOT_SETTINGS_COUNT; i++)
+        s->v[i] = robot_settings_info[i].min;
+
+    s->v[ROBOT_SETTING_INPUT0_CH] = 2;
+    s->v[ROBOT_SETTING_INPUT1_CH] = 1;
+    s->v[ROBOT_SETTING_ARM_CH] = 7;
+    s->v[ROBOT_SETTING_WEAPON_CH] = 9;
+    for (int w = 0; w < MIXER_NUM_WHEELS; w++)
+        s->v[ROBOT_SETTING_TRIM_FRONT_LEFT + w] = 100;
+    s->v[ROBOT_SETTING_REVERSE] = 0x3;
+    s->v[ROBOT_SETTING_DRIVE_LIMIT] = 100;
+    s->v[ROBOT_SETTING_WEAPON_LIMIT] = 100;
+    s->v[ROBOT_SETTING_FAILSAFE_MS] = 500;
+}
+
+static void random_settings(struct robot_settings *s)
+{
+    for (int i = 0; i < ROBOT_SETTINGS_COUNT; i++) {
+        const struct robot_setting_info *info = &robot_settings_info[i];
+
+        s->v[i] = info->min + rng() % (info->max - info->min + 1);
+    }
+}
+
+static void check_table(void)
+{
+    struct robot_settings s;
+
+    for (int i = 0; i < ROBOT_SETTINGS_COUNT; i++) {
+        check(robot_settings_info[i].name != NULL, "table: setting missing");
+        check(robot_settings_info[i].min <= robot_settings_info[i].max,
+              "table: range backwards");
+    }
+
+    defaults(&s);
+    check(robot_settings_check(&s), "table: defaults out of range");
+    s.v[ROBOT_SETTING_DEADBAND] = 51;
+    check(!robot_settings_check(&s), "table: out of range accepted");
+}
+
+static void check_roundtrip(void)
+{
+    struct robot_settings want, got;
+    uint8_t buf[ROBOT_SETTINGS_MAX_SIZE];
+    size_t len;
+    bool ok = true;
+
+    for (int r = 0; r < 10000; r++) {
+        random_settings(&want);
+        len = robot_settings_encode(&want, buf);
+        ok &= len == ROBOT_SETTINGS_MAX_SIZE;
+
+        defaults(&got);
+        ok &= robot_settings_decode(buf, len, &got) == ROBOT_SETTINGS_COUNT;
+        ok &= !memcmp(&want, &got, sizeof(want));
+    }
+    check(ok, "roundtrip: settings differ");
+}
+
+static void check_versions(void)
+{
+    struct robot_settings saved, got, def;
+    uint8_t buf[ROBOT_SETTINGS_MAX_SIZE + 20];
+    size_t len;
+    int n;
+
+    defaults(&def);
+    random_settings(&saved);
+    len = robot_settings_encode(&saved, buf);
+
+    /* Older firmware only knew the first few. */
+    buf[1] = 5;
+    got = def;
+    n = robot_settings_decode(buf, 2 + 2 * 5, &got);
+    check(n == 5 && !memcmp(got.v, saved.v, 5 * sizeof(got.v[0])) &&
+              !memcmp(&got.v[5], &def.v[5],
+                      (ROBOT_SETTINGS_COUNT - 5) * sizeof(got.v[0])),
+          "versions: older settings");
+
+    /* Newer firmware has more on the end, whether it's all read or not. */
+    buf[1] = ROBOT_SETTINGS_COUNT + 10;
+    memset(&buf[len], 0xa5, 20);
+    got = def;
+    n = robot_settings_decode(buf, len + 20, &got);
+    check(n == ROBOT_SETTINGS_COUNT && !memcmp(&got, &saved, sizeof(got)),
+          "versions: newer settings");
+    got = def;
+    n = robot_settings_decode(buf, len, &got);
+    check(n == ROBOT_SETTINGS_COUNT && !memcmp(&got, &saved, sizeof(got)),
+          "versions: newer settings cut short");
+
+    /* A version this firmware doesn't know changes nothing. */
+    buf[0] = ROBOT_SETTINGS_VERSION + 1;
+    buf[1] = ROBOT_SETTINGS_COUNT;
+    got = def;
+    check(robot_settings_decode(buf, len, &got) < 0 &&
+              !memcmp(&got, &def, sizeof(got)),
+          "versions: unknown version");
+
+    /* Nor does one that's cut short. */
+    buf[0] = ROBOT_SETTINGS_VERSION;
+    got = def;
+    check(robot_settings_decode(buf, len - 1, &got) < 0 &&
+              robot_settings_decode(buf, 1, &got) < 0 &&
+              !memcmp(&got, &def, sizeof(got)),
+          "versions: short");
+
+    /* One bad setting only loses that one. */
+    buf[2 + 2 * ROBOT_SETTING_EXPO] = 101;
+    buf[2 + 2 * ROBOT_SETTING_EXPO + 1] = 0;
+    got = def;
+    n = robot_settings_decode(buf, len, &got);
+    check(n == ROBOT_SETTINGS_COUNT - 1 &&
+              got.v[ROBOT_SETTING_EXPO] == def.v[ROBOT_SETTING_EXPO] &&
+              got.v[ROBOT_SETTING_DEADBAND] == saved.v[ROBOT_SETTING_DEADBAND],
+          "versions: out of range");
+}
+
+/**
+ * @brief The defaults have to give the mixer the same config as before
+ * there were settings, and the limits have to hold.
+ */
+static void check_mixer(void)
+{
+    struct mixer_config want, got;
+    struct robot_settings s;
+    struct mixer mixer;
+    struct mixer_output out;
+    uint16_t ch[16];
+    uint32_t full;
+
+    mixer_config_default(&want);
+    got = want;
+    defaults(&s);
+    robot_settings_mixer_config(&s, &got);
+    check(!memcmp(&want, &got, sizeof(want)), "mixer: defaults differ");
+
+    for (int i = 0; i < 16; i++) ch[i] = 1024;
+    ch[7] = 2047;
+    ch[9] = 2047;
+    ch[2] = 2047;
+
+    mixer_init(&mixer, &want);
+    mixer_run(&mixer, ch, &out);
+    full = out.drive[MIXER_WHEEL_FRONT_LEFT];
+
+    s.v[ROBOT_SETTING_DRIVE_LIMIT] = 50;
+    s.v[ROBOT_SETTING_WEAPON_LIMIT] = 30;
+    got = want;
+    robot_settings_mixer_config(&s, &got);
+    mixer_init(&mixer, &got);
+    mixer_run(&mixer, ch, &out);
+    check(full > 0 && out.drive[MIXER_WHEEL_FRONT_LEFT] <= full / 2 &&
+              out.drive[MIXER_WHEEL_FRONT_LEFT] + 1 >= full / 2,
+          "mixer: drive limit");
+    check(out.weapon_pulse == 1300000, "mixer: weapon limit");
+
+    s.v[ROBOT_SETTING_WEAPON_LIMIT] = 0;
+    got = want;
+    robot_settings_mixer_config(&s, &got);
+    mixer_init(&mixer, &got);
+    mixer_run(&mixer, ch, &out);
+    check(out.weapon_pulse == MIXER_WEAPON_PULSE_MIN, "mixer: weapon off");
+}
+
+int main(void)
+{
+    check_table();
+    check_roundtrip();
+    check_versions();
+    check_mixer();
+
+    printf("%s\n", fails ? "FAILED" : "OK");
+
+    return fails ? 1 : 0;
+}
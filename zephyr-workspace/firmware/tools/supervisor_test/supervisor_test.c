@@ -0,0 +1,303 @@
+/*
+ * Host-side checks for the supervisor's deadline tracking: periodic tasks
+ * on time and late, runs that overrun or hang, tasks that only run when
+ * there's something to do, are paused or change rate, and the clock
+ * wrapping.
+ *
+ * The supervisor's checks are simulated the way the firmware runs them,
+ * every so often from its own thread, and a check that fails is a missed
+ * watchdog feed.
+ *
+ * Build and run from the firmware directory:
+ *
+ *     cc -O2 -Isrc -o supervisor_test \
+ *         tools/supervisor_test/supervisor_test.c src/task_monitor.c
+ *     ./supervisor_test
+ *
+ * The exit code is non-zero if any check fails.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../bench.h"
+#include "task_monitor.h"
+
+/* Microseconds, like the firmware's cycle counter but slower. */
+#define CHECK_INTERVAL 250000
+
+/**
+ * @brief A task and the supervisor checking it.
+ */
+struct sim
+{
+    struct task_monitor task;
+    uint32_t now;
+    uint32_t next_check;
+    /* Checks that failed, so the watchdog went unfed. */
+    unsigned unfed;
+};
+
+static void sim_init(struct sim *sim, uint32_t deadline, uint32_t period,
+                     uint32_t start)
+{
+    task_monitor_register(&sim->task, deadline, period, start);
+    sim->now = start;
+    sim->next_check = start + CHECK_INTERVAL;
+    sim->unfed = 0;
+}
+
+/**
+ * @brief Run the supervisor up to t.
+ */
+static void sim_run(struct sim *sim, uint32_t t)
+{
+    while ((int32_t)(sim->next_check - t) <= 0) {
+        if (!task_monitor_check(&sim->task, sim->next_check))
+            sim->unfed++;
+        sim->next_check += CHECK_INTERVAL;
+    }
+    sim->now = t;
+}
+
+/**
+ * @brief A run of the task at t that takes took.
+ */
+static void sim_task(struct sim *sim, uint32_t t, uint32_t took)
+{
+    sim_run(sim, t);
+    task_monitor_start(&sim->task, t);
+    sim_run(sim, t + took);
+    task_monitor_done(&sim->task, t + took);
+}
+
+/**
+ * @brief The IMU loop, every 2 ms with jitter, which mustn't go off.
+ */
+static void check_on_time(uint32_t start)
+{
+    struct sim sim;
+    uint32_t t = start;
+
+    sim_init(&sim, 20000, 100000, t);
+    for (int i = 0; i < 100000; i++) {
+        t += 1500 + rng() % 1000;
+        sim_task(&sim, t, 100 + rng() % 400);
+    }
+    sim_run(&sim, t + 1000);
+
+    check(sim.unfed == 0 && sim.task.stats.misses == 0,
+          "on time: went off");
+    check(sim.task.stats.runs == 100000, "on time: runs");
+    check(sim.task.stats.wcet < 500 && sim.task.stats.wcet >= 400,
+          "on time: wcet");
+    check(sim.task.stats.max_gap < 2500 && sim.task.stats.max_gap >= 2400,
+          "on time: max gap");
+    check(sim.task.stats.busy / sim.task.stats.runs >= 290 &&
+              sim.task.stats.busy / sim.task.stats.runs < 310,
+          "on time: mean run");
+
+    printf("on time,%u runs,wcet %u us,max gap %u us,mean %u us\n",
+           sim.task.stats.runs, sim.task.stats.wcet, sim.task.stats.max_gap,
+           (uint32_t)(sim.task.stats.busy / sim.task.stats.runs));
+}
+
+/**
+ * @brief A gap longer than the period, counted once, and the next check
+ * doesn't feed.
+ */
+static void check_late(void)
+{
+    struct sim sim;
+    uint32_t t = 0;
+
+    sim_init(&sim, 20000, 100000, t);
+    for (int i = 0; i < 100; i++) sim_task(&sim, t += 2000, 100);
+
+    /* Stopped for half a second. */
+    t += 500000;
+    sim_run(&sim, t);
+    check(sim.unfed >= 1, "late: fed while stopped");
+    check(sim.task.stats.misses == 1, "late: counted more than once");
+
+    for (int i = 0; i < 1000; i++) sim_task(&sim, t += 2000, 100);
+    check(sim.task.stats.misses == 1, "late: counted again on restart");
+    check(sim.task.stats.max_gap == 502000, "late: max gap");
+
+    /* Fed again once it's back. */
+    sim.unfed = 0;
+    for (int i = 0; i < 1000; i++) sim_task(&sim, t += 2000, 100);
+    check(sim.unfed == 0, "late: not fed after coming back");
+
+    printf("late,%u misses,max gap %u us\n", sim.task.stats.misses,
+           sim.task.stats.max_gap);
+}
+
+/**
+ * @brief A run that hangs is caught while it's still going, and only
+ * counted once when it does finish.
+ */
+static void check_overrun(void)
+{
+    struct sim sim;
+    uint32_t t = 0;
+
+    sim_init(&sim, 1000000, 0, t);
+
+    /* A black box erase that's slow but in time. */
+    sim_task(&sim, t += 10000, 800000);
+    check(sim.unfed == 0 && sim.task.stats.misses == 0,
+          "overrun: slow run went off");
+
+    t += 1000000;
+    sim_run(&sim, t);
+    task_monitor_start(&sim.task, t);
+    sim_run(&sim, t + 1500000);
+    check(sim.unfed >= 1 && sim.task.stats.misses == 1,
+          "overrun: hang not caught");
+
+    task_monitor_done(&sim.task, t + 1500000);
+    check(sim.task.stats.misses == 1, "overrun: counted twice");
+    check(sim.task.stats.wcet == 1500000, "overrun: wcet");
+
+    /* An overrun between two checks still stops the next feed. */
+    sim_init(&sim, 20000, 0, 0);
+    sim_task(&sim, 100, 30000);
+    sim.unfed = 0;
+    sim_run(&sim, CHECK_INTERVAL);
+    check(sim.unfed == 1 && sim.task.stats.misses == 1,
+          "overrun: short overrun missed");
+    sim_run(&sim, 2 * CHECK_INTERVAL);
+    check(sim.unfed == 1, "overrun: not fed after");
+
+    printf("overrun,%u misses,wcet %u us\n", sim.task.stats.misses,
+           sim.task.stats.wcet);
+}
+
+/**
+ * @brief A task that only runs when there's something to do, like the
+ * radio callback, can go quiet for ever.
+ */
+static void check_event(void)
+{
+    struct sim sim;
+    uint32_t t = 0;
+
+    sim_init(&sim, 20000, 0, t);
+    sim_run(&sim, t += 10000000);
+    check(sim.unfed == 0, "event: went off before running");
+
+    for (int i = 0; i < 1000; i++) sim_task(&sim, t += 4000, 50);
+    sim_run(&sim, t += 60000000);
+    check(sim.unfed == 0 && sim.task.stats.misses == 0,
+          "event: went off while quiet");
+    check(sim.task.stats.max_gap == 0, "event: max gap");
+}
+
+/**
+ * @brief A periodic task that's powered down for a while, like the IMU
+ * with no radio.
+ */
+static void check_pause(void)
+{
+    struct sim sim;
+    uint32_t t = 0;
+
+    sim_init(&sim, 20000, 100000, t);
+    for (int i = 0; i < 100; i++) sim_task(&sim, t += 2000, 100);
+
+    task_monitor_pause(&sim.task);
+    /* A tick that was already on its way still counts. */
+    sim_task(&sim, t += 2000, 100);
+    sim_run(&sim, t += 60000000);
+    check(sim.unfed == 0 && sim.task.stats.misses == 0,
+          "pause: went off while paused");
+
+    /* The period starts again from the resume, not the last run. */
+    task_monitor_resume(&sim.task, t);
+    sim_run(&sim, t += 50000);
+    for (int i = 0; i < 100; i++) sim_task(&sim, t += 2000, 100);
+    check(sim.unfed == 0 && sim.task.stats.misses == 0,
+          "pause: went off after resuming");
+    check(sim.task.stats.max_gap < 100000, "pause: gap counted");
+
+    /* And it's watched again. */
+    sim_run(&sim, t += 1000000);
+    check(sim.unfed >= 1 && sim.task.stats.misses == 1,
+          "pause: not watched after resuming");
+
+    /* Resuming when it wasn't paused doesn't move its period on. */
+    sim_init(&sim, 20000, 100000, 0);
+    task_monitor_resume(&sim.task, 90000);
+    check(!task_monitor_check(&sim.task, 100001), "pause: resumed anyway");
+}
+
+/**
+ * @brief A task whose period follows its rate, like the radio callback
+ * with the packet rate.
+ */
+static void check_set_period(void)
+{
+    struct sim sim;
+    uint32_t t = 0;
+
+    /* 50 Hz, then 500 Hz with a period to match. */
+    sim_init(&sim, 20000, 100000, t);
+    for (int i = 0; i < 100; i++) sim_task(&sim, t += 20000, 100);
+    task_monitor_set_period(&sim.task, 10000);
+    for (int i = 0; i < 1000; i++) sim_task(&sim, t += 2000, 100);
+    check(sim.unfed == 0 && sim.task.stats.misses == 0,
+          "set period: went off");
+
+    /* A gap that was fine at 50 Hz isn't now. */
+    sim_task(&sim, t += 20000, 100);
+    check(sim.task.stats.misses == 1, "set period: gap not caught");
+    sim_run(&sim, t + CHECK_INTERVAL);
+    check(sim.unfed == 1, "set period: fed after the gap");
+}
+
+/**
+ * @brief Tasks that haven't registered, or never finish a run.
+ */
+static void check_edges(void)
+{
+    struct task_monitor task = {0};
+
+    task_monitor_start(&task, 100);
+    task_monitor_done(&task, 1000000000);
+    check(task_monitor_check(&task, 2000000000) && task.stats.runs == 0,
+          "edges: unregistered");
+
+    /* Done without a start doesn't count anything. */
+    task_monitor_register(&task, 100, 0, 0);
+    task_monitor_done(&task, 1000);
+    check(task_monitor_check(&task, 2000) && task.stats.misses == 0 &&
+              task.stats.wcet == 0,
+          "edges: done without start");
+
+    /* A periodic task that never runs is late once its first period is
+     * up. */
+    task_monitor_register(&task, 100, 1000, 0);
+    check(task_monitor_check(&task, 1000), "edges: early");
+    check(!task_monitor_check(&task, 1001), "edges: never ran");
+    check(!task_monitor_check(&task, 2000) && task.stats.misses == 1,
+          "edges: never ran counted again");
+}
+
+int main(void)
+{
+    check_on_time(0);
+    /* Past the clock wrapping. */
+    check_on_time(UINT32_MAX - 1000000);
+    check_late();
+    check_overrun();
+    check_event();
+    check_pause();
+    check_set_period();
+    check_edges();
+
+    printf("%s\n", fails ? "FAILED" : "OK");
+
+    return fails ? 1 : 0;
+}
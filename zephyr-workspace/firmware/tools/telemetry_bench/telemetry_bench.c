@@ -0,0 +1,279 @@
+/*
+ * Host-side checks and benchmarks for the USB telemetry frames and the
+ * rings they wait in.
+ *
+ * Build and run from the firmware directory:
+ *
+ *     cc -O2 -Isrc -o telemetry_bench tools/telemetry_bench/telemetry_bench.c \
+ *         src/telemetry_frame.c
+ *     ./telemetry_bench
+ *
+ * The exit code is non-zero if any check fails.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../bench.h"
+#include "telemetry_frame.h"
+
+static void random_packet(struct telemetry_packet *pkt)
+{
+    memset(pkt, 0, sizeof(*pkt));
+    pkt->type = rng() % TELEMETRY_TYPE_COUNT;
+    pkt->seq = rng();
+    pkt->cycles = rng();
+
+    /* Plenty of zero octets, like small values have. */
+    for (int i = 0; i < telemetry_types[pkt->type].fields; i++)
+        pkt->v[i] = (rng() & 1) ? (int32_t)rng() : (int32_t)(rng() % 256) - 128;
+}
+
+static bool same(const struct telemetry_packet *a,
+                 const struct telemetry_packet *b)
+{
+    if (a->type != b->type || a->seq != b->seq || a->cycles != b->cycles)
+        return false;
+
+    return !memcmp(a->v, b->v,
+                   telemetry_types[a->type].fields * sizeof(a->v[0]));
+}
+
+static void cobs_roundtrip(const uint8_t *in, size_t len, const char *what)
+{
+    uint8_t enc[1200], dec[1200];
+    size_t n;
+    bool ok;
+
+    n = telemetry_cobs_encode(in, len, enc);
+    ok = n <= len + len / 254 + 1 && !memchr(enc, 0, n);
+    ok &= telemetry_cobs_decode(enc, n, dec) == (int)len;
+    ok &= !memcmp(in, dec, len);
+    check(ok, what);
+}
+
+static void check_cobs(void)
+{
+    uint8_t buf[1000];
+
+    memset(buf, 0, sizeof(buf));
+    cobs_roundtrip(buf, 0, "cobs: empty");
+    cobs_roundtrip(buf, 1, "cobs: one zero");
+    cobs_roundtrip(buf, 300, "cobs: run of zeros");
+
+    /* Either side of a full 254 octet block. */
+    memset(buf, 0x55, sizeof(buf));
+    for (size_t len = 250; len < 520; len++)
+        cobs_roundtrip(buf, len, "cobs: long block");
+
+    buf[253] = 0;
+    buf[254] = 0;
+    cobs_roundtrip(buf, 600, "cobs: zeros at a block end");
+
+    for (int r = 0; r < 10000; r++) {
+        size_t len = rng() % sizeof(buf);
+
+        for (size_t i = 0; i < len; i++) buf[i] = (rng() & 3) ? rng() : 0;
+        cobs_roundtrip(buf, len, "cobs: random");
+    }
+
+    /* A code that runs past the end, or a zero inside. */
+    check(telemetry_cobs_decode((const uint8_t[]){5, 1, 2}, 3, buf) < 0,
+          "cobs: short block accepted");
+    check(telemetry_cobs_decode((const uint8_t[]){3, 1, 0}, 3, buf) < 0,
+          "cobs: zero accepted");
+}
+
+static void check_frames(void)
+{
+    struct telemetry_packet pkt, got;
+    uint8_t frame[TELEMETRY_MAX_FRAME];
+    size_t len;
+    bool ok = true, fits = true;
+
+    for (int r = 0; r < 100000; r++) {
+        random_packet(&pkt);
+        len = telemetry_frame_encode(&pkt, frame);
+        fits &= len <= TELEMETRY_MAX_FRAME;
+        ok &= frame[len - 1] == 0 && !memchr(frame, 0, len - 1);
+        ok &= telemetry_frame_decode(frame, len - 1, &got) && same(&pkt, &got);
+    }
+    check(fits, "frames: longer than TELEMETRY_MAX_FRAME");
+    check(ok, "frames: roundtrip");
+
+    /* The longest packet there is, with no zeros at all. */
+    memset(&pkt, 0, sizeof(pkt));
+    pkt.type = TELEMETRY_CHANNELS;
+    pkt.seq = 0xff;
+    pkt.cycles = 0xffffffff;
+    for (int i = 0; i < TELEMETRY_MAX_FIELDS; i++) pkt.v[i] = -1;
+    len = telemetry_frame_encode(&pkt, frame);
+    check(len <= TELEMETRY_MAX_FRAME, "frames: worst case too long");
+
+    /* Wrong length for its type, and a type that doesn't exist. */
+    pkt.type = TELEMETRY_LINK;
+    len = telemetry_frame_encode(&pkt, frame);
+    check(!telemetry_frame_decode(frame, len - 5, &got), "frames: short");
+    frame[1] = TELEMETRY_TYPE_COUNT;
+    check(!telemetry_frame_decode(frame, len - 1, &got), "frames: bad type");
+}
+
+/**
+ * @brief Split what came out of a ring on the zeros, as the host does, and
+ * check it's the packets that went in.
+ */
+static size_t unframe(const uint8_t *data, size_t len,
+                      struct telemetry_packet *out, size_t max, size_t *bad)
+{
+    size_t start = 0, count = 0;
+
+    *bad = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (data[i])
+            continue;
+
+        if (count < max &&
+            telemetry_frame_decode(&data[start], i - start, &out[count]))
+            count++;
+        else
+            (*bad)++;
+        start = i + 1;
+    }
+
+    return count;
+}
+
+static struct telemetry_packet want[20000], got[20000];
+static uint8_t stream[2000000];
+
+static void check_ring(void)
+{
+    uint8_t buf[256];
+    struct telemetry_ring ring;
+    struct telemetry_packet pkt;
+    size_t n = 0, len = 0, count, bad, put = 0;
+    bool ok = true;
+
+    telemetry_ring_init(&ring, buf, sizeof(buf));
+    check(telemetry_ring_peek(&ring, &(const uint8_t *){0}) == 0,
+          "ring: not empty");
+
+    /* Fill it up, then drain it a random amount at a time, topping it up
+     * as it goes, so frames wrap round the end. */
+    while (n < sizeof(want) / sizeof(want[0])) {
+        const uint8_t *data;
+        size_t avail, take;
+
+        random_packet(&pkt);
+        pkt.seq = ring.seq[pkt.type];
+        if (telemetry_ring_put(&ring, pkt.type, pkt.cycles, pkt.v))
+            want[n++] = pkt;
+        put++;
+
+        if (rng() % 3)
+            continue;
+
+        avail = telemetry_ring_peek(&ring, &data);
+        ok &= avail <= sizeof(buf);
+        take = avail ? rng() % avail + 1 : 0;
+        memcpy(&stream[len], data, take);
+        len += take;
+        telemetry_ring_consume(&ring, take);
+    }
+    for (;;) {
+        const uint8_t *data;
+        size_t avail = telemetry_ring_peek(&ring, &data);
+
+        if (!avail)
+            break;
+        memcpy(&stream[len], data, avail);
+        len += avail;
+        telemetry_ring_consume(&ring, avail);
+    }
+    check(ok, "ring: peeked too much");
+
+    count = unframe(stream, len, got, n, &bad);
+    check(count == n && bad == 0, "ring: packet count");
+    for (size_t i = 0; ok && i < count; i++) ok &= same(&want[i], &got[i]);
+    check(ok, "ring: packets differ");
+    check(ring.dropped == put - n, "ring: drop count");
+    check(ring.dropped > 0, "ring: never filled");
+
+    printf("ring,%zu packets,%u dropped,%.1f octets/packet\n", n,
+           ring.dropped, (double)len / n);
+}
+
+/**
+ * @brief A host that opens the port part way through a frame, or sees
+ * noise, is back in step from the next zero.
+ */
+static void check_resync(void)
+{
+    struct telemetry_packet pkt;
+    size_t len = 0, count, bad;
+    bool ok = true;
+
+    /* Junk with no zeros runs into the first frame, which is lost. */
+    for (int i = 0; i < 40; i++) stream[len++] = rng() | 1;
+    random_packet(&pkt);
+    len += telemetry_frame_encode(&pkt, &stream[len]);
+
+    for (int i = 0; i < 100; i++) {
+        random_packet(&want[i]);
+        len += telemetry_frame_encode(&want[i], &stream[len]);
+    }
+
+    count = unframe(stream, len, got, 100, &bad);
+    check(count == 100 && bad == 1, "resync: packet count");
+    for (size_t i = 0; ok && i < count; i++) ok &= same(&want[i], &got[i]);
+    check(ok, "resync: packets differ");
+}
+
+static volatile size_t sink;
+
+static void bench(void)
+{
+    struct telemetry_packet pkt[64];
+    uint8_t frame[TELEMETRY_MAX_FRAME];
+    uint8_t buf[4096];
+    struct telemetry_ring ring;
+    const unsigned reps = 5000000;
+    double start, ns;
+
+    for (int i = 0; i < 64; i++) random_packet(&pkt[i]);
+
+    start = now_s();
+    for (unsigned r = 0; r < reps; r++)
+        sink += telemetry_frame_encode(&pkt[r & 63], frame);
+    ns = (now_s() - start) * 1e9 / reps;
+    printf("encode,%.1f ns/packet\n", ns);
+
+    /* What a source pays per packet, with the ring kept from filling. */
+    telemetry_ring_init(&ring, buf, sizeof(buf));
+    start = now_s();
+    for (unsigned r = 0; r < reps; r++) {
+        const uint8_t *data;
+
+        telemetry_ring_put(&ring, pkt[r & 63].type, r, pkt[r & 63].v);
+        if ((r & 15) == 15)
+            telemetry_ring_consume(&ring, telemetry_ring_peek(&ring, &data));
+    }
+    ns = (now_s() - start) * 1e9 / reps;
+    sink += ring.dropped;
+    printf("put,%.1f ns/packet\n", ns);
+}
+
+int main(void)
+{
+    check_cobs();
+    check_frames();
+    check_ring();
+    check_resync();
+    bench();
+
+    printf("%s\n", fails ? "FAILED" : "OK");
+
+    return fails ? 1 : 0;
+}
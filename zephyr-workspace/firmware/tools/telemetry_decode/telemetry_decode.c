@@ -0,0 +1,124 @@
+/*
+ * Turns the binary telemetry stream from the robot's second USB serial port
+ * into CSV, one line per packet: the type, the time in seconds, then the
+ * fields. Each type's columns are given in a comment the first time it's
+ * seen, and lost packets are reported on stderr.
+ *
+ * Build from the firmware directory:
+ *
+ *     cc -O2 -Isrc -o telemetry_decode \
+ *         tools/telemetry_decode/telemetry_decode.c src/telemetry_frame.c
+ *
+ * Then, on Linux:
+ *
+ *     stty -F /dev/ttyACM1 raw
+ *     ./telemetry_decode [file] [type...] < /dev/ttyACM1
+ *
+ * Naming types, like "imu yaw", only prints those.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "telemetry_frame.h"
+
+/* Until the first info packet says otherwise: the STM32L412's clock. */
+static double cycles_per_sec = 80000000;
+
+static bool wanted[TELEMETRY_TYPE_COUNT];
+static bool seen[TELEMETRY_TYPE_COUNT];
+static uint8_t next_seq[TELEMETRY_TYPE_COUNT];
+
+/* The cycle counter, carried past 32 bits. */
+static uint64_t cycles;
+static bool started;
+
+static unsigned long bad_frames;
+
+static void packet(const struct telemetry_packet *pkt)
+{
+    const struct telemetry_type_info *info = &telemetry_types[pkt->type];
+
+    if (started)
+        cycles += (uint32_t)(pkt->cycles - (uint32_t)cycles);
+    else
+        cycles = pkt->cycles;
+    started = true;
+
+    if (pkt->type == TELEMETRY_INFO && pkt->v[0] > 0)
+        cycles_per_sec = pkt->v[0];
+
+    if (seen[pkt->type] && pkt->seq != next_seq[pkt->type])
+        fprintf(stderr, "%s: lost %u packets\n", info->name,
+                (uint8_t)(pkt->seq - next_seq[pkt->type]));
+    next_seq[pkt->type] = pkt->seq + 1;
+
+    if (!wanted[pkt->type])
+        return;
+
+    if (!seen[pkt->type])
+        printf("# %s,time_s,%s\n", info->name, info->columns);
+    seen[pkt->type] = true;
+
+    printf("%s,%.6f", info->name, cycles / cycles_per_sec);
+    for (int i = 0; i < info->fields; i++) printf(",%d", (int)pkt->v[i]);
+    printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t frame[TELEMETRY_MAX_FRAME];
+    struct telemetry_packet pkt;
+    FILE *in = stdin;
+    size_t len = 0;
+    bool any = false;
+    int c;
+
+    for (int i = 1; i < argc; i++) {
+        int t;
+
+        for (t = 0; t < TELEMETRY_TYPE_COUNT; t++) {
+            if (!strcmp(argv[i], telemetry_types[t].name)) {
+                wanted[t] = true;
+                any = true;
+                break;
+            }
+        }
+        if (t < TELEMETRY_TYPE_COUNT)
+            continue;
+
+        in = fopen(argv[i], "rb");
+        if (!in) {
+            perror(argv[i]);
+            return 1;
+        }
+    }
+    if (!any)
+        memset(wanted, true, sizeof(wanted));
+
+    /* A line at a time, for piping into a live plot. */
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    while ((c = getc(in)) != EOF) {
+        if (c) {
+            /* Too long to be a frame: wait for the next zero. */
+            if (len < sizeof(frame))
+                frame[len] = c;
+            len++;
+            continue;
+        }
+
+        if (len <= sizeof(frame) && telemetry_frame_decode(frame, len, &pkt))
+            packet(&pkt);
+        else if (len)
+            bad_frames++;
+        len = 0;
+    }
+
+    /* The first frame is usually cut short by starting part way in. */
+    if (bad_frames > 1)
+        fprintf(stderr, "%lu bad frames\n", bad_frames);
+
+    return 0;
+}
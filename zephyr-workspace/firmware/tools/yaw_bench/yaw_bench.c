@@ -0,0 +1,294 @@
+/*
+ * Host-side checks and benchmarks for the yaw rate controller, against a
+ * simulated robot.
+ *
+ * Build and run from the firmware directory:
+ *
+ *     cc -O2 -Isrc -o yaw_bench tools/yaw_bench/yaw_bench.c src/yaw_pid.c -lm
+ *     ./yaw_bench
+ *
+ * The exit code is non-zero if any check fails.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../bench.h"
+#include "yaw_pid.h"
+
+/* The controller runs at the gyro FIFO watermark rate on the robot. */
+#define RATE_HZ (1660 / 3)
+
+/* The plant is stepped this many times per controller tick. */
+#define SUBSTEPS 20
+
+/**
+ * @brief A two wheel drive robot turning on the spot.
+ *
+ * Steering sets the motor torque through a lag for the motor current, and
+ * the robot's inertia and the tyres' scrub turn that into a yaw rate that
+ * settles at gain * steering.
+ */
+struct plant
+{
+    /* Yaw rate at full steering, in dps. */
+    double gain;
+    /* Motor and body time constants, in seconds. */
+    double tau_motor;
+    double tau_body;
+    /* Yaw rate the floor or a bent wheel adds, in dps. */
+    double offset;
+    /* Gyro noise, in dps peak to peak. */
+    double noise;
+
+    double torque;
+    double rate;
+};
+
+static void plant_init(struct plant *plant)
+{
+    *plant = (struct plant){
+        .gain = 1000,
+        .tau_motor = 0.015,
+        .tau_body = 0.060,
+        .noise = 2,
+    };
+}
+
+static void plant_step(struct plant *plant, int32_t steering)
+{
+    const double dt = 1.0 / (RATE_HZ * SUBSTEPS);
+    double u = (double)steering / YAW_Q15_ONE;
+
+    for (int i = 0; i < SUBSTEPS; i++) {
+        double target = plant->gain * plant->torque + plant->offset;
+
+        plant->torque += (u - plant->torque) * dt / plant->tau_motor;
+        plant->rate += (target - plant->rate) * dt / plant->tau_body;
+    }
+}
+
+/**
+ * @brief What the gyro says, in mdps, at the 2000 dps full scale.
+ */
+static int32_t gyro(const struct plant *plant)
+{
+    double noise = plant->noise * ((double)(rng() & 0xffff) / 0xffff - 0.5);
+    int32_t raw = lround((plant->rate + noise) / 0.070);
+
+    return raw * 70;
+}
+
+static void config_bench(struct yaw_config *config)
+{
+    yaw_config_default(config);
+    config->rate_hz = RATE_HZ;
+}
+
+struct run
+{
+    double final;
+    double peak;
+    /* Time from the start until the rate stayed within the band. */
+    double settle_s;
+};
+
+/**
+ * @brief Run the loop for a while, and work out how it went.
+ *
+ * @param settle_band How close to the setpoint counts as settled, in dps.
+ */
+static struct run run_loop(struct yaw_pid *pid, struct plant *plant,
+                           int32_t setpoint, double seconds,
+                           double settle_band)
+{
+    const double target = (double)setpoint / YAW_Q15_ONE * 720;
+    int ticks = seconds * RATE_HZ;
+    struct run run = {.peak = plant->rate, .settle_s = 0};
+
+    for (int t = 0; t < ticks; t++) {
+        /* The output lands a tick late, as it does on the robot. */
+        int32_t out = yaw_pid_run(pid, setpoint, gyro(plant), NULL);
+
+        plant_step(plant, out);
+
+        if (fabs(plant->rate) > fabs(run.peak))
+            run.peak = plant->rate;
+        if (fabs(plant->rate - target) > settle_band)
+            run.settle_s = (double)(t + 1) / RATE_HZ;
+    }
+
+    run.final = plant->rate;
+
+    return run;
+}
+
+static void check_step(void)
+{
+    struct yaw_config config;
+    struct yaw_pid pid;
+    struct plant plant;
+    struct run run;
+
+    config_bench(&config);
+    yaw_pid_init(&pid, &config);
+    plant_init(&plant);
+
+    /* Half stick is 360 dps. */
+    run = run_loop(&pid, &plant, YAW_Q15_ONE / 2, 1.0, 18);
+    check(fabs(run.final - 360) < 10, "step: final rate");
+    check(run.peak < 360 * 1.15, "step: overshoot");
+    check(run.settle_s < 0.2, "step: settle time");
+    printf("step,360 dps,settled in %.0f ms,peak %.0f dps\n",
+           run.settle_s * 1000, run.peak);
+
+    /* And back to straight. */
+    run = run_loop(&pid, &plant, 0, 1.0, 18);
+    check(fabs(run.final) < 10, "step: back to zero");
+    check(run.settle_s < 0.2, "step: settle back");
+}
+
+/**
+ * @brief A bent wheel or a sloped floor pulls the robot round. Open loop
+ * it veers for good; closed loop the integral takes it out.
+ */
+static void check_offset(void)
+{
+    struct yaw_config config;
+    struct yaw_pid pid;
+    struct plant plant;
+    struct run run;
+
+    config_bench(&config);
+    yaw_pid_init(&pid, &config);
+    plant_init(&plant);
+    plant.offset = 120;
+
+    run = run_loop(&pid, &plant, 0, 1.5, 10);
+    check(fabs(run.final) < 10, "offset: not taken out");
+    check(run.settle_s < 0.5, "offset: too slow");
+    printf("offset,120 dps,held to %.1f dps in %.0f ms\n", run.final,
+           run.settle_s * 1000);
+}
+
+/**
+ * @brief A hit spins the robot; it has to come back to straight.
+ */
+static void check_hit(void)
+{
+    struct yaw_config config;
+    struct yaw_pid pid;
+    struct plant plant;
+    struct run run;
+
+    config_bench(&config);
+    yaw_pid_init(&pid, &config);
+    plant_init(&plant);
+
+    run_loop(&pid, &plant, 0, 0.2, 10);
+    plant.rate = 600;
+
+    run = run_loop(&pid, &plant, 0, 1.0, 30);
+    check(fabs(run.final) < 10, "hit: not recovered");
+    check(run.settle_s < 0.15, "hit: too slow");
+    printf("hit,600 dps,back within 30 dps in %.0f ms\n",
+           run.settle_s * 1000);
+}
+
+/**
+ * @brief Ask for more than the robot can do for a long time, then let go.
+ * Without anti-windup the integral would keep it spinning long after.
+ */
+static void check_windup(void)
+{
+    struct yaw_config config;
+    struct yaw_pid pid;
+    struct plant plant;
+    struct run run;
+
+    config_bench(&config);
+    yaw_pid_init(&pid, &config);
+    plant_init(&plant);
+
+    /* Flat batteries: full steering only makes 400 dps. */
+    plant.gain = 400;
+
+    run = run_loop(&pid, &plant, YAW_Q15_ONE, 2.0, 18);
+    check(run.final > 380, "windup: not saturated");
+
+    run = run_loop(&pid, &plant, 0, 1.0, 18);
+    check(run.settle_s < 0.15, "windup: slow to let go");
+    check(fabs(run.final) < 10, "windup: not stopped");
+    printf("windup,released in %.0f ms\n", run.settle_s * 1000);
+}
+
+/**
+ * @brief Changing gains part way through a turn mustn't jolt the output.
+ */
+static void check_retune(void)
+{
+    struct yaw_config config;
+    struct yaw_pid pid;
+    struct plant plant;
+    struct yaw_terms before, after;
+    struct yaw_gains gains;
+
+    config_bench(&config);
+    yaw_pid_init(&pid, &config);
+    plant_init(&plant);
+    plant.noise = 0;
+    plant.offset = 60;
+
+    run_loop(&pid, &plant, YAW_Q15_ONE / 4, 1.0, 18);
+    yaw_pid_run(&pid, YAW_Q15_ONE / 4, gyro(&plant), &before);
+
+    gains = config.gains;
+    gains.ki *= 2;
+    yaw_pid_set_gains(&pid, &gains);
+    yaw_pid_run(&pid, YAW_Q15_ONE / 4, gyro(&plant), &after);
+
+    check(abs(after.output - before.output) < YAW_Q15_ONE / 100,
+          "retune: bump");
+}
+
+static volatile int32_t sink;
+
+static void bench(void)
+{
+    const unsigned reps = 20000000;
+    struct yaw_config config;
+    struct yaw_pid pid;
+    int32_t gyros[256];
+    double start, ns;
+
+    for (int i = 0; i < 256; i++)
+        gyros[i] = (int32_t)(rng() % 2000000) - 1000000;
+
+    config_bench(&config);
+    config.gains.kd = YAW_Q12_ONE / 100;
+    yaw_pid_init(&pid, &config);
+
+    start = now_s();
+    for (unsigned r = 0; r < reps; r++)
+        sink = yaw_pid_run(&pid, (int32_t)(r & 0xffff) - YAW_Q15_ONE,
+                           gyros[r & 255], NULL);
+    ns = (now_s() - start) * 1e9 / reps;
+
+    printf("pid,step,%.1f ns/tick\n", ns);
+}
+
+int main(void)
+{
+    check_step();
+    check_offset();
+    check_hit();
+    check_windup();
+    check_retune();
+    bench();
+
+    printf("%s\n", fails ? "FAILED" : "OK");
+
+    return fails ? 1 : 0;
+}